@@ -0,0 +1,786 @@
+﻿#include "ASTExport.h"
+#include "ASTree.h"
+#include "bytecode.h"
+#include "data.h"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+enum ExportKind {
+    K_MODULE, K_NODELIST, K_CHAINSTORE, K_OBJECT, K_UNARY, K_BINARY, K_COMPARE,
+    K_SLICE, K_STORE, K_RETURN, K_NAME, K_DELETE, K_FUNCTION, K_CLASS, K_CALL,
+    K_KEYWORD_ARG, K_IMPORT, K_TUPLE, K_LIST, K_SET, K_MAP, K_KW_NAMES_MAP, K_MAP_ITEM,
+    K_CONST_MAP, K_SUBSCR, K_PRINT, K_CONVERT, K_KEYWORD, K_RAISE, K_EXEC,
+    K_BLOCK, K_COND_BLOCK, K_ITER_BLOCK, K_CONTAINER_BLOCK, K_WITH_BLOCK,
+    K_COMPREHENSION, K_LOAD_BUILD_CLASS, K_AWAITABLE, K_FORMATTED_VALUE,
+    K_JOINED_STR, K_ANNOTATED_VAR, K_TERNARY, K_LOCALS, K_INVALID,
+    K_COUNT
+};
+
+struct KindSchema {
+    const char* name;
+    std::vector<const char*> fields;
+};
+
+/* 与 ASTExport.h 中的表格一一对应，顺序即 ExportKind 的顺序 */
+const KindSchema s_schema[K_COUNT] = {
+    { "Module", { "schema", "version", "filename", "clean", "body" } },
+    { "NodeList", { "nodes" } },
+    { "ChainStore", { "targets", "value" } },
+    { "Object", { "type", "value", "repr" } },
+    { "Unary", { "op", "operand" } },
+    { "Binary", { "op", "left", "right" } },
+    { "Compare", { "op", "left", "right" } },
+    { "Slice", { "kind", "lower", "upper" } },
+    { "Store", { "value", "target" } },
+    { "Return", { "kind", "value" } },
+    { "Name", { "id" } },
+    { "Delete", { "target" } },
+    { "Function", { "name", "qualname", "args", "posonlyargcount", "kwonlyargcount",
+                    "varargs", "varkw", "defaults", "kw_defaults", "flags", "firstline",
+                    "clean", "body" } },
+    { "Class", { "name", "bases", "code" } },
+    { "Call", { "func", "args", "keywords", "starargs", "kwargs" } },
+    { "KeywordArg", { "name", "value" } },
+    { "Import", { "name", "fromlist", "stores" } },
+    { "Tuple", { "elts", "parens" } },
+    { "List", { "elts" } },
+    { "Set", { "elts" } },
+    { "Map", { "items" } },
+    { "KwNamesMap", { "items" } },
+    { "MapItem", { "key", "value" } },
+    { "ConstMap", { "keys", "values" } },
+    { "Subscr", { "value", "slice" } },
+    { "Print", { "values", "stream", "eol" } },
+    { "Convert", { "value" } },
+    { "Keyword", { "word" } },
+    { "Raise", { "args" } },
+    { "Exec", { "body", "globals", "locals" } },
+    { "Block", { "type", "end", "body" } },
+    { "CondBlock", { "type", "end", "body", "test", "negative" } },
+    { "IterBlock", { "type", "end", "body", "iter", "target", "condition",
+                     "comprehension", "start" } },
+    { "ContainerBlock", { "type", "end", "body", "finally", "except" } },
+    { "WithBlock", { "type", "end", "body", "expr", "var" } },
+    { "Comprehension", { "result", "generators" } },
+    { "LoadBuildClass", { "object" } },
+    { "Awaitable", { "value" } },
+    { "FormattedValue", { "value", "conversion", "format_spec" } },
+    { "JoinedStr", { "values" } },
+    { "AnnotatedVar", { "target", "annotation" } },
+    { "Ternary", { "test", "body", "orelse" } },
+    { "Locals", { } },
+    { "Invalid", { "type" } },
+};
+
+/* JSON 与二进制共用的输出接口。基类负责检查每个节点的成员数与种类表一致 */
+class ASTWriter {
+public:
+    virtual ~ASTWriter() { }
+
+    void beginNode(int kind)
+    {
+        value();
+        m_frames.push_back({ kind, 0 });
+        openNode(kind);
+    }
+
+    void endNode()
+    {
+        const Frame& frame = m_frames.back();
+        if (frame.count != s_schema[frame.kind].fields.size())
+            throw std::logic_error("AST 导出的成员数与种类表不一致");
+        m_frames.pop_back();
+        closeNode();
+    }
+
+    void beginList()
+    {
+        value();
+        m_frames.push_back({ -1, 0 });
+        openList();
+    }
+
+    void endList()
+    {
+        size_t count = m_frames.back().count;
+        m_frames.pop_back();
+        closeList(count);
+    }
+
+    void null() { value(); writeNull(); }
+    void boolean(bool b) { value(); writeBool(b); }
+    void integer(long long n) { value(); writeInt(n); }
+    void string(const std::string& str) { value(); writeString(str); }
+
+protected:
+    struct Frame {
+        int kind;       // -1 表示列表
+        size_t count;
+    };
+
+    /* 在每个值之前调用；frame 为空表示根节点 */
+    virtual void separator(const Frame* frame) = 0;
+    virtual void openNode(int kind) = 0;
+    virtual void closeNode() = 0;
+    virtual void openList() = 0;
+    virtual void closeList(size_t count) = 0;
+    virtual void writeNull() = 0;
+    virtual void writeBool(bool b) = 0;
+    virtual void writeInt(long long n) = 0;
+    virtual void writeString(const std::string& str) = 0;
+
+private:
+    void value()
+    {
+        if (m_frames.empty()) {
+            separator(nullptr);
+            return;
+        }
+        Frame& frame = m_frames.back();
+        if (frame.kind >= 0 && frame.count >= s_schema[frame.kind].fields.size())
+            throw std::logic_error("AST 导出的成员数与种类表不一致");
+        separator(&frame);
+        ++frame.count;
+    }
+
+    std::vector<Frame> m_frames;
+};
+
+class JsonWriter : public ASTWriter {
+public:
+    explicit JsonWriter(std::ostream& out) : m_out(out) { }
+
+protected:
+    void separator(const Frame* frame) override
+    {
+        if (!frame)
+            return;
+        if (frame->kind < 0) {
+            if (frame->count)
+                m_out << ",";
+        } else {
+            m_out << ",\"" << s_schema[frame->kind].fields[frame->count] << "\":";
+        }
+    }
+
+    void openNode(int kind) override { m_out << "{\"node\":\"" << s_schema[kind].name << "\""; }
+    void closeNode() override { m_out << "}"; }
+    void openList() override { m_out << "["; }
+    void closeList(size_t) override { m_out << "]"; }
+    void writeNull() override { m_out << "null"; }
+    void writeBool(bool b) override { m_out << (b ? "true" : "false"); }
+    void writeInt(long long n) override { m_out << n; }
+    void writeString(const std::string& str) override { json_print_string(m_out, str); }
+
+private:
+    std::ostream& m_out;
+};
+
+class BinaryWriter : public ASTWriter {
+public:
+    enum Tag { TAG_NULL, TAG_FALSE, TAG_TRUE, TAG_INT, TAG_STRING, TAG_LIST, TAG_NODE };
+
+    BinaryWriter() : m_buffers(1) { }
+
+    /* 输出文件头（种类表）和根节点 */
+    void finish(std::ostream& out)
+    {
+        std::string header("PYCAST01");
+        putVarint(header, K_COUNT);
+        for (const auto& kind : s_schema) {
+            putString(header, kind.name);
+            putVarint(header, kind.fields.size());
+            for (const char* field : kind.fields)
+                putString(header, field);
+        }
+        out.write(header.data(), header.size());
+        out.write(m_buffers[0].data(), m_buffers[0].size());
+    }
+
+protected:
+    void separator(const Frame*) override { }
+
+    void openNode(int kind) override
+    {
+        m_buffers.emplace_back();
+        putVarint(m_buffers.back(), (unsigned)kind);
+    }
+
+    void closeNode() override { closeBuffer(TAG_NODE, std::string()); }
+
+    void openList() override { m_buffers.emplace_back(); }
+
+    void closeList(size_t count) override
+    {
+        std::string prefix;
+        putVarint(prefix, count);
+        closeBuffer(TAG_LIST, prefix);
+    }
+
+    void writeNull() override { m_buffers.back() += (char)TAG_NULL; }
+    void writeBool(bool b) override { m_buffers.back() += (char)(b ? TAG_TRUE : TAG_FALSE); }
+
+    void writeInt(long long n) override
+    {
+        m_buffers.back() += (char)TAG_INT;
+        putVarint(m_buffers.back(), ((unsigned long long)n << 1) ^ (unsigned long long)(n >> 63));
+    }
+
+    void writeString(const std::string& str) override
+    {
+        m_buffers.back() += (char)TAG_STRING;
+        putString(m_buffers.back(), str);
+    }
+
+private:
+    static void putVarint(std::string& out, unsigned long long value)
+    {
+        while (value >= 0x80) {
+            out += (char)((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += (char)value;
+    }
+
+    static void putString(std::string& out, const std::string& str)
+    {
+        putVarint(out, str.size());
+        out += str;
+    }
+
+    void closeBuffer(Tag tag, const std::string& prefix)
+    {
+        std::string body = std::move(m_buffers.back());
+        m_buffers.pop_back();
+        std::string& parent = m_buffers.back();
+        parent += (char)tag;
+        putVarint(parent, prefix.size() + body.size());
+        parent += prefix;
+        parent += body;
+    }
+
+    std::vector<std::string> m_buffers;
+};
+
+const char* object_type_name(PycRef<PycObject> obj, PycModule* mod)
+{
+    switch (obj.type()) {
+    case PycObject::TYPE_NONE:
+        return "None";
+    case PycObject::TYPE_TRUE:
+    case PycObject::TYPE_FALSE:
+        return "bool";
+    case PycObject::TYPE_INT:
+    case PycObject::TYPE_INT64:
+    case PycObject::TYPE_LONG:
+        return "int";
+    case PycObject::TYPE_FLOAT:
+    case PycObject::TYPE_BINARY_FLOAT:
+        return "float";
+    case PycObject::TYPE_COMPLEX:
+    case PycObject::TYPE_BINARY_COMPLEX:
+        return "complex";
+    case PycObject::TYPE_STRING:
+        return mod->majorVer() >= 3 ? "bytes" : "str";
+    case PycObject::TYPE_UNICODE:
+        return mod->majorVer() >= 3 ? "str" : "unicode";
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_ASCII:
+    case PycObject::TYPE_ASCII_INTERNED:
+    case PycObject::TYPE_SHORT_ASCII:
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        return "str";
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+        return "tuple";
+    case PycObject::TYPE_LIST:
+        return "list";
+    case PycObject::TYPE_DICT:
+        return "dict";
+    case PycObject::TYPE_SET:
+        return "set";
+    case PycObject::TYPE_FROZENSET:
+        return "frozenset";
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        return "code";
+    case PycObject::TYPE_ELLIPSIS:
+        return "ellipsis";
+    case PycObject::TYPE_STOPITER:
+        return "StopIteration";
+    default:
+        return "object";
+    }
+}
+
+std::string trim_op(const char* op)
+{
+    std::string str(op);
+    size_t first = str.find_first_not_of(' ');
+    size_t last = str.find_last_not_of(' ');
+    return first == std::string::npos ? std::string() : str.substr(first, last - first + 1);
+}
+
+class ASTExporter {
+public:
+    ASTExporter(ASTWriter& writer, PycModule* mod) : m_writer(writer), m_mod(mod) { }
+
+    void module()
+    {
+        PycRef<PycCode> code = m_mod->code();
+        m_writer.beginNode(K_MODULE);
+        m_writer.integer(1);
+        m_writer.string(std::to_string(m_mod->majorVer()) + "." + std::to_string(m_mod->minorVer()));
+        stringOrNull(code->fileName());
+        body(code, code->qualifiedName(nullptr, std::string()));
+        m_writer.endNode();
+    }
+
+private:
+    /* 输出 clean 与 body 两个成员 */
+    void body(PycRef<PycCode> code, const std::string& qualname)
+    {
+        if (!m_codes.insert((PycCode*)code).second) {
+            // 代码对象通过引用构成了环
+            m_writer.boolean(false);
+            m_writer.null();
+            return;
+        }
+        bool clean;
+        PycRef<ASTNode> tree = BuildFromCode(code, m_mod, clean);
+        m_writer.boolean(clean);
+        m_scopes.emplace_back((PycCode*)code, qualname);
+        node(tree);
+        m_scopes.pop_back();
+        m_codes.erase((PycCode*)code);
+    }
+
+    void stringOrNull(PycRef<PycString> str)
+    {
+        if (str != NULL)
+            m_writer.string(str->strValue());
+        else
+            m_writer.null();
+    }
+
+    template <typename Container>
+    void list(const Container& nodes)
+    {
+        m_writer.beginList();
+        for (const auto& item : nodes)
+            node(item);
+        m_writer.endList();
+    }
+
+    template <typename Container>
+    void items(const Container& pairs, int kind)
+    {
+        m_writer.beginList();
+        for (const auto& pair : pairs) {
+            m_writer.beginNode(kind);
+            node(pair.first);
+            node(pair.second);
+            m_writer.endNode();
+        }
+        m_writer.endList();
+    }
+
+    void object(PycRef<PycObject> obj)
+    {
+        m_writer.beginNode(K_OBJECT);
+        m_writer.string(object_type_name(obj, m_mod));
+        PycRef<PycString> str = obj.try_cast<PycString>();
+        if (str != NULL && (obj.type() != PycObject::TYPE_STRING || m_mod->majorVer() < 3))
+            m_writer.string(str->strValue());
+        else
+            m_writer.null();
+        std::ostringstream repr;
+        print_const(repr, obj, m_mod);
+        m_writer.string(repr.str());
+        m_writer.endNode();
+    }
+
+    void function(PycRef<ASTFunction> func)
+    {
+        PycRef<ASTObject> codeNode = func->code().try_cast<ASTObject>();
+        PycRef<PycCode> code = codeNode != NULL ? codeNode->object().try_cast<PycCode>()
+                                                : PycRef<PycCode>();
+        m_writer.beginNode(K_FUNCTION);
+        if (code == NULL) {
+            for (int i = 0; i < 7; ++i)
+                m_writer.null();
+            list(func->defargs());
+            list(func->kwdefargs());
+            m_writer.null();
+            m_writer.null();
+            m_writer.boolean(false);
+            node(func->code());
+            m_writer.endNode();
+            return;
+        }
+
+        std::string qualname = m_scopes.empty()
+                ? code->qualifiedName(nullptr, std::string())
+                : code->qualifiedName(m_scopes.back().first, m_scopes.back().second);
+        stringOrNull(code->name());
+        m_writer.string(qualname);
+
+        int index = 0;
+        auto local = [&code, &index]() {
+            PycRef<PycSequence> names = code->localNames();
+            if (names == NULL || index >= names->size())
+                return std::string();
+            PycRef<PycString> name = names->get(index++).try_cast<PycString>();
+            return name != NULL ? name->strValue() : std::string();
+        };
+        m_writer.beginList();
+        for (int i = 0; i < code->argCount() + code->kwOnlyArgCount(); ++i)
+            m_writer.string(local());
+        m_writer.endList();
+        m_writer.integer(code->posOnlyArgCount());
+        m_writer.integer(code->kwOnlyArgCount());
+        if (code->flags() & PycCode::CO_VARARGS)
+            m_writer.string(local());
+        else
+            m_writer.null();
+        if (code->flags() & PycCode::CO_VARKEYWORDS)
+            m_writer.string(local());
+        else
+            m_writer.null();
+
+        list(func->defargs());
+        list(func->kwdefargs());
+        m_writer.integer(code->flags());
+        m_writer.integer(code->firstLine());
+        body(code, qualname);
+        m_writer.endNode();
+    }
+
+    void block(PycRef<ASTBlock> blk)
+    {
+        static const char* const s_blockTypes[] = {
+            "main", "if", "else", "elif", "try", "container", "except",
+            "finally", "while", "for", "with", "async_for"
+        };
+
+        ASTBlock* raw = (ASTBlock*)blk;
+        ASTCondBlock* cond = dynamic_cast<ASTCondBlock*>(raw);
+        ASTIterBlock* iter = dynamic_cast<ASTIterBlock*>(raw);
+        ASTContainerBlock* container = dynamic_cast<ASTContainerBlock*>(raw);
+        ASTWithBlock* with = dynamic_cast<ASTWithBlock*>(raw);
+
+        m_writer.beginNode(cond ? K_COND_BLOCK : iter ? K_ITER_BLOCK
+                           : container ? K_CONTAINER_BLOCK : with ? K_WITH_BLOCK : K_BLOCK);
+        m_writer.string(s_blockTypes[blk->blktype()]);
+        m_writer.integer(blk->end());
+        list(blk->nodes());
+        if (cond) {
+            node(cond->cond());
+            m_writer.boolean(cond->negative());
+        } else if (iter) {
+            node(iter->iter());
+            node(iter->index());
+            node(iter->condition());
+            m_writer.boolean(iter->isComprehension());
+            m_writer.integer(iter->start());
+        } else if (container) {
+            m_writer.integer(container->finally());
+            m_writer.integer(container->except());
+        } else if (with) {
+            node(with->expr());
+            node(with->var());
+        }
+        m_writer.endNode();
+    }
+
+    void node(PycRef<ASTNode> node)
+    {
+        if (node == NULL) {
+            m_writer.null();
+            return;
+        }
+        if (!m_path.insert((ASTNode*)node).second) {
+            // 节点出现在自己的子树中，不再展开
+            m_writer.null();
+            return;
+        }
+
+        switch (node.type()) {
+        case ASTNode::NODE_NODELIST:
+            m_writer.beginNode(K_NODELIST);
+            list(node.cast<ASTNodeList>()->nodes());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_CHAINSTORE:
+            m_writer.beginNode(K_CHAINSTORE);
+            list(node.cast<ASTChainStore>()->nodes());
+            this->node(node.cast<ASTChainStore>()->src());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_OBJECT:
+            object(node.cast<ASTObject>()->object());
+            break;
+        case ASTNode::NODE_UNARY:
+            {
+                PycRef<ASTUnary> unary = node.cast<ASTUnary>();
+                m_writer.beginNode(K_UNARY);
+                m_writer.string(trim_op(unary->op_str()));
+                this->node(unary->operand());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_BINARY:
+        case ASTNode::NODE_COMPARE:
+            {
+                PycRef<ASTBinary> binary = node.cast<ASTBinary>();
+                m_writer.beginNode(node.type() == ASTNode::NODE_BINARY ? K_BINARY : K_COMPARE);
+                m_writer.string(trim_op(binary->op_str()));
+                this->node(binary->left());
+                this->node(binary->right());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_SLICE:
+            {
+                PycRef<ASTSlice> slice = node.cast<ASTSlice>();
+                m_writer.beginNode(K_SLICE);
+                m_writer.integer(slice->op());
+                this->node(slice->left());
+                this->node(slice->right());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_STORE:
+            m_writer.beginNode(K_STORE);
+            this->node(node.cast<ASTStore>()->src());
+            this->node(node.cast<ASTStore>()->dest());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_RETURN:
+            {
+                static const char* const s_kinds[] = { "return", "yield", "yield_from" };
+                PycRef<ASTReturn> ret = node.cast<ASTReturn>();
+                m_writer.beginNode(K_RETURN);
+                m_writer.string(s_kinds[ret->rettype()]);
+                this->node(ret->value());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_NAME:
+            m_writer.beginNode(K_NAME);
+            stringOrNull(node.cast<ASTName>()->name());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_DELETE:
+            m_writer.beginNode(K_DELETE);
+            this->node(node.cast<ASTDelete>()->value());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_FUNCTION:
+            function(node.cast<ASTFunction>());
+            break;
+        case ASTNode::NODE_CLASS:
+            {
+                PycRef<ASTClass> cls = node.cast<ASTClass>();
+                m_writer.beginNode(K_CLASS);
+                this->node(cls->name());
+                this->node(cls->bases());
+                this->node(cls->code());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_CALL:
+            {
+                PycRef<ASTCall> call = node.cast<ASTCall>();
+                m_writer.beginNode(K_CALL);
+                this->node(call->func());
+                list(call->pparams());
+                items(call->kwparams(), K_KEYWORD_ARG);
+                this->node(call->var());
+                this->node(call->kw());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_IMPORT:
+            {
+                PycRef<ASTImport> import = node.cast<ASTImport>();
+                m_writer.beginNode(K_IMPORT);
+                this->node(import->name());
+                this->node(import->fromlist());
+                m_writer.beginList();
+                for (const auto& store : import->stores())
+                    this->node(store.cast<ASTNode>());
+                m_writer.endList();
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_TUPLE:
+            m_writer.beginNode(K_TUPLE);
+            list(node.cast<ASTTuple>()->values());
+            m_writer.boolean(node.cast<ASTTuple>()->requireParens());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_LIST:
+            m_writer.beginNode(K_LIST);
+            list(node.cast<ASTList>()->values());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_SET:
+            m_writer.beginNode(K_SET);
+            list(node.cast<ASTSet>()->values());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_MAP:
+            m_writer.beginNode(K_MAP);
+            items(node.cast<ASTMap>()->values(), K_MAP_ITEM);
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_KW_NAMES_MAP:
+            m_writer.beginNode(K_KW_NAMES_MAP);
+            items(node.cast<ASTKwNamesMap>()->values(), K_MAP_ITEM);
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_CONST_MAP:
+            m_writer.beginNode(K_CONST_MAP);
+            this->node(node.cast<ASTConstMap>()->keys());
+            list(node.cast<ASTConstMap>()->values());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_SUBSCR:
+            m_writer.beginNode(K_SUBSCR);
+            this->node(node.cast<ASTSubscr>()->name());
+            this->node(node.cast<ASTSubscr>()->key());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_PRINT:
+            {
+                PycRef<ASTPrint> print = node.cast<ASTPrint>();
+                m_writer.beginNode(K_PRINT);
+                list(print->values());
+                this->node(print->stream());
+                m_writer.boolean(print->eol());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_CONVERT:
+            m_writer.beginNode(K_CONVERT);
+            this->node(node.cast<ASTConvert>()->name());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_KEYWORD:
+            m_writer.beginNode(K_KEYWORD);
+            m_writer.string(node.cast<ASTKeyword>()->word_str());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_RAISE:
+            m_writer.beginNode(K_RAISE);
+            list(node.cast<ASTRaise>()->params());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_EXEC:
+            {
+                PycRef<ASTExec> exec = node.cast<ASTExec>();
+                m_writer.beginNode(K_EXEC);
+                this->node(exec->statement());
+                this->node(exec->globals());
+                this->node(exec->locals());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_BLOCK:
+            block(node.cast<ASTBlock>());
+            break;
+        case ASTNode::NODE_COMPREHENSION:
+            {
+                PycRef<ASTComprehension> comp = node.cast<ASTComprehension>();
+                m_writer.beginNode(K_COMPREHENSION);
+                this->node(comp->result());
+                m_writer.beginList();
+                for (const auto& gen : comp->generators())
+                    this->node(gen.cast<ASTNode>());
+                m_writer.endList();
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_LOADBUILDCLASS:
+            m_writer.beginNode(K_LOAD_BUILD_CLASS);
+            object(node.cast<ASTLoadBuildClass>()->object());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_AWAITABLE:
+            m_writer.beginNode(K_AWAITABLE);
+            this->node(node.cast<ASTAwaitable>()->expression());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_FORMATTEDVALUE:
+            {
+                PycRef<ASTFormattedValue> value = node.cast<ASTFormattedValue>();
+                m_writer.beginNode(K_FORMATTED_VALUE);
+                this->node(value->val());
+                m_writer.integer(value->conversion() & ASTFormattedValue::CONVERSION_MASK);
+                this->node(value->format_spec());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_JOINEDSTR:
+            m_writer.beginNode(K_JOINED_STR);
+            list(node.cast<ASTJoinedStr>()->values());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_ANNOTATED_VAR:
+            m_writer.beginNode(K_ANNOTATED_VAR);
+            this->node(node.cast<ASTAnnotatedVar>()->name());
+            this->node(node.cast<ASTAnnotatedVar>()->annotation());
+            m_writer.endNode();
+            break;
+        case ASTNode::NODE_TERNARY:
+            {
+                PycRef<ASTTernary> ternary = node.cast<ASTTernary>();
+                m_writer.beginNode(K_TERNARY);
+                this->node(ternary->if_block());
+                this->node(ternary->if_expr());
+                this->node(ternary->else_expr());
+                m_writer.endNode();
+            }
+            break;
+        case ASTNode::NODE_LOCALS:
+            m_writer.beginNode(K_LOCALS);
+            m_writer.endNode();
+            break;
+        default:
+            m_writer.beginNode(K_INVALID);
+            m_writer.integer(node.type());
+            m_writer.endNode();
+            break;
+        }
+
+        m_path.erase((ASTNode*)node);
+    }
+
+    ASTWriter& m_writer;
+    PycModule* m_mod;
+    std::vector<std::pair<const PycCode*, std::string>> m_scopes;
+    std::unordered_set<PycCode*> m_codes;
+    std::unordered_set<ASTNode*> m_path;
+};
+
+}
+
+void ast_export_json(PycModule* mod, std::ostream& out)
+{
+    JsonWriter writer(out);
+    ASTExporter(writer, mod).module();
+    out << "\n";
+}
+
+void ast_export_binary(PycModule* mod, std::ostream& out)
+{
+    BinaryWriter writer;
+    ASTExporter(writer, mod).module();
+    writer.finish(out);
+}
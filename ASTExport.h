@@ -0,0 +1,75 @@
+﻿#ifndef _PYC_ASTEXPORT_H
+#define _PYC_ASTEXPORT_H
+
+#include <ostream>
+
+class PycModule;
+
+/* 结构化 AST 导出（pycdc --ast-json / --ast-bin）。
+ *
+ * 导出的是 BuildFromCode 得到的原始语法树（未经 print_src 的任何清理），
+ * 函数、lambda、类体与推导式的代码对象会递归展开，因此整棵树覆盖模块中的所有代码。
+ * 解编译不完整的代码对象同样会导出，只是对应 Function / Module 节点的 clean 为 false。
+ *
+ * JSON 形式：每个节点是一个对象，"node" 为节点种类，其余成员按下表依次出现；
+ * 子节点缺失时为 null，列表为数组。
+ *
+ *   Module          schema(=1), version("x.y"), filename, clean, body
+ *   NodeList        nodes[]
+ *   ChainStore      targets[], value
+ *   Object          type（Python 类型名）, value（str 为文本，其他为 null）, repr（源代码形式）
+ *   Unary           op, operand
+ *   Binary          op, left, right            （op 为 "." 时是属性访问，right 为 Name）
+ *   Compare         op, left, right
+ *   Slice           kind(0..3，见 ASTSlice::SliceOp), lower, upper
+ *   Store           value, target
+ *   Return          kind("return"|"yield"|"yield_from"), value
+ *   Name            id
+ *   Delete          target
+ *   Function        name, qualname, args[], posonlyargcount, kwonlyargcount, varargs, varkw,
+ *                   defaults[], kw_defaults[], flags, firstline, clean, body
+ *   Class           name, bases, code          （code 通常是调用类体 Function 的 Call）
+ *   Call            func, args[], keywords[], starargs, kwargs
+ *   KeywordArg      name, value
+ *   Import          name, fromlist, stores[]
+ *   Tuple           elts[], parens
+ *   List / Set      elts[]
+ *   Map             items[]                    （MapItem）
+ *   KwNamesMap      items[]                    （MapItem）
+ *   MapItem         key, value
+ *   ConstMap        keys, values[]
+ *   Subscr          value, slice
+ *   Print           values[], stream, eol
+ *   Convert         value
+ *   Keyword         word("pass"|"break"|"continue")
+ *   Raise           args[]
+ *   Exec            body, globals, locals
+ *   Block           type, end, body[]
+ *   CondBlock       type, end, body[], test, negative
+ *   IterBlock       type, end, body[], iter, target, condition, comprehension, start
+ *   ContainerBlock  type, end, body[], finally, except
+ *   WithBlock       type, end, body[], expr, var
+ *   Comprehension   result, generators[]       （IterBlock）
+ *   LoadBuildClass  object
+ *   Awaitable       value
+ *   FormattedValue  value, conversion(0..3), format_spec
+ *   JoinedStr       values[]
+ *   AnnotatedVar    target, annotation
+ *   Ternary         test, body, orelse         （test 为 CondBlock）
+ *   Locals          （无成员）
+ *   Invalid         type（未知的 ASTNode 类型编号）
+ *
+ * 二进制形式：开头是 8 字节 "PYCAST01"，随后是节点种类表（varint 种类数，
+ * 每个种类依次为名称与各成员名，均为 varint 长度加 UTF-8 字节），最后是根节点的值。
+ * 每个值以 1 字节标记开头：
+ *   0 null   1 false   2 true
+ *   3 整数   zigzag varint
+ *   4 字符串 varint 长度，字节
+ *   5 列表   varint 字节数，varint 元素数，元素
+ *   6 节点   varint 字节数，varint 种类编号，各成员的值（顺序与种类表相同）
+ * 列表与节点带有字节数，读取方可以整体跳过不关心的子树。 */
+
+void ast_export_json(PycModule* mod, std::ostream& out);
+void ast_export_binary(PycModule* mod, std::ostream& out);
+
+#endif
@@ -1,5 +1,25 @@
 ﻿#include "ASTNode.h"
 #include "bytecode.h"
+#include <vector>
+
+void ASTNode::release(ASTNode *node)
+{
+    thread_local std::vector<ASTNode *> pending;
+    thread_local bool releasing = false;
+
+    if (releasing) {
+        pending.push_back(node);
+        return;
+    }
+    releasing = true;
+    delete node;
+    while (!pending.empty()) {
+        ASTNode *next = pending.back();
+        pending.pop_back();
+        delete next;
+    }
+    releasing = false;
+}
 
 /* ASTNodeList */
 void ASTNodeList::removeLast()
@@ -2,9 +2,13 @@
 #define _PYC_ASTNODE_H
 
 #include "pyc_module.h"
+#include <cstdint>
 #include <list>
 #include <deque>
 
+/* 当前线程创建的语法树节点数（FastStack 的复制按栈槽数计入），用于反编译预算（见 ASTree.h） */
+inline thread_local uint64_t ast_node_count = 0;
+
 /* 与 PycObject 类似的接口，因此 PycRef 可以在其上工作... *
  * 但这并*不*意味着两者可以互换！ */
 class ASTNode {
@@ -52,7 +56,7 @@ public:
         NODE_LOCALS,        // 本地变量节点
     };
 
-    ASTNode(int type = NODE_INVALID) : m_refs(), m_type(type), m_processed() { }
+    ASTNode(int type = NODE_INVALID) : m_refs(), m_type(type), m_processed() { ++ast_node_count; }
     virtual ~ASTNode() { }
 
     int type() const { return internalGetType(this); }
@@ -82,9 +86,13 @@ private:
     static void internalDelRef(ASTNode *node)
     {
         if (node && --node->m_refs == 0)
-            delete node;
+            release(node);
     }
 
+    // 删除节点；删除过程中引用计数归零的子节点排队后逐个删除，
+    // 释放很长的表达式链（如上万项的 a + b + ...）也不会递归
+    static void release(ASTNode *node);
+
 public:
     void addRef() { internalAddRef(this); }    // 增加引用计数
     void delRef() { internalDelRef(this); }    // 减少引用计数
@@ -1,11 +1,20 @@
-﻿#include <cstring>
+﻿#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <cstdint>
+#include <sstream>
 #include <stdexcept>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include "ASTree.h"
 #include "FastStack.h"
 #include "pyc_numeric.h"
 #include "bytecode.h"
+#include "opcode_profile.h"
+#include "trace.h"
+#include "pyc_probes.h"
+#include "result_cache.h"
 
 // 必须使用三引号（''' 或 """），以处理包含相反引号风格的插值字符串字面量。
 // 示例：f'''{"插值的 '123' 字面量"}'''    -> 有效。
@@ -17,18 +26,96 @@
 
 static void append_to_chain_store(const PycRef<ASTNode>& chainStore,
         PycRef<ASTNode> item, FastStack& stack, const PycRef<ASTBlock>& curblock);
+bool print_docstring(PycRef<PycObject> obj, int indent, PycModule* mod,
+                     std::ostream& pyc_output);
 
 /* 使用此变量来确定是否发生错误（以及因此是否应避免清理输出树） */
-static bool cleanBuild;
+static thread_local bool cleanBuild;
 
 /* 使用此变量来禁止在 lambda 中打印 return 关键字和换行符。 */
-static bool inLambda = false;
+static thread_local bool inLambda = false;
 
 /* 使用此变量来跟踪是否需要打印任何文档字符串和我们正在使用的全局变量列表（例如在函数内部）。 */
-static bool printDocstringAndGlobals = false;
+static thread_local bool printDocstringAndGlobals = false;
 
 /* 使用此变量来跟踪是否需要打印类或模块文档字符串 */
-static bool printClassDocstring = true;
+static thread_local bool printClassDocstring = true;
+
+// 大纲模式：函数体只输出文档字符串和 "..."，不对其执行 BuildFromCode。
+// outlineDefault 是进程范围的设置，各线程在 decompyle_reset 时取用
+static bool outlineDefault = false;
+static thread_local bool outlineMode = false;
+
+/* 反编译预算（见 ASTree.h）。
+ * 超出时抛出 BudgetExceeded，由最内层正在渲染的 decompyle_code 捕获并改为输出反汇编；
+ * 之后的检查不再抛出，尚未开始的代码对象直接输出反汇编。 */
+namespace {
+
+class BudgetExceeded : public std::runtime_error {
+public:
+    explicit BudgetExceeded(const char* reason) : std::runtime_error(reason) { }
+};
+
+struct BudgetState {
+    bool active;            // 顶层 decompyle 正在进行，且设置了预算
+    bool exhausted;
+    const char* reason;
+    unsigned ticks;
+    uint64_t instructions;
+    uint64_t nodesStart;
+    unsigned fallbacks;     // 改为输出反汇编的代码对象数
+    std::chrono::steady_clock::time_point deadline;
+    std::vector<std::ostream*> streams;     // 各层正在渲染的代码对象的输出
+
+    BudgetState() : active(false), exhausted(false), reason(nullptr), ticks(0),
+                    instructions(0), nodesStart(0), fallbacks(0) { }
+};
+
+PycDecompileBudget s_budgetLimits;
+bool s_budgetEnabled = false;
+thread_local BudgetState s_budget;
+
+const char BUDGET_OUTPUT[] = "输出大小";
+
+void budget_exceed(const char* reason)
+{
+    s_budget.exhausted = true;
+    s_budget.reason = reason;
+    throw BudgetExceeded(reason);
+}
+
+void budget_check_slow()
+{
+    if (s_budgetLimits.timeMs && std::chrono::steady_clock::now() > s_budget.deadline)
+        budget_exceed("时间");
+    if (s_budgetLimits.outputBytes) {
+        // 各层的输出在完成后才并入上一层，正在渲染的部分互不重叠
+        uint64_t total = 0;
+        for (std::ostream* out : s_budget.streams) {
+            std::streamoff pos = out->tellp();
+            if (pos > 0)
+                total += (uint64_t)pos;
+        }
+        if (total > s_budgetLimits.outputBytes)
+            budget_exceed(BUDGET_OUTPUT);
+    }
+}
+
+/* BuildFromCode 每处理一条指令、print_src 每处理一个节点调用一次，通常只是几次比较 */
+inline void budget_tick(bool instruction)
+{
+    if (!s_budget.active || s_budget.exhausted)
+        return;
+    if (instruction && s_budgetLimits.instructions
+            && ++s_budget.instructions > s_budgetLimits.instructions)
+        budget_exceed("指令数");
+    if (s_budgetLimits.nodes && ast_node_count - s_budget.nodesStart > s_budgetLimits.nodes)
+        budget_exceed("语法树节点数");
+    if ((++s_budget.ticks & 255) == 0)
+        budget_check_slow();
+}
+
+}
 
 // 所有 top/pop 调用的快捷方式
 static PycRef<ASTNode> StackPopTop(FastStack& stack)
@@ -71,8 +158,15 @@ static void CheckIfExpr(FastStack& stack, PycRef<ASTBlock> curblock)
     stack.push(new ASTTernary(std::move(if_block), std::move(if_expr), std::move(else_expr)));
 }
 
-PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
+static PycRef<PycCode> defined_code(PycRef<ASTNode> node);
+
+/* until 不为空时，定义了 until 的 def / class 语句一加入代码块就停止构建，
+ * 通过 found 返回这条语句（供 --only 使用）；没有遇到时照常构建到结尾 */
+static PycRef<ASTNode> BuildStatements(PycRef<PycCode> code, PycModule* mod, const PycCode* until,
+                                       PycRef<ASTNode>* found)
 {
+    PYC_PROBE2(build__start, code->name()->value(), code->code()->length());
+
     PycBuffer source(code->code()->value(), code->code()->length());
 
     FastStack stack((mod->majorVer() == 1) ? 20 : code->stackSize());
@@ -108,8 +202,10 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
 
         curpos = pos;
         bc_next(source, mod, opcode, operand, pos);
+        budget_tick(true);
 
         if (need_try && opcode != Pyc::SETUP_EXCEPT_A) {
+            OPCODE_PROFILE_SCOPE(mod, OpcodeProfile::SLOT_NEED_TRY);
             need_try = false;
 
             /* 为 except/finally 语句存储当前栈 */
@@ -128,6 +224,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                 && opcode != Pyc::POP_JUMP_IF_TRUE_A
                 && opcode != Pyc::POP_JUMP_FORWARD_IF_TRUE_A
                 && opcode != Pyc::POP_BLOCK) {
+            OPCODE_PROFILE_SCOPE(mod, OpcodeProfile::SLOT_ELSE_POP);
             else_pop = false;
 
             PycRef<ASTBlock> prev = curblock;
@@ -157,12 +254,13 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
             }
         }
 
+        OPCODE_PROFILE_SCOPE(mod, opcode);
         switch (opcode) {
         case Pyc::BINARY_OP_A:
             {
                 ASTBinary::BinOp op = ASTBinary::from_binary_op(operand);
                 if (op == ASTBinary::BIN_INVALID)
-                    fprintf(stderr, "不支持的 `BINARY_OP` 操作数值: %d\n", operand);
+                    pyc_warnf("不支持的 `BINARY_OP` 操作数值: %d\n", operand);
                 PycRef<ASTNode> right = stack.top();
                 stack.pop();
                 PycRef<ASTNode> left = stack.top();
@@ -837,7 +935,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                             stack = stack_hist.top();
                             stack_hist.pop();
                             if (!curblock->inited())
-                                fprintf(stderr, "解编译 'async for' 时出错。\n");
+                                pyc_warnf("解编译 'async for' 时出错。\n");
                         } else {
                             blocks.push(container);
                         }
@@ -971,7 +1069,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     curblock = blocks.top();
                     stack.push(nullptr);
                 } else {
-                     fprintf(stderr, "不支持在 SETUP_LOOP 之外使用 GET_AITER\n");
+                     pyc_warnf("不支持在 SETUP_LOOP 之外使用 GET_AITER\n");
                 }
             }
             break;
@@ -1232,7 +1330,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     stack = stack_hist.top();
                     stack_hist.pop();
                 } else {
-                    fprintf(stderr, "警告：栈历史为空，可能发生了错误\n");
+                    pyc_warnf("警告：栈历史为空，可能发生了错误\n");
                 }
 
                 PycRef<ASTBlock> prev = curblock;
@@ -1381,7 +1479,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                                 blocks.push(except);
                             }
                         } else {
-                            fprintf(stderr, "发生了可怕的事情！！\n");
+                            pyc_warnf("发生了可怕的事情！！\n");
                         }
                         prev = nil;
                     } else {
@@ -1423,14 +1521,14 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                 stack.pop();
 
                 if (rhs.type() != ASTNode::NODE_OBJECT) {
-                    fprintf(stderr, "为 SET_UPDATE 找到不支持的参数\n");
+                    pyc_warnf("为 SET_UPDATE 找到不支持的参数\n");
                     break;
                 }
 
                 // 我只见过这个是 TYPE_FROZENSET，但让我们小心点...
                 PycRef<PycObject> obj = rhs.cast<ASTObject>()->object();
                 if (obj->type() != PycObject::TYPE_FROZENSET) {
-                    fprintf(stderr, "为 SET_UPDATE 找到不支持的参数类型\n");
+                    pyc_warnf("为 SET_UPDATE 找到不支持的参数类型\n");
                     break;
                 }
 
@@ -1450,14 +1548,14 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                 stack.pop();
 
                 if (rhs.type() != ASTNode::NODE_OBJECT) {
-                    fprintf(stderr, "为 LIST_EXTEND 找到不支持的参数\n");
+                    pyc_warnf("为 LIST_EXTEND 找到不支持的参数\n");
                     break;
                 }
 
                 // 我只见过这个是 SMALL_TUPLE，但让我们小心点...
                 PycRef<PycObject> obj = rhs.cast<ASTObject>()->object();
                 if (obj->type() != PycObject::TYPE_TUPLE && obj->type() != PycObject::TYPE_SMALL_TUPLE) {
-                    fprintf(stderr, "为 LIST_EXTEND 找到不支持的参数类型\n");
+                    pyc_warnf("为 LIST_EXTEND 找到不支持的参数类型\n");
                     break;
                 }
 
@@ -1612,7 +1710,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                         stack = stack_hist.top();
                         stack_hist.pop();
                     } else {
-                        fprintf(stderr, "警告：栈历史为空，可能发生了错误\n");
+                        pyc_warnf("警告：栈历史为空，可能发生了错误\n");
                     }
                 }
                 PycRef<ASTBlock> tmp = curblock;
@@ -1705,7 +1803,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     curblock->append(prev.cast<ASTNode>());
                 }
                 else {
-                    fprintf(stderr, "END_FOR 的块类型 %i 错误\n", curblock->blktype());
+                    pyc_warnf("END_FOR 的块类型 %i 错误\n", curblock->blktype());
                 }
             }
             break;
@@ -1922,7 +2020,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                 stack.pop();
 
                 if (none != NULL) {
-                    fprintf(stderr, "发生了可怕的事情！\n");
+                    pyc_warnf("发生了可怕的事情！\n");
                     break;
                 }
 
@@ -1934,7 +2032,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     curblock->append(with.cast<ASTNode>());
                 }
                 else {
-                    fprintf(stderr, "发生了可怕的事情！在 %d 处没有找到匹配的 with 块用于 WITH_CLEANUP\n", curpos);
+                    pyc_warnf("发生了可怕的事情！在 %d 处没有找到匹配的 with 块用于 WITH_CLEANUP\n", curpos);
                 }
             }
             break;
@@ -2030,7 +2128,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     if (tup.type() == ASTNode::NODE_TUPLE)
                         tup.cast<ASTTuple>()->add(attr);
                     else
-                        fputs("发生了可怕的事情！\n", stderr);
+                        pyc_warn("发生了可怕的事情！\n");
 
                     if (--unpack <= 0) {
                         stack.pop();
@@ -2065,7 +2163,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     if (tup.type() == ASTNode::NODE_TUPLE)
                         tup.cast<ASTTuple>()->add(name);
                     else
-                        fputs("发生了可怕的事情！\n", stderr);
+                        pyc_warn("发生了可怕的事情！\n");
 
                     if (--unpack <= 0) {
                         stack.pop();
@@ -2105,7 +2203,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     if (tup.type() == ASTNode::NODE_TUPLE)
                         tup.cast<ASTTuple>()->add(name);
                     else
-                        fputs("发生了可怕的事情！\n", stderr);
+                        pyc_warn("发生了可怕的事情！\n");
 
                     if (--unpack <= 0) {
                         stack.pop();
@@ -2164,7 +2262,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     if (tup.type() == ASTNode::NODE_TUPLE)
                         tup.cast<ASTTuple>()->add(name);
                     else
-                        fputs("发生了可怕的事情！\n", stderr);
+                        pyc_warn("发生了可怕的事情！\n");
 
                     if (--unpack <= 0) {
                         stack.pop();
@@ -2206,7 +2304,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     if (tup.type() == ASTNode::NODE_TUPLE)
                         tup.cast<ASTTuple>()->add(name);
                     else
-                        fputs("发生了可怕的事情！\n", stderr);
+                        pyc_warn("发生了可怕的事情！\n");
 
                     if (--unpack <= 0) {
                         stack.pop();
@@ -2327,7 +2425,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     if (tup.type() == ASTNode::NODE_TUPLE)
                         tup.cast<ASTTuple>()->add(save);
                     else
-                        fputs("发生了可怕的事情！\n", stderr);
+                        pyc_warn("发生了可怕的事情！\n");
 
                     if (--unpack <= 0) {
                         stack.pop();
@@ -2578,8 +2676,9 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
             }
             break;
         default:
-            fprintf(stderr, "不支持的操作码: %s (%d)\n", Pyc::OpcodeName(opcode), opcode);
+            pyc_warnf("不支持的操作码: %s (%d)\n", Pyc::OpcodeName(opcode), opcode);
             cleanBuild = false;
+            PYC_PROBE2(build__end, code->name()->value(), 0);
             return new ASTNodeList(defblock->nodes());
         }
 
@@ -2587,10 +2686,18 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                       || (curblock->blktype() == ASTBlock::BLK_IF)
                       || (curblock->blktype() == ASTBlock::BLK_ELIF) )
                  && (curblock->end() == pos);
+
+        if (until && !curblock->nodes().empty()
+                && defined_code(curblock->nodes().back()).isIdent(until)) {
+            *found = curblock->nodes().back();
+            cleanBuild = true;
+            PYC_PROBE2(build__end, code->name()->value(), 1);
+            return new ASTNodeList(defblock->nodes());
+        }
     }
 
     if (stack_hist.size()) {
-        fputs("警告：栈历史不为空！\n", stderr);
+        pyc_warn("警告：栈历史不为空！\n");
 
         while (stack_hist.size()) {
             stack_hist.pop();
@@ -2598,7 +2705,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
     }
 
     if (blocks.size() > 1) {
-        fputs("警告：块栈不为空！\n", stderr);
+        pyc_warn("警告：块栈不为空！\n");
 
         while (blocks.size() > 1) {
             PycRef<ASTBlock> tmp = blocks.top();
@@ -2609,9 +2716,22 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
     }
 
     cleanBuild = true;
+    PYC_PROBE2(build__end, code->name()->value(), 1);
     return new ASTNodeList(defblock->nodes());
 }
 
+PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
+{
+    return BuildStatements(code, mod, nullptr, nullptr);
+}
+
+PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod, bool& clean)
+{
+    PycRef<ASTNode> tree = BuildFromCode(code, mod);
+    clean = cleanBuild;
+    return tree;
+}
+
 static void append_to_chain_store(const PycRef<ASTNode> &chainStore,
         PycRef<ASTNode> item, FastStack& stack, const PycRef<ASTBlock>& curblock)
 {
@@ -2685,31 +2805,6 @@ static int cmp_prec(PycRef<ASTNode> parent, PycRef<ASTNode> child)
     return -1;
 }
 
-static void print_ordered(PycRef<ASTNode> parent, PycRef<ASTNode> child,
-                          PycModule* mod, std::ostream& pyc_output)
-{
-    if (child.type() == ASTNode::NODE_BINARY ||
-        child.type() == ASTNode::NODE_COMPARE) {
-        if (cmp_prec(parent, child) > 0) {
-            pyc_output << "(";
-            print_src(child, mod, pyc_output);
-            pyc_output << ")";
-        } else {
-            print_src(child, mod, pyc_output);
-        }
-    } else if (child.type() == ASTNode::NODE_UNARY) {
-        if (cmp_prec(parent, child) > 0) {
-            pyc_output << "(";
-            print_src(child, mod, pyc_output);
-            pyc_output << ")";
-        } else {
-            print_src(child, mod, pyc_output);
-        }
-    } else {
-        print_src(child, mod, pyc_output);
-    }
-}
-
 static void start_line(int indent, std::ostream& pyc_output)
 {
     if (inLambda)
@@ -2725,66 +2820,235 @@ static void end_line(std::ostream& pyc_output)
     pyc_output << "\n";
 }
 
-int cur_indent = -1;
-static void print_block(PycRef<ASTBlock> blk, PycModule* mod,
-                        std::ostream& pyc_output)
+static thread_local int cur_indent = -1;
+static thread_local std::unordered_set<ASTNode *> node_seen;
+
+namespace {
+
+/* print_src 的工作项 */
+enum PrintOp {
+    PRINT_NODE,             // 打印节点 node
+    PRINT_TEXT,             // 输出 text
+    PRINT_CONST,            // 输出 f-string 中的常量 object
+    PRINT_WARNING,          // 给出警告 text
+    PRINT_START_LINE,       // start_line(cur_indent + value)
+    PRINT_END_LINE,         // end_line()
+    PRINT_INDENT,           // cur_indent += value
+    PRINT_SET_LAMBDA,       // inLambda = value
+    PRINT_PUSH_LAMBDA,      // 保存 inLambda，value 不为 0 时置位
+    PRINT_POP_LAMBDA,       // 恢复最近一次 PRINT_PUSH_LAMBDA 保存的 inLambda
+    PRINT_FUNCTION_BODY,    // 接下来的代码对象是函数体
+    PRINT_CLASS_BODY,       // 接下来的代码对象是类体
+    PRINT_DOCSTRING,        // print_docstring(object, cur_indent + value)
+    PRINT_END_NODE,         // 节点 node 及其子节点打印完毕
+};
+
+struct PrintItem {
+    PrintOp op;
+    int value;
+    PycRef<ASTNode> node;
+    PycRef<PycObject> object;
+    std::string text;
+
+    explicit PrintItem(PrintOp op, int value = 0) : op(op), value(value) { }
+};
+
+/* 用显式的工作栈打印语法树。
+ * 节点的处理函数不递归打印子节点，而是把输出的文本、子节点和对全局状态的修改
+ * 按原来的执行顺序排成一串工作项，逆序压入工作栈，由 run() 逐项执行，
+ * 所需的本机栈深度因此与语法树的形状无关。
+ * 排在第一个子节点之前的工作项与之后的执行顺序无关，直接执行，不进入工作栈。
+ * 嵌套的代码对象仍由 decompyle() 反编译，每层代码对象占用一层本机调用 */
+class SourcePrinter {
+public:
+    SourcePrinter(PycModule* mod, std::ostream& pyc_output)
+        : m_mod(mod), m_out(pyc_output) { }
+
+    void run(PycRef<ASTNode> node);
+
+private:
+    void execute(PrintItem& item);
+    void printNode(const PycRef<ASTNode>& node);
+
+    void emit(PrintItem&& item);
+    void op(PrintOp op, int value = 0) { emit(PrintItem(op, value)); }
+    void text(const char* str);
+    void text(const std::string& str) { text(str.c_str()); }
+    void child(PycRef<ASTNode> node);
+    void ordered(const PycRef<ASTNode>& parent, PycRef<ASTNode> node);
+    void block(PycRef<ASTBlock> blk);
+    void formattedValue(PycRef<ASTFormattedValue> formatted_value);
+
+    PycModule* m_mod;
+    std::ostream& m_out;
+    std::vector<PrintItem> m_work;
+    std::vector<PrintItem> m_pending;       // 当前处理函数排出、尚未入栈的工作项（正序）
+    std::vector<bool> m_lambdas;
+};
+
+void SourcePrinter::run(PycRef<ASTNode> node)
+{
+    PrintItem root(PRINT_NODE);
+    root.node = std::move(node);
+    m_work.push_back(std::move(root));
+    while (!m_work.empty()) {
+        PrintItem item = std::move(m_work.back());
+        m_work.pop_back();
+        execute(item);
+    }
+}
+
+void SourcePrinter::emit(PrintItem&& item)
+{
+    if (m_pending.empty() && item.op != PRINT_NODE)
+        execute(item);
+    else
+        m_pending.push_back(std::move(item));
+}
+
+void SourcePrinter::text(const char* str)
+{
+    if (m_pending.empty()) {
+        m_out << str;
+        return;
+    }
+    PrintItem item(PRINT_TEXT);
+    item.text = str;
+    m_pending.push_back(std::move(item));
+}
+
+void SourcePrinter::child(PycRef<ASTNode> node)
+{
+    PrintItem item(PRINT_NODE);
+    item.node = std::move(node);
+    m_pending.push_back(std::move(item));
+}
+
+void SourcePrinter::execute(PrintItem& item)
+{
+    switch (item.op) {
+    case PRINT_NODE:
+        printNode(item.node);
+        for (auto it = m_pending.rbegin(); it != m_pending.rend(); ++it)
+            m_work.push_back(std::move(*it));
+        m_pending.clear();
+        break;
+    case PRINT_TEXT:
+        m_out << item.text;
+        break;
+    case PRINT_CONST:
+        // 当打印 f-string 的一部分时，保持引号风格一致。
+        // 这避免了当 ''' 或 """ 是字符串的一部分时出现问题。
+        print_const(m_out, item.object, m_mod, F_STRING_QUOTE);
+        break;
+    case PRINT_WARNING:
+        pyc_warn(item.text.c_str());
+        break;
+    case PRINT_START_LINE:
+        start_line(cur_indent + item.value, m_out);
+        break;
+    case PRINT_END_LINE:
+        end_line(m_out);
+        break;
+    case PRINT_INDENT:
+        cur_indent += item.value;
+        break;
+    case PRINT_SET_LAMBDA:
+        inLambda = item.value != 0;
+        break;
+    case PRINT_PUSH_LAMBDA:
+        m_lambdas.push_back(inLambda);
+        inLambda |= item.value != 0;
+        break;
+    case PRINT_POP_LAMBDA:
+        inLambda = m_lambdas.back();
+        m_lambdas.pop_back();
+        break;
+    case PRINT_FUNCTION_BODY:
+        printDocstringAndGlobals = true;
+        break;
+    case PRINT_CLASS_BODY:
+        printClassDocstring = true;
+        break;
+    case PRINT_DOCSTRING:
+        print_docstring(item.object, cur_indent + item.value, m_mod, m_out);
+        break;
+    case PRINT_END_NODE:
+        cleanBuild = true;
+        node_seen.erase((ASTNode *)item.node);
+        break;
+    }
+}
+
+void SourcePrinter::ordered(const PycRef<ASTNode>& parent, PycRef<ASTNode> node)
+{
+    if ((node.type() == ASTNode::NODE_BINARY ||
+         node.type() == ASTNode::NODE_COMPARE ||
+         node.type() == ASTNode::NODE_UNARY) && cmp_prec(parent, node) > 0) {
+        text("(");
+        child(std::move(node));
+        text(")");
+    } else {
+        child(std::move(node));
+    }
+}
+
+void SourcePrinter::block(PycRef<ASTBlock> blk)
 {
     ASTBlock::list_t lines = blk->nodes();
 
     if (lines.size() == 0) {
-        PycRef<ASTNode> pass = new ASTKeyword(ASTKeyword::KW_PASS);
-        start_line(cur_indent, pyc_output);
-        print_src(pass, mod, pyc_output);
+        op(PRINT_START_LINE);
+        child(new ASTKeyword(ASTKeyword::KW_PASS));
     }
 
     for (auto ln = lines.cbegin(); ln != lines.cend();) {
         if ((*ln).cast<ASTNode>().type() != ASTNode::NODE_NODELIST) {
-            start_line(cur_indent, pyc_output);
+            op(PRINT_START_LINE);
         }
-        print_src(*ln, mod, pyc_output);
+        child(*ln);
         if (++ln != lines.end()) {
-            end_line(pyc_output);
+            op(PRINT_END_LINE);
         }
     }
 }
 
-void print_formatted_value(PycRef<ASTFormattedValue> formatted_value, PycModule* mod,
-                           std::ostream& pyc_output)
+void SourcePrinter::formattedValue(PycRef<ASTFormattedValue> formatted_value)
 {
-    pyc_output << "{";
-    print_src(formatted_value->val(), mod, pyc_output);
+    text("{");
+    child(formatted_value->val());
 
     switch (formatted_value->conversion() & ASTFormattedValue::CONVERSION_MASK) {
     case ASTFormattedValue::NONE:
         break;
     case ASTFormattedValue::STR:
-        pyc_output << "!s";
+        text("!s");
         break;
     case ASTFormattedValue::REPR:
-        pyc_output << "!r";
+        text("!r");
         break;
     case ASTFormattedValue::ASCII:
-        pyc_output << "!a";
+        text("!a");
         break;
     }
     if (formatted_value->conversion() & ASTFormattedValue::HAVE_FMT_SPEC) {
-        pyc_output << ":" << formatted_value->format_spec().cast<ASTObject>()->object().cast<PycString>()->value();
+        text(":");
+        text(formatted_value->format_spec().cast<ASTObject>()->object().cast<PycString>()->value());
     }
-    pyc_output << "}";
+    text("}");
 }
 
-static std::unordered_set<ASTNode *> node_seen;
-
-void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
+void SourcePrinter::printNode(const PycRef<ASTNode>& node)
 {
     if (node == NULL) {
-        pyc_output << "None";
+        m_out << "None";
         cleanBuild = true;
         return;
     }
+    budget_tick(false);
 
     if (node_seen.find((ASTNode *)node) != node_seen.end()) {
-        fputs("警告：检测到循环引用\n", stderr);
+        pyc_warn("警告：检测到循环引用\n");
         return;
     }
     node_seen.insert((ASTNode *)node);
@@ -2794,183 +3058,190 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
     case ASTNode::NODE_COMPARE:
         {
             PycRef<ASTBinary> bin = node.cast<ASTBinary>();
-            print_ordered(node, bin->left(), mod, pyc_output);
-            pyc_output << bin->op_str();
-            print_ordered(node, bin->right(), mod, pyc_output);
+            ordered(node, bin->left());
+            text(bin->op_str());
+            ordered(node, bin->right());
         }
         break;
     case ASTNode::NODE_UNARY:
         {
             PycRef<ASTUnary> un = node.cast<ASTUnary>();
-            pyc_output << un->op_str();
-            print_ordered(node, un->operand(), mod, pyc_output);
+            text(un->op_str());
+            ordered(node, un->operand());
         }
         break;
     case ASTNode::NODE_CALL:
         {
             PycRef<ASTCall> call = node.cast<ASTCall>();
-            print_src(call->func(), mod, pyc_output);
-            pyc_output << "(";
+            child(call->func());
+            text("(");
             bool first = true;
             for (const auto& param : call->pparams()) {
                 if (!first)
-                    pyc_output << ", ";
-                print_src(param, mod, pyc_output);
+                    text(", ");
+                child(param);
                 first = false;
             }
             for (const auto& param : call->kwparams()) {
                 if (!first)
-                    pyc_output << ", ";
+                    text(", ");
                 if (param.first.type() == ASTNode::NODE_NAME) {
-                    pyc_output << param.first.cast<ASTName>()->name()->value() << " = ";
+                    text(param.first.cast<ASTName>()->name()->value());
                 } else {
                     PycRef<PycString> str_name = param.first.cast<ASTObject>()->object().cast<PycString>();
-                    pyc_output << str_name->value() << " = ";
+                    text(str_name->value());
                 }
-                print_src(param.second, mod, pyc_output);
+                text(" = ");
+                child(param.second);
                 first = false;
             }
             if (call->hasVar()) {
                 if (!first)
-                    pyc_output << ", ";
-                pyc_output << "*";
-                print_src(call->var(), mod, pyc_output);
+                    text(", ");
+                text("*");
+                child(call->var());
                 first = false;
             }
             if (call->hasKW()) {
                 if (!first)
-                    pyc_output << ", ";
-                pyc_output << "**";
-                print_src(call->kw(), mod, pyc_output);
+                    text(", ");
+                text("**");
+                child(call->kw());
                 first = false;
             }
-            pyc_output << ")";
+            text(")");
         }
         break;
     case ASTNode::NODE_DELETE:
         {
-            pyc_output << "del ";
-            print_src(node.cast<ASTDelete>()->value(), mod, pyc_output);
+            text("del ");
+            child(node.cast<ASTDelete>()->value());
         }
         break;
     case ASTNode::NODE_EXEC:
         {
             PycRef<ASTExec> exec = node.cast<ASTExec>();
-            pyc_output << "exec ";
-            print_src(exec->statement(), mod, pyc_output);
+            text("exec ");
+            child(exec->statement());
 
             if (exec->globals() != NULL) {
-                pyc_output << " in ";
-                print_src(exec->globals(), mod, pyc_output);
+                text(" in ");
+                child(exec->globals());
 
                 if (exec->locals() != NULL
                         && exec->globals() != exec->locals()) {
-                    pyc_output << ", ";
-                    print_src(exec->locals(), mod, pyc_output);
+                    text(", ");
+                    child(exec->locals());
                 }
             }
         }
         break;
     case ASTNode::NODE_FORMATTEDVALUE:
-        pyc_output << "f" F_STRING_QUOTE;
-        print_formatted_value(node.cast<ASTFormattedValue>(), mod, pyc_output);
-        pyc_output << F_STRING_QUOTE;
+        text("f" F_STRING_QUOTE);
+        formattedValue(node.cast<ASTFormattedValue>());
+        text(F_STRING_QUOTE);
         break;
     case ASTNode::NODE_JOINEDSTR:
-        pyc_output << "f" F_STRING_QUOTE;
+        text("f" F_STRING_QUOTE);
         for (const auto& val : node.cast<ASTJoinedStr>()->values()) {
             switch (val.type()) {
             case ASTNode::NODE_FORMATTEDVALUE:
-                print_formatted_value(val.cast<ASTFormattedValue>(), mod, pyc_output);
+                formattedValue(val.cast<ASTFormattedValue>());
                 break;
             case ASTNode::NODE_OBJECT:
-                // 当打印 f-string 的一部分时，保持引号风格一致。
-                // 这避免了当 ''' 或 """ 是字符串的一部分时出现问题。
-                print_const(pyc_output, val.cast<ASTObject>()->object(), mod, F_STRING_QUOTE);
+                {
+                    PrintItem item(PRINT_CONST);
+                    item.object = val.cast<ASTObject>()->object();
+                    emit(std::move(item));
+                }
                 break;
             default:
-                fprintf(stderr, "NODE_JOINEDSTR 中不支持的节点类型 %d\n", val.type());
+                {
+                    PrintItem item(PRINT_WARNING);
+                    item.text = "NODE_JOINEDSTR 中不支持的节点类型 " + std::to_string(val.type()) + "\n";
+                    emit(std::move(item));
+                }
             }
         }
-        pyc_output << F_STRING_QUOTE;
+        text(F_STRING_QUOTE);
         break;
     case ASTNode::NODE_KEYWORD:
-        pyc_output << node.cast<ASTKeyword>()->word_str();
+        text(node.cast<ASTKeyword>()->word_str());
         break;
     case ASTNode::NODE_LIST:
         {
-            pyc_output << "[";
+            text("[");
             bool first = true;
-            cur_indent++;
+            op(PRINT_INDENT, 1);
             for (const auto& val : node.cast<ASTList>()->values()) {
                 if (first)
-                    pyc_output << "\n";
+                    text("\n");
                 else
-                    pyc_output << ",\n";
-                start_line(cur_indent, pyc_output);
-                print_src(val, mod, pyc_output);
+                    text(",\n");
+                op(PRINT_START_LINE);
+                child(val);
                 first = false;
             }
-            cur_indent--;
-            pyc_output << "]";
+            op(PRINT_INDENT, -1);
+            text("]");
         }
         break;
     case ASTNode::NODE_SET:
         {
-            pyc_output << "{";
+            text("{");
             bool first = true;
-            cur_indent++;
+            op(PRINT_INDENT, 1);
             for (const auto& val : node.cast<ASTSet>()->values()) {
                 if (first)
-                    pyc_output << "\n";
+                    text("\n");
                 else
-                    pyc_output << ",\n";
-                start_line(cur_indent, pyc_output);
-                print_src(val, mod, pyc_output);
+                    text(",\n");
+                op(PRINT_START_LINE);
+                child(val);
                 first = false;
             }
-            cur_indent--;
-            pyc_output << "}";
+            op(PRINT_INDENT, -1);
+            text("}");
         }
         break;
     case ASTNode::NODE_COMPREHENSION:
         {
             PycRef<ASTComprehension> comp = node.cast<ASTComprehension>();
 
-            pyc_output << "[ ";
-            print_src(comp->result(), mod, pyc_output);
+            text("[ ");
+            child(comp->result());
 
             for (const auto& gen : comp->generators()) {
-                pyc_output << " for ";
-                print_src(gen->index(), mod, pyc_output);
-                pyc_output << " in ";
-                print_src(gen->iter(), mod, pyc_output);
+                text(" for ");
+                child(gen->index());
+                text(" in ");
+                child(gen->iter());
                 if (gen->condition()) {
-                    pyc_output << " if ";
-                    print_src(gen->condition(), mod, pyc_output);
+                    text(" if ");
+                    child(gen->condition());
                 }
             }
-            pyc_output << " ]";
+            text(" ]");
         }
         break;
     case ASTNode::NODE_MAP:
         {
-            pyc_output << "{";
+            text("{");
             bool first = true;
-            cur_indent++;
+            op(PRINT_INDENT, 1);
             for (const auto& val : node.cast<ASTMap>()->values()) {
                 if (first)
-                    pyc_output << "\n";
+                    text("\n");
                 else
-                    pyc_output << ",\n";
-                start_line(cur_indent, pyc_output);
-                print_src(val.first, mod, pyc_output);
-                pyc_output << ": ";
-                print_src(val.second, mod, pyc_output);
+                    text(",\n");
+                op(PRINT_START_LINE);
+                child(val.first);
+                text(": ");
+                child(val.second);
                 first = false;
             }
-            cur_indent--;
-            pyc_output << " }";
+            op(PRINT_INDENT, -1);
+            text(" }");
         }
         break;
     case ASTNode::NODE_CONST_MAP:
@@ -2988,23 +3259,23 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
                 map->add(new ASTObject(key), value);
             }
 
-            print_src(map, mod, pyc_output);
+            child(map);
         }
         break;
     case ASTNode::NODE_NAME:
-        pyc_output << node.cast<ASTName>()->name()->value();
+        text(node.cast<ASTName>()->name()->value());
         break;
     case ASTNode::NODE_NODELIST:
         {
-            cur_indent++;
+            op(PRINT_INDENT, 1);
             for (const auto& ln : node.cast<ASTNodeList>()->nodes()) {
                 if (ln.cast<ASTNode>().type() != ASTNode::NODE_NODELIST) {
-                    start_line(cur_indent, pyc_output);
+                    op(PRINT_START_LINE);
                 }
-                print_src(ln, mod, pyc_output);
-                end_line(pyc_output);
+                child(ln);
+                op(PRINT_END_LINE);
             }
-            cur_indent--;
+            op(PRINT_INDENT, -1);
         }
         break;
     case ASTNode::NODE_BLOCK:
@@ -3014,87 +3285,88 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
                 break;
 
             if (blk->blktype() == ASTBlock::BLK_CONTAINER) {
-                end_line(pyc_output);
-                print_block(blk, mod, pyc_output);
-                end_line(pyc_output);
+                op(PRINT_END_LINE);
+                block(blk);
+                op(PRINT_END_LINE);
                 break;
             }
 
-            pyc_output << blk->type_str();
+            text(blk->type_str());
             if (blk->blktype() == ASTBlock::BLK_IF
                     || blk->blktype() == ASTBlock::BLK_ELIF
                     || blk->blktype() == ASTBlock::BLK_WHILE) {
                 if (blk.cast<ASTCondBlock>()->negative())
-                    pyc_output << " not ";
+                    text(" not ");
                 else
-                    pyc_output << " ";
+                    text(" ");
 
-                print_src(blk.cast<ASTCondBlock>()->cond(), mod, pyc_output);
+                child(blk.cast<ASTCondBlock>()->cond());
             } else if (blk->blktype() == ASTBlock::BLK_FOR || blk->blktype() == ASTBlock::BLK_ASYNCFOR) {
-                pyc_output << " ";
-                print_src(blk.cast<ASTIterBlock>()->index(), mod, pyc_output);
-                pyc_output << " in ";
-                print_src(blk.cast<ASTIterBlock>()->iter(), mod, pyc_output);
+                text(" ");
+                child(blk.cast<ASTIterBlock>()->index());
+                text(" in ");
+                child(blk.cast<ASTIterBlock>()->iter());
             } else if (blk->blktype() == ASTBlock::BLK_EXCEPT &&
                     blk.cast<ASTCondBlock>()->cond() != NULL) {
-                pyc_output << " ";
-                print_src(blk.cast<ASTCondBlock>()->cond(), mod, pyc_output);
+                text(" ");
+                child(blk.cast<ASTCondBlock>()->cond());
             } else if (blk->blktype() == ASTBlock::BLK_WITH) {
-                pyc_output << " ";
-                print_src(blk.cast<ASTWithBlock>()->expr(), mod, pyc_output);
+                text(" ");
+                child(blk.cast<ASTWithBlock>()->expr());
                 PycRef<ASTNode> var = blk.try_cast<ASTWithBlock>()->var();
                 if (var != NULL) {
-                    pyc_output << " as ";
-                    print_src(var, mod, pyc_output);
+                    text(" as ");
+                    child(var);
                 }
             }
-            pyc_output << ":\n";
+            text(":\n");
 
-            cur_indent++;
-            print_block(blk, mod, pyc_output);
-            cur_indent--;
+            op(PRINT_INDENT, 1);
+            block(blk);
+            op(PRINT_INDENT, -1);
         }
         break;
     case ASTNode::NODE_OBJECT:
         {
+            // 没有排在前面的工作项，直接输出
             PycRef<PycObject> obj = node.cast<ASTObject>()->object();
             if (obj.type() == PycObject::TYPE_CODE) {
                 PycRef<PycCode> code = obj.cast<PycCode>();
-                decompyle(code, mod, pyc_output);
+                decompyle(code, m_mod, m_out);
             } else {
-                print_const(pyc_output, obj, mod);
+                print_const(m_out, obj, m_mod);
             }
         }
         break;
     case ASTNode::NODE_PRINT:
         {
-            pyc_output << "print ";
+            text("print ");
             bool first = true;
             if (node.cast<ASTPrint>()->stream() != nullptr) {
-                pyc_output << ">>";
-                print_src(node.cast<ASTPrint>()->stream(), mod, pyc_output);
+                text(">>");
+                child(node.cast<ASTPrint>()->stream());
                 first = false;
             }
 
             for (const auto& val : node.cast<ASTPrint>()->values()) {
                 if (!first)
-                    pyc_output << ", ";
-                print_src(val, mod, pyc_output);
+                    text(", ");
+                child(val);
                 first = false;
             }
             if (!node.cast<ASTPrint>()->eol())
-                pyc_output << ",";
+                text(",");
         }
         break;
     case ASTNode::NODE_RAISE:
         {
             PycRef<ASTRaise> raise = node.cast<ASTRaise>();
-            pyc_output << "raise ";
+            text("raise ");
             bool first = true;
             for (const auto& param : raise->params()) {
                 if (!first)
-                    pyc_output << ", ";
-                print_src(param, mod, pyc_output);
+                    text(", ");
+                child(param);
                 first = false;
             }
         }
@@ -3106,22 +3378,22 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
             if (!inLambda) {
                 switch (ret->rettype()) {
                 case ASTReturn::RETURN:
-                    pyc_output << "return ";
+                    text("return ");
                     break;
                 case ASTReturn::YIELD:
-                    pyc_output << "yield ";
+                    text("yield ");
                     break;
                 case ASTReturn::YIELD_FROM:
                     if (value.type() == ASTNode::NODE_AWAITABLE) {
-                        pyc_output << "await ";
+                        text("await ");
                         value = value.cast<ASTAwaitable>()->expression();
                     } else {
-                        pyc_output << "yield from ";
+                        text("yield from ");
                     }
                     break;
                 }
             }
-            print_src(value, mod, pyc_output);
+            child(value);
         }
         break;
     case ASTNode::NODE_SLICE:
@@ -3129,11 +3401,11 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
             PycRef<ASTSlice> slice = node.cast<ASTSlice>();
 
             if (slice->op() & ASTSlice::SLICE1) {
-                print_src(slice->left(), mod, pyc_output);
+                child(slice->left());
             }
-            pyc_output << ":";
+            text(":");
             if (slice->op() & ASTSlice::SLICE2) {
-                print_src(slice->right(), mod, pyc_output);
+                child(slice->right());
             }
         }
         break;
@@ -3143,46 +3415,46 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
             if (import->stores().size()) {
                 ASTImport::list_t stores = import->stores();
 
-                pyc_output << "from ";
+                text("from ");
                 if (import->name().type() == ASTNode::NODE_IMPORT)
-                    print_src(import->name().cast<ASTImport>()->name(), mod, pyc_output);
+                    child(import->name().cast<ASTImport>()->name());
                 else
-                    print_src(import->name(), mod, pyc_output);
-                pyc_output << " import ";
+                    child(import->name());
+                text(" import ");
 
                 if (stores.size() == 1) {
                     auto src = stores.front()->src();
                     auto dest = stores.front()->dest();
-                    print_src(src, mod, pyc_output);
+                    child(src);
 
                     if (src.cast<ASTName>()->name()->value() != dest.cast<ASTName>()->name()->value()) {
-                        pyc_output << " as ";
-                        print_src(dest, mod, pyc_output);
+                        text(" as ");
+                        child(dest);
                     }
                 } else {
                     bool first = true;
                     for (const auto& st : stores) {
                         if (!first)
-                            pyc_output << ", ";
-                        print_src(st->src(), mod, pyc_output);
+                            text(", ");
+                        child(st->src());
                         first = false;
 
                         if (st->src().cast<ASTName>()->name()->value() != st->dest().cast<ASTName>()->name()->value()) {
-                            pyc_output << " as ";
-                            print_src(st->dest(), mod, pyc_output);
+                            text(" as ");
+                            child(st->dest());
                         }
                     }
                 }
             } else {
-                pyc_output << "import ";
-                print_src(import->name(), mod, pyc_output);
+                text("import ");
+                child(import->name());
             }
         }
         break;
     case ASTNode::NODE_FUNCTION:
         {
             /* 实际的命名函数是带有名称的 NODE_STORE */
-            pyc_output << "(lambda ";
+            text("(lambda ");
             PycRef<ASTNode> code = node.cast<ASTFunction>()->code();
             PycRef<PycCode> code_src = code.cast<ASTObject>()->object().cast<PycCode>();
             ASTFunction::defarg_t defargs = node.cast<ASTFunction>()->defargs();
@@ -3191,32 +3463,32 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
             int narg = 0;
             for (int i=0; i<code_src->argCount(); i++) {
                 if (narg)
-                    pyc_output << ", ";
-                pyc_output << code_src->getLocal(narg++)->value();
+                    text(", ");
+                text(code_src->getLocal(narg++)->value());
                 if ((code_src->argCount() - i) <= (int)defargs.size()) {
-                    pyc_output << " = ";
-                    print_src(*da++, mod, pyc_output);
+                    text(" = ");
+                    child(*da++);
                 }
             }
             da = kwdefargs.cbegin();
             if (code_src->kwOnlyArgCount() != 0) {
-                pyc_output << (narg == 0 ? "*" : ", *");
+                text(narg == 0 ? "*" : ", *");
                 for (int i = 0; i < code_src->argCount(); i++) {
-                    pyc_output << ", ";
-                    pyc_output << code_src->getLocal(narg++)->value();
+                    text(", ");
+                    text(code_src->getLocal(narg++)->value());
                     if ((code_src->kwOnlyArgCount() - i) <= (int)kwdefargs.size()) {
-                        pyc_output << " = ";
-                        print_src(*da++, mod, pyc_output);
+                        text(" = ");
+                        child(*da++);
                     }
                 }
             }
-            pyc_output << ": ";
+            text(": ");
 
-            inLambda = true;
-            print_src(code, mod, pyc_output);
-            inLambda = false;
+            op(PRINT_SET_LAMBDA, 1);
+            child(code);
+            op(PRINT_SET_LAMBDA, 0);
 
-            pyc_output << ")";
+            text(")");
         }
         break;
     case ASTNode::NODE_STORE:
@@ -3229,19 +3501,19 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
                 bool isLambda = false;
 
                 if (strcmp(code_src->name()->value(), "<lambda>") == 0) {
-                    pyc_output << "\n";
-                    start_line(cur_indent, pyc_output);
-                    print_src(dest, mod, pyc_output);
-                    pyc_output << " = lambda ";
+                    text("\n");
+                    op(PRINT_START_LINE);
+                    child(dest);
+                    text(" = lambda ");
                     isLambda = true;
                 } else {
-                    pyc_output << "\n";
-                    start_line(cur_indent, pyc_output);
+                    text("\n");
+                    op(PRINT_START_LINE);
                     if (code_src->flags() & PycCode::CO_COROUTINE)
-                        pyc_output << "async ";
-                    pyc_output << "def ";
-                    print_src(dest, mod, pyc_output);
-                    pyc_output << "(";
+                        text("async ");
+                    text("def ");
+                    child(dest);
+                    text("(");
                 }
 
                 ASTFunction::defarg_t defargs = src.cast<ASTFunction>()->defargs();
@@ -3250,141 +3522,151 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
                 int narg = 0;
                 for (int i = 0; i < code_src->argCount(); ++i) {
                     if (narg)
-                        pyc_output << ", ";
-                    pyc_output << code_src->getLocal(narg++)->value();
+                        text(", ");
+                    text(code_src->getLocal(narg++)->value());
                     if ((code_src->argCount() - i) <= (int)defargs.size()) {
-                        pyc_output << " = ";
-                        print_src(*da++, mod, pyc_output);
+                        text(" = ");
+                        child(*da++);
                     }
                 }
                 da = kwdefargs.cbegin();
                 if (code_src->kwOnlyArgCount() != 0) {
-                    pyc_output << (narg == 0 ? "*" : ", *");
+                    text(narg == 0 ? "*" : ", *");
                     for (int i = 0; i < code_src->kwOnlyArgCount(); ++i) {
-                        pyc_output << ", ";
-                        pyc_output << code_src->getLocal(narg++)->value();
+                        text(", ");
+                        text(code_src->getLocal(narg++)->value());
                         if ((code_src->kwOnlyArgCount() - i) <= (int)kwdefargs.size()) {
-                            pyc_output << " = ";
-                            print_src(*da++, mod, pyc_output);
+                            text(" = ");
+                            child(*da++);
                         }
                     }
                 }
                 if (code_src->flags() & PycCode::CO_VARARGS) {
                     if (narg)
-                        pyc_output << ", ";
-                    pyc_output << "*" << code_src->getLocal(narg++)->value();
+                        text(", ");
+                    text("*");
+                    text(code_src->getLocal(narg++)->value());
                 }
                 if (code_src->flags() & PycCode::CO_VARKEYWORDS) {
                     if (narg)
-                        pyc_output << ", ";
-                    pyc_output << "**" << code_src->getLocal(narg++)->value();
+                        text(", ");
+                    text("**");
+                    text(code_src->getLocal(narg++)->value());
                 }
 
                 if (isLambda) {
-                    pyc_output << ": ";
+                    text(": ");
                 } else {
-                    pyc_output << "):\n";
-                    printDocstringAndGlobals = true;
+                    text("):\n");
+                    if (outlineMode) {
+                        if (code_src->consts()->size()) {
+                            PrintItem item(PRINT_DOCSTRING, 1);
+                            item.object = code_src->getConst(0);
+                            emit(std::move(item));
+                        }
+                        op(PRINT_START_LINE, 1);
+                        text("...");
+                        op(PRINT_END_LINE);
+                        break;
+                    }
+                    op(PRINT_FUNCTION_BODY);
                 }
 
-                bool preLambda = inLambda;
-                inLambda |= isLambda;
-
-                print_src(code, mod, pyc_output);
-
-                inLambda = preLambda;
+                op(PRINT_PUSH_LAMBDA, isLambda);
+                child(code);
+                op(PRINT_POP_LAMBDA);
             } else if (src.type() == ASTNode::NODE_CLASS) {
-                pyc_output << "\n";
-                start_line(cur_indent, pyc_output);
-                pyc_output << "class ";
-                print_src(dest, mod, pyc_output);
+                text("\n");
+                op(PRINT_START_LINE);
+                text("class ");
+                child(dest);
                 PycRef<ASTTuple> bases = src.cast<ASTClass>()->bases().cast<ASTTuple>();
                 if (bases->values().size() > 0) {
-                    pyc_output << "(";
+                    text("(");
                     bool first = true;
                     for (const auto& val : bases->values()) {
                         if (!first)
-                            pyc_output << ", ";
-                        print_src(val, mod, pyc_output);
+                            text(", ");
+                        child(val);
                         first = false;
                     }
-                    pyc_output << "):\n";
+                    text("):\n");
                 } else {
                     // 如果没有基类，不要放括号
-                    pyc_output << ":\n";
+                    text(":\n");
                 }
-                printClassDocstring = true;
+                op(PRINT_CLASS_BODY);
                 PycRef<ASTNode> code = src.cast<ASTClass>()->code().cast<ASTCall>()
                                        ->func().cast<ASTFunction>()->code();
-                print_src(code, mod, pyc_output);
+                child(code);
             } else if (src.type() == ASTNode::NODE_IMPORT) {
                 PycRef<ASTImport> import = src.cast<ASTImport>();
                 if (import->fromlist() != NULL) {
                     PycRef<PycObject> fromlist = import->fromlist().cast<ASTObject>()->object();
                     if (fromlist != Pyc_None) {
-                        pyc_output << "from ";
+                        text("from ");
                         if (import->name().type() == ASTNode::NODE_IMPORT)
-                            print_src(import->name().cast<ASTImport>()->name(), mod, pyc_output);
+                            child(import->name().cast<ASTImport>()->name());
                         else
-                            print_src(import->name(), mod, pyc_output);
-                        pyc_output << " import ";
+                            child(import->name());
+                        text(" import ");
                         if (fromlist.type() == PycObject::TYPE_TUPLE ||
                                 fromlist.type() == PycObject::TYPE_SMALL_TUPLE) {
                             bool first = true;
                             for (const auto& val : fromlist.cast<PycTuple>()->values()) {
                                 if (!first)
-                                    pyc_output << ", ";
-                                pyc_output << val.cast<PycString>()->value();
+                                    text(", ");
+                                text(val.cast<PycString>()->value());
                                 first = false;
                             }
                         } else {
-                            pyc_output << fromlist.cast<PycString>()->value();
+                            text(fromlist.cast<PycString>()->value());
                         }
                     } else {
-                        pyc_output << "import ";
-                        print_src(import->name(), mod, pyc_output);
+                        text("import ");
+                        child(import->name());
                     }
                 } else {
-                    pyc_output << "import ";
+                    text("import ");
                     PycRef<ASTNode> import_name = import->name();
-                    print_src(import_name, mod, pyc_output);
+                    child(import_name);
                     if (!dest.cast<ASTName>()->name()->isEqual(import_name.cast<ASTName>()->name().cast<PycObject>())) {
-                        pyc_output << " as ";
-                        print_src(dest, mod, pyc_output);
+                        text(" as ");
+                        child(dest);
                     }
                 }
             } else if (src.type() == ASTNode::NODE_BINARY
                     && src.cast<ASTBinary>()->is_inplace()) {
-                print_src(src, mod, pyc_output);
+                child(src);
             } else {
-                print_src(dest, mod, pyc_output);
-                pyc_output << " = ";
-                print_src(src, mod, pyc_output);
+                child(dest);
+                text(" = ");
+                child(src);
             }
         }
         break;
     case ASTNode::NODE_CHAINSTORE:
         {
             for (auto& dest : node.cast<ASTChainStore>()->nodes()) {
-                print_src(dest, mod, pyc_output);
-                pyc_output << " = ";
+                child(dest);
+                text(" = ");
             }
-            print_src(node.cast<ASTChainStore>()->src(), mod, pyc_output);
+            child(node.cast<ASTChainStore>()->src());
         }
         break;
     case ASTNode::NODE_SUBSCR:
         {
-            print_src(node.cast<ASTSubscr>()->name(), mod, pyc_output);
-            pyc_output << "[";
-            print_src(node.cast<ASTSubscr>()->key(), mod, pyc_output);
-            pyc_output << "]";
+            child(node.cast<ASTSubscr>()->name());
+            text("[");
+            child(node.cast<ASTSubscr>()->key());
+            text("]");
         }
         break;
     case ASTNode::NODE_CONVERT:
         {
-            pyc_output << "`";
-            print_src(node.cast<ASTConvert>()->name(), mod, pyc_output);
-            pyc_output << "`";
+            text("`");
+            child(node.cast<ASTConvert>()->name());
+            text("`");
         }
         break;
     case ASTNode::NODE_TUPLE:
@@ -3392,18 +3674,18 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
             PycRef<ASTTuple> tuple = node.cast<ASTTuple>();
             ASTTuple::value_t values = tuple->values();
             if (tuple->requireParens())
-                pyc_output << "(";
+                text("(");
             bool first = true;
             for (const auto& val : values) {
                 if (!first)
-                    pyc_output << ", ";
-                print_src(val, mod, pyc_output);
+                    text(", ");
+                child(val);
                 first = false;
             }
             if (values.size() == 1)
-                pyc_output << ',';
+                text(",");
             if (tuple->requireParens())
-                pyc_output << ')';
+                text(")");
         }
         break;
     case ASTNode::NODE_ANNOTATED_VAR:
@@ -3412,9 +3694,9 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
             PycRef<ASTObject> name = annotated_var->name().cast<ASTObject>();
             PycRef<ASTNode> annotation = annotated_var->annotation();
 
-            pyc_output << name->object().cast<PycString>()->value();
-            pyc_output << ": ";
-            print_src(annotation, mod, pyc_output);
+            text(name->object().cast<PycString>()->value());
+            text(": ");
+            child(annotation);
         }
         break;
     case ASTNode::NODE_TERNARY:
@@ -3428,28 +3710,37 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
              * 但是，让我们不要添加括号 - 以在大多数情况下保持源代码尽可能接近原始代码
              */
             PycRef<ASTTernary> ternary = node.cast<ASTTernary>();
-            //pyc_output << "(";
-            print_src(ternary->if_expr(), mod, pyc_output);
+            //text("(");
+            child(ternary->if_expr());
             const auto if_block = ternary->if_block().cast<ASTCondBlock>();
-            pyc_output << " if ";
+            text(" if ");
             if (if_block->negative())
-                pyc_output << "not ";
-            print_src(if_block->cond(), mod, pyc_output);
-            pyc_output << " else ";
-            print_src(ternary->else_expr(), mod, pyc_output);
-            //pyc_output << ")";
+                text("not ");
+            child(if_block->cond());
+            text(" else ");
+            child(ternary->else_expr());
+            //text(")");
         }
         break;
     default:
-        pyc_output << "<NODE:" << node->type() << ">";
-        fprintf(stderr, "不支持的节点类型: %d\n", node->type());
+        m_out << "<NODE:" << node->type() << ">";
+        pyc_warnf("不支持的节点类型: %d\n", node->type());
         cleanBuild = false;
         node_seen.erase((ASTNode *)node);
         return;
     }
 
-    cleanBuild = true;
-    node_seen.erase((ASTNode *)node);
+    PrintItem end(PRINT_END_NODE);
+    end.node = node;
+    emit(std::move(end));
+}
+
+}
+
+void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
+{
+    SourcePrinter printer(mod, pyc_output);
+    printer.run(std::move(node));
 }
 
 bool print_docstring(PycRef<PycObject> obj, int indent, PycModule* mod,
@@ -3466,17 +3757,26 @@ bool print_docstring(PycRef<PycObject> obj, int indent, PycModule* mod,
     return false;
 }
 
-static std::unordered_set<PycCode *> code_seen;
+/* 正在渲染的代码对象，其大小也就是当前代码对象的嵌套层数 */
+static thread_local std::unordered_set<PycCode *> code_seen;
+/* 遇到循环引用或嵌套过深而没有渲染的次数；渲染过程中计数变化时，输出取决于调用路径 */
+static thread_local unsigned code_truncations = 0;
 
-void decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
+/* 反编译时代码对象的最大嵌套层数。渲染是递归的，每层代码对象约占 6 KB 栈空间，
+ * 而 --max-depth 只限制加载，合法的 pyc 中代码对象可以嵌套近 1000 层。
+ * Python 源代码的缩进不超过 100 层，256 层足够正常的代码，在 2 MB 的线程栈中也不会溢出 */
+static const unsigned MAX_CODE_NESTING = 256;
+
+static void render_code(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
 {
-    if (code_seen.find((PycCode *)code) != code_seen.end()) {
-        fputs("警告：检测到循环引用\n", stderr);
-        return;
-    }
-    code_seen.insert((PycCode *)code);
+    Trace::Span span("decompyle", "decompile", code->name()->value());
+    PYC_PROBE1(decompyle__start, code->name()->value());
 
-    PycRef<ASTNode> source = BuildFromCode(code, mod);
+    PycRef<ASTNode> source;
+    {
+        Trace::Span build_span("BuildFromCode", "decompile", code->name()->value());
+        source = BuildFromCode(code, mod);
+    }
 
     PycRef<ASTNodeList> clean = source.cast<ASTNodeList>();
     if (cleanBuild) {
@@ -3563,12 +3863,518 @@ void decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
         printDocstringAndGlobals = false;
     }
 
-    print_src(source, mod, pyc_output);
+    {
+        Trace::Span print_span("print_src", "output", code->name()->value());
+        PYC_PROBE1(print__start, code->name()->value());
+        print_src(source, mod, pyc_output);
+        PYC_PROBE1(print__end, code->name()->value());
+    }
 
     if (!cleanBuild || !part1clean) {
         start_line(cur_indent, pyc_output);
         pyc_output << "# 警告：解编译不完整\n";
     }
 
+    PYC_PROBE1(decompyle__end, code->name()->value());
+}
+
+/* 以注释形式输出一个代码对象（不含嵌套的代码对象）的反汇编 */
+static void print_disasm_comment(PycRef<PycCode> code, PycModule* mod, int indent,
+                                 std::ostream& pyc_output)
+{
+    std::ostringstream disasm;
+    try {
+        bc_disasm(disasm, code, mod, 0, 0);
+    } catch (std::exception&) {
+        // 只输出已经得到的部分
+    }
+    std::istringstream lines(disasm.str());
+    std::string line;
+    while (std::getline(lines, line)) {
+        start_line(indent, pyc_output);
+        pyc_output << "# " << line << "\n";
+    }
+}
+
+/* 预算耗尽时代码对象的输出：注释形式的反汇编加上 pass，保持外层代码仍可编译。
+ * 其中嵌套的函数和类不会再被渲染，因此按常量中的顺序逐个附上它们的反汇编 */
+static void print_budget_fallback(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
+{
+    ++s_budget.fallbacks;
+    cleanBuild = false;
+    printDocstringAndGlobals = false;
+    printClassDocstring = false;
+    if (inLambda) {
+        pyc_output << "...";
+        return;
+    }
+
+    int indent = cur_indent + 1;
+    start_line(indent, pyc_output);
+    pyc_output << "# 警告：超出反编译预算（" << s_budget.reason << "），以下为反汇编\n";
+    // 输出大小超出预算时不再追加反汇编
+    if (s_budget.reason != BUDGET_OUTPUT) {
+        // 嵌套的代码对象用显式的栈遍历，附上以点分隔的名称路径
+        std::vector<std::pair<PycRef<PycCode>, std::string>> pending;
+        std::unordered_set<PycCode *> visited;
+        pending.emplace_back(code, std::string());
+        while (!pending.empty()) {
+            PycRef<PycCode> current = pending.back().first;
+            std::string path = std::move(pending.back().second);
+            pending.pop_back();
+            if (!visited.insert((PycCode *)current).second)
+                continue;
+            if (!path.empty()) {
+                start_line(indent, pyc_output);
+                pyc_output << "# " << path << " 的反汇编：\n";
+            }
+            print_disasm_comment(current, mod, indent, pyc_output);
+
+            size_t first = pending.size();
+            for (int i = 0; i < current->consts()->size(); ++i) {
+                PycRef<PycObject> obj = current->getConst(i);
+                if (obj.type() != PycObject::TYPE_CODE && obj.type() != PycObject::TYPE_CODE2)
+                    continue;
+                PycRef<PycCode> child = obj.cast<PycCode>();
+                pending.emplace_back(child, path.empty() ? std::string(child->name()->value())
+                                            : path + "." + child->name()->value());
+            }
+            std::reverse(pending.begin() + first, pending.end());
+        }
+    }
+    start_line(indent, pyc_output);
+    pyc_output << "pass\n";
+}
+
+/* 在预算之内渲染代码对象。输出先写入局部缓冲区，超出预算时丢弃已生成的部分，
+ * 恢复渲染状态后改为输出反汇编 */
+static void render_code_budgeted(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
+{
+    if (s_budget.exhausted) {
+        print_budget_fallback(code, mod, pyc_output);
+        return;
+    }
+
+    int savedIndent = cur_indent;
+    bool savedLambda = inLambda;
+    bool savedDocstringAndGlobals = printDocstringAndGlobals;
+    bool savedClassDocstring = printClassDocstring;
+    std::unordered_set<ASTNode *> savedNodes = node_seen;
+    std::unordered_set<PycCode *> savedCodes = code_seen;
+
+    std::ostringstream body;
+    s_budget.streams.push_back(&body);
+    try {
+        render_code(code, mod, body);
+    } catch (BudgetExceeded& ex) {
+        s_budget.streams.pop_back();
+        cur_indent = savedIndent;
+        inLambda = savedLambda;
+        printDocstringAndGlobals = savedDocstringAndGlobals;
+        printClassDocstring = savedClassDocstring;
+        node_seen = std::move(savedNodes);
+        code_seen = std::move(savedCodes);
+        pyc_warnf("警告：%s 超出反编译预算（%s），已改为输出反汇编\n",
+                  code->name()->value(), ex.what());
+        print_budget_fallback(code, mod, pyc_output);
+        return;
+    }
+    s_budget.streams.pop_back();
+    pyc_output << body.str();
+}
+
+/* 嵌套过深的代码对象不再递归反编译，只输出注释和 pass */
+static void print_nesting_fallback(PycRef<PycCode> code, std::ostream& pyc_output)
+{
+    pyc_warnf("警告：%s 的代码对象嵌套超过 %u 层，未反编译\n",
+              code->name()->value(), MAX_CODE_NESTING);
+    ++code_truncations;
+    cleanBuild = false;
+    printDocstringAndGlobals = false;
+    printClassDocstring = false;
+    if (inLambda) {
+        pyc_output << "...";
+        return;
+    }
+    start_line(cur_indent + 1, pyc_output);
+    pyc_output << "# 警告：代码对象嵌套超过 " << MAX_CODE_NESTING << " 层，未反编译\n";
+    start_line(cur_indent + 1, pyc_output);
+    pyc_output << "pass\n";
+}
+
+static void decompyle_code(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
+{
+    if (code_seen.find((PycCode *)code) != code_seen.end()) {
+        pyc_warn("警告：检测到循环引用\n");
+        ++code_truncations;
+        return;
+    }
+    if (code_seen.size() >= MAX_CODE_NESTING) {
+        print_nesting_fallback(code, pyc_output);
+        return;
+    }
+    code_seen.insert((PycCode *)code);
+    if (s_budget.active)
+        render_code_budgeted(code, mod, pyc_output);
+    else
+        render_code(code, mod, pyc_output);
     code_seen.erase((PycCode *)code);
-}
\ No newline at end of file
+}
+
+/* 代码对象渲染结果的复用。
+ * 结构哈希相同、渲染上下文（缩进、lambda、文档字符串状态）也相同的代码对象，
+ * 输出必然相同，因此直接复用之前的文本而不再执行 BuildFromCode。 */
+namespace {
+
+struct MemoEntry {
+    std::string output;
+    std::string warnings;
+    bool clean;
+};
+
+const size_t MEMO_MAX_BYTES = 64 * 1024 * 1024;
+
+thread_local std::unordered_map<std::string, MemoEntry> s_memo;
+thread_local size_t s_memoBytes = 0;
+bool s_memoEnabled = false;
+PycResultCache* s_memoStore = nullptr;
+thread_local PycPrerenderSource* s_prerender = nullptr;
+
+std::string memo_key(PycRef<PycCode> code, PycModule* mod)
+{
+    int64_t fields[] = {
+        (int64_t)code->structuralHash(),
+        cur_indent,
+        inLambda,
+        printDocstringAndGlobals,
+        printClassDocstring,
+        code.isIdent(mod->code()),
+        outlineMode,
+    };
+    std::string key;
+    for (int64_t field : fields) {
+        for (int i = 0; i < 8; ++i)
+            key += (char)(field >> (i * 8));
+    }
+    return key;
+}
+
+void memo_insert(const std::string& key, MemoEntry entry)
+{
+    size_t size = key.size() + entry.output.size() + entry.warnings.size();
+    if (s_memoBytes + size > MEMO_MAX_BYTES) {
+        s_memo.clear();
+        s_memoBytes = 0;
+    }
+    if (s_memo.emplace(key, std::move(entry)).second)
+        s_memoBytes += size;
+}
+
+void memo_replay(const MemoEntry& entry, std::ostream& pyc_output)
+{
+    pyc_output.write(entry.output.data(), entry.output.size());
+    if (!entry.warnings.empty())
+        pyc_warn(entry.warnings.c_str());
+    cleanBuild = entry.clean;
+    printDocstringAndGlobals = false;
+    printClassDocstring = false;
+}
+
+}
+
+void decompyle_reset()
+{
+    cleanBuild = false;
+    inLambda = false;
+    printDocstringAndGlobals = false;
+    printClassDocstring = true;
+    cur_indent = -1;
+    node_seen.clear();
+    code_seen.clear();
+    outlineMode = outlineDefault;
+}
+
+void decompyle_set_outline(bool enabled)
+{
+    outlineDefault = enabled;
+    outlineMode = enabled;
+}
+
+void decompyle_set_memo(bool enabled, PycResultCache* store)
+{
+    s_memoEnabled = enabled;
+    s_memoStore = store;
+    s_memo.clear();
+    s_memoBytes = 0;
+}
+
+void decompyle_set_budget(const PycDecompileBudget& budget)
+{
+    s_budgetLimits = budget;
+    s_budgetEnabled = budget.timeMs || budget.instructions || budget.nodes || budget.outputBytes;
+}
+
+std::vector<int> decompyle_split(PycRef<PycCode> code)
+{
+    // 提前反编译的结果按复用结果的规则验证，不能复用时也就不能拆分
+    std::vector<int> indices;
+    if (!s_memoEnabled || s_budgetEnabled)
+        return indices;
+    for (int i = 0; i < code->consts()->size(); ++i) {
+        PycRef<PycObject> obj = code->getConst(i);
+        if (obj.type() != PycObject::TYPE_CODE && obj.type() != PycObject::TYPE_CODE2)
+            continue;
+        // lambda 和推导式的名称以 '<' 开头，在表达式中输出，不值得拆分；
+        // 大纲模式下函数体不反编译
+        PycRef<PycCode> child = obj.cast<PycCode>();
+        if (child->name()->value()[0] == '<'
+                || (outlineMode && (child->flags() & PycCode::CO_OPTIMIZED)))
+            continue;
+        indices.push_back(i);
+    }
+    if (indices.size() < 2)
+        indices.clear();
+    return indices;
+}
+
+bool decompyle_prerender(PycModule* mod, int constIndex, PycPrerendered& result)
+{
+    PycRef<PycCode> code = mod->code()->getConst(constIndex).cast<PycCode>();
+
+    // 顶层 def / class 语句中反编译代码对象时的状态：函数体输出文档字符串和 global 声明，
+    // 类体输出类的文档字符串（Python 2 的类体也带有 CO_NEWLOCALS，因此按 CO_OPTIMIZED 区分）。
+    // 猜测不对时键不同，结果不会被使用
+    bool isFunction = (code->flags() & PycCode::CO_OPTIMIZED) != 0;
+    decompyle_reset();
+    cur_indent = 0;
+    printDocstringAndGlobals = isFunction;
+    printClassDocstring = !isFunction;
+    code_seen.insert((PycCode *)mod->code());
+    result.key = memo_key(code, mod);
+
+    std::ostringstream body;
+    unsigned truncations = code_truncations;
+    {
+        PycWarningCapture capture(result.warnings);
+        decompyle_code(code, mod, body);
+    }
+    result.output = body.str();
+    result.clean = cleanBuild;
+    decompyle_reset();
+    return truncations == code_truncations;
+}
+
+void decompyle_set_prerender(PycPrerenderSource* source)
+{
+    s_prerender = source;
+}
+
+namespace {
+
+/* 顶层 decompyle 调用期间启用预算 */
+class BudgetScope {
+public:
+    BudgetScope() : m_owner(s_budgetEnabled && !s_budget.active)
+    {
+        if (!m_owner)
+            return;
+        s_budget = BudgetState();
+        s_budget.active = true;
+        s_budget.nodesStart = ast_node_count;
+        s_budget.deadline = std::chrono::steady_clock::now()
+                            + std::chrono::milliseconds(s_budgetLimits.timeMs);
+    }
+
+    ~BudgetScope()
+    {
+        if (!m_owner)
+            return;
+        if (s_budget.fallbacks > 1)
+            pyc_warnf("警告：另有 %u 个代码对象因预算耗尽改为输出反汇编\n", s_budget.fallbacks - 1);
+        s_budget = BudgetState();
+    }
+
+private:
+    bool m_owner;
+};
+
+}
+
+void decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
+{
+    BudgetScope budget;
+    // 设置了预算时不复用结果：复用的代码对象不消耗预算，输出会与反编译的先后顺序有关
+    if (!s_memoEnabled || s_budgetEnabled || code_seen.find((PycCode *)code) != code_seen.end()) {
+        decompyle_code(code, mod, pyc_output);
+        return;
+    }
+
+    std::string key = memo_key(code, mod);
+    auto it = s_memo.find(key);
+    if (it != s_memo.end()) {
+        PYC_PROBE1(decompyle__reuse, code->name()->value());
+        memo_replay(it->second, pyc_output);
+        return;
+    }
+
+    std::string storeKey;
+    if (s_memoStore) {
+        PycResultCache::Entry stored;
+        storeKey = PycResultCache::makeKey(key.data(), key.size(), "code");
+        if (s_memoStore->lookup(storeKey, stored)) {
+            PYC_PROBE1(decompyle__reuse, code->name()->value());
+            MemoEntry entry { std::move(stored.output), std::move(stored.warnings), stored.clean };
+            memo_replay(entry, pyc_output);
+            memo_insert(key, std::move(entry));
+            return;
+        }
+    }
+
+    MemoEntry entry;
+    PycPrerendered prerendered;
+    if (s_prerender && s_prerender->claim((PycCode *)code, key, prerendered)) {
+        PYC_PROBE1(decompyle__reuse, code->name()->value());
+        entry.output = std::move(prerendered.output);
+        entry.warnings = std::move(prerendered.warnings);
+        entry.clean = prerendered.clean;
+        memo_replay(entry, pyc_output);
+    } else {
+        std::ostringstream body;
+        unsigned truncations = code_truncations;
+        {
+            PycWarningCapture capture(entry.warnings);
+            decompyle_code(code, mod, body);
+        }
+        entry.output = body.str();
+        entry.clean = cleanBuild;
+        memo_replay(entry, pyc_output);
+
+        // 渲染过程中遇到循环引用或嵌套过深时，输出取决于调用路径，不能复用
+        if (truncations != code_truncations)
+            return;
+    }
+
+    if (s_memoStore) {
+        PycResultCache::Entry stored;
+        stored.major = mod->majorVer();
+        stored.minor = mod->minorVer();
+        stored.unicode = mod->isUnicode();
+        stored.clean = entry.clean;
+        stored.output = entry.output;
+        stored.warnings = entry.warnings;
+        s_memoStore->store(storeKey, stored);
+    }
+    memo_insert(key, std::move(entry));
+}
+
+/* --only：按限定名查找代码对象。
+ * 每一层只在常量中查找名称匹配的代码对象，不相关的代码对象不会被访问，
+ * 配合延迟加载时也就不会被解析。"<locals>" 部分可以省略。 */
+static bool find_code_path(PycRef<PycCode> code, const std::vector<std::string>& parts,
+                           size_t index, std::vector<PycRef<PycCode>>& path)
+{
+    path.push_back(code);
+    if (index == parts.size())
+        return true;
+
+    for (int i = 0; i < code->consts()->size(); ++i) {
+        PycRef<PycObject> obj = code->getConst(i);
+        if (obj.type() != PycObject::TYPE_CODE && obj.type() != PycObject::TYPE_CODE2)
+            continue;
+        PycRef<PycCode> child = obj.cast<PycCode>();
+        if (child->name()->isEqual(parts[index])
+                && find_code_path(child, parts, index + 1, path))
+            return true;
+    }
+    path.pop_back();
+    return false;
+}
+
+/* def / class 语句中定义的代码对象，其他语句返回 NULL */
+static PycRef<PycCode> defined_code(PycRef<ASTNode> node)
+{
+    if (node.type() != ASTNode::NODE_STORE)
+        return NULL;
+    PycRef<ASTNode> src = node.cast<ASTStore>()->src();
+    PycRef<ASTNode> code;
+    if (src.type() == ASTNode::NODE_FUNCTION) {
+        code = src.cast<ASTFunction>()->code();
+    } else if (src.type() == ASTNode::NODE_CLASS) {
+        PycRef<ASTCall> call = src.cast<ASTClass>()->code().try_cast<ASTCall>();
+        if (call != NULL && call->func().type() == ASTNode::NODE_FUNCTION)
+            code = call->func().cast<ASTFunction>()->code();
+    }
+    if (code.type() != ASTNode::NODE_OBJECT)
+        return NULL;
+    return code.cast<ASTObject>()->object().try_cast<PycCode>();
+}
+
+/* 在语句列表及其中的代码块里查找定义了 target 的语句 */
+static PycRef<ASTNode> find_definition(PycRef<ASTNode> node, PycRef<PycCode> target)
+{
+    if (node.type() == ASTNode::NODE_NODELIST) {
+        for (const auto& ln : node.cast<ASTNodeList>()->nodes()) {
+            PycRef<ASTNode> found = find_definition(ln, target);
+            if (found != NULL)
+                return found;
+        }
+    } else if (node.type() == ASTNode::NODE_BLOCK) {
+        for (const auto& ln : node.cast<ASTBlock>()->nodes()) {
+            PycRef<ASTNode> found = find_definition(ln, target);
+            if (found != NULL)
+                return found;
+        }
+    } else if (defined_code(node).isIdent((PycCode *)target)) {
+        return node;
+    }
+    return NULL;
+}
+
+bool decompyle_only(PycRef<PycCode> code, PycModule* mod, const std::string& qualname,
+                    std::ostream& pyc_output)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (;;) {
+        size_t dot = qualname.find('.', start);
+        std::string part = qualname.substr(start, dot == std::string::npos ? dot : dot - start);
+        if (part != "<locals>")
+            parts.push_back(part);
+        if (dot == std::string::npos)
+            break;
+        start = dot + 1;
+    }
+
+    std::vector<PycRef<PycCode>> path;
+    if (!find_code_path(code, parts, 0, path))
+        return false;
+    PycRef<PycCode> target = path.back();
+    if (path.size() == 1) {
+        decompyle(target, mod, pyc_output);
+        return true;
+    }
+
+    // 对直接外层代码执行 BuildFromCode 以得到 def/class 语句（默认参数、基类），
+    // 构建到这条语句为止；外层的其他语句和其余代码对象都不输出，也不会被反编译
+    PycRef<PycCode> parent = path[path.size() - 2];
+    PycRef<ASTNode> definition;
+    {
+        Trace::Span build_span("BuildFromCode", "decompile", parent->name()->value());
+        PycRef<ASTNode> source = BuildStatements(parent, mod, target, &definition);
+        if (definition == NULL)
+            definition = find_definition(source, target);
+    }
+
+    cur_indent = 0;
+    if (definition != NULL) {
+        print_src(definition, mod, pyc_output);
+        end_line(pyc_output);
+    } else {
+        // 例如 lambda、推导式或经装饰器包装的函数：只能输出代码体
+        pyc_warnf("警告：未找到 %s 的定义语句，只输出其代码体\n", qualname.c_str());
+        cur_indent = -1;
+        decompyle(target, mod, pyc_output);
+    }
+    cur_indent = -1;
+    return true;
+}
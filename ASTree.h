@@ -2,14 +2,81 @@
 #define _PYC_ASTREE_H
 
 #include "ASTNode.h"
+#include <cstdint>
+#include <string>
+#include <vector>
 
 // 抽象语法树 (AST)
 PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod);
 
+// 同上，clean 返回是否处理了全部字节码（为 false 时反编译输出会带有"解编译不完整"标记）
+PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod, bool& clean);
+
 // 从 AST 生成 Python 代码
 void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output);
 
 // 反编译: Python 代码
 void decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output);
 
+// 只反编译限定名为 qualname 的函数或类（例如 "A.f"、"outer.<locals>.inner"）及其中嵌套的代码，
+// 输出与完整反编译时该定义语句的输出相同（缩进从 0 开始）；找不到时返回 false
+bool decompyle_only(PycRef<PycCode> code, PycModule* mod, const std::string& qualname,
+                    std::ostream& pyc_output);
+
+// 恢复当前线程的反编译状态，在同一线程上反编译下一个模块之前调用
+// （上一次反编译可能因异常中途退出）
+void decompyle_reset();
+
+// 大纲模式：模块和类体照常反编译，函数体只输出文档字符串和 "..."（lambda 除外）。
+// 立即作用于当前线程；其他线程在下一次 decompyle_reset 时取用，须在启动工作线程之前调用
+void decompyle_set_outline(bool enabled);
+
+// 按结构哈希复用已反编译代码对象的输出。默认关闭：启用后每个嵌套代码对象都先渲染到
+// 单独的缓冲区再复制到外层，只在可能遇到重复代码的归档模式和 --cache-dir 时值得。
+// store 不为空时同时在磁盘缓存中查找和保存每个代码对象的结果。
+// 设置对所有线程生效，须在启动工作线程之前调用；内存中的结果按线程分别保存
+class PycResultCache;
+void decompyle_set_memo(bool enabled, PycResultCache* store = nullptr);
+
+// 每个模块（一次顶层 decompyle 调用）的反编译预算，各项为 0 表示不限。
+// 在 BuildFromCode 的主循环和 print_src 中检查；超出时正在反编译的代码对象改为输出
+// 注释形式的反汇编并附上其中嵌套的每个代码对象的反汇编，之后尚未开始的代码对象同样直接
+// 输出反汇编，模块的其余部分照常输出。
+// 设置对所有线程生效，须在启动工作线程之前调用
+struct PycDecompileBudget {
+    unsigned timeMs;            // 墙钟时间（毫秒）
+    uint64_t instructions;      // BuildFromCode 处理的指令数
+    uint64_t nodes;             // 创建的语法树节点数，stack_hist 复制的栈槽也计入
+    uint64_t outputBytes;       // 输出的源代码字节数
+
+    PycDecompileBudget() : timeMs(0), instructions(0), nodes(0), outputBytes(0) { }
+};
+void decompyle_set_budget(const PycDecompileBudget& budget);
+
+// 由其他线程提前反编译模块中的顶层函数和类（批量模式的工作窃取，见 pyc_batch.cpp）。
+// decompyle_split 返回值得拆分出去的代码对象在模块常量中的下标；关闭了结果复用、设置了预算
+// 或可拆分的代码对象少于两个时返回空
+std::vector<int> decompyle_split(PycRef<PycCode> code);
+
+struct PycPrerendered {
+    std::string key;            // 渲染上下文，与复用结果时的键相同
+    std::string output;
+    std::string warnings;
+    bool clean;
+
+    PycPrerendered() : clean(false) { }
+};
+
+// 在当前线程上按顶层定义的上下文反编译模块的第 constIndex 个常量；
+// 渲染过程中遇到循环引用或代码对象嵌套过深时返回 false
+bool decompyle_prerender(PycModule* mod, int constIndex, PycPrerendered& result);
+
+// 当前线程反编译代码对象之前先向 source 索取提前完成的结果，键相同时直接使用
+class PycPrerenderSource {
+public:
+    virtual ~PycPrerenderSource() { }
+    virtual bool claim(const PycCode* code, const std::string& key, PycPrerendered& result) = 0;
+};
+void decompyle_set_prerender(PycPrerenderSource* source);
+
 #endif
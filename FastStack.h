@@ -9,10 +9,11 @@ public:
     FastStack(int size) : m_ptr(-1) { m_stack.resize(size); }
 
     FastStack(const FastStack& copy)
-        : m_stack(copy.m_stack), m_ptr(copy.m_ptr) { }
+        : m_stack(copy.m_stack), m_ptr(copy.m_ptr) { ast_node_count += m_stack.size(); }
 
     FastStack& operator=(const FastStack& copy)
     {
+        ast_node_count += copy.m_stack.size();
         m_stack = copy.m_stack;
         m_ptr = copy.m_ptr;
         return *this;
@@ -51,7 +52,7 @@ public:
             }
         }
         else {
-            fprintf(stderr, "incorrect operand %i\n", i);
+            pyc_warnf("incorrect operand %i\n", i);
             return nullptr;
         }
     }
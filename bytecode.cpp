@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <cstdint>
 #include <cmath>
+#include <sstream>
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -63,7 +64,7 @@ const char* Pyc::OpcodeName(int opcode)
     if (opcode < PYC_LAST_OPCODE)
         return opcode_names[opcode];
 
-    static char badcode[16];
+    static thread_local char badcode[16];
     snprintf(badcode, sizeof(badcode), "<%d>", opcode);
     return badcode;
 };
@@ -302,298 +303,302 @@ void bc_next(PycBuffer& source, PycModule* mod, int& opcode, int& operand, int&
     }
 }
 
-void bc_disasm(std::ostream& pyc_output, PycRef<PycCode> code, PycModule* mod,
-               int indent, unsigned flags)
-{
-    static const char *cmp_strings[] = {
-        "<", "<=", "==", "!=", ">", ">=", "in", "not in", "is", "is not",
-        "<EXCEPTION MATCH>", "<BAD>"
-    };
-    static const size_t cmp_strings_len = sizeof(cmp_strings) / sizeof(cmp_strings[0]);
+static const char *cmp_strings[] = {
+    "<", "<=", "==", "!=", ">", ">=", "in", "not in", "is", "is not",
+    "<EXCEPTION MATCH>", "<BAD>"
+};
+static const size_t cmp_strings_len = sizeof(cmp_strings) / sizeof(cmp_strings[0]);
 
-    static const char *binop_strings[] = {
-        "+", "&", "//", "<<", "@", "*", "%", "|", "**", ">>", "-", "/", "^",
-        "+=", "&=", "//=", "<<=", "@=", "*=", "%=", "|=", "**=", ">>=", "-=", "/=", "^=",
-    };
-    static const size_t binop_strings_len = sizeof(binop_strings) / sizeof(binop_strings[0]);
+static const char *binop_strings[] = {
+    "+", "&", "//", "<<", "@", "*", "%", "|", "**", ">>", "-", "/", "^",
+    "+=", "&=", "//=", "<<=", "@=", "*=", "%=", "|=", "**=", ">>=", "-=", "/=", "^=",
+};
+static const size_t binop_strings_len = sizeof(binop_strings) / sizeof(binop_strings[0]);
 
-    static const char *intrinsic1_names[] = {
-        "INTRINSIC_1_INVALID", "INTRINSIC_PRINT", "INTRINSIC_IMPORT_STAR",
-        "INTRINSIC_STOPITERATION_ERROR", "INTRINSIC_ASYNC_GEN_WRAP",
-        "INTRINSIC_UNARY_POSITIVE", "INTRINSIC_LIST_TO_TUPLE", "INTRINSIC_TYPEVAR",
-        "INTRINSIC_PARAMSPEC", "INTRINSIC_TYPEVARTUPLE",
-        "INTRINSIC_SUBSCRIPT_GENERIC", "INTRINSIC_TYPEALIAS",
-    };
-    static const size_t intrinsic1_names_len = sizeof(intrinsic1_names) / sizeof(intrinsic1_names[0]);
+static const char *intrinsic1_names[] = {
+    "INTRINSIC_1_INVALID", "INTRINSIC_PRINT", "INTRINSIC_IMPORT_STAR",
+    "INTRINSIC_STOPITERATION_ERROR", "INTRINSIC_ASYNC_GEN_WRAP",
+    "INTRINSIC_UNARY_POSITIVE", "INTRINSIC_LIST_TO_TUPLE", "INTRINSIC_TYPEVAR",
+    "INTRINSIC_PARAMSPEC", "INTRINSIC_TYPEVARTUPLE",
+    "INTRINSIC_SUBSCRIPT_GENERIC", "INTRINSIC_TYPEALIAS",
+};
+static const size_t intrinsic1_names_len = sizeof(intrinsic1_names) / sizeof(intrinsic1_names[0]);
 
-    static const char *intrinsic2_names[] = {
-        "INTRINSIC_2_INVALID", "INTRINSIC_PREP_RERAISE_STAR",
-        "INTRINSIC_TYPEVAR_WITH_BOUND", "INTRINSIC_TYPEVAR_WITH_CONSTRAINTS",
-        "INTRINSIC_SET_FUNCTION_TYPE_PARAMS", "INTRINSIC_SET_TYPEPARAM_DEFAULT",
-    };
-    static const size_t intrinsic2_names_len = sizeof(intrinsic2_names) / sizeof(intrinsic2_names[0]);
+static const char *intrinsic2_names[] = {
+    "INTRINSIC_2_INVALID", "INTRINSIC_PREP_RERAISE_STAR",
+    "INTRINSIC_TYPEVAR_WITH_BOUND", "INTRINSIC_TYPEVAR_WITH_CONSTRAINTS",
+    "INTRINSIC_SET_FUNCTION_TYPE_PARAMS", "INTRINSIC_SET_TYPEPARAM_DEFAULT",
+};
+static const size_t intrinsic2_names_len = sizeof(intrinsic2_names) / sizeof(intrinsic2_names[0]);
 
-    static const char *format_value_names[] = {
-        "FVC_NONE", "FVC_STR", "FVC_REPR", "FVC_ASCII",
+static const char *format_value_names[] = {
+    "FVC_NONE", "FVC_STR", "FVC_REPR", "FVC_ASCII",
+};
+static const size_t format_value_names_len = sizeof(format_value_names) / sizeof(format_value_names[0]);
+
+static void resolve_symbol(PycInstruction& insn, const char* const* names, size_t count, int index)
+{
+    insn.argKind = PycInstruction::ARG_SYMBOL;
+    insn.resolved = (index >= 0 && static_cast<size_t>(index) < count) ? names[index] : "UNKNOWN";
+}
+
+const char* PycInstruction::argKindName(int kind)
+{
+    static const char* names[] = {
+        "none", "int", "const", "name", "local", "cell", "jump", "symbol", "invalid"
     };
-    static const size_t format_value_names_len = sizeof(format_value_names) / sizeof(format_value_names[0]);
+    return (kind >= 0 && kind <= ARG_INVALID) ? names[kind] : "unknown";
+}
 
+void bc_resolve(PycRef<PycCode> code, PycModule* mod, PycInstruction& insn, int next_pos)
+{
+    const int operand = insn.operand;
+    insn.argKind = (insn.opcode >= Pyc::PYC_HAVE_ARG) ? PycInstruction::ARG_INT
+                                                       : PycInstruction::ARG_NONE;
+    insn.target = -1;
+    insn.resolved.clear();
+    if (insn.opcode < Pyc::PYC_HAVE_ARG)
+        return;
+
+    try {
+        switch (insn.opcode) {
+        case Pyc::LOAD_CONST_A:
+        case Pyc::RESERVE_FAST_A:
+        case Pyc::KW_NAMES_A:
+        case Pyc::RETURN_CONST_A:
+        case Pyc::INSTRUMENTED_RETURN_CONST_A:
+            {
+                std::ostringstream text;
+                print_const(text, code->getConst(operand), mod);
+                insn.resolved = text.str();
+                insn.argKind = PycInstruction::ARG_CONST;
+            }
+            break;
+        case Pyc::LOAD_GLOBAL_A:
+            // Special case for Python 3.11+
+            if (mod->verCompare(3, 11) >= 0) {
+                insn.resolved = code->getName(operand >> 1)->value();
+                if (operand & 1)
+                    insn.resolved = "NULL + " + insn.resolved;
+            } else {
+                insn.resolved = code->getName(operand)->value();
+            }
+            insn.argKind = PycInstruction::ARG_NAME;
+            break;
+        case Pyc::DELETE_ATTR_A:
+        case Pyc::DELETE_GLOBAL_A:
+        case Pyc::DELETE_NAME_A:
+        case Pyc::IMPORT_FROM_A:
+        case Pyc::IMPORT_NAME_A:
+        case Pyc::LOAD_ATTR_A:
+        case Pyc::LOAD_LOCAL_A:
+        case Pyc::LOAD_NAME_A:
+        case Pyc::STORE_ATTR_A:
+        case Pyc::STORE_GLOBAL_A:
+        case Pyc::STORE_NAME_A:
+        case Pyc::STORE_ANNOTATION_A:
+        case Pyc::LOAD_METHOD_A:
+        case Pyc::LOAD_FROM_DICT_OR_GLOBALS_A:
+            {
+                auto arg = operand;
+                if (insn.opcode == Pyc::LOAD_ATTR_A && mod->verCompare(3, 12) >= 0)
+                    arg >>= 1;
+                insn.resolved = code->getName(arg)->value();
+                insn.argKind = PycInstruction::ARG_NAME;
+            }
+            break;
+        case Pyc::LOAD_SUPER_ATTR_A:
+        case Pyc::INSTRUMENTED_LOAD_SUPER_ATTR_A:
+            insn.resolved = code->getName(operand >> 2)->value();
+            insn.argKind = PycInstruction::ARG_NAME;
+            break;
+        case Pyc::DELETE_FAST_A:
+        case Pyc::LOAD_FAST_A:
+        case Pyc::STORE_FAST_A:
+        case Pyc::LOAD_FAST_CHECK_A:
+        case Pyc::LOAD_FAST_AND_CLEAR_A:
+            insn.resolved = code->getLocal(operand)->value();
+            insn.argKind = PycInstruction::ARG_LOCAL;
+            break;
+        case Pyc::LOAD_FAST_LOAD_FAST_A:
+        case Pyc::STORE_FAST_LOAD_FAST_A:
+        case Pyc::STORE_FAST_STORE_FAST_A:
+            insn.resolved = std::string(code->getLocal(operand >> 4)->value()) + ", "
+                          + code->getLocal(operand & 0xF)->value();
+            insn.argKind = PycInstruction::ARG_LOCAL;
+            break;
+        case Pyc::LOAD_CLOSURE_A:
+        case Pyc::LOAD_DEREF_A:
+        case Pyc::STORE_DEREF_A:
+        case Pyc::DELETE_DEREF_A:
+        case Pyc::MAKE_CELL_A:
+        case Pyc::CALL_FINALLY_A:
+        case Pyc::LOAD_FROM_DICT_OR_DEREF_A:
+            insn.resolved = code->getCellVar(mod, operand)->value();
+            insn.argKind = PycInstruction::ARG_CELL;
+            break;
+        case Pyc::JUMP_FORWARD_A:
+        case Pyc::JUMP_IF_FALSE_A:
+        case Pyc::JUMP_IF_TRUE_A:
+        case Pyc::SETUP_LOOP_A:
+        case Pyc::SETUP_FINALLY_A:
+        case Pyc::SETUP_EXCEPT_A:
+        case Pyc::FOR_LOOP_A:
+        case Pyc::FOR_ITER_A:
+        case Pyc::SETUP_WITH_A:
+        case Pyc::SETUP_ASYNC_WITH_A:
+        case Pyc::POP_JUMP_FORWARD_IF_FALSE_A:
+        case Pyc::POP_JUMP_FORWARD_IF_TRUE_A:
+        case Pyc::SEND_A:
+        case Pyc::POP_JUMP_FORWARD_IF_NOT_NONE_A:
+        case Pyc::POP_JUMP_FORWARD_IF_NONE_A:
+        case Pyc::POP_JUMP_IF_NOT_NONE_A:
+        case Pyc::POP_JUMP_IF_NONE_A:
+        case Pyc::INSTRUMENTED_POP_JUMP_IF_NOT_NONE_A:
+        case Pyc::INSTRUMENTED_POP_JUMP_IF_NONE_A:
+        case Pyc::INSTRUMENTED_JUMP_FORWARD_A:
+        case Pyc::INSTRUMENTED_FOR_ITER_A:
+        case Pyc::INSTRUMENTED_POP_JUMP_IF_FALSE_A:
+        case Pyc::INSTRUMENTED_POP_JUMP_IF_TRUE_A:
+            {
+                /* TODO: Fix offset based on CACHE instructions.
+                   Offset is relative to next non-CACHE instruction
+                   and thus will be printed lower than actual value.
+                   See TODO @ END_FOR ASTree.cpp */
+                int offs = operand;
+                if (mod->verCompare(3, 10) >= 0)
+                    offs *= sizeof(uint16_t); // BPO-27129
+                insn.target = next_pos + offs;
+                insn.argKind = PycInstruction::ARG_JUMP;
+            }
+            break;
+        case Pyc::JUMP_BACKWARD_NO_INTERRUPT_A:
+        case Pyc::JUMP_BACKWARD_A:
+        case Pyc::POP_JUMP_BACKWARD_IF_NOT_NONE_A:
+        case Pyc::POP_JUMP_BACKWARD_IF_NONE_A:
+        case Pyc::POP_JUMP_BACKWARD_IF_FALSE_A:
+        case Pyc::POP_JUMP_BACKWARD_IF_TRUE_A:
+        case Pyc::INSTRUMENTED_JUMP_BACKWARD_A:
+            // BACKWARD jumps were only introduced in Python 3.11
+            insn.target = next_pos - operand * (int)sizeof(uint16_t); // BPO-27129
+            insn.argKind = PycInstruction::ARG_JUMP;
+            break;
+        case Pyc::POP_JUMP_IF_FALSE_A:
+        case Pyc::POP_JUMP_IF_TRUE_A:
+        case Pyc::JUMP_IF_FALSE_OR_POP_A:
+        case Pyc::JUMP_IF_TRUE_OR_POP_A:
+        case Pyc::JUMP_ABSOLUTE_A:
+        case Pyc::JUMP_IF_NOT_EXC_MATCH_A:
+            if (mod->verCompare(3, 12) >= 0) {
+                // These are now relative as well
+                insn.target = next_pos + operand * (int)sizeof(uint16_t);
+                insn.argKind = PycInstruction::ARG_JUMP;
+            } else if (mod->verCompare(3, 10) >= 0) {
+                // BPO-27129
+                insn.target = operand * (int)sizeof(uint16_t);
+                insn.argKind = PycInstruction::ARG_JUMP;
+            } else {
+                // 文本反汇编只显示数值，但目标就是该绝对偏移
+                insn.target = operand;
+            }
+            break;
+        case Pyc::COMPARE_OP_A:
+            {
+                auto arg = operand;
+                if (mod->verCompare(3, 12) == 0)
+                    arg >>= 4; // changed under GH-100923
+                else if (mod->verCompare(3, 13) >= 0)
+                    arg >>= 5;
+                resolve_symbol(insn, cmp_strings, cmp_strings_len, arg);
+            }
+            break;
+        case Pyc::BINARY_OP_A:
+            resolve_symbol(insn, binop_strings, binop_strings_len, operand);
+            break;
+        case Pyc::IS_OP_A:
+            {
+                static const char* names[] = { "is", "is not" };
+                resolve_symbol(insn, names, 2, operand);
+            }
+            break;
+        case Pyc::CONTAINS_OP_A:
+            {
+                static const char* names[] = { "in", "not in" };
+                resolve_symbol(insn, names, 2, operand);
+            }
+            break;
+        case Pyc::CALL_INTRINSIC_1_A:
+            resolve_symbol(insn, intrinsic1_names, intrinsic1_names_len, operand);
+            break;
+        case Pyc::CALL_INTRINSIC_2_A:
+            resolve_symbol(insn, intrinsic2_names, intrinsic2_names_len, operand);
+            break;
+        case Pyc::FORMAT_VALUE_A:
+            resolve_symbol(insn, format_value_names, format_value_names_len, operand & 0x03);
+            if (insn.resolved != "UNKNOWN" && (operand & 0x04))
+                insn.resolved += " | FVS_HAVE_SPEC";
+            break;
+        case Pyc::CONVERT_VALUE_A:
+            resolve_symbol(insn, format_value_names, format_value_names_len, operand);
+            break;
+        case Pyc::SET_FUNCTION_ATTRIBUTE_A:
+            {
+                // This looks like a bitmask, but CPython treats it as an exclusive lookup...
+                static const char* names[] = {
+                    "MAKE_FUNCTION_DEFAULTS", "MAKE_FUNCTION_KWDEFAULTS",
+                    "MAKE_FUNCTION_ANNOTATIONS", "MAKE_FUNCTION_CLOSURE"
+                };
+                int index = (operand == 0x01) ? 0 : (operand == 0x02) ? 1
+                          : (operand == 0x04) ? 2 : (operand == 0x08) ? 3 : -1;
+                resolve_symbol(insn, names, 4, index);
+            }
+            break;
+        default:
+            break;
+        }
+    } catch (const std::out_of_range &) {
+        insn.argKind = PycInstruction::ARG_INVALID;
+        insn.resolved.clear();
+    }
+}
+
+void bc_disasm(std::ostream& pyc_output, PycRef<PycCode> code, PycModule* mod,
+               int indent, unsigned flags)
+{
     PycBuffer source(code->code()->value(), code->code()->length());
 
-    int opcode, operand;
+    PycInstruction insn;
     int pos = 0;
     while (!source.atEof()) {
-        int start_pos = pos;
-        bc_next(source, mod, opcode, operand, pos);
-        if (opcode == Pyc::CACHE && (flags & Pyc::DISASM_SHOW_CACHES) == 0)
+        insn.offset = pos;
+        bc_next(source, mod, insn.opcode, insn.operand, pos);
+        if (insn.opcode == Pyc::CACHE && (flags & Pyc::DISASM_SHOW_CACHES) == 0)
             continue;
 
         for (int i=0; i<indent; i++)
             pyc_output << "    ";
-        formatted_print(pyc_output, "%-7d %-30s  ", start_pos, Pyc::OpcodeName(opcode));
+        formatted_print(pyc_output, "%-7d %-30s  ", insn.offset, Pyc::OpcodeName(insn.opcode));
 
-        if (opcode >= Pyc::PYC_HAVE_ARG) {
-            switch (opcode) {
-            case Pyc::LOAD_CONST_A:
-            case Pyc::RESERVE_FAST_A:
-            case Pyc::KW_NAMES_A:
-            case Pyc::RETURN_CONST_A:
-            case Pyc::INSTRUMENTED_RETURN_CONST_A:
-                try {
-                    auto constParam = code->getConst(operand);
-                    formatted_print(pyc_output, "%d: ", operand);
-                    print_const(pyc_output, constParam, mod);
-                } catch (const std::out_of_range &) {
-                    formatted_print(pyc_output, "%d <INVALID>", operand);
-                }
-                break;
-            case Pyc::LOAD_GLOBAL_A:
-                try {
-                    // Special case for Python 3.11+
-                    if (mod->verCompare(3, 11) >= 0) {
-                        if (operand & 1)
-                            formatted_print(pyc_output, "%d: NULL + %s", operand, code->getName(operand >> 1)->value());
-                        else
-                            formatted_print(pyc_output, "%d: %s", operand, code->getName(operand >> 1)->value());
-                    } else {
-                        formatted_print(pyc_output, "%d: %s", operand, code->getName(operand)->value());
-                    }
-                } catch (const std::out_of_range &) {
-                    formatted_print(pyc_output, "%d <INVALID>", operand);
-                }
-                break;
-            case Pyc::DELETE_ATTR_A:
-            case Pyc::DELETE_GLOBAL_A:
-            case Pyc::DELETE_NAME_A:
-            case Pyc::IMPORT_FROM_A:
-            case Pyc::IMPORT_NAME_A:
-            case Pyc::LOAD_ATTR_A:
-            case Pyc::LOAD_LOCAL_A:
-            case Pyc::LOAD_NAME_A:
-            case Pyc::STORE_ATTR_A:
-            case Pyc::STORE_GLOBAL_A:
-            case Pyc::STORE_NAME_A:
-            case Pyc::STORE_ANNOTATION_A:
-            case Pyc::LOAD_METHOD_A:
-            case Pyc::LOAD_FROM_DICT_OR_GLOBALS_A:
-                try {
-                    auto arg = operand;
-                    if (opcode == Pyc::LOAD_ATTR_A && mod->verCompare(3, 12) >= 0)
-                        arg >>= 1;
-                    formatted_print(pyc_output, "%d: %s", operand, code->getName(arg)->value());
-                } catch (const std::out_of_range &) {
-                    formatted_print(pyc_output, "%d <INVALID>", operand);
-                }
+        if (insn.opcode >= Pyc::PYC_HAVE_ARG) {
+            bc_resolve(code, mod, insn, pos);
+            switch (insn.argKind) {
+            case PycInstruction::ARG_CONST:
+            case PycInstruction::ARG_NAME:
+            case PycInstruction::ARG_LOCAL:
+            case PycInstruction::ARG_CELL:
+                pyc_output << insn.operand << ": " << insn.resolved;
                 break;
-            case Pyc::LOAD_SUPER_ATTR_A:
-            case Pyc::INSTRUMENTED_LOAD_SUPER_ATTR_A:
-                try {
-                    formatted_print(pyc_output, "%d: %s", operand, code->getName(operand >> 2)->value());
-                } catch (const std::out_of_range &) {
-                    formatted_print(pyc_output, "%d <INVALID>", operand);
-                }
+            case PycInstruction::ARG_JUMP:
+                formatted_print(pyc_output, "%d (to %d)", insn.operand, insn.target);
                 break;
-            case Pyc::DELETE_FAST_A:
-            case Pyc::LOAD_FAST_A:
-            case Pyc::STORE_FAST_A:
-            case Pyc::LOAD_FAST_CHECK_A:
-            case Pyc::LOAD_FAST_AND_CLEAR_A:
-                try {
-                    formatted_print(pyc_output, "%d: %s", operand, code->getLocal(operand)->value());
-                } catch (const std::out_of_range &) {
-                    formatted_print(pyc_output, "%d <INVALID>", operand);
-                }
-                break;
-            case Pyc::LOAD_FAST_LOAD_FAST_A:
-            case Pyc::STORE_FAST_LOAD_FAST_A:
-            case Pyc::STORE_FAST_STORE_FAST_A:
-                try {
-                    formatted_print(pyc_output, "%d: %s, %s", operand,
-                                    code->getLocal(operand >> 4)->value(),
-                                    code->getLocal(operand & 0xF)->value());
-                } catch (const std::out_of_range &) {
-                    formatted_print(pyc_output, "%d <INVALID>", operand);
-                }
-                break;
-            case Pyc::LOAD_CLOSURE_A:
-            case Pyc::LOAD_DEREF_A:
-            case Pyc::STORE_DEREF_A:
-            case Pyc::DELETE_DEREF_A:
-            case Pyc::MAKE_CELL_A:
-            case Pyc::CALL_FINALLY_A:
-            case Pyc::LOAD_FROM_DICT_OR_DEREF_A:
-                try {
-                    formatted_print(pyc_output, "%d: %s", operand, code->getCellVar(mod, operand)->value());
-                } catch (const std::out_of_range &) {
-                    formatted_print(pyc_output, "%d <INVALID>", operand);
-                }
-                break;
-            case Pyc::JUMP_FORWARD_A:
-            case Pyc::JUMP_IF_FALSE_A:
-            case Pyc::JUMP_IF_TRUE_A:
-            case Pyc::SETUP_LOOP_A:
-            case Pyc::SETUP_FINALLY_A:
-            case Pyc::SETUP_EXCEPT_A:
-            case Pyc::FOR_LOOP_A:
-            case Pyc::FOR_ITER_A:
-            case Pyc::SETUP_WITH_A:
-            case Pyc::SETUP_ASYNC_WITH_A:
-            case Pyc::POP_JUMP_FORWARD_IF_FALSE_A:
-            case Pyc::POP_JUMP_FORWARD_IF_TRUE_A:
-            case Pyc::SEND_A:
-            case Pyc::POP_JUMP_FORWARD_IF_NOT_NONE_A:
-            case Pyc::POP_JUMP_FORWARD_IF_NONE_A:
-            case Pyc::POP_JUMP_IF_NOT_NONE_A:
-            case Pyc::POP_JUMP_IF_NONE_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_NOT_NONE_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_NONE_A:
-            case Pyc::INSTRUMENTED_JUMP_FORWARD_A:
-            case Pyc::INSTRUMENTED_FOR_ITER_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_FALSE_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_TRUE_A:
-                {
-                    /* TODO: Fix offset based on CACHE instructions.
-                       Offset is relative to next non-CACHE instruction
-                       and thus will be printed lower than actual value.
-                       See TODO @ END_FOR ASTree.cpp */
-                    int offs = operand;
-                    if (mod->verCompare(3, 10) >= 0)
-                        offs *= sizeof(uint16_t); // BPO-27129
-                    formatted_print(pyc_output, "%d (to %d)", operand, pos+offs);
-                }
+            case PycInstruction::ARG_SYMBOL:
+                pyc_output << insn.operand << " (" << insn.resolved << ")";
                 break;
-            case Pyc::JUMP_BACKWARD_NO_INTERRUPT_A:
-            case Pyc::JUMP_BACKWARD_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_NOT_NONE_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_NONE_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_FALSE_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_TRUE_A:
-            case Pyc::INSTRUMENTED_JUMP_BACKWARD_A:
-                {
-                    // BACKWARD jumps were only introduced in Python 3.11
-                    int offs = operand * sizeof(uint16_t); // BPO-27129
-                    formatted_print(pyc_output, "%d (to %d)", operand, pos-offs);
-                }
-                break;
-            case Pyc::POP_JUMP_IF_FALSE_A:
-            case Pyc::POP_JUMP_IF_TRUE_A:
-            case Pyc::JUMP_IF_FALSE_OR_POP_A:
-            case Pyc::JUMP_IF_TRUE_OR_POP_A:
-            case Pyc::JUMP_ABSOLUTE_A:
-            case Pyc::JUMP_IF_NOT_EXC_MATCH_A:
-                if (mod->verCompare(3, 12) >= 0) {
-                    // These are now relative as well
-                    int offs = operand * sizeof(uint16_t);
-                    formatted_print(pyc_output, "%d (to %d)", operand, pos+offs);
-                } else if (mod->verCompare(3, 10) >= 0) {
-                    // BPO-27129
-                    formatted_print(pyc_output, "%d (to %d)", operand,
-                                    int(operand * sizeof(uint16_t)));
-                } else {
-                    formatted_print(pyc_output, "%d", operand);
-                }
-                break;
-            case Pyc::COMPARE_OP_A:
-                {
-                    auto arg = operand;
-                    if (mod->verCompare(3, 12) == 0)
-                        arg >>= 4; // changed under GH-100923
-                    else if (mod->verCompare(3, 13) >= 0)
-                        arg >>= 5;
-                    if (static_cast<size_t>(arg) < cmp_strings_len)
-                        formatted_print(pyc_output, "%d (%s)", operand, cmp_strings[arg]);
-                    else
-                        formatted_print(pyc_output, "%d (UNKNOWN)", operand);
-                }
-                break;
-            case Pyc::BINARY_OP_A:
-                if (static_cast<size_t>(operand) < binop_strings_len)
-                    formatted_print(pyc_output, "%d (%s)", operand, binop_strings[operand]);
-                else
-                    formatted_print(pyc_output, "%d (UNKNOWN)", operand);
-                break;
-            case Pyc::IS_OP_A:
-                formatted_print(pyc_output, "%d (%s)", operand, (operand == 0) ? "is"
-                                                      : (operand == 1) ? "is not"
-                                                      : "UNKNOWN");
-                break;
-            case Pyc::CONTAINS_OP_A:
-                formatted_print(pyc_output, "%d (%s)", operand, (operand == 0) ? "in"
-                                                      : (operand == 1) ? "not in"
-                                                      : "UNKNOWN");
-                break;
-            case Pyc::CALL_INTRINSIC_1_A:
-                if (static_cast<size_t>(operand) < intrinsic1_names_len)
-                    formatted_print(pyc_output, "%d (%s)", operand, intrinsic1_names[operand]);
-                else
-                    formatted_print(pyc_output, "%d (UNKNOWN)", operand);
-                break;
-            case Pyc::CALL_INTRINSIC_2_A:
-                if (static_cast<size_t>(operand) < intrinsic2_names_len)
-                    formatted_print(pyc_output, "%d (%s)", operand, intrinsic2_names[operand]);
-                else
-                    formatted_print(pyc_output, "%d (UNKNOWN)", operand);
-                break;
-            case Pyc::FORMAT_VALUE_A:
-                {
-                    auto conv = static_cast<size_t>(operand & 0x03);
-                    const char *flag = (operand & 0x04) ? " | FVS_HAVE_SPEC" : "";
-                    if (conv < format_value_names_len) {
-                        formatted_print(pyc_output, "%d (%s%s)", operand,
-                                        format_value_names[conv], flag);
-                    } else {
-                        formatted_print(pyc_output, "%d (UNKNOWN)", operand);
-                    }
-                }
-                break;
-            case Pyc::CONVERT_VALUE_A:
-                if (static_cast<size_t>(operand) < format_value_names_len)
-                    formatted_print(pyc_output, "%d (%s)", operand, format_value_names[operand]);
-                else
-                    formatted_print(pyc_output, "%d (UNKNOWN)", operand);
-                break;
-            case Pyc::SET_FUNCTION_ATTRIBUTE_A:
-                // This looks like a bitmask, but CPython treats it as an exclusive lookup...
-                switch (operand) {
-                case 0x01:
-                    formatted_print(pyc_output, "%d (MAKE_FUNCTION_DEFAULTS)", operand);
-                    break;
-                case 0x02:
-                    formatted_print(pyc_output, "%d (MAKE_FUNCTION_KWDEFAULTS)", operand);
-                    break;
-                case 0x04:
-                    formatted_print(pyc_output, "%d (MAKE_FUNCTION_ANNOTATIONS)", operand);
-                    break;
-                case 0x08:
-                    formatted_print(pyc_output, "%d (MAKE_FUNCTION_CLOSURE)", operand);
-                    break;
-                default:
-                    formatted_print(pyc_output, "%d (UNKNOWN)", operand);
-                    break;
-                }
+            case PycInstruction::ARG_INVALID:
+                formatted_print(pyc_output, "%d <INVALID>", insn.operand);
                 break;
             default:
-                formatted_print(pyc_output, "%d", operand);
+                formatted_print(pyc_output, "%d", insn.operand);
                 break;
             }
         }
@@ -1,6 +1,10 @@
-﻿#include "pyc_code.h"
+﻿#ifndef _PYC_BYTECODE_H
+#define _PYC_BYTECODE_H
+
+#include "pyc_code.h"
 #include "pyc_module.h"
 #include "data.h"
+#include <string>
 
 namespace Pyc {
 
@@ -27,6 +31,33 @@ int ByteToOpcode(int maj, int min, int opcode);
 
 }
 
+/* 一条已解码的指令及其参数的含义，文本反汇编与 pycdas --jsonl / --packed 共用 */
+struct PycInstruction {
+    enum ArgKind {
+        ARG_NONE,       // 没有参数
+        ARG_INT,        // 参数只是一个数值
+        ARG_CONST,      // resolved 为常量的源代码形式
+        ARG_NAME,       // co_names 中的名称
+        ARG_LOCAL,      // 局部变量名
+        ARG_CELL,       // cell / free 变量名
+        ARG_JUMP,       // target 为跳转目标
+        ARG_SYMBOL,     // resolved 为运算符或标志的名称
+        ARG_INVALID,    // 参数超出了对应表的范围
+    };
+
+    int offset;
+    int opcode;         // Pyc::Opcode
+    int operand;
+    int argKind;
+    int target;         // 跳转目标偏移，-1 表示不是跳转（3.10 之前的绝对跳转 argKind 为 ARG_INT）
+    std::string resolved;
+
+    static const char* argKindName(int kind);
+};
+
+/* 填写 insn 的 argKind、target 和 resolved；next_pos 为下一条指令的偏移 */
+void bc_resolve(PycRef<PycCode> code, PycModule* mod, PycInstruction& insn, int next_pos);
+
 void print_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod,
                  const char* parent_f_string_quote = nullptr);
 void bc_next(PycBuffer& source, PycModule* mod, int& opcode, int& operand, int& pos);
@@ -34,3 +65,5 @@ void bc_disasm(std::ostream& pyc_output, PycRef<PycCode> code, PycModule* mod,
                int indent, unsigned flags);
 void bc_exceptiontable(std::ostream& pyc_output, PycRef<PycCode> code,
                int indent);
+
+#endif
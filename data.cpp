@@ -2,6 +2,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
+#include <stdexcept>
 #include <windows.h>
 
 // 添加编码转换函数
@@ -123,8 +124,7 @@ int PycFile::getByte()
 {
     int ch = fgetc(m_stream);
     if (ch == EOF) {
-        fputs("PycFile::getByte(): Unexpected end of stream\n", stderr);
-        std::exit(1);
+        throw std::runtime_error("PycFile::getByte(): Unexpected end of stream");
     }
     return ch;
 }
@@ -132,8 +132,7 @@ int PycFile::getByte()
 void PycFile::getBuffer(int bytes, void* buffer)
 {
     if (fread(buffer, 1, bytes, m_stream) != (size_t)bytes) {
-        fputs("PycFile::getBuffer(): Unexpected end of stream\n", stderr);
-        std::exit(1);
+        throw std::runtime_error("PycFile::getBuffer(): Unexpected end of stream");
     }
 }
 
@@ -142,8 +141,7 @@ void PycFile::getBuffer(int bytes, void* buffer)
 int PycBuffer::getByte()
 {
     if (atEof()) {
-        fputs("PycBuffer::getByte(): Unexpected end of stream\n", stderr);
-        std::exit(1);
+        throw std::runtime_error("PycBuffer::getByte(): Unexpected end of stream");
     }
     int ch = (int)(*(m_buffer + m_pos));
     ++m_pos;
@@ -153,14 +151,81 @@ int PycBuffer::getByte()
 void PycBuffer::getBuffer(int bytes, void* buffer)
 {
     if (m_pos + bytes > m_size) {
-        fputs("PycBuffer::getBuffer(): Unexpected end of stream\n", stderr);
-        std::exit(1);
+        throw std::runtime_error("PycBuffer::getBuffer(): Unexpected end of stream");
     }
     if (bytes != 0)
         memcpy(buffer, (m_buffer + m_pos), bytes);
     m_pos += bytes;
 }
 
+const void* PycBuffer::view(int bytes)
+{
+    if (bytes < 0 || bytes > m_size - m_pos) {
+        throw std::runtime_error("PycBuffer::view(): Unexpected end of stream");
+    }
+    const void* data = m_buffer + m_pos;
+    m_pos += bytes;
+    return data;
+}
+
+void PycBuffer::setPosition(int pos)
+{
+    if (pos < 0 || pos > m_size)
+        throw std::out_of_range("PycBuffer::setPosition(): Position out of range");
+    m_pos = pos;
+}
+
+bool read_whole_file(const char* filename, std::string& contents)
+{
+    FILE* stream = fopen(filename, "rb");
+    if (!stream)
+        return false;
+
+    contents.clear();
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), stream)) > 0)
+        contents.append(buffer, count);
+    bool ok = !ferror(stream);
+    fclose(stream);
+    return ok;
+}
+
+static thread_local std::string* s_warningSink = nullptr;
+
+void pyc_warn(const char* message)
+{
+    if (s_warningSink)
+        s_warningSink->append(message);
+    else
+        fputs(message, stderr);
+}
+
+void pyc_warnf(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if (s_warningSink) {
+        char buffer[4096];
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        s_warningSink->append(buffer);
+    } else {
+        vfprintf(stderr, format, args);
+    }
+    va_end(args);
+}
+
+PycWarningCapture::PycWarningCapture(std::string& sink)
+    : m_previous(s_warningSink)
+{
+    s_warningSink = &sink;
+}
+
+PycWarningCapture::~PycWarningCapture()
+{
+    s_warningSink = m_previous;
+}
+
 int formatted_print(std::ostream& stream, const char* format, ...)
 {
     va_list args;
@@ -185,4 +250,75 @@ int formatted_printv(std::ostream& stream, const char* format, va_list args)
     }
     
     return result;
-}
\ No newline at end of file
+}
+
+/* 返回从 str 开始的合法 UTF-8 序列长度，非法时返回 0 */
+static size_t utf8_sequence_length(const unsigned char* str, size_t avail)
+{
+    size_t len;
+    if (str[0] < 0x80)
+        return 1;
+    else if ((str[0] & 0xE0) == 0xC0 && str[0] >= 0xC2)
+        len = 2;
+    else if ((str[0] & 0xF0) == 0xE0)
+        len = 3;
+    else if ((str[0] & 0xF8) == 0xF0 && str[0] <= 0xF4)
+        len = 4;
+    else
+        return 0;
+
+    if (len > avail)
+        return 0;
+    for (size_t i = 1; i < len; ++i) {
+        if ((str[i] & 0xC0) != 0x80)
+            return 0;
+    }
+    return len;
+}
+
+void json_print_string(std::ostream& stream, const char* str, size_t len, bool latin1)
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    auto ustr = reinterpret_cast<const unsigned char*>(str);
+
+    stream << '"';
+    size_t pos = 0;
+    while (pos < len) {
+        unsigned char ch = ustr[pos];
+        switch (ch) {
+        case '"':
+            stream << "\\\"";
+            break;
+        case '\\':
+            stream << "\\\\";
+            break;
+        case '\n':
+            stream << "\\n";
+            break;
+        case '\r':
+            stream << "\\r";
+            break;
+        case '\t':
+            stream << "\\t";
+            break;
+        default:
+            if (ch < 0x20 || ch == 0x7F) {
+                stream << "\\u00" << hexdigits[ch >> 4] << hexdigits[ch & 0xF];
+            } else if (ch >= 0x80) {
+                size_t seqlen = latin1 ? 0 : utf8_sequence_length(ustr + pos, len - pos);
+                if (seqlen == 0) {
+                    // 非 UTF-8 字节（例如 Python 2 的 str 常量）按 Latin-1 解释
+                    stream << "\\u00" << hexdigits[ch >> 4] << hexdigits[ch & 0xF];
+                } else {
+                    stream.write(str + pos, seqlen);
+                    pos += seqlen;
+                    continue;
+                }
+            } else {
+                stream << (char)ch;
+            }
+        }
+        ++pos;
+    }
+    stream << '"';
+}
@@ -3,6 +3,7 @@
 
 #include <cstdio>
 #include <ostream>
+#include <string>
 
 #ifdef WIN32
 typedef __int64 Pyc_INT64;
@@ -20,6 +21,7 @@ public:
 
     virtual int getByte() = 0;
     virtual void getBuffer(int bytes, void* buffer) = 0;
+    virtual int position() const = 0;
     int get16();
     int get32();
     Pyc_INT64 get64();
@@ -35,6 +37,7 @@ public:
 
     int getByte() override;
     void getBuffer(int bytes, void* buffer) override;
+    int position() const override { return (int)ftell(m_stream); }
 
 private:
     FILE* m_stream;
@@ -51,13 +54,47 @@ public:
 
     int getByte() override;
     void getBuffer(int bytes, void* buffer) override;
+    int position() const override { return m_pos; }
+
+    void setPosition(int pos);
+
+    /* 跳过 bytes 个字节并返回指向它们的指针，不复制 */
+    const void* view(int bytes);
 
 private:
     const unsigned char* m_buffer;
     int m_size, m_pos;
 };
 
+// 将整个文件读入内存，失败时返回 false
+bool read_whole_file(const char* filename, std::string& contents);
+
+// 加载与反编译过程中的诊断信息：默认写到 stderr，
+// 在 PycWarningCapture 的作用域内改为追加到指定字符串（仅对当前线程生效）
+void pyc_warn(const char* message);
+void pyc_warnf(const char* format, ...);
+
+class PycWarningCapture {
+public:
+    explicit PycWarningCapture(std::string& sink);
+    ~PycWarningCapture();
+
+    PycWarningCapture(const PycWarningCapture&) = delete;
+    PycWarningCapture& operator=(const PycWarningCapture&) = delete;
+
+private:
+    std::string* m_previous;
+};
+
 int formatted_print(std::ostream& stream, const char* format, ...);
 int formatted_printv(std::ostream& stream, const char* format, va_list args);
 
+// 以 JSON 字符串字面量形式输出（含引号），非 UTF-8 字节按 Latin-1 转义；
+// latin1 为 true 时（用于 bytes 常量）所有大于 0x7F 的字节都按 Latin-1 转义
+void json_print_string(std::ostream& stream, const char* str, size_t len, bool latin1 = false);
+inline void json_print_string(std::ostream& stream, const std::string& str, bool latin1 = false)
+{
+    json_print_string(stream, str.data(), str.size(), latin1);
+}
+
 #endif
@@ -0,0 +1,128 @@
+﻿#include "opcode_profile.h"
+
+#ifdef OPCODE_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PYC_HAVE_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define PYC_HAVE_RDTSC
+#endif
+
+namespace {
+
+/* 版本索引：(major - 1) * 16 + minor，覆盖 1.0 ~ 3.15 */
+const int VERSION_SLOTS = 3 * 16;
+
+struct Counter {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> elapsed;
+};
+
+Counter s_counters[VERSION_SLOTS][OpcodeProfile::SLOT_COUNT];
+
+int versionIndex(const PycModule* mod)
+{
+    int maj = mod->majorVer(), min = mod->minorVer();
+    if (maj < 1 || maj > 3 || min < 0 || min > 15)
+        return -1;
+    return (maj - 1) * 16 + min;
+}
+
+const char* slotName(int slot)
+{
+    switch (slot) {
+    case OpcodeProfile::SLOT_NEED_TRY:
+        return "<need_try>";
+    case OpcodeProfile::SLOT_ELSE_POP:
+        return "<else_pop>";
+    case OpcodeProfile::SLOT_INVALID:
+        return "<INVALID>";
+    default:
+        return Pyc::OpcodeName(slot);
+    }
+}
+
+/* 退出时自动输出，这样 main 中的所有返回路径都会被覆盖 */
+struct DumpAtExit {
+    ~DumpAtExit() { OpcodeProfile::dump(stderr); }
+} s_dumpAtExit;
+
+}
+
+uint64_t OpcodeProfile::now()
+{
+#ifdef PYC_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+const char* OpcodeProfile::unitName()
+{
+#ifdef PYC_HAVE_RDTSC
+    return "cycles";
+#else
+    return "ns";
+#endif
+}
+
+void OpcodeProfile::record(const PycModule* mod, int slot, uint64_t elapsed)
+{
+    int ver = versionIndex(mod);
+    if (ver < 0)
+        return;
+    if (slot < 0 || slot >= SLOT_COUNT)
+        slot = SLOT_INVALID;
+
+    Counter& counter = s_counters[ver][slot];
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+    counter.elapsed.fetch_add(elapsed, std::memory_order_relaxed);
+}
+
+void OpcodeProfile::dump(FILE* out)
+{
+    for (int ver = 0; ver < VERSION_SLOTS; ++ver) {
+        std::vector<int> slots;
+        uint64_t total = 0, executed = 0;
+        for (int slot = 0; slot < SLOT_COUNT; ++slot) {
+            uint64_t count = s_counters[ver][slot].count.load(std::memory_order_relaxed);
+            if (count == 0)
+                continue;
+            slots.push_back(slot);
+            executed += count;
+            total += s_counters[ver][slot].elapsed.load(std::memory_order_relaxed);
+        }
+        if (slots.empty())
+            continue;
+
+        // 按累计耗时降序排列，最热的处理分支在最前面
+        std::sort(slots.begin(), slots.end(), [ver](int a, int b) {
+            return s_counters[ver][a].elapsed.load(std::memory_order_relaxed)
+                 > s_counters[ver][b].elapsed.load(std::memory_order_relaxed);
+        });
+
+        fprintf(out, "\n== 操作码分派统计：Python %d.%d (%llu 次分派, %llu %s) ==\n",
+                ver / 16 + 1, ver % 16, (unsigned long long)executed,
+                (unsigned long long)total, unitName());
+        fprintf(out, "%-36s %12s %16s %12s %7s\n", "操作码", "次数", unitName(), "平均", "占比");
+        for (int slot : slots) {
+            uint64_t count = s_counters[ver][slot].count.load(std::memory_order_relaxed);
+            uint64_t elapsed = s_counters[ver][slot].elapsed.load(std::memory_order_relaxed);
+            fprintf(out, "%-36s %12llu %16llu %12.1f %6.2f%%\n", slotName(slot),
+                    (unsigned long long)count, (unsigned long long)elapsed,
+                    (double)elapsed / (double)count,
+                    total ? 100.0 * (double)elapsed / (double)total : 0.0);
+        }
+    }
+}
+
+#endif
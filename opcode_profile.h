@@ -0,0 +1,54 @@
+﻿#ifndef _PYC_OPCODE_PROFILE_H
+#define _PYC_OPCODE_PROFILE_H
+
+/* BuildFromCode 的逐操作码分派统计（仅在 ENABLE_OPCODE_PROFILE 构建中启用）。
+ * 对每个 Python 版本分别记录每个处理分支的执行次数与累计耗时，
+ * 进程退出时输出直方图到 stderr。 */
+
+#ifdef OPCODE_PROFILE
+
+#include "bytecode.h"
+#include <cstdint>
+#include <cstdio>
+
+namespace OpcodeProfile {
+
+/* 除真实操作码外，额外的统计槽位 */
+enum Slot {
+    SLOT_NEED_TRY = Pyc::PYC_LAST_OPCODE,   // 分派前的 need_try 块处理
+    SLOT_ELSE_POP,                          // 分派前的 else_pop 块闭合处理
+    SLOT_INVALID,                           // 无法映射的操作码
+    SLOT_COUNT
+};
+
+/* 当前时间戳：x86 上为 TSC 周期，其他平台为纳秒 */
+uint64_t now();
+const char* unitName();
+
+void record(const PycModule* mod, int slot, uint64_t elapsed);
+void dump(FILE* out);
+
+class Scope {
+public:
+    Scope(const PycModule* mod, int slot)
+        : m_mod(mod), m_slot(slot), m_start(now()) { }
+    ~Scope() { record(m_mod, m_slot, now() - m_start); }
+
+private:
+    const PycModule* m_mod;
+    int m_slot;
+    uint64_t m_start;
+};
+
+}
+
+#define OPCODE_PROFILE_SCOPE(mod, slot) \
+    OpcodeProfile::Scope opcode_profile_scope_(mod, slot)
+
+#else
+
+#define OPCODE_PROFILE_SCOPE(mod, slot) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,1501 @@
+﻿#include "pyc_batch.h"
+#include "ASTree.h"
+#include "bytecode.h"
+#include "pyc_cost.h"
+#include "pyc_prefetch.h"
+#include "pyc_pyinstaller.h"
+#include "pyc_tar.h"
+#include "pyc_zip.h"
+#include "utf8out_stream.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+
+#ifndef WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Result {
+    bool done;
+    bool ok;
+    std::string content;
+    std::string disasm;
+    std::string stats;
+    std::string messages;   // 警告与错误，按条目集中输出
+
+    Result() : done(false), ok(false) { }
+};
+
+/* 条目队列取得的输入；data 可能指向 storage，因此不移动，只通过 unique_ptr 传递 */
+struct Input {
+    std::string storage;
+    const char* data;
+    size_t size;
+    std::string error;      // 取得输入失败时的错误信息
+
+    Input() : data(nullptr), size(0) { }
+};
+
+/* 条目的处理顺序。
+ * 按原始顺序取得输入，放入最多 workers * 4 个条目的窗口并估计反编译代价（见 pyc_cost.h），无法估计时按输入大小计。
+ * 每次交出窗口中代价最高的条目，只要它达到窗口总代价的 1/workers，否则交出窗口中最早的条目；
+ * 最早的条目连续被越过 workers * 4 次后必须交出。
+ * 不完全按代价排序：提前完成的结果要在 OrderedOutput 中等待之前的条目，
+ * 这样等待写出的结果数量有上限，而耗时最长的条目也不会拖到最后才开始。
+ * 每个输入只取得一次，不预先扫描全部输入；目录输入的预读（--read-ahead）照常与处理重叠。
+ * 进程隔离模式下输入可能来自不可信的来源，父进程不解析输入（estimate 为 false），一律按输入大小计。
+ * 只有一个工作线程时不必调整顺序，窗口只有一个条目 */
+class ItemQueue {
+public:
+    ItemQueue(const std::vector<PycBatchItem>& items, unsigned workers, bool estimate)
+        : m_items(items), m_workers(workers < 2 ? 1 : workers), m_capacity(workers < 2 ? 1 : workers * 4),
+          m_estimate(estimate && workers >= 2), m_loaded(0), m_loading(0), m_skipped(0) { }
+
+    /* 取得下一个要处理的条目，全部交出后返回 false。
+     * 输入在调用线程中取得，此时不持有锁，多个线程可以同时取得不同条目的输入 */
+    bool next(size_t& index, std::unique_ptr<Input>& input, uint64_t& cost);
+
+private:
+    struct Entry {
+        size_t index;
+        uint64_t cost;
+        std::unique_ptr<Input> input;
+    };
+
+    void load(Entry& entry) const;
+
+    const std::vector<PycBatchItem>& m_items;
+    unsigned m_workers;
+    size_t m_capacity;
+    bool m_estimate;
+    std::vector<Entry> m_window;    // 按条目编号排序
+    size_t m_loaded;                // 下一个要取得输入的条目
+    size_t m_loading;               // 正在取得输入的条目数
+    size_t m_skipped;               // 最早的条目连续被越过的次数
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+};
+
+class OrderedOutput;
+
+/* 工作线程模式的调度。
+ * 线程从 ItemQueue 依次领取条目；条目全部分配之后，空闲的线程从仍在反编译的大模块中
+ * 窃取顶层的函数和类，在自己的线程上提前反编译（decompyle_prerender，见 ASTree.h）。
+ * 模块的所有者反编译到这些代码对象时：尚未开始的收回自己处理，正在进行的等待完成，
+ * 已完成的在渲染上下文相同时直接使用结果，因此输出与不拆分时逐字节相同。
+ * 工作进程之间不共享对象，进程隔离模式不拆分模块。 */
+class ThreadScheduler {
+    struct Job;
+
+public:
+    ThreadScheduler(const std::vector<PycBatchItem>& items, OrderedOutput& output,
+                    const PycBatchOptions& options, ItemQueue& queue)
+        : m_items(items), m_output(output), m_options(options), m_queue(queue), m_workers(0),
+          m_drained(false), m_owners(0), m_lastJob(0) { }
+
+    void run(unsigned workers);
+
+    /* 所有者反编译模块期间把它的顶层代码对象交给其他线程，析构时收回尚未开始的部分 */
+    class Share {
+    public:
+        Share(ThreadScheduler* scheduler, uint64_t cost, const PycBatchItem& item,
+              const char* data, size_t size, PycModule& mod);
+        ~Share();
+
+        Share(const Share&) = delete;
+        Share& operator=(const Share&) = delete;
+
+    private:
+        ThreadScheduler* m_scheduler;
+        std::shared_ptr<Job> m_job;
+    };
+
+private:
+    struct Helper;
+
+    void work();
+    bool steal(std::shared_ptr<Job>& job, size_t& task);
+    void help(Job& job, size_t task, Helper& helper);
+
+    const std::vector<PycBatchItem>& m_items;
+    OrderedOutput& m_output;
+    const PycBatchOptions& m_options;
+    ItemQueue& m_queue;
+    unsigned m_workers;
+    bool m_drained;                 // 队列中的条目已全部领取
+    size_t m_owners;                // 正在领取或处理条目的线程数
+    uint64_t m_lastJob;
+    std::vector<std::shared_ptr<Job>> m_jobs;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+};
+
+/* 检查输出路径：去掉空段和 "."，拒绝 ".."、盘符和绝对路径（防止写到输出目录之外） */
+bool safe_relative_path(const std::string& path, std::string& clean)
+{
+    clean.clear();
+    if (path.empty() || path[0] == '/' || path[0] == '\\')
+        return false;
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        size_t sep = path.find_first_of("/\\", pos);
+        if (sep == std::string::npos)
+            sep = path.size();
+        std::string part = path.substr(pos, sep - pos);
+        pos = sep + 1;
+        if (part.empty() || part == ".")
+            continue;
+        if (part == ".." || part.find(':') != std::string::npos)
+            return false;
+        if (!clean.empty())
+            clean += '/';
+        clean += part;
+    }
+    return !clean.empty();
+}
+
+/* 每行警告前加上条目名，便于在并行输出中区分来源 */
+void append_prefixed(std::string& out, const std::string& name, const std::string& text)
+{
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = text.size() - 1;
+        out += name;
+        out += ": ";
+        out.append(text, pos, eol + 1 - pos);
+        if (out.back() != '\n')
+            out += '\n';
+        pos = eol + 1;
+    }
+}
+
+long long elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return (long long)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+void load_module(const PycBatchItem& item, const char* data, size_t size, PycModule& mod)
+{
+    if (size > INT_MAX)
+        throw std::runtime_error("输入过大");
+    if (item.major >= 0)
+        mod.loadFromMarshalledBuffer(data, (int)size, item.major, item.minor);
+    else
+        mod.loadFromBuffer(data, (int)size);
+    if (!mod.isValid() || mod.code() == NULL)
+        throw std::runtime_error("无法加载输入");
+}
+
+/* input 为空时调用 item.load 取得输入；scheduler 不为空时大模块可以拆分给其他线程 */
+void process(const PycBatchItem& item, const Input* input, const PycBatchOptions& options,
+             Result& result, ThreadScheduler* scheduler = nullptr, uint64_t cost = 0)
+{
+    std::string warnings, error;
+    long long loadUs = 0, decompileUs = 0, disasmUs = 0;
+    int major = -1, minor = -1;
+    {
+        PycWarningCapture capture(warnings);
+        try {
+            auto start = std::chrono::steady_clock::now();
+            std::string storage;
+            const char* data = nullptr;
+            size_t size = 0;
+            if (input) {
+                if (!input->error.empty())
+                    throw std::runtime_error(input->error);
+                data = input->data;
+                size = input->size;
+            } else {
+                item.load(storage, data, size);
+            }
+
+            PycModule mod;
+            load_module(item, data, size, mod);
+            loadUs = elapsed_us(start);
+            major = mod.majorVer();
+            minor = mod.minorVer();
+
+            start = std::chrono::steady_clock::now();
+            std::ostringstream out;
+            out << "# 源代码由 Decompyle++ 生成\n";
+            formatted_print(out, "# 文件：%s (Python %d.%d%s)\n\n", item.name.c_str(),
+                            mod.majorVer(), mod.minorVer(),
+                            (mod.majorVer() < 3 && mod.isUnicode()) ? " Unicode" : "");
+            utf8out_stream pyc_output(out);
+            decompyle_reset();
+            {
+                ThreadScheduler::Share share(scheduler, cost, item, data, size, mod);
+                decompyle(mod.code(), &mod, pyc_output);
+            }
+            pyc_output.flush();
+            result.content = out.str();
+            decompileUs = elapsed_us(start);
+
+            if (options.disasm) {
+                // 与 pycdas 的默认输出相同
+                start = std::chrono::steady_clock::now();
+                std::ostringstream dis;
+                dis << "# 反汇编代码由 pycdas 生成\n";
+                formatted_print(dis, "# 文件: %s (Python %d.%d%s)\n\n", item.name.c_str(),
+                                mod.majorVer(), mod.minorVer(),
+                                (mod.majorVer() < 3 && mod.isUnicode()) ? " Unicode" : "");
+                bc_disasm(dis, mod.code(), &mod, 0, Pyc::DISASM_PYCODE_VERBOSE);
+                result.disasm = dis.str();
+                disasmUs = elapsed_us(start);
+            }
+            result.ok = true;
+        } catch (std::exception& ex) {
+            error = ex.what();
+        }
+    }
+
+    if (result.ok && options.stats) {
+        // 与服务模式响应头中的字段相同
+        std::ostringstream stats;
+        stats << "version=" << major << "." << minor << "\n"
+              << "load_us=" << loadUs << "\n"
+              << "decompile_us=" << decompileUs << "\n"
+              << "disasm_us=" << disasmUs << "\n"
+              << "source=" << result.content.size() << "\n"
+              << "disasm=" << result.disasm.size() << "\n"
+              << "warnings=" << warnings.size() << "\n";
+        result.stats = stats.str();
+    }
+
+    append_prefixed(result.messages, item.name, warnings);
+    if (!error.empty())
+        result.messages += "错误：" + item.name + ": " + error + "\n";
+}
+
+class DirectorySink : public PycBatchSink {
+public:
+    explicit DirectorySink(fs::path root) : m_root(std::move(root)) { }
+
+    bool write(const std::string& path, const std::string& content, std::string& error) override
+    {
+        fs::path target = m_root / fs::u8path(path);
+        std::error_code ec;
+        fs::create_directories(target.parent_path(), ec);
+        std::ofstream out(target, std::ios_base::out | std::ios_base::binary);
+        out.write(content.data(), content.size());
+        out.close();
+        if (out.fail()) {
+            error = "写入文件 " + target.string() + " 失败";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    fs::path m_root;
+};
+
+class ZipSink : public PycBatchSink {
+public:
+    bool open(const std::string& path, std::string& error) { return m_writer.open(path, error); }
+
+    bool write(const std::string& path, const std::string& content, std::string& error) override
+    {
+        return m_writer.add(path, content.data(), content.size(), error);
+    }
+
+    bool finish(std::string& error) override { return m_writer.finish(error); }
+
+private:
+    PycZipWriter m_writer;
+};
+
+class TarSink : public PycBatchSink {
+public:
+    bool open(const std::string& path, std::string& error) { return m_writer.open(path, error); }
+
+    bool write(const std::string& path, const std::string& content, std::string& error) override
+    {
+        return m_writer.add(path, content.data(), content.size(), error);
+    }
+
+    bool finish(std::string& error) override { return m_writer.finish(error); }
+
+private:
+    PycTarWriter m_writer;
+};
+
+/* 附加输出的路径：a/b.py -> a/b.dis */
+std::string companion_path(const std::string& path, const char* ext)
+{
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash + 1))
+        return path.substr(0, dot) + ext;
+    return path + ext;
+}
+
+}
+
+std::unique_ptr<PycBatchSink> pyc_directory_sink(const std::string& root, std::string& error)
+{
+    std::error_code ec;
+    fs::path path = fs::u8path(root);
+    fs::create_directories(path, ec);
+    if (!fs::is_directory(path, ec)) {
+        error = "无法创建输出目录 " + root;
+        return nullptr;
+    }
+    return std::unique_ptr<PycBatchSink>(new DirectorySink(path));
+}
+
+std::unique_ptr<PycBatchSink> pyc_zip_sink(const std::string& path, std::string& error)
+{
+    std::unique_ptr<ZipSink> sink(new ZipSink);
+    if (!sink->open(path, error))
+        return nullptr;
+    return std::unique_ptr<PycBatchSink>(sink.release());
+}
+
+std::unique_ptr<PycBatchSink> pyc_tar_sink(const std::string& path, std::string& error)
+{
+    std::unique_ptr<TarSink> sink(new TarSink);
+    if (!sink->open(path, error))
+        return nullptr;
+    return std::unique_ptr<PycBatchSink>(sink.release());
+}
+
+namespace {
+
+/* 按原始顺序交给输出端：每个条目完成后，写出从 next 开始所有已完成的条目 */
+class OrderedOutput {
+public:
+    OrderedOutput(const std::vector<PycBatchItem>& items, PycBatchSink& sink,
+                  const PycBatchOptions& options)
+        : m_items(items), m_sink(sink), m_options(options), m_results(items.size()),
+          m_next(0), m_failed(0) { }
+
+    void complete(size_t index, Result result)
+    {
+        result.done = true;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results[index] = std::move(result);
+        while (m_next < m_results.size() && m_results[m_next].done) {
+            write(m_items[m_next], m_results[m_next]);
+            m_results[m_next] = Result();
+            m_results[m_next].done = true;
+            ++m_next;
+        }
+    }
+
+    size_t finish()
+    {
+        std::string error;
+        if (!m_sink.finish(error)) {
+            fprintf(stderr, "错误：%s\n", error.c_str());
+            ++m_failed;
+        }
+        return m_failed;
+    }
+
+private:
+    void write(const PycBatchItem& item, const Result& result)
+    {
+        fputs(result.messages.c_str(), stderr);
+        if (!result.ok) {
+            ++m_failed;
+            return;
+        }
+        std::string path, error;
+        if (!safe_relative_path(item.output, path)) {
+            fprintf(stderr, "错误：%s: 输出路径不安全：%s\n", item.name.c_str(),
+                    item.output.c_str());
+            ++m_failed;
+        } else if (!m_sink.write(path, result.content, error)
+                   || (m_options.disasm
+                       && !m_sink.write(companion_path(path, ".dis"), result.disasm, error))
+                   || (m_options.stats
+                       && !m_sink.write(companion_path(path, ".stats"), result.stats, error))) {
+            fprintf(stderr, "错误：%s: %s\n", item.name.c_str(), error.c_str());
+            ++m_failed;
+        }
+    }
+
+    const std::vector<PycBatchItem>& m_items;
+    PycBatchSink& m_sink;
+    const PycBatchOptions& m_options;
+    std::vector<Result> m_results;
+    size_t m_next, m_failed;
+    std::mutex m_mutex;
+};
+
+/* 代价低于此值的模块不拆分给其他线程，单位与 PycCostEstimate::cost() 相同 */
+const uint64_t STEAL_MIN_COST = 32 * 1024;
+
+void ItemQueue::load(Entry& entry) const
+{
+    const PycBatchItem& item = m_items[entry.index];
+    Input& input = *entry.input;
+    entry.cost = 0;
+    try {
+        item.load(input.storage, input.data, input.size);
+    } catch (std::exception& ex) {
+        input.error = ex.what();
+        return;
+    }
+
+    PycCostEstimate cost;
+    if (m_estimate && pyc_estimate_cost(input.data, input.size, item.major, item.minor, cost))
+        entry.cost = cost.cost();
+    else
+        entry.cost = input.size;
+}
+
+bool ItemQueue::next(size_t& index, std::unique_ptr<Input>& input, uint64_t& cost)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        while (m_loaded < m_items.size() && m_window.size() + m_loading < m_capacity) {
+            Entry entry;
+            entry.index = m_loaded++;
+            entry.input.reset(new Input);
+            ++m_loading;
+            lock.unlock();
+            load(entry);
+            lock.lock();
+            --m_loading;
+            auto pos = std::upper_bound(m_window.begin(), m_window.end(), entry.index,
+                                        [](size_t value, const Entry& other) {
+                                            return value < other.index;
+                                        });
+            m_window.insert(pos, std::move(entry));
+            m_changed.notify_all();
+        }
+        if (!m_window.empty())
+            break;
+        // 窗口为空且没有正在取得的输入时，所有条目都已交出
+        if (m_loading == 0)
+            return false;
+        m_changed.wait(lock);
+    }
+
+    size_t pick = 0;
+    if (m_skipped < m_capacity) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < m_window.size(); ++i) {
+            total += m_window[i].cost;
+            if (m_window[i].cost > m_window[pick].cost)
+                pick = i;
+        }
+        if (m_window[pick].cost == 0 || m_window[pick].cost * m_workers < total)
+            pick = 0;
+    }
+    m_skipped = (pick == 0) ? 0 : m_skipped + 1;
+
+    index = m_window[pick].index;
+    cost = m_window[pick].cost;
+    input = std::move(m_window[pick].input);
+    m_window.erase(m_window.begin() + pick);
+    return true;
+}
+
+/* 一个正在反编译、可以拆分的模块 */
+struct ThreadScheduler::Job : public PycPrerenderSource {
+    enum TaskState {
+        TASK_PENDING,
+        TASK_RUNNING,
+        TASK_DONE,
+        TASK_CANCELLED,         // 所有者已收回或已使用
+    };
+
+    struct Task {
+        int constIndex;
+        TaskState state;
+        bool ok;
+        PycPrerendered result;
+
+        explicit Task(int index) : constIndex(index), state(TASK_PENDING), ok(false) { }
+    };
+
+    ThreadScheduler* scheduler;
+    uint64_t id;
+    const PycBatchItem* item;
+    const char* data;           // 所有者的输入，所有者等待正在进行的任务结束后才释放
+    size_t size;
+    std::vector<Task> tasks;
+    std::unordered_map<const PycCode*, size_t> index;   // 所有者模块中的代码对象 -> 任务
+    size_t pending, running;
+
+    /* 在所有者线程上调用 */
+    bool claim(const PycCode* code, const std::string& key, PycPrerendered& result) override
+    {
+        auto it = index.find(code);
+        if (it == index.end())
+            return false;
+        std::unique_lock<std::mutex> lock(scheduler->m_mutex);
+        Task& task = tasks[it->second];
+        if (task.state == TASK_PENDING) {
+            task.state = TASK_CANCELLED;
+            --pending;
+            return false;
+        }
+        scheduler->m_changed.wait(lock, [&task] { return task.state != TASK_RUNNING; });
+        if (task.state != TASK_DONE)
+            return false;
+        task.state = TASK_CANCELLED;
+        if (!task.ok || task.result.key != key)
+            return false;
+        result = std::move(task.result);
+        return true;
+    }
+};
+
+/* 窃取任务的线程加载的模块，连续窃取同一个模块的任务时只加载一次 */
+struct ThreadScheduler::Helper {
+    uint64_t job;
+    std::unique_ptr<PycModule> mod;
+
+    Helper() : job(0) { }
+
+    void reset()
+    {
+        job = 0;
+        mod.reset();
+    }
+};
+
+ThreadScheduler::Share::Share(ThreadScheduler* scheduler, uint64_t cost, const PycBatchItem& item,
+                              const char* data, size_t size, PycModule& mod)
+    : m_scheduler(scheduler)
+{
+    if (!scheduler || scheduler->m_workers < 2 || cost < STEAL_MIN_COST)
+        return;
+    std::vector<int> consts = decompyle_split(mod.code());
+    if (consts.empty())
+        return;
+
+    auto job = std::make_shared<Job>();
+    job->scheduler = scheduler;
+    job->item = &item;
+    job->data = data;
+    job->size = size;
+    for (int i : consts) {
+        job->index.emplace((PycCode *)mod.code()->getConst(i).cast<PycCode>(), job->tasks.size());
+        job->tasks.emplace_back(i);
+    }
+    job->pending = job->tasks.size();
+    job->running = 0;
+    {
+        std::lock_guard<std::mutex> lock(scheduler->m_mutex);
+        job->id = ++scheduler->m_lastJob;
+        scheduler->m_jobs.push_back(job);
+    }
+    scheduler->m_changed.notify_all();
+    m_job = std::move(job);
+    decompyle_set_prerender(m_job.get());
+}
+
+ThreadScheduler::Share::~Share()
+{
+    if (!m_job)
+        return;
+    decompyle_set_prerender(nullptr);
+
+    std::unique_lock<std::mutex> lock(m_scheduler->m_mutex);
+    for (Job::Task& task : m_job->tasks) {
+        if (task.state == Job::TASK_PENDING)
+            task.state = Job::TASK_CANCELLED;
+    }
+    m_job->pending = 0;
+    m_scheduler->m_changed.wait(lock, [this] { return m_job->running == 0; });
+    auto& jobs = m_scheduler->m_jobs;
+    jobs.erase(std::find(jobs.begin(), jobs.end(), m_job));
+}
+
+/* 从尚未开始的任务最多的模块中取最后一个任务，所有者从前往后处理，两者尽量不相遇。
+ * 调用时持有 m_mutex */
+bool ThreadScheduler::steal(std::shared_ptr<Job>& job, size_t& task)
+{
+    job.reset();
+    for (const auto& candidate : m_jobs) {
+        if (candidate->pending && (!job || candidate->pending > job->pending))
+            job = candidate;
+    }
+    if (!job)
+        return false;
+    for (task = job->tasks.size(); task-- > 0; ) {
+        if (job->tasks[task].state == Job::TASK_PENDING)
+            break;
+    }
+    job->tasks[task].state = Job::TASK_RUNNING;
+    --job->pending;
+    ++job->running;
+    return true;
+}
+
+void ThreadScheduler::help(Job& job, size_t task, Helper& helper)
+{
+    // 对象的引用计数不是原子的，窃取的线程从所有者的输入重新加载一份模块
+    PycPrerendered result;
+    bool ok = false;
+    try {
+        if (helper.job != job.id) {
+            helper.reset();
+            std::unique_ptr<PycModule> mod(new PycModule);
+            std::string discard;
+            PycWarningCapture capture(discard);
+            load_module(*job.item, job.data, job.size, *mod);
+            helper.mod = std::move(mod);
+            helper.job = job.id;
+        }
+        ok = decompyle_prerender(helper.mod.get(), job.tasks[task].constIndex, result);
+    } catch (std::exception&) {
+        // 所有者会自己反编译这个代码对象并报告错误
+        decompyle_reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Job::Task& entry = job.tasks[task];
+        entry.result = std::move(result);
+        entry.ok = ok;
+        entry.state = Job::TASK_DONE;
+        --job.running;
+    }
+    m_changed.notify_all();
+}
+
+void ThreadScheduler::work()
+{
+    Helper helper;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        if (!m_drained) {
+            ++m_owners;
+            lock.unlock();
+            helper.reset();
+
+            size_t index;
+            std::unique_ptr<Input> input;
+            uint64_t cost;
+            bool taken = m_queue.next(index, input, cost);
+            if (taken) {
+                Result result;
+                process(m_items[index], input.get(), m_options, result, this, cost);
+                input.reset();
+                m_output.complete(index, std::move(result));
+            }
+
+            lock.lock();
+            if (!taken)
+                m_drained = true;
+            --m_owners;
+            m_changed.notify_all();
+            continue;
+        }
+
+        std::shared_ptr<Job> job;
+        size_t task;
+        if (steal(job, task)) {
+            lock.unlock();
+            help(*job, task, helper);
+            job.reset();
+            lock.lock();
+            continue;
+        }
+        // 所有条目都已分配，也没有正在处理的条目时，不会再有新的任务
+        if (m_owners == 0)
+            break;
+        m_changed.wait(lock);
+    }
+}
+
+void ThreadScheduler::run(unsigned workers)
+{
+    m_workers = workers;
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i)
+        threads.emplace_back(&ThreadScheduler::work, this);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+#ifndef WIN32
+
+/* 进程隔离模式。
+ * 工作进程由 PycForkServer 的服务进程创建（见 pyc_batch.h），之后通过管道逐个接收任务：
+ *   请求  8 字节条目编号、带 8 字节长度前缀的条目名称、各 4 字节的版本号、带长度前缀的输入数据
+ *   响应  1 字节是否成功，以及各带 8 字节长度前缀的源代码、反汇编、统计信息与诊断信息
+ * 服务进程在归档模式创建任何线程之前就已 fork 出来，工作进程中没有父进程的条目列表，
+ * 处理所需的条目字段随任务一起传递。
+ * 输入数据由父进程通过 ItemQueue 取得，预读线程和归档都只在父进程中存在；
+ * 对输入的解析和反编译全部在工作进程中进行。
+ * 工作进程崩溃（管道提前关闭）或超时（被 SIGKILL 结束）时，当前条目记为失败，
+ * 随即请服务进程补充一个新的工作进程，其余条目不受影响。 */
+class ProcessPool {
+public:
+    ProcessPool(const std::vector<PycBatchItem>& items, OrderedOutput& output,
+                const PycBatchOptions& options, ItemQueue& queue, PycForkServer& server)
+        : m_items(items), m_output(output), m_options(options), m_queue(queue), m_server(server),
+          m_remaining(items.size()), m_crashed(0) { }
+
+    /* 返回 false 表示一个工作进程也无法创建 */
+    bool run(unsigned count);
+
+private:
+    struct Worker {
+        long pid;
+        int request;            // 父进程写入任务
+        int response;           // 父进程读取结果
+        bool busy;
+        size_t index;
+        std::chrono::steady_clock::time_point started;
+        std::string pending;    // 已读到的部分响应
+
+        Worker() : pid(-1), request(-1), response(-1), busy(false), index(0) { }
+    };
+
+    bool spawn(Worker& worker);
+    void dispatch(Worker& worker);
+    void receive(Worker& worker);
+    void lost(Worker& worker, const std::string& reason);
+    void fail(size_t index, const std::string& message);
+
+    const std::vector<PycBatchItem>& m_items;
+    OrderedOutput& m_output;
+    const PycBatchOptions& m_options;
+    ItemQueue& m_queue;
+    PycForkServer& m_server;
+    std::vector<Worker> m_workers;
+    size_t m_remaining, m_crashed;
+};
+
+bool write_all(int fd, const void* buffer, size_t size)
+{
+    const char* data = (const char*)buffer;
+    while (size) {
+        ssize_t count = write(fd, data, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        data += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+bool read_all(int fd, void* buffer, size_t size)
+{
+    char* data = (char*)buffer;
+    while (size) {
+        ssize_t count = read(fd, data, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        data += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+bool write_block(int fd, const char* data, size_t size)
+{
+    uint64_t length = size;
+    return write_all(fd, &length, sizeof(length)) && write_all(fd, data, size);
+}
+
+bool read_block(int fd, std::string& data)
+{
+    uint64_t length;
+    if (!read_all(fd, &length, sizeof(length)) || length > SIZE_MAX)
+        return false;
+    data.resize((size_t)length);
+    return read_all(fd, &data[0], data.size());
+}
+
+/* 工作进程：逐个处理任务，任务管道关闭后退出 */
+[[noreturn]] void worker_main(int request, int response, const PycBatchOptions& options)
+{
+    std::string input;
+    for (;;) {
+        uint64_t index;
+        int32_t version[2];
+        PycBatchItem item;
+        if (!read_all(request, &index, sizeof(index)) || !read_block(request, item.name)
+                || !read_all(request, version, sizeof(version)) || !read_block(request, input))
+            break;
+
+        item.major = version[0];
+        item.minor = version[1];
+        item.load = [&input](std::string&, const char*& data, size_t& size) {
+            data = input.data();
+            size = input.size();
+        };
+        Result result;
+        process(item, nullptr, options, result);
+
+        char ok = result.ok ? 1 : 0;
+        if (!write_all(response, &ok, 1)
+                || !write_block(response, result.content.data(), result.content.size())
+                || !write_block(response, result.disasm.data(), result.disasm.size())
+                || !write_block(response, result.stats.data(), result.stats.size())
+                || !write_block(response, result.messages.data(), result.messages.size()))
+            break;
+    }
+    // 不执行析构和 atexit，继承自父进程的 stdio 缓冲区不能再写出一次
+    _exit(0);
+}
+
+/* 服务进程的命令，每个命令 1 字节，之后是参数 */
+enum : char {
+    SERVER_SPAWN = 'S',     // 创建工作进程；响应 8 字节进程号（失败时为 -1），成功时附带两个管道描述符
+    SERVER_REAP = 'W',      // 参数为 8 字节进程号，等待它退出；响应 4 字节 waitpid 状态
+};
+
+/* 通过 Unix 套接字发送数据，fds 不为空时附带两个文件描述符 */
+bool send_with_fds(int socket, const void* data, size_t size, const int* fds)
+{
+    iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    if (fds) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, 2 * sizeof(int));
+    }
+    ssize_t count;
+    while ((count = sendmsg(socket, &msg, 0)) < 0 && errno == EINTR)
+        ;
+    return count == (ssize_t)size;
+}
+
+/* 接收 send_with_fds() 发送的数据；附带的描述符写入 fds，没有时为 -1 */
+bool recv_with_fds(int socket, void* data, size_t size, int* fds)
+{
+    iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = size;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    ssize_t count;
+    while ((count = recvmsg(socket, &msg, 0)) < 0 && errno == EINTR)
+        ;
+    fds[0] = fds[1] = -1;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+                && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+            memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+    }
+    return count == (ssize_t)size;
+}
+
+/* 服务进程：按父进程的命令创建和回收工作进程，控制连接关闭后回收剩余的工作进程并退出 */
+[[noreturn]] void server_main(int socket, const PycBatchOptions& options)
+{
+    // 父进程提前退出时写控制连接会产生 SIGPIPE，改为由 write 返回错误
+    signal(SIGPIPE, SIG_IGN);
+
+    char command;
+    while (read_all(socket, &command, 1)) {
+        if (command == SERVER_SPAWN) {
+            int request[2], response[2];
+            int64_t pid = -1;
+            if (pipe(request) == 0) {
+                if (pipe(response) == 0) {
+                    pid = fork();
+                    if (pid == 0) {
+                        close(socket);
+                        close(request[1]);
+                        close(response[0]);
+                        signal(SIGPIPE, SIG_DFL);
+                        worker_main(request[0], response[1], options);
+                    }
+                    close(request[0]);
+                    close(response[1]);
+                    if (pid < 0) {
+                        close(request[1]);
+                        close(response[0]);
+                    }
+                } else {
+                    close(request[0]);
+                    close(request[1]);
+                }
+            }
+            int fds[2] = { request[1], response[0] };
+            bool sent = send_with_fds(socket, &pid, sizeof(pid), pid > 0 ? fds : nullptr);
+            if (pid > 0) {
+                // 描述符已复制给父进程，服务进程不保留，否则工作进程退出时父进程读不到文件结束
+                close(fds[0]);
+                close(fds[1]);
+            }
+            if (!sent)
+                break;
+        } else if (command == SERVER_REAP) {
+            int64_t pid;
+            if (!read_all(socket, &pid, sizeof(pid)))
+                break;
+            int status = 0;
+            while (waitpid((pid_t)pid, &status, 0) < 0 && errno == EINTR)
+                ;
+            int32_t reply = status;
+            if (!write_all(socket, &reply, sizeof(reply)))
+                break;
+        } else {
+            break;
+        }
+    }
+
+    close(socket);
+    while (wait(nullptr) > 0 || errno == EINTR)
+        ;
+    _exit(0);
+}
+
+bool ProcessPool::spawn(Worker& worker)
+{
+    if (!m_server.spawn(worker.pid, worker.request, worker.response))
+        return false;
+    fcntl(worker.response, F_SETFL, fcntl(worker.response, F_GETFL) | O_NONBLOCK);
+    worker.busy = false;
+    std::string().swap(worker.pending);
+    return true;
+}
+
+void ProcessPool::fail(size_t index, const std::string& message)
+{
+    Result result;
+    result.messages = "错误：" + m_items[index].name + ": " + message + "\n";
+    m_output.complete(index, std::move(result));
+    --m_remaining;
+}
+
+void ProcessPool::dispatch(Worker& worker)
+{
+    size_t index;
+    std::unique_ptr<Input> input;
+    uint64_t cost;
+    while (m_queue.next(index, input, cost)) {
+        if (!input->error.empty()) {
+            fail(index, input->error);
+            continue;
+        }
+
+        const PycBatchItem& item = m_items[index];
+        worker.busy = true;
+        worker.index = index;
+        worker.started = std::chrono::steady_clock::now();
+        uint64_t id = index;
+        int32_t version[2] = { item.major, item.minor };
+        bool sent = write_all(worker.request, &id, sizeof(id))
+                    && write_block(worker.request, item.name.data(), item.name.size())
+                    && write_all(worker.request, version, sizeof(version))
+                    && write_block(worker.request, input->data, input->size);
+        input.reset();
+        if (!sent)
+            lost(worker, "无法向工作进程发送任务");
+        return;
+    }
+}
+
+/* 响应完整时取出结果并返回 true，否则返回 false 继续等待 */
+bool parse_response(const std::string& data, Result& result)
+{
+    std::string* fields[] = { &result.content, &result.disasm, &result.stats, &result.messages };
+    const size_t count = sizeof(fields) / sizeof(fields[0]);
+    size_t offsets[count], lengths[count];
+    if (data.empty())
+        return false;
+    size_t pos = 1;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t length;
+        if (data.size() - pos < sizeof(length))
+            return false;
+        memcpy(&length, data.data() + pos, sizeof(length));
+        pos += sizeof(length);
+        if (length > data.size() - pos)
+            return false;
+        offsets[i] = pos;
+        lengths[i] = (size_t)length;
+        pos += lengths[i];
+    }
+    result.ok = data[0] != 0;
+    for (size_t i = 0; i < count; ++i)
+        fields[i]->assign(data, offsets[i], lengths[i]);
+    return true;
+}
+
+/* 读取工作进程已经写出的数据（响应管道是非阻塞的），响应完整时交出结果。
+ * 每次最多读取 RECEIVE_CHUNK 字节后回到 poll，持续写出的工作进程不会占住调度线程，
+ * 只写出一部分响应就停下的工作进程同样会超时 */
+void ProcessPool::receive(Worker& worker)
+{
+    const size_t RECEIVE_CHUNK = 1024 * 1024;
+    char buffer[64 * 1024];
+    for (size_t total = 0; total < RECEIVE_CHUNK; ) {
+        ssize_t count = read(worker.response, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (count <= 0) {
+            lost(worker, "");
+            return;
+        }
+        worker.pending.append(buffer, (size_t)count);
+        total += (size_t)count;
+    }
+
+    Result result;
+    if (!parse_response(worker.pending, result))
+        return;
+    std::string().swap(worker.pending);
+    worker.busy = false;
+    m_output.complete(worker.index, std::move(result));
+    --m_remaining;
+}
+
+void ProcessPool::lost(Worker& worker, const std::string& reason)
+{
+    close(worker.request);
+    close(worker.response);
+    int status = 0;
+    m_server.reap(worker.pid, status);
+    worker.pid = -1;
+
+    std::string message = reason;
+    if (message.empty()) {
+        if (WIFSIGNALED(status))
+            message = "工作进程被信号 " + std::to_string(WTERMSIG(status)) + " 终止";
+        else
+            message = "工作进程意外退出";
+    }
+    if (worker.busy) {
+        worker.busy = false;
+        ++m_crashed;
+        fail(worker.index, message + "，已跳过该文件");
+    }
+
+    if (!spawn(worker))
+        fputs("错误：无法创建新的工作进程\n", stderr);
+}
+
+bool ProcessPool::run(unsigned count)
+{
+    m_workers.resize(count);
+    for (Worker& worker : m_workers) {
+        if (!spawn(worker))
+            break;
+    }
+    if (m_workers.front().pid < 0)
+        return false;
+
+    // 工作进程退出后写管道会产生 SIGPIPE，改为由 write 返回错误
+    struct sigaction ignore, previous;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &previous);
+
+    const auto timeout = std::chrono::seconds(m_options.timeout);
+    std::vector<pollfd> fds;
+    std::vector<Worker*> polled;
+    while (m_remaining > 0) {
+        fds.clear();
+        polled.clear();
+        int wait = -1;
+        auto now = std::chrono::steady_clock::now();
+        for (Worker& worker : m_workers) {
+            if (worker.pid < 0)
+                continue;
+            if (!worker.busy)
+                dispatch(worker);
+            if (!worker.busy)
+                continue;
+            if (m_options.timeout) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        worker.started + timeout - now).count();
+                if (left < 0)
+                    left = 0;
+                if (wait < 0 || left < wait)
+                    wait = (int)left;
+            }
+            fds.push_back({ worker.response, POLLIN, 0 });
+            polled.push_back(&worker);
+        }
+        if (fds.empty()) {
+            // 工作进程全部无法重新创建，剩余的条目只能放弃
+            size_t index;
+            std::unique_ptr<Input> input;
+            uint64_t cost;
+            while (m_queue.next(index, input, cost))
+                fail(index, "没有可用的工作进程");
+            break;
+        }
+
+        int ready = poll(fds.data(), fds.size(), wait);
+        if (ready < 0 && errno != EINTR)
+            break;
+        now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fds.size(); ++i) {
+            Worker& worker = *polled[i];
+            if (ready > 0 && (fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                receive(worker);
+            if (worker.busy && m_options.timeout && now - worker.started >= timeout) {
+                kill(worker.pid, SIGKILL);
+                lost(worker, "处理超过 " + std::to_string(m_options.timeout) + " 秒");
+            }
+        }
+    }
+
+    // 关闭任务管道，工作进程读到文件结束后自行退出
+    for (Worker& worker : m_workers) {
+        if (worker.pid < 0)
+            continue;
+        close(worker.request);
+        close(worker.response);
+        int status;
+        m_server.reap(worker.pid, status);
+    }
+    sigaction(SIGPIPE, &previous, nullptr);
+
+    if (m_crashed)
+        fprintf(stderr, "警告：%zu 个文件导致工作进程崩溃或超时\n", m_crashed);
+    return true;
+}
+
+#endif
+
+}
+
+#ifndef WIN32
+
+PycForkServer::PycForkServer(const PycBatchOptions& options)
+    : m_socket(-1), m_pid(-1)
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+        return;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sockets[0]);
+        close(sockets[1]);
+        return;
+    }
+    if (pid == 0) {
+        close(sockets[0]);
+        server_main(sockets[1], options);
+    }
+    close(sockets[1]);
+    m_socket = sockets[0];
+    m_pid = pid;
+}
+
+PycForkServer::~PycForkServer()
+{
+    if (m_socket < 0)
+        return;
+    close(m_socket);
+    while (waitpid((pid_t)m_pid, nullptr, 0) < 0 && errno == EINTR)
+        ;
+}
+
+bool PycForkServer::spawn(long& pid, int& request, int& response)
+{
+    if (m_socket < 0)
+        return false;
+    char command = SERVER_SPAWN;
+    int64_t reply;
+    int fds[2];
+    if (!write_all(m_socket, &command, 1) || !recv_with_fds(m_socket, &reply, sizeof(reply), fds))
+        return false;
+    if (reply <= 0 || fds[0] < 0) {
+        if (fds[0] >= 0) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+        return false;
+    }
+    pid = (long)reply;
+    request = fds[0];
+    response = fds[1];
+    return true;
+}
+
+bool PycForkServer::reap(long pid, int& status)
+{
+    status = 0;
+    char command = SERVER_REAP;
+    int64_t id = pid;
+    int32_t reply;
+    if (m_socket < 0 || !write_all(m_socket, &command, 1) || !write_all(m_socket, &id, sizeof(id))
+            || !read_all(m_socket, &reply, sizeof(reply)))
+        return false;
+    status = reply;
+    return true;
+}
+
+#else
+
+PycForkServer::PycForkServer(const PycBatchOptions&) : m_socket(-1), m_pid(-1) { }
+PycForkServer::~PycForkServer() { }
+bool PycForkServer::spawn(long&, int&, int&) { return false; }
+bool PycForkServer::reap(long, int&) { return false; }
+
+#endif
+
+size_t pyc_batch_run(const std::vector<PycBatchItem>& items, PycBatchSink& sink, unsigned workers,
+                     const PycBatchOptions& options, PycForkServer* server)
+{
+    OrderedOutput output(items, sink, options);
+    if (workers == 0)
+        workers = PycWorkerPool::defaultSize();
+    ItemQueue queue(items, workers, !options.isolate);
+
+    if (options.isolate) {
+#ifdef WIN32
+        (void)server;
+        fputs("警告：当前平台不支持进程隔离模式，改用工作线程\n", stderr);
+#else
+        if (server && server->isRunning()) {
+            ProcessPool pool(items, output, options, queue, *server);
+            if (pool.run(workers))
+                return output.finish();
+        }
+        fputs("警告：无法创建工作进程，改用工作线程\n", stderr);
+#endif
+    }
+
+    ThreadScheduler scheduler(items, output, options, queue);
+    scheduler.run(workers);
+    return output.finish();
+}
+
+std::string pyc_source_path(const std::string& member)
+{
+    std::string path = member;
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos)
+        path.erase(dot);
+
+    size_t slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? std::string() : path.substr(0, slash + 1);
+    std::string base = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    const std::string cacheDir = "__pycache__/";
+    if (dir.size() >= cacheDir.size()
+            && dir.compare(dir.size() - cacheDir.size(), cacheDir.size(), cacheDir) == 0) {
+        // 去掉解释器标签，例如 mod.cpython-311 -> mod
+        dir.erase(dir.size() - cacheDir.size());
+        size_t tag = base.rfind('.');
+        if (tag != std::string::npos && tag > 0)
+            base.erase(tag);
+    }
+    return dir + base + ".py";
+}
+
+namespace {
+
+/* 记录已使用的输出路径；与之前的条目冲突时依次尝试 candidates 中的下一个，全部冲突时返回 false */
+class OutputPaths {
+public:
+    bool claim(PycBatchItem& item, std::initializer_list<std::string> candidates)
+    {
+        for (const std::string& candidate : candidates) {
+            auto inserted = m_used.emplace(candidate, item.name);
+            if (inserted.second) {
+                item.output = candidate;
+                return true;
+            }
+        }
+        fprintf(stderr, "警告：%s 与 %s 的输出路径相同，已跳过\n", item.name.c_str(),
+                m_used[*candidates.begin()].c_str());
+        return false;
+    }
+
+private:
+    std::unordered_map<std::string, std::string> m_used;
+};
+
+void zip_items(std::shared_ptr<PycZipArchive> archive, std::vector<PycBatchItem>& items)
+{
+    OutputPaths outputs;
+    for (const PycZipArchive::Entry& entry : archive->entries()) {
+        const std::string& name = entry.name;
+        if (entry.isDirectory() || name.size() < 4
+                || (name.compare(name.size() - 4, 4, ".pyc") != 0
+                    && name.compare(name.size() - 4, 4, ".pyo") != 0))
+            continue;
+
+        PycBatchItem item;
+        item.name = name;
+        // foo.pyc 与 __pycache__/foo.*.pyc 同时存在时，后者保留原来的目录结构
+        if (!outputs.claim(item, { pyc_source_path(name), name.substr(0, name.size() - 4) + ".py" }))
+            continue;
+
+        const PycZipArchive::Entry* member = &entry;
+        item.load = [archive, member](std::string& storage, const char*& data, size_t& size) {
+            std::string error;
+            if (!archive->read(*member, storage, data, size, error))
+                throw std::runtime_error(error);
+        };
+        items.push_back(std::move(item));
+    }
+}
+
+bool pyinstaller_items(std::shared_ptr<PycPyInstaller> archive,
+                       std::vector<PycBatchItem>& items, std::string& error)
+{
+    if (!PycModule::isSupportedVersion(archive->majorVer(), archive->minorVer())) {
+        error = "不支持打包时使用的 Python 版本 " + std::to_string(archive->majorVer()) + "."
+              + std::to_string(archive->minorVer());
+        return false;
+    }
+
+    OutputPaths outputs;
+    for (const PycPyInstaller::Module& module : archive->modules()) {
+        PycBatchItem item;
+        item.name = module.container.empty() ? module.name : module.container + ":" + module.name;
+
+        // PYZ 中是点分模块名，包对应 __init__.py
+        std::string path = module.name;
+        if (!module.container.empty()) {
+            for (char& ch : path) {
+                if (ch == '.')
+                    ch = '/';
+            }
+        }
+        if (module.isPackage())
+            path += "/__init__";
+        std::string fallback = module.container.empty() ? "CArchive/" + path + ".py"
+                                                        : module.container + "/" + path + ".py";
+        if (!outputs.claim(item, { path + ".py", fallback }))
+            continue;
+
+        // 条目是不带文件头的序列化代码对象，按打包时的版本加载
+        const PycPyInstaller::Module* entry = &module;
+        item.load = [archive, entry](std::string& storage, const char*& data, size_t& size) {
+            std::string error;
+            if (!archive->read(*entry, storage, data, size, error))
+                throw std::runtime_error(error);
+        };
+        item.major = archive->majorVer();
+        item.minor = archive->minorVer();
+        items.push_back(std::move(item));
+    }
+    return true;
+}
+
+}
+
+bool pyc_archive_items(const std::string& path, std::vector<PycBatchItem>& items, std::string& error)
+{
+    std::string data;
+    if (!read_whole_file(path.c_str(), data)) {
+        error = "无法读取文件";
+        return false;
+    }
+
+    // PyInstaller 可执行文件的 cookie 特征明确，先于 zip 检查
+    if (PycPyInstaller::isPyInstaller(data)) {
+        auto archive = std::make_shared<PycPyInstaller>();
+        return archive->openBuffer(std::move(data), error) && pyinstaller_items(archive, items, error);
+    }
+    auto archive = std::make_shared<PycZipArchive>();
+    if (!archive->openBuffer(std::move(data), error))
+        return false;
+    zip_items(archive, items);
+    return true;
+}
+
+bool pyc_directory_items(const std::string& root, uint64_t readAhead,
+                         std::vector<PycBatchItem>& items, std::string& error)
+{
+    fs::path base = fs::u8path(root);
+    std::vector<std::string> paths, names;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(base, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string ext = it->path().extension().string();
+        if ((ext == ".pyc" || ext == ".pyo") && it->is_regular_file(ec)) {
+            paths.push_back(it->path().string());
+            names.push_back(it->path().lexically_relative(base).generic_u8string());
+        }
+    }
+    if (ec) {
+        error = "无法遍历目录 " + root + "：" + ec.message();
+        return false;
+    }
+
+    // 按相对路径排序，使条目顺序与目录遍历的顺序无关
+    std::vector<size_t> order(paths.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&names](size_t a, size_t b) { return names[a] < names[b]; });
+    // 输出路径冲突而跳过的文件不必读取
+    OutputPaths outputs;
+    std::vector<std::string> inputs;
+    size_t first = items.size();
+    for (size_t i : order) {
+        PycBatchItem item;
+        item.name = names[i];
+        if (!outputs.claim(item, { pyc_source_path(item.name),
+                                   item.name.substr(0, item.name.size() - 4) + ".py" }))
+            continue;
+        inputs.push_back(paths[i]);
+        items.push_back(std::move(item));
+    }
+
+    auto prefetcher = std::make_shared<PycPrefetcher>(std::move(inputs), 0, readAhead);
+    for (size_t i = 0; first + i < items.size(); ++i) {
+        items[first + i].load = [prefetcher, i](std::string& storage, const char*& data, size_t& size) {
+            std::string error;
+            if (!prefetcher->take(i, storage, error))
+                throw std::runtime_error(error);
+            data = storage.data();
+            size = storage.size();
+        };
+    }
+    return true;
+}
@@ -0,0 +1,113 @@
+﻿#ifndef _PYC_BATCH_H
+#define _PYC_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* 批量反编译（pycdc --out-dir / --out-zip / --out-tar）。
+ *
+ * 每个条目由工作线程独立完成加载与反编译，结果交给输出端；
+ * 输出端总是按条目的原始顺序收到结果，与线程数和完成的先后无关。
+ * 多个工作线程时先估计每个条目的反编译代价（见 pyc_cost.h），代价高的条目先处理，
+ * 大模块中的顶层函数和类还可以分给空闲的线程。
+ * 反编译失败的条目只在标准错误上报告，不产生输出文件。 */
+struct PycBatchItem {
+    std::string name;       // 用于文件头和诊断信息
+    std::string output;     // 输出的相对路径，以 '/' 分隔
+
+    // 大于等于 0 时输入是序列化的代码对象（相当于 -c -v major.minor）
+    int major, minor;
+
+    /* 在工作线程中调用，取得输入数据：data 可以指向调用者持有的内存，
+     * 也可以指向 storage；失败时抛出异常。每个条目只调用一次 */
+    std::function<void(std::string& storage, const char*& data, size_t& size)> load;
+
+    PycBatchItem() : major(-1), minor(-1) { }
+};
+
+class PycBatchSink {
+public:
+    virtual ~PycBatchSink() { }
+
+    /* 写出一个条目的结果；path 已经过检查，不含 ".." 和绝对路径 */
+    virtual bool write(const std::string& path, const std::string& content, std::string& error) = 0;
+
+    /* 所有条目写出之后调用一次 */
+    virtual bool finish(std::string& error) { (void)error; return true; }
+};
+
+/* 在目录下按相对路径写出，自动创建中间目录 */
+std::unique_ptr<PycBatchSink> pyc_directory_sink(const std::string& root, std::string& error);
+
+/* 写入一个未压缩的 zip 归档 */
+std::unique_ptr<PycBatchSink> pyc_zip_sink(const std::string& path, std::string& error);
+
+/* 流式写入一个 tar 归档，由单独的线程大块顺序写出（见 pyc_tar.h） */
+std::unique_ptr<PycBatchSink> pyc_tar_sink(const std::string& path, std::string& error);
+
+struct PycBatchOptions {
+    // 每个条目除源代码 a/b.py 之外的附加输出
+    bool disasm;        // a/b.dis，与 pycdas 的默认输出相同
+    bool stats;         // a/b.stats，key=value 格式的版本、各阶段耗时和输出大小
+
+    // 进程隔离：在预先创建的工作进程中反编译，崩溃或超时只影响当前条目（仅 POSIX）
+    bool isolate;
+    unsigned timeout;   // 单个条目的处理时限（秒），0 表示不限；只在进程隔离时有效
+
+    PycBatchOptions() : disasm(false), stats(false), isolate(false), timeout(60) { }
+};
+
+/* 进程隔离模式的服务进程。
+ * 多线程的进程中 fork 出的子进程只有调用 fork 的线程，其他线程持有的锁（包括 malloc 的锁）
+ * 可能永远不会释放；而归档模式会创建预读、tar 写出和工作线程。
+ * 因此在创建这些线程之前先 fork 出一个单线程的服务进程，工作进程（包括崩溃或超时后补充的）
+ * 都由它创建，父进程本身不再调用 fork。WIN32 下不可用 */
+class PycForkServer {
+public:
+    /* 启动服务进程，工作进程按 options 处理条目；失败时 isRunning() 为 false */
+    explicit PycForkServer(const PycBatchOptions& options);
+
+    /* 关闭控制连接并等待服务进程退出 */
+    ~PycForkServer();
+
+    PycForkServer(const PycForkServer&) = delete;
+    PycForkServer& operator=(const PycForkServer&) = delete;
+
+    bool isRunning() const { return m_socket >= 0; }
+
+    /* 创建一个工作进程，request 和 response 为父进程一端的任务管道和结果管道 */
+    bool spawn(long& pid, int& request, int& response);
+
+    /* 等待工作进程退出，status 为 waitpid 的状态 */
+    bool reap(long pid, int& status);
+
+private:
+    int m_socket;
+    long m_pid;
+};
+
+/* 处理所有条目，返回失败的条目数；workers 为 0 时使用 CPU 核心数。
+ * 进程隔离模式需要提供已启动的 server，否则改用工作线程 */
+size_t pyc_batch_run(const std::vector<PycBatchItem>& items, PycBatchSink& sink, unsigned workers,
+                     const PycBatchOptions& options, PycForkServer* server = nullptr);
+
+/* 归档内 .pyc 成员对应的输出路径：foo/bar.pyc -> foo/bar.py，
+ * PEP 3147 布局 foo/__pycache__/bar.cpython-311.pyc -> foo/bar.py */
+std::string pyc_source_path(const std::string& member);
+
+/* 按文件内容判断输入的种类，生成对应的条目：
+ *   PyInstaller 可执行文件  入口脚本、CArchive 中的模块以及所有 PYZ 中的模块（见 pyc_pyinstaller.h）
+ *   zip 归档（wheel、egg 等）  所有 .pyc / .pyo 成员
+ * 文件只读取一次并在内存中保持打开，直到返回的条目全部销毁 */
+bool pyc_archive_items(const std::string& path, std::vector<PycBatchItem>& items, std::string& error);
+
+/* 目录下（递归）的所有 .pyc / .pyo 文件，按相对路径排序。
+ * 文件由 PycPrefetcher 提前读入内存，已读入未取走的数据不超过 readAhead 字节 */
+bool pyc_directory_items(const std::string& root, uint64_t readAhead,
+                         std::vector<PycBatchItem>& items, std::string& error);
+
+#endif
@@ -1,6 +1,7 @@
 ﻿#include "pyc_code.h"
 #include "pyc_module.h"
 #include "data.h"
+#include "pyc_hash.h"
 
 /* == Marshal structure for Code object ==
                 1.0     1.3     1.5     2.1     2.3     3.0     3.8     3.11
@@ -28,6 +29,14 @@ exceptiontable                                                          Obj
 
 void PycCode::load(PycData* stream, PycModule* mod)
 {
+    // 嵌套的对象（包括代码对象）由 LoadContents() 用显式的栈逐层读取
+    LoadContents(this, stream, mod);
+}
+
+void PycCode::loadHeader(PycData* stream, PycModule* mod)
+{
+    m_hashVersion = (mod->majorVer() << 16) | (mod->minorVer() << 8) | (mod->isUnicode() ? 1 : 0);
+
     if (mod->verCompare(1, 3) >= 0 && mod->verCompare(2, 3) < 0)
         m_argCount = stream->get16();
     else if (mod->verCompare(2, 3) >= 0)
@@ -71,56 +80,203 @@ void PycCode::load(PycData* stream, PycModule* mod)
         m_flags = (m_flags & 0xFFFF) | ((m_flags & 0xFFF0000) << 4);
     }
 
-    m_code = LoadObject(stream, mod).cast<PycString>();
-    m_consts = LoadObject(stream, mod).cast<PycSequence>();
-    m_names = LoadObject(stream, mod).cast<PycSequence>();
-
-    if (mod->verCompare(1, 3) >= 0)
-        m_localNames = LoadObject(stream, mod).cast<PycSequence>();
-    else
+    if (mod->verCompare(1, 3) < 0)
         m_localNames = new PycTuple;
-
-    if (mod->verCompare(3, 11) >= 0)
-        m_localKinds = LoadObject(stream, mod).cast<PycString>();
-    else
+    if (mod->verCompare(3, 11) < 0)
         m_localKinds = new PycString;
-
-    if (mod->verCompare(2, 1) >= 0 && mod->verCompare(3, 11) < 0)
-        m_freeVars = LoadObject(stream, mod).cast<PycSequence>();
-    else
+    if (mod->verCompare(2, 1) < 0 || mod->verCompare(3, 11) >= 0) {
         m_freeVars = new PycTuple;
-
-    if (mod->verCompare(2, 1) >= 0 && mod->verCompare(3, 11) < 0)
-        m_cellVars = LoadObject(stream, mod).cast<PycSequence>();
-    else
         m_cellVars = new PycTuple;
-
-    m_fileName = LoadObject(stream, mod).cast<PycString>();
-    m_name = LoadObject(stream, mod).cast<PycString>();
-
-    if (mod->verCompare(3, 11) >= 0)
-        m_qualName = LoadObject(stream, mod).cast<PycString>();
-    else
+    }
+    if (mod->verCompare(3, 11) < 0)
         m_qualName = new PycString;
+    if (mod->verCompare(1, 5) < 0)
+        m_lnTable = new PycString;
+    if (mod->verCompare(3, 11) < 0)
+        m_exceptTable = new PycString;
+}
 
+void PycCode::skipHeader(PycData* stream, PycModule* mod)
+{
+    if (mod->verCompare(1, 3) >= 0 && mod->verCompare(2, 3) < 0)
+        stream->get16();
+    else if (mod->verCompare(2, 3) >= 0)
+        stream->get32();                    // argcount
+    if (mod->verCompare(3, 8) >= 0)
+        stream->get32();                    // posonlyargcount
+    if (mod->majorVer() >= 3)
+        stream->get32();                    // kwonlyargcount
+    if (mod->verCompare(1, 3) >= 0 && mod->verCompare(2, 3) < 0)
+        stream->get16();
+    else if (mod->verCompare(2, 3) >= 0 && mod->verCompare(3, 11) < 0)
+        stream->get32();                    // nlocals
     if (mod->verCompare(1, 5) >= 0 && mod->verCompare(2, 3) < 0)
-        m_firstLine = stream->get16();
+        stream->get16();
     else if (mod->verCompare(2, 3) >= 0)
-        m_firstLine = stream->get32();
+        stream->get32();                    // stacksize
+    if (mod->verCompare(1, 3) >= 0 && mod->verCompare(2, 3) < 0)
+        stream->get16();
+    else if (mod->verCompare(2, 3) >= 0)
+        stream->get32();                    // flags
+}
 
-    if (mod->verCompare(1, 5) >= 0)
-        m_lnTable = LoadObject(stream, mod).cast<PycString>();
-    else
-        m_lnTable = new PycString;
+int PycCode::nextField(int field, PycData* stream, PycModule* mod, int* firstLine)
+{
+    for (int next = field + 1; next < FIELD_END; ++next) {
+        if (next == FIELD_LNTABLE) {
+            // 首行号位于名称（3.11 起为限定名）与行号表之间
+            int line = 0;
+            if (mod->verCompare(1, 5) >= 0 && mod->verCompare(2, 3) < 0)
+                line = stream->get16();
+            else if (mod->verCompare(2, 3) >= 0)
+                line = stream->get32();
+            if (firstLine && mod->verCompare(1, 5) >= 0)
+                *firstLine = line;
+        }
 
-    if (mod->verCompare(3, 11) >= 0)
-        m_exceptTable = LoadObject(stream, mod).cast<PycString>();
-    else
-        m_exceptTable = new PycString;
+        bool present;
+        switch (next) {
+        case FIELD_LOCALNAMES:
+            present = mod->verCompare(1, 3) >= 0;
+            break;
+        case FIELD_LOCALKINDS:
+        case FIELD_QUALNAME:
+        case FIELD_EXCEPTTABLE:
+            present = mod->verCompare(3, 11) >= 0;
+            break;
+        case FIELD_FREEVARS:
+        case FIELD_CELLVARS:
+            present = mod->verCompare(2, 1) >= 0 && mod->verCompare(3, 11) < 0;
+            break;
+        case FIELD_LNTABLE:
+            present = mod->verCompare(1, 5) >= 0;
+            break;
+        default:
+            present = true;
+            break;
+        }
+        if (present)
+            return next;
+    }
+    return FIELD_END;
+}
+
+void PycCode::setField(int field, PycRef<PycObject> value)
+{
+    switch (field) {
+    case FIELD_CODE:        m_code = value.cast<PycString>(); break;
+    case FIELD_CONSTS:      m_consts = value.cast<PycSequence>(); break;
+    case FIELD_NAMES:       m_names = value.cast<PycSequence>(); break;
+    case FIELD_LOCALNAMES:  m_localNames = value.cast<PycSequence>(); break;
+    case FIELD_LOCALKINDS:  m_localKinds = value.cast<PycString>(); break;
+    case FIELD_FREEVARS:    m_freeVars = value.cast<PycSequence>(); break;
+    case FIELD_CELLVARS:    m_cellVars = value.cast<PycSequence>(); break;
+    case FIELD_FILENAME:    m_fileName = value.cast<PycString>(); break;
+    case FIELD_NAME:        m_name = value.cast<PycString>(); break;
+    case FIELD_QUALNAME:    m_qualName = value.cast<PycString>(); break;
+    case FIELD_LNTABLE:     m_lnTable = value.cast<PycString>(); break;
+    case FIELD_EXCEPTTABLE: m_exceptTable = value.cast<PycString>(); break;
+    }
+}
+
+uint64_t PycCode::structuralHash() const
+{
+    ensureLoaded();
+    if (m_hashState == HASH_BUSY) {
+        // 经由引用构成的环：以固定值代替，结果仍然确定
+        return 0;
+    }
+    if (m_hashState == HASH_DONE)
+        return m_hash;
+
+    // 仍在读取字段的代码对象（经由引用在自己的常量中被访问到）内容还会变化，哈希不缓存
+    int state = m_hashState;
+    m_hashState = HASH_BUSY;
+    // 版本与 Unicode 标志会影响常量的输出方式，因此也计入哈希
+    PycHasher hasher;
+    hasher.updateInt(m_hashVersion);
+    hasher.updateInt(m_argCount);
+    hasher.updateInt(m_posOnlyArgCount);
+    hasher.updateInt(m_kwOnlyArgCount);
+    hasher.updateInt(m_numLocals);
+    hasher.updateInt(m_stackSize);
+    hasher.updateInt(m_flags);
+    HashObject(hasher, m_code);
+    HashObject(hasher, m_consts);
+    HashObject(hasher, m_names);
+    HashObject(hasher, m_localNames);
+    HashObject(hasher, m_localKinds);
+    HashObject(hasher, m_freeVars);
+    HashObject(hasher, m_cellVars);
+    HashObject(hasher, m_name);
+    HashObject(hasher, m_exceptTable);
+    m_hash = hasher.digest();
+    m_hashState = (state == HASH_LOADING) ? HASH_LOADING : HASH_DONE;
+    return m_hash;
+}
+
+void PycCode::hash(PycHasher& hasher) const
+{
+    hasher.updateInt(type());
+    hasher.updateInt((int64_t)structuralHash());
+}
+
+void PycCode::defer(PycData* stream, PycModule* mod)
+{
+    std::unique_ptr<LazyState> lazy(new LazyState);
+    lazy->mod = mod;
+    lazy->offset = stream->position();
+    lazy->firstRef = mod->nextRef();
+    lazy->firstIntern = mod->nextIntern();
+    skip(stream, mod);
+    lazy->endRef = mod->nextRef();
+    lazy->endIntern = mod->nextIntern();
+
+    m_lazy = std::move(lazy);
+    mod->registerLazy(this);
+}
+
+bool PycCode::lazyOwns(bool intern, int index) const
+{
+    if (!m_lazy)
+        return false;
+    if (intern)
+        return index >= m_lazy->firstIntern && index < m_lazy->endIntern;
+    return index >= m_lazy->firstRef && index < m_lazy->endRef;
+}
+
+void PycCode::materialize()
+{
+    if (!m_lazy)
+        return;
+
+    // 先取下延迟状态，避免解析过程中经由访问器重入
+    std::unique_ptr<LazyState> lazy = std::move(m_lazy);
+    PycModule* mod = lazy->mod;
+    const std::string& data = mod->lazyData();
+    PycBuffer in(data.data(), (int)data.size());
+    in.setPosition(lazy->offset);
+
+    // 在跳过时占下的编号范围内按顺序填入引用和 intern 字符串
+    PycModule::SlotCursor saved = mod->seekSlots(lazy->firstRef, lazy->firstIntern);
+    try {
+        load(&in, mod);
+    } catch (...) {
+        mod->restoreSlots(saved);
+        m_lazy = std::move(lazy);
+        throw;
+    }
+    mod->restoreSlots(saved);
+}
+
+void PycCode::skip(PycData* stream, PycModule* mod)
+{
+    SkipContents(TYPE_CODE, stream, mod);
 }
 
 PycRef<PycString> PycCode::getCellVar(PycModule* mod, int idx) const
 {
+    ensureLoaded();
     if (mod->verCompare(3, 11) >= 0)
         return getLocal(idx);
 
@@ -145,8 +301,84 @@ int _parse_varint(PycBuffer& data, int& pos) {
     return val;
 }
 
+std::string PycCode::qualifiedName(const PycCode* parent, const std::string& parentQualName) const
+{
+    ensureLoaded();
+    if (m_qualName != NULL && m_qualName->length() != 0)
+        return m_qualName->value();
+    if (parent == NULL || parent == this)
+        return m_name->value();
+
+    // 模块中的定义直接使用名称；函数中的定义带有 "<locals>"
+    if (parentQualName == "<module>" || parentQualName == "?")
+        return m_name->value();
+    // 类体没有 CO_OPTIMIZED 标志，函数体有
+    if (parent->flags() & CO_OPTIMIZED)
+        return parentQualName + ".<locals>." + m_name->value();
+    return parentQualName + "." + m_name->value();
+}
+
+void WalkCode(PycRef<PycCode> root, PycCodeVisitor& visitor)
+{
+    // 常量容器与代码对象一样占一层，owner 指向所属代码对象的那一层
+    struct Frame {
+        PycRef<PycSequence> items;
+        int next;
+        size_t owner;
+        PycRef<PycCode> code;
+        std::string qualname;
+        int id;
+    };
+    std::vector<Frame> stack;
+    int nextId = 0;
+
+    auto enter = [&](PycRef<PycCode> code) {
+        Frame frame { code->consts(), 0, stack.size(), code, std::string(), nextId++ };
+        int parentId = -1;
+        if (stack.empty()) {
+            frame.qualname = code->qualifiedName(nullptr, std::string());
+        } else {
+            const Frame& parent = stack[stack.back().owner];
+            frame.qualname = code->qualifiedName(parent.code, parent.qualname);
+            parentId = parent.id;
+        }
+        visitor.visitCode(code, frame.qualname, frame.id, parentId);
+        stack.push_back(std::move(frame));
+    };
+
+    enter(root);
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        if (top.items == NULL || top.next >= top.items->size()) {
+            stack.pop_back();
+            continue;
+        }
+        PycRef<PycObject> obj = top.items->get(top.next++);
+        switch (obj.type()) {
+        case PycObject::TYPE_CODE:
+        case PycObject::TYPE_CODE2:
+            enter(obj.cast<PycCode>());
+            break;
+        case PycObject::TYPE_TUPLE:
+        case PycObject::TYPE_SMALL_TUPLE:
+        case PycObject::TYPE_LIST:
+        case PycObject::TYPE_SET:
+        case PycObject::TYPE_FROZENSET:
+            stack.push_back(Frame { obj.cast<PycSequence>(), 0, top.owner, NULL, std::string(), -1 });
+            break;
+        default:
+            {
+                const Frame& owner = stack[top.owner];
+                visitor.visitConst(owner.code, owner.qualname, obj);
+            }
+            break;
+        }
+    }
+}
+
 std::vector<PycExceptionTableEntry> PycCode::exceptionTableEntries() const
 {
+    ensureLoaded();
     PycBuffer data(m_exceptTable->value(), m_exceptTable->length());
 
     std::vector<PycExceptionTableEntry> entries;
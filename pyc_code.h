@@ -3,6 +3,8 @@
 
 #include "pyc_sequence.h"
 #include "pyc_string.h"
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 class PycData;
@@ -51,42 +53,89 @@ public:
 
     PycCode(int type = TYPE_CODE)
         : PycObject(type), m_argCount(), m_posOnlyArgCount(), m_kwOnlyArgCount(),
-          m_numLocals(), m_stackSize(), m_flags(), m_firstLine() { }
+          m_numLocals(), m_stackSize(), m_flags(), m_firstLine(), m_hash(),
+          m_hashState(HASH_NONE), m_hashVersion() { }
 
     void load(PycData* stream, PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
+
+    /* 延迟加载：记录代码对象在输入中的位置并跳过其内容，
+     * 之后任何访问器被调用时才真正解析（见 PycModule::setLazyLoading） */
+    void defer(PycData* stream, PycModule* mod);
+    bool isLazy() const { return m_lazy != nullptr; }
+    bool lazyOwns(bool intern, int index) const;
+    void materialize();
+
+    /* 不创建对象地跳过一个代码对象，只为其中的引用和 intern 字符串占位 */
+    static void skip(PycData* stream, PycModule* mod);
+
+    /* 以下供 LoadObject() / SkipObject() 逐个字段读取代码对象，不经过递归。
+     * 对象字段按 marshal 中的顺序编号（见 pyc_code.cpp 开头的表格） */
+    enum Field {
+        FIELD_NONE = -1,
+        FIELD_CODE, FIELD_CONSTS, FIELD_NAMES, FIELD_LOCALNAMES, FIELD_LOCALKINDS,
+        FIELD_FREEVARS, FIELD_CELLVARS, FIELD_FILENAME, FIELD_NAME, FIELD_QUALNAME,
+        FIELD_LNTABLE, FIELD_EXCEPTTABLE,
+        FIELD_END
+    };
+
+    /* 读取第一个对象字段之前的整数字段；当前版本没有的对象字段设为空对象 */
+    void loadHeader(PycData* stream, PycModule* mod);
+    static void skipHeader(PycData* stream, PycModule* mod);
+
+    /* field 之后当前版本存在的下一个对象字段，没有时返回 FIELD_END；
+     * 途经对象字段之间的整数字段（首行号）时读取它，firstLine 为空时丢弃 */
+    static int nextField(int field, PycData* stream, PycModule* mod, int* firstLine);
+    int nextField(int field, PycData* stream, PycModule* mod)
+    {
+        return nextField(field, stream, mod, &m_firstLine);
+    }
 
-    int argCount() const { return m_argCount; }
-    int posOnlyArgCount() const { return m_posOnlyArgCount; }
-    int kwOnlyArgCount() const { return m_kwOnlyArgCount; }
-    int numLocals() const { return m_numLocals; }
-    int stackSize() const { return m_stackSize; }
-    int flags() const { return m_flags; }
-    PycRef<PycString> code() const { return m_code; }
-    PycRef<PycSequence> consts() const { return m_consts; }
-    PycRef<PycSequence> names() const { return m_names; }
-    PycRef<PycSequence> localNames() const { return m_localNames; }
-    PycRef<PycString> localKinds() const { return m_localKinds; }
-    PycRef<PycSequence> freeVars() const { return m_freeVars; }
-    PycRef<PycSequence> cellVars() const { return m_cellVars; }
-    PycRef<PycString> fileName() const { return m_fileName; }
-    PycRef<PycString> name() const { return m_name; }
-    PycRef<PycString> qualName() const { return m_qualName; }
-    int firstLine() const { return m_firstLine; }
-    PycRef<PycString> lnTable() const { return m_lnTable; }
-    PycRef<PycString> exceptTable() const { return m_exceptTable; }
+    /* 设置读到的对象字段，类型不符时抛出 std::bad_cast（与 load() 相同） */
+    void setField(int field, PycRef<PycObject> value);
+
+    /* 读取字段期间不缓存结构哈希（见 PycSimpleSequence::setLoading） */
+    void setLoading(bool loading) { m_hashState = loading ? HASH_LOADING : HASH_NONE; }
+
+    int argCount() const { ensureLoaded(); return m_argCount; }
+    int posOnlyArgCount() const { ensureLoaded(); return m_posOnlyArgCount; }
+    int kwOnlyArgCount() const { ensureLoaded(); return m_kwOnlyArgCount; }
+    int numLocals() const { ensureLoaded(); return m_numLocals; }
+    int stackSize() const { ensureLoaded(); return m_stackSize; }
+    int flags() const { ensureLoaded(); return m_flags; }
+    PycRef<PycString> code() const { ensureLoaded(); return m_code; }
+    PycRef<PycSequence> consts() const { ensureLoaded(); return m_consts; }
+    PycRef<PycSequence> names() const { ensureLoaded(); return m_names; }
+    PycRef<PycSequence> localNames() const { ensureLoaded(); return m_localNames; }
+    PycRef<PycString> localKinds() const { ensureLoaded(); return m_localKinds; }
+    PycRef<PycSequence> freeVars() const { ensureLoaded(); return m_freeVars; }
+    PycRef<PycSequence> cellVars() const { ensureLoaded(); return m_cellVars; }
+    PycRef<PycString> fileName() const { ensureLoaded(); return m_fileName; }
+    PycRef<PycString> name() const { ensureLoaded(); return m_name; }
+    PycRef<PycString> qualName() const { ensureLoaded(); return m_qualName; }
+    int firstLine() const { ensureLoaded(); return m_firstLine; }
+    PycRef<PycString> lnTable() const { ensureLoaded(); return m_lnTable; }
+    PycRef<PycString> exceptTable() const { ensureLoaded(); return m_exceptTable; }
+
+    /* 结构哈希（Merkle 方式包含嵌套的代码对象），首次调用时计算。
+     * 不包含文件名、首行号和行号表，因此不同文件中相同的函数哈希相同 */
+    uint64_t structuralHash() const;
 
     PycRef<PycObject> getConst(int idx) const
     {
+        ensureLoaded();
         return m_consts->get(idx);
     }
 
     PycRef<PycString> getName(int idx) const
     {
+        ensureLoaded();
         return m_names->get(idx).cast<PycString>();
     }
 
     PycRef<PycString> getLocal(int idx) const
     {
+        ensureLoaded();
         return m_localNames->get(idx).cast<PycString>();
     }
 
@@ -96,12 +145,30 @@ public:
 
     void markGlobal(PycRef<PycString> varname)
     {
+        ensureLoaded();
         m_globalsUsed.emplace_back(std::move(varname));
     }
 
     std::vector<PycExceptionTableEntry> exceptionTableEntries() const;
 
+    /* 限定名。3.11 起直接取 co_qualname，更早的版本按 Python 的规则由外层代码推出，
+     * 例如 "A.f"、"outer.<locals>.inner"；parent 为空表示这是模块的代码 */
+    std::string qualifiedName(const PycCode* parent, const std::string& parentQualName) const;
+
 private:
+    void ensureLoaded() const
+    {
+        if (m_lazy)
+            const_cast<PycCode*>(this)->materialize();
+    }
+
+    struct LazyState {
+        PycModule* mod;
+        int offset;
+        int firstRef, endRef;
+        int firstIntern, endIntern;
+    };
+
     int m_argCount, m_posOnlyArgCount, m_kwOnlyArgCount, m_numLocals;
     int m_stackSize, m_flags;
     PycRef<PycString> m_code;
@@ -118,6 +185,31 @@ private:
     PycRef<PycString> m_lnTable;
     PycRef<PycString> m_exceptTable;
     globals_t m_globalsUsed; /* Global vars used in this code */
+
+    enum { HASH_NONE, HASH_LOADING, HASH_BUSY, HASH_DONE };
+    mutable uint64_t m_hash;
+    mutable int m_hashState;
+    int m_hashVersion;
+    std::unique_ptr<LazyState> m_lazy;
 };
 
+/* 遍历代码对象树的回调，见 WalkCode() */
+class PycCodeVisitor {
+public:
+    virtual ~PycCodeVisitor() { }
+
+    /* 进入一个代码对象；id 按先序从 0 编号，parentId 为外层代码的编号，模块代码为 -1 */
+    virtual void visitCode(PycRef<PycCode> code, const std::string& qualname,
+                           int id, int parentId) = 0;
+
+    /* code 的常量表中（包括常量元组、列表、集合内）既不是代码对象也不是容器的常量 */
+    virtual void visitConst(PycRef<PycCode> /*code*/, const std::string& /*qualname*/,
+                            PycRef<PycObject> /*obj*/) { }
+};
+
+/* 以显式栈先序遍历 root 及其常量中嵌套的所有代码对象，嵌套深度不受调用栈限制。
+ * 常量按顺序访问，遇到代码对象时立即进入，因此外层代码中位于它之后的常量
+ * 在它的整个子树之后才被访问。 */
+void WalkCode(PycRef<PycCode> root, PycCodeVisitor& visitor);
+
 #endif
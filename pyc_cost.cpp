@@ -0,0 +1,87 @@
+﻿#include "pyc_cost.h"
+#include "pyc_skim.h"
+#include "bytecode.h"
+#include "data.h"
+#include <stdexcept>
+
+namespace {
+
+/* 粗略的经验值：每个代码对象有固定的建树和输出开销，
+ * 每个异常处理块在 BuildFromCode 中会复制一次求值栈 */
+const uint64_t CODE_OBJECT_COST = 64;
+const uint64_t HANDLER_COST = 256;
+
+class CostVisitor : public PycSkimVisitor {
+public:
+    CostVisitor(PycSkimmer& skimmer, PycCostEstimate& estimate)
+        : m_skimmer(skimmer), m_estimate(estimate) { }
+
+    void beginCode(int) override { ++m_estimate.codeObjects; }
+
+    void visitString(const PycSkimString& str, Field field) override
+    {
+        if (field == FIELD_BYTECODE) {
+            m_estimate.bytecode += (uint64_t)str.size;
+            if (m_skimmer.module()->verCompare(3, 11) < 0)
+                countSetups(str);
+        } else if (field == FIELD_EXCEPTTABLE) {
+            // 每个条目第一个字节的最高位置位
+            for (int i = 0; i < str.size; ++i) {
+                if (str.data[i] & 0x80)
+                    ++m_estimate.handlers;
+            }
+        }
+    }
+
+private:
+    void countSetups(const PycSkimString& code)
+    {
+        PycModule* mod = m_skimmer.module();
+        PycBuffer source(code.data, code.size);
+        int opcode, operand, pos = 0;
+        try {
+            while (!source.atEof()) {
+                bc_next(source, mod, opcode, operand, pos);
+                switch (opcode) {
+                case Pyc::SETUP_EXCEPT_A:
+                case Pyc::SETUP_FINALLY_A:
+                case Pyc::SETUP_WITH_A:
+                case Pyc::SETUP_ASYNC_WITH_A:
+                    ++m_estimate.handlers;
+                    break;
+                default:
+                    break;
+                }
+            }
+        } catch (std::exception&) {
+            // 末尾截断的指令不影响估计
+        }
+    }
+
+    PycSkimmer& m_skimmer;
+    PycCostEstimate& m_estimate;
+};
+
+}
+
+uint64_t PycCostEstimate::cost() const
+{
+    return bytecode + codeObjects * CODE_OBJECT_COST + handlers * HANDLER_COST;
+}
+
+bool pyc_estimate_cost(const void* data, size_t size, int major, int minor,
+                       PycCostEstimate& estimate)
+{
+    estimate = PycCostEstimate();
+    PycSkimmer skimmer;
+    CostVisitor visitor(skimmer, estimate);
+    try {
+        if (major >= 0)
+            skimmer.skimMarshalled(data, size, major, minor, visitor);
+        else if (!skimmer.skim(data, size, visitor))
+            return false;
+    } catch (std::exception&) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+﻿#ifndef _PYC_COST_H
+#define _PYC_COST_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* 反编译代价的估计，供批量模式安排处理顺序（见 pyc_batch.cpp）。
+ * 文件大小不能很好地反映反编译耗时：常量、名称和行号表往往占了大半，
+ * 耗时主要取决于字节码的总长度、代码对象的个数和异常处理块的个数。
+ * 这些数据由 PycSkimmer 按加载时相同的语法（SkimObject）读取，不创建任何对象，
+ * 3.11 以前的 SETUP_* 指令用 bc_next 解码，开销与读入文件相当。 */
+struct PycCostEstimate {
+    uint64_t bytecode;      // 所有代码对象的字节码总长度
+    uint64_t codeObjects;
+    uint64_t handlers;      // 异常处理块：3.11 起为异常表的条目数，之前为 SETUP_* 指令数
+
+    PycCostEstimate() : bytecode(0), codeObjects(0), handlers(0) { }
+
+    /* 以字节码字节数为单位的估计值 */
+    uint64_t cost() const;
+};
+
+/* 估计 pyc 文件（major < 0）或序列化代码对象（相当于 -c -v major.minor）的代价；
+ * 无法识别或格式错误时返回 false */
+bool pyc_estimate_cost(const void* data, size_t size, int major, int minor,
+                       PycCostEstimate& estimate);
+
+#endif
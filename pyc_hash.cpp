@@ -0,0 +1,157 @@
+﻿#include "pyc_hash.h"
+#include <cstring>
+
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/* 按小端序读取，保证不同平台得到相同的哈希值 */
+inline uint64_t read64(const unsigned char* ptr)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i)
+        value = (value << 8) | ptr[i];
+    return value;
+}
+
+inline uint32_t read32(const unsigned char* ptr)
+{
+    return (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8)
+         | ((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+inline uint64_t accRound(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= accRound(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t finalize(uint64_t hash, const unsigned char* ptr, size_t len)
+{
+    while (len >= 8) {
+        hash ^= accRound(0, read64(ptr));
+        hash = rotl(hash, 27) * PRIME1 + PRIME4;
+        ptr += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        hash ^= (uint64_t)read32(ptr) * PRIME1;
+        hash = rotl(hash, 23) * PRIME2 + PRIME3;
+        ptr += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        hash ^= (*ptr) * PRIME5;
+        hash = rotl(hash, 11) * PRIME1;
+        ++ptr;
+        --len;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+}
+
+uint64_t pyc_hash64(const void* data, size_t size, uint64_t seed)
+{
+    PycHasher hasher(seed);
+    hasher.update(data, size);
+    return hasher.digest();
+}
+
+PycHasher::PycHasher(uint64_t seed)
+    : m_seed(seed), m_total(0), m_buffered(0)
+{
+    m_acc[0] = seed + PRIME1 + PRIME2;
+    m_acc[1] = seed + PRIME2;
+    m_acc[2] = seed;
+    m_acc[3] = seed - PRIME1;
+}
+
+void PycHasher::update(const void* data, size_t size)
+{
+    auto ptr = static_cast<const unsigned char*>(data);
+    m_total += size;
+
+    if (m_buffered + size < sizeof(m_buffer)) {
+        if (size)
+            memcpy(m_buffer + m_buffered, ptr, size);
+        m_buffered += size;
+        return;
+    }
+
+    if (m_buffered) {
+        size_t fill = sizeof(m_buffer) - m_buffered;
+        memcpy(m_buffer + m_buffered, ptr, fill);
+        for (int i = 0; i < 4; ++i)
+            m_acc[i] = accRound(m_acc[i], read64(m_buffer + i * 8));
+        ptr += fill;
+        size -= fill;
+        m_buffered = 0;
+    }
+
+    while (size >= 32) {
+        for (int i = 0; i < 4; ++i)
+            m_acc[i] = accRound(m_acc[i], read64(ptr + i * 8));
+        ptr += 32;
+        size -= 32;
+    }
+
+    if (size)
+        memcpy(m_buffer, ptr, size);
+    m_buffered = size;
+}
+
+void PycHasher::updateInt(int64_t value)
+{
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; ++i)
+        bytes[i] = (unsigned char)((uint64_t)value >> (i * 8));
+    update(bytes, sizeof(bytes));
+}
+
+uint64_t PycHasher::digest() const
+{
+    uint64_t hash;
+    if (m_total >= 32) {
+        hash = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+        for (int i = 0; i < 4; ++i)
+            hash = mergeRound(hash, m_acc[i]);
+    } else {
+        hash = m_seed + PRIME5;
+    }
+    hash += m_total;
+    return finalize(hash, m_buffer, m_buffered);
+}
+
+std::string pyc_hash_hex(uint64_t hash)
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    std::string result(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        result[i] = hexdigits[hash & 0xF];
+        hash >>= 4;
+    }
+    return result;
+}
@@ -0,0 +1,33 @@
+﻿#ifndef _PYC_HASH_H
+#define _PYC_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* 64 位非加密哈希（XXH64 算法），用于结果缓存键和代码对象去重 */
+uint64_t pyc_hash64(const void* data, size_t size, uint64_t seed = 0);
+
+/* 可分段输入的哈希状态，结果与对拼接后的数据调用 pyc_hash64 相同 */
+class PycHasher {
+public:
+    explicit PycHasher(uint64_t seed = 0);
+
+    void update(const void* data, size_t size);
+    void update(const std::string& str) { update(str.data(), str.size()); }
+    void updateInt(int64_t value);
+
+    uint64_t digest() const;
+
+private:
+    uint64_t m_acc[4];
+    uint64_t m_seed;
+    uint64_t m_total;
+    unsigned char m_buffer[32];
+    size_t m_buffered;
+};
+
+/* 以 16 个十六进制字符表示哈希值 */
+std::string pyc_hash_hex(uint64_t hash);
+
+#endif
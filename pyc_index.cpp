@@ -0,0 +1,729 @@
+﻿#include "pyc_index.h"
+#include "pyc_hash.h"
+#include "bytecode.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/* 格式变化时需要修改此值 */
+const char INDEX_MAGIC[8] = { 'P', 'Y', 'C', 'I', 'D', 'X', '0', '1' };
+
+// 文件头：magic，4 个 u32（文件数、限定名数、词数、保留），6 个 u64（各段偏移）
+const size_t HEADER_SIZE = 8 + 4 * 4 + 6 * 8;
+const size_t FILE_ENTRY_SIZE = 40;      // u64 路径偏移, u32 路径长度, u32 保留, u64 大小, i64 修改时间, u64 哈希
+const size_t QUAL_ENTRY_SIZE = 16;      // u64 偏移, u32 长度, u32 保留
+const size_t TERM_ENTRY_SIZE = 24;      // u64 偏移, u32 长度, u32 出现次数, u64 倒排表偏移
+
+void put_u32(std::string& out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out += (char)(value >> (i * 8));
+}
+
+void put_u64(std::string& out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        out += (char)(value >> (i * 8));
+}
+
+void put_varint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out += (char)((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+uint32_t get_u32(const unsigned char* bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8)
+         | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+uint64_t get_u64(const unsigned char* bytes)
+{
+    return (uint64_t)get_u32(bytes) | ((uint64_t)get_u32(bytes + 4) << 32);
+}
+
+bool get_varint(const unsigned char*& pos, const unsigned char* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        unsigned char byte = *pos++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+struct Header {
+    uint32_t fileCount, qualCount, termCount;
+    uint64_t filesOffset, qualsOffset, termsOffset, postingsOffset, postingsEnd, stringsOffset;
+};
+
+bool parse_header(const unsigned char* bytes, Header& header)
+{
+    if (memcmp(bytes, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+        return false;
+    header.fileCount = get_u32(bytes + 8);
+    header.qualCount = get_u32(bytes + 12);
+    header.termCount = get_u32(bytes + 16);
+    header.filesOffset = get_u64(bytes + 24);
+    header.qualsOffset = get_u64(bytes + 32);
+    header.termsOffset = get_u64(bytes + 40);
+    header.postingsOffset = get_u64(bytes + 48);
+    header.postingsEnd = get_u64(bytes + 56);
+    header.stringsOffset = get_u64(bytes + 64);
+    return true;
+}
+
+int64_t file_mtime(const fs::path& path, std::error_code& ec)
+{
+    auto time = fs::last_write_time(path, ec);
+    return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch()).count();
+}
+
+std::string name_at(PycRef<PycCode> code, int index)
+{
+    try {
+        return code->getName(index)->strValue();
+    } catch (const std::out_of_range&) {
+        return std::string();
+    }
+}
+
+std::string local_at(PycRef<PycCode> code, int index)
+{
+    try {
+        return code->getLocal(index)->strValue();
+    } catch (const std::out_of_range&) {
+        return std::string();
+    }
+}
+
+void add_strings(PycRef<PycSequence> seq, const std::string& qualname, int kind,
+                 std::vector<PycIndex::Occurrence>& occurrences)
+{
+    for (int i = 0; seq != NULL && i < seq->size(); ++i) {
+        PycRef<PycString> str = seq->get(i).try_cast<PycString>();
+        if (str != NULL)
+            occurrences.push_back({ str->strValue(), qualname, -1, kind });
+    }
+}
+
+/* 扫描字节码中的导入与属性访问链 */
+void extract_bytecode(PycRef<PycCode> code, const std::string& qualname, PycModule* mod,
+                      std::vector<PycIndex::Occurrence>& occurrences)
+{
+    PycBuffer source(code->code()->value(), code->code()->length());
+    std::string chain, module;
+    int opcode, operand;
+    int pos = 0;
+    while (!source.atEof()) {
+        int start = pos;
+        bc_next(source, mod, opcode, operand, pos);
+        switch (opcode) {
+        case Pyc::CACHE:
+        case Pyc::EXTENDED_ARG_A:
+            continue;
+        case Pyc::LOAD_NAME_A:
+            chain = name_at(code, operand);
+            continue;
+        case Pyc::LOAD_GLOBAL_A:
+            chain = name_at(code, mod->verCompare(3, 11) >= 0 ? operand >> 1 : operand);
+            continue;
+        case Pyc::LOAD_FAST_A:
+            chain = local_at(code, operand);
+            continue;
+        case Pyc::LOAD_ATTR_A:
+        case Pyc::LOAD_METHOD_A:
+            if (!chain.empty()) {
+                int arg = (opcode == Pyc::LOAD_ATTR_A && mod->verCompare(3, 12) >= 0)
+                        ? operand >> 1 : operand;
+                std::string attr = name_at(code, arg);
+                if (attr.empty()) {
+                    chain.clear();
+                } else {
+                    chain += "." + attr;
+                    occurrences.push_back({ chain, qualname, start, PycIndex::KIND_ATTR });
+                }
+            }
+            continue;
+        case Pyc::IMPORT_NAME_A:
+            module = name_at(code, operand);
+            if (!module.empty())
+                occurrences.push_back({ module, qualname, start, PycIndex::KIND_IMPORT });
+            chain.clear();
+            continue;
+        case Pyc::IMPORT_FROM_A:
+            if (!module.empty()) {
+                std::string name = name_at(code, operand);
+                if (!name.empty())
+                    occurrences.push_back({ module + "." + name, qualname, start,
+                                            PycIndex::KIND_IMPORT });
+            }
+            chain.clear();
+            continue;
+        case Pyc::STORE_NAME_A:
+        case Pyc::STORE_FAST_A:
+        case Pyc::STORE_GLOBAL_A:
+            // from m import a, b 中每个 IMPORT_FROM 之后都有一次存储
+            chain.clear();
+            continue;
+        default:
+            chain.clear();
+            module.clear();
+            continue;
+        }
+    }
+}
+
+class Extractor : public PycCodeVisitor {
+public:
+    Extractor(PycModule* mod, std::vector<PycIndex::Occurrence>& occurrences)
+        : m_mod(mod), m_occurrences(occurrences) { }
+
+    void visitCode(PycRef<PycCode> code, const std::string& qualname, int, int) override
+    {
+        add_strings(code->names(), qualname, PycIndex::KIND_NAME, m_occurrences);
+        add_strings(code->localNames(), qualname, PycIndex::KIND_VARNAME, m_occurrences);
+        extract_bytecode(code, qualname, m_mod, m_occurrences);
+    }
+
+    void visitConst(PycRef<PycCode>, const std::string& qualname, PycRef<PycObject> obj) override
+    {
+        switch (obj.type()) {
+        case PycObject::TYPE_STRING:
+        case PycObject::TYPE_UNICODE:
+        case PycObject::TYPE_INTERNED:
+        case PycObject::TYPE_ASCII:
+        case PycObject::TYPE_ASCII_INTERNED:
+        case PycObject::TYPE_SHORT_ASCII:
+        case PycObject::TYPE_SHORT_ASCII_INTERNED:
+            m_occurrences.push_back({ obj.cast<PycString>()->strValue(), qualname, -1,
+                                      PycIndex::KIND_CONST });
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    PycModule* m_mod;
+    std::vector<PycIndex::Occurrence>& m_occurrences;
+};
+
+}
+
+const char* PycIndex::kindName(int kind)
+{
+    static const char* const names[] = { "name", "varname", "const", "import", "attr" };
+    return (kind >= 0 && kind < KIND_COUNT) ? names[kind] : "unknown";
+}
+
+void PycIndex::extract(PycModule* mod, std::vector<Occurrence>& occurrences)
+{
+    if (mod->code() != NULL) {
+        Extractor extractor(mod, occurrences);
+        WalkCode(mod->code(), extractor);
+    }
+}
+
+
+/* PycIndexWriter */
+PycIndexWriter::PycIndexWriter()
+{
+}
+
+uint32_t PycIndexWriter::internTerm(const std::string& term)
+{
+    auto result = m_termIds.emplace(term, (uint32_t)m_terms.size());
+    if (result.second)
+        m_terms.push_back(term);
+    return result.first->second;
+}
+
+uint32_t PycIndexWriter::internQual(const std::string& qual)
+{
+    auto result = m_qualIds.emplace(qual, (uint32_t)m_quals.size());
+    if (result.second)
+        m_quals.push_back(qual);
+    return result.first->second;
+}
+
+bool PycIndexWriter::load(const std::string& path, std::string& error)
+{
+    std::string data;
+    if (!read_whole_file(path.c_str(), data)) {
+        std::error_code ec;
+        if (!fs::exists(path, ec))
+            return true;
+        error = "无法读取索引文件";
+        return false;
+    }
+
+    const unsigned char* base = (const unsigned char*)data.data();
+    Header header;
+    if (data.size() < HEADER_SIZE || !parse_header(base, header)) {
+        error = "不是 pycindex 索引文件";
+        return false;
+    }
+    auto inRange = [&data](uint64_t offset, uint64_t size) {
+        return offset <= data.size() && size <= data.size() - offset;
+    };
+    if (!inRange(header.filesOffset, (uint64_t)header.fileCount * FILE_ENTRY_SIZE)
+            || !inRange(header.qualsOffset, (uint64_t)header.qualCount * QUAL_ENTRY_SIZE)
+            || !inRange(header.termsOffset, (uint64_t)header.termCount * TERM_ENTRY_SIZE)
+            || header.postingsOffset > header.postingsEnd || !inRange(header.postingsEnd, 0)) {
+        error = "索引文件已损坏";
+        return false;
+    }
+    auto stringAt = [&](const unsigned char* entry, std::string& str) {
+        uint64_t offset = get_u64(entry);
+        uint32_t length = get_u32(entry + 8);
+        if (!inRange(offset, length))
+            return false;
+        str.assign(data, (size_t)offset, length);
+        return true;
+    };
+
+    size_t firstFile = m_files.size();
+    for (uint32_t i = 0; i < header.fileCount; ++i) {
+        const unsigned char* entry = base + header.filesOffset + (uint64_t)i * FILE_ENTRY_SIZE;
+        FileRecord record;
+        if (!stringAt(entry, record.path)) {
+            error = "索引文件已损坏";
+            return false;
+        }
+        record.size = get_u64(entry + 16);
+        record.mtime = (int64_t)get_u64(entry + 24);
+        record.hash = get_u64(entry + 32);
+        record.live = true;
+        m_fileIds[record.path] = m_files.size();
+        m_files.push_back(std::move(record));
+    }
+
+    std::vector<uint32_t> quals(header.qualCount);
+    for (uint32_t i = 0; i < header.qualCount; ++i) {
+        std::string qual;
+        if (!stringAt(base + header.qualsOffset + (uint64_t)i * QUAL_ENTRY_SIZE, qual)) {
+            error = "索引文件已损坏";
+            return false;
+        }
+        quals[i] = internQual(qual);
+    }
+
+    for (uint32_t i = 0; i < header.termCount; ++i) {
+        const unsigned char* entry = base + header.termsOffset + (uint64_t)i * TERM_ENTRY_SIZE;
+        std::string term;
+        if (!stringAt(entry, term)) {
+            error = "索引文件已损坏";
+            return false;
+        }
+        uint32_t termId = internTerm(term);
+        uint32_t count = get_u32(entry + 12);
+        uint64_t start = get_u64(entry + 16);
+        uint64_t end = (i + 1 < header.termCount)
+                ? get_u64(entry + TERM_ENTRY_SIZE + 16) : header.postingsEnd;
+        if (start < header.postingsOffset || start > end || end > header.postingsEnd) {
+            error = "索引文件已损坏";
+            return false;
+        }
+
+        const unsigned char* pos = base + start;
+        const unsigned char* stop = base + end;
+        uint64_t file = 0;
+        for (uint32_t j = 0; j < count; ++j) {
+            uint64_t delta, qual, offset;
+            if (!get_varint(pos, stop, delta) || !get_varint(pos, stop, qual)
+                    || !get_varint(pos, stop, offset) || pos >= stop) {
+                error = "索引文件已损坏";
+                return false;
+            }
+            uint8_t kind = *pos++;
+            file += delta;
+            if (file >= header.fileCount || qual >= header.qualCount) {
+                error = "索引文件已损坏";
+                return false;
+            }
+            m_files[firstFile + (size_t)file].postings.push_back(
+                    { termId, quals[(size_t)qual], (int32_t)offset - 1, kind });
+        }
+    }
+    return true;
+}
+
+PycIndexWriter::UpdateResult PycIndexWriter::update(const std::string& file, std::string& error)
+{
+    std::error_code ec;
+    uint64_t size = fs::file_size(file, ec);
+    int64_t mtime = ec ? 0 : file_mtime(file, ec);
+    if (ec) {
+        error = ec.message();
+        return UPDATE_FAILED;
+    }
+
+    auto it = m_fileIds.find(file);
+    FileRecord* record = (it != m_fileIds.end()) ? &m_files[it->second] : nullptr;
+    if (record && record->live && record->size == size && record->mtime == mtime)
+        return UPDATE_UNCHANGED;
+
+    std::string data;
+    if (!read_whole_file(file.c_str(), data)) {
+        error = "无法读取文件";
+        return UPDATE_FAILED;
+    }
+    uint64_t hash = pyc_hash64(data.data(), data.size());
+    if (record && record->live && record->hash == hash) {
+        // 只是修改时间变了
+        record->size = size;
+        record->mtime = mtime;
+        return UPDATE_UNCHANGED;
+    }
+
+    std::vector<PycIndex::Occurrence> occurrences;
+    try {
+        PycModule mod;
+        mod.loadFromBuffer(data.data(), (int)data.size());
+        if (!mod.isValid() || mod.code() == NULL) {
+            error = "无法加载文件";
+            return UPDATE_FAILED;
+        }
+        PycIndex::extract(&mod, occurrences);
+    } catch (std::exception& ex) {
+        error = ex.what();
+        return UPDATE_FAILED;
+    }
+
+    if (!record) {
+        m_fileIds[file] = m_files.size();
+        m_files.emplace_back();
+        record = &m_files.back();
+        record->path = file;
+    }
+    record->size = size;
+    record->mtime = mtime;
+    record->hash = hash;
+    record->live = true;
+    record->postings.clear();
+    record->postings.reserve(occurrences.size());
+    for (const auto& occ : occurrences) {
+        record->postings.push_back({ internTerm(occ.term), internQual(occ.qualname),
+                                     (int32_t)occ.offset, (uint8_t)occ.kind });
+    }
+    return UPDATE_INDEXED;
+}
+
+bool PycIndexWriter::remove(const std::string& file)
+{
+    auto it = m_fileIds.find(file);
+    if (it == m_fileIds.end())
+        return false;
+    m_files[it->second].live = false;
+    m_files[it->second].postings.clear();
+    m_fileIds.erase(it);
+    return true;
+}
+
+size_t PycIndexWriter::prune()
+{
+    std::vector<std::string> missing;
+    for (const auto& entry : m_fileIds) {
+        std::error_code ec;
+        if (!fs::exists(entry.first, ec))
+            missing.push_back(entry.first);
+    }
+    for (const auto& file : missing)
+        remove(file);
+    return missing.size();
+}
+
+bool PycIndexWriter::save(const std::string& path, std::string& error) const
+{
+    // 文件按路径排序，使相同内容的索引文件完全相同
+    std::vector<const FileRecord*> files;
+    for (const auto& record : m_files) {
+        if (record.live)
+            files.push_back(&record);
+    }
+    std::sort(files.begin(), files.end(), [](const FileRecord* a, const FileRecord* b) {
+        return a->path < b->path;
+    });
+
+    // 每个词的倒排表，按文件顺序排列
+    struct TermPostings {
+        uint32_t count = 0;
+        uint32_t lastFile = 0;
+        std::string encoded;
+    };
+    std::vector<TermPostings> postings(m_terms.size());
+    std::vector<uint32_t> qualIds(m_quals.size(), UINT32_MAX);
+    std::vector<uint32_t> usedQuals;
+    for (uint32_t fileId = 0; fileId < files.size(); ++fileId) {
+        for (const auto& posting : files[fileId]->postings) {
+            if (qualIds[posting.qual] == UINT32_MAX) {
+                qualIds[posting.qual] = (uint32_t)usedQuals.size();
+                usedQuals.push_back(posting.qual);
+            }
+            TermPostings& list = postings[posting.term];
+            put_varint(list.encoded, fileId - list.lastFile);
+            put_varint(list.encoded, qualIds[posting.qual]);
+            put_varint(list.encoded, (uint64_t)((int64_t)posting.offset + 1));
+            list.encoded += (char)posting.kind;
+            list.lastFile = fileId;
+            ++list.count;
+        }
+    }
+
+    std::vector<uint32_t> terms;
+    for (uint32_t i = 0; i < postings.size(); ++i) {
+        if (postings[i].count)
+            terms.push_back(i);
+    }
+    std::sort(terms.begin(), terms.end(), [this](uint32_t a, uint32_t b) {
+        return m_terms[a] < m_terms[b];
+    });
+
+    Header header;
+    header.fileCount = (uint32_t)files.size();
+    header.qualCount = (uint32_t)usedQuals.size();
+    header.termCount = (uint32_t)terms.size();
+    header.filesOffset = HEADER_SIZE;
+    header.qualsOffset = header.filesOffset + (uint64_t)header.fileCount * FILE_ENTRY_SIZE;
+    header.termsOffset = header.qualsOffset + (uint64_t)header.qualCount * QUAL_ENTRY_SIZE;
+    header.postingsOffset = header.termsOffset + (uint64_t)header.termCount * TERM_ENTRY_SIZE;
+    header.postingsEnd = header.postingsOffset;
+    for (uint32_t term : terms)
+        header.postingsEnd += postings[term].encoded.size();
+    header.stringsOffset = header.postingsEnd;
+
+    std::string out, strings;
+    out.reserve((size_t)header.stringsOffset);
+    out.append(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    put_u32(out, header.fileCount);
+    put_u32(out, header.qualCount);
+    put_u32(out, header.termCount);
+    put_u32(out, 0);
+    put_u64(out, header.filesOffset);
+    put_u64(out, header.qualsOffset);
+    put_u64(out, header.termsOffset);
+    put_u64(out, header.postingsOffset);
+    put_u64(out, header.postingsEnd);
+    put_u64(out, header.stringsOffset);
+
+    auto putString = [&](const std::string& str) {
+        put_u64(out, header.stringsOffset + strings.size());
+        put_u32(out, (uint32_t)str.size());
+        strings += str;
+    };
+    for (const FileRecord* record : files) {
+        putString(record->path);
+        put_u32(out, 0);
+        put_u64(out, record->size);
+        put_u64(out, (uint64_t)record->mtime);
+        put_u64(out, record->hash);
+    }
+    for (uint32_t qual : usedQuals) {
+        putString(m_quals[qual]);
+        put_u32(out, 0);
+    }
+    uint64_t postingsOffset = header.postingsOffset;
+    for (uint32_t term : terms) {
+        putString(m_terms[term]);
+        put_u32(out, postings[term].count);
+        put_u64(out, postingsOffset);
+        postingsOffset += postings[term].encoded.size();
+    }
+    for (uint32_t term : terms)
+        out += postings[term].encoded;
+
+    std::string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        error = "无法写入 " + tmpPath;
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size()
+            && fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    ok = (fclose(file) == 0) && ok;
+    std::error_code ec;
+    if (ok) {
+        fs::rename(tmpPath, path, ec);
+        ok = !ec;
+    }
+    if (!ok) {
+        fs::remove(tmpPath, ec);
+        error = "无法写入 " + path;
+        return false;
+    }
+    return true;
+}
+
+
+/* PycIndexReader */
+PycIndexReader::PycIndexReader(const std::string& path)
+    : m_in(nullptr), m_fileCount(), m_qualCount(), m_termCount(), m_filesOffset(),
+      m_qualsOffset(), m_termsOffset(), m_postingsOffset(), m_postingsEnd()
+{
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) {
+        m_error = "无法打开索引文件";
+        return;
+    }
+    unsigned char bytes[HEADER_SIZE];
+    Header header;
+    if (fread(bytes, 1, sizeof(bytes), in) != sizeof(bytes) || !parse_header(bytes, header)) {
+        fclose(in);
+        m_error = "不是 pycindex 索引文件";
+        return;
+    }
+    m_in = in;
+    m_fileCount = header.fileCount;
+    m_qualCount = header.qualCount;
+    m_termCount = header.termCount;
+    m_filesOffset = header.filesOffset;
+    m_qualsOffset = header.qualsOffset;
+    m_termsOffset = header.termsOffset;
+    m_postingsOffset = header.postingsOffset;
+    m_postingsEnd = header.postingsEnd;
+}
+
+PycIndexReader::~PycIndexReader()
+{
+    if (m_in)
+        fclose(m_in);
+}
+
+bool PycIndexReader::readAt(uint64_t offset, void* buffer, size_t size)
+{
+#ifdef WIN32
+    if (_fseeki64(m_in, (__int64)offset, SEEK_SET) != 0)
+        return false;
+#else
+    if (fseeko(m_in, (off_t)offset, SEEK_SET) != 0)
+        return false;
+#endif
+    return fread(buffer, 1, size, m_in) == size;
+}
+
+bool PycIndexReader::readString(uint64_t offset, uint32_t length, std::string& str)
+{
+    str.resize(length);
+    return length == 0 || readAt(offset, &str[0], length);
+}
+
+bool PycIndexReader::readTerm(uint32_t index, std::string& term, uint64_t& postings,
+                              uint64_t& postingsEnd)
+{
+    unsigned char entry[TERM_ENTRY_SIZE * 2];
+    size_t size = (index + 1 < m_termCount) ? sizeof(entry) : TERM_ENTRY_SIZE;
+    if (!readAt(m_termsOffset + (uint64_t)index * TERM_ENTRY_SIZE, entry, size))
+        return false;
+    postings = get_u64(entry + 16);
+    postingsEnd = (size == sizeof(entry)) ? get_u64(entry + TERM_ENTRY_SIZE + 16) : m_postingsEnd;
+    return readString(get_u64(entry), get_u32(entry + 8), term);
+}
+
+bool PycIndexReader::readFile(uint32_t index, std::string& path)
+{
+    unsigned char entry[12];
+    return index < m_fileCount
+        && readAt(m_filesOffset + (uint64_t)index * FILE_ENTRY_SIZE, entry, sizeof(entry))
+        && readString(get_u64(entry), get_u32(entry + 8), path);
+}
+
+bool PycIndexReader::readQual(uint32_t index, std::string& qual)
+{
+    unsigned char entry[12];
+    return index < m_qualCount
+        && readAt(m_qualsOffset + (uint64_t)index * QUAL_ENTRY_SIZE, entry, sizeof(entry))
+        && readString(get_u64(entry), get_u32(entry + 8), qual);
+}
+
+bool PycIndexReader::find(const std::string& term, bool prefix, std::vector<PycIndex::Hit>& hits)
+{
+    if (!m_in)
+        return false;
+
+    // 二分查找第一个不小于 term 的词
+    uint32_t lo = 0, hi = m_termCount;
+    std::string current;
+    uint64_t start, end;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (!readTerm(mid, current, start, end)) {
+            m_error = "索引文件已损坏";
+            return false;
+        }
+        if (current < term)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    std::map<uint32_t, std::string> files, quals;
+    for (uint32_t index = lo; index < m_termCount; ++index) {
+        if (!readTerm(index, current, start, end)) {
+            m_error = "索引文件已损坏";
+            return false;
+        }
+        if (prefix ? current.compare(0, term.size(), term) != 0 : current != term)
+            break;
+        if (start > end || end > m_postingsEnd || start < m_postingsOffset) {
+            m_error = "索引文件已损坏";
+            return false;
+        }
+
+        std::string encoded;
+        if (!readString(start, (uint32_t)(end - start), encoded)) {
+            m_error = "索引文件已损坏";
+            return false;
+        }
+        const unsigned char* pos = (const unsigned char*)encoded.data();
+        const unsigned char* stop = pos + encoded.size();
+        uint64_t file = 0;
+        while (pos < stop) {
+            uint64_t delta, qual, offset;
+            if (!get_varint(pos, stop, delta) || !get_varint(pos, stop, qual)
+                    || !get_varint(pos, stop, offset) || pos >= stop) {
+                m_error = "索引文件已损坏";
+                return false;
+            }
+            int kind = *pos++;
+            file += delta;
+
+            auto fileIt = files.find((uint32_t)file);
+            if (fileIt == files.end()) {
+                std::string path;
+                if (!readFile((uint32_t)file, path)) {
+                    m_error = "索引文件已损坏";
+                    return false;
+                }
+                fileIt = files.emplace((uint32_t)file, std::move(path)).first;
+            }
+            auto qualIt = quals.find((uint32_t)qual);
+            if (qualIt == quals.end()) {
+                std::string name;
+                if (!readQual((uint32_t)qual, name)) {
+                    m_error = "索引文件已损坏";
+                    return false;
+                }
+                qualIt = quals.emplace((uint32_t)qual, std::move(name)).first;
+            }
+            hits.push_back({ current, fileIt->second, qualIt->second, (int)offset - 1, kind });
+        }
+        if (!prefix)
+            break;
+    }
+    return true;
+}
@@ -0,0 +1,141 @@
+﻿#ifndef _PYC_INDEX_H
+#define _PYC_INDEX_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PycModule;
+
+/* 名称与常量的倒排索引（pycindex）。
+ *
+ * 索引词来自每个代码对象的 co_names、co_varnames 和字符串常量，以及字节码中的
+ * 导入与属性访问：IMPORT_NAME 得到模块名，IMPORT_FROM 得到 "模块.名称"，
+ * LOAD_NAME / LOAD_GLOBAL / LOAD_FAST 之后的 LOAD_ATTR / LOAD_METHOD 链得到
+ * 完整的点分名称（例如 "subprocess.Popen"、"os.path.join"）。
+ * 每次出现记录文件、代码对象的限定名、字节码偏移（来自名称表或常量表的为 -1）和种类。
+ *
+ * 索引文件中的词典按字节序排列，查询时只需二分查找并读取命中的倒排表，
+ * 不必把整个索引读入内存。 */
+class PycIndex {
+public:
+    enum Kind {
+        KIND_NAME,          // co_names
+        KIND_VARNAME,       // co_varnames
+        KIND_CONST,         // 字符串常量
+        KIND_IMPORT,        // IMPORT_NAME / IMPORT_FROM
+        KIND_ATTR,          // 属性访问链
+        KIND_COUNT
+    };
+
+    static const char* kindName(int kind);
+
+    struct Hit {
+        std::string term;
+        std::string file;
+        std::string qualname;
+        int offset;
+        int kind;
+    };
+
+    /* 从模块的所有代码对象中提取索引词 */
+    struct Occurrence {
+        std::string term;
+        std::string qualname;
+        int offset;
+        int kind;
+    };
+    static void extract(PycModule* mod, std::vector<Occurrence>& occurrences);
+};
+
+/* 在内存中维护整个索引，用于建立和增量更新。
+ * 更新时只重新解析大小、修改时间或内容哈希发生变化的文件，其余文件沿用已有的倒排记录；
+ * save() 以临时文件加重命名的方式原子地替换索引文件。
+ * 索引没有分段：即使只有一个文件变化，load() 也会读入全部倒排记录，save() 也会重写
+ * 整个索引文件，因此每次更新的时间和内存与索引的总大小成正比。对很大的语料库，
+ * 应把文件分批传给同一次 update，而不是每个文件调用一次。 */
+class PycIndexWriter {
+public:
+    enum UpdateResult {
+        UPDATE_UNCHANGED,
+        UPDATE_INDEXED,
+        UPDATE_FAILED,
+    };
+
+    PycIndexWriter();
+
+    /* 读入已有的索引；文件不存在时返回 true 并从空索引开始，格式错误时返回 false */
+    bool load(const std::string& path, std::string& error);
+
+    UpdateResult update(const std::string& file, std::string& error);
+    bool remove(const std::string& file);
+
+    /* 删除磁盘上已不存在的文件，返回删除的数量 */
+    size_t prune();
+
+    bool save(const std::string& path, std::string& error) const;
+
+    size_t fileCount() const { return m_fileIds.size(); }
+
+private:
+    struct Posting {
+        uint32_t term;
+        uint32_t qual;
+        int32_t offset;
+        uint8_t kind;
+    };
+
+    struct FileRecord {
+        std::string path;
+        uint64_t size;
+        int64_t mtime;
+        uint64_t hash;
+        bool live;
+        std::vector<Posting> postings;
+    };
+
+    uint32_t internTerm(const std::string& term);
+    uint32_t internQual(const std::string& qual);
+
+    std::vector<FileRecord> m_files;
+    std::unordered_map<std::string, size_t> m_fileIds;
+    std::vector<std::string> m_terms;
+    std::unordered_map<std::string, uint32_t> m_termIds;
+    std::vector<std::string> m_quals;
+    std::unordered_map<std::string, uint32_t> m_qualIds;
+};
+
+/* 只读查询。打开时只读取文件头，每次查询按需读取词典项和倒排表 */
+class PycIndexReader {
+public:
+    explicit PycIndexReader(const std::string& path);
+    ~PycIndexReader();
+
+    PycIndexReader(const PycIndexReader&) = delete;
+    PycIndexReader& operator=(const PycIndexReader&) = delete;
+
+    bool isOpen() const { return m_in != nullptr; }
+    const std::string& error() const { return m_error; }
+
+    /* 查找一个词；prefix 为 true 时查找所有以 term 开头的词 */
+    bool find(const std::string& term, bool prefix, std::vector<PycIndex::Hit>& hits);
+
+    uint32_t fileCount() const { return m_fileCount; }
+    uint32_t termCount() const { return m_termCount; }
+
+private:
+    bool readAt(uint64_t offset, void* buffer, size_t size);
+    bool readString(uint64_t offset, uint32_t length, std::string& str);
+    bool readTerm(uint32_t index, std::string& term, uint64_t& postings, uint64_t& postingsEnd);
+    bool readFile(uint32_t index, std::string& path);
+    bool readQual(uint32_t index, std::string& qual);
+
+    FILE* m_in;
+    std::string m_error;
+    uint32_t m_fileCount, m_qualCount, m_termCount;
+    uint64_t m_filesOffset, m_qualsOffset, m_termsOffset, m_postingsOffset, m_postingsEnd;
+};
+
+#endif
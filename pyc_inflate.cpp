@@ -0,0 +1,531 @@
+#include "pyc_inflate.h"
+#include <cstring>
+
+namespace {
+
+const int MAX_BITS = 15;
+const int MAX_LITLEN_CODES = 286;
+const int MAX_DIST_CODES = 30;
+
+/* 一级查找表的位数：不超过该长度的编码一次查表即可解出，更长的编码按规范 Huffman 逐位比较 */
+const int FAST_BITS = 10;
+const unsigned FAST_MASK = (1u << FAST_BITS) - 1;
+
+/* decode() 的特殊返回值 */
+const int SYM_NEED_INPUT = -1;
+const int SYM_INVALID = -2;
+
+const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+const uint8_t CODE_LENGTH_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+}
+
+/* 一级查找表项为 (码长 << 9) | 符号，0 表示需要走逐位比较的慢速路径 */
+struct PycInflater::Table {
+    uint16_t fast[1 << FAST_BITS];
+    uint16_t count[MAX_BITS + 1];
+    uint16_t symbol[288];
+
+    /* 由各符号的码长构造解码表；返回值小于 0 表示码长超额，大于 0 表示编码不完整 */
+    int build(const uint8_t* length, int n)
+    {
+        memset(fast, 0, sizeof(fast));
+        memset(count, 0, sizeof(count));
+        for (int sym = 0; sym < n; ++sym)
+            count[length[sym]]++;
+        if (count[0] == n)
+            return 0;
+
+        int left = 1;
+        for (int len = 1; len <= MAX_BITS; ++len) {
+            left <<= 1;
+            left -= count[len];
+            if (left < 0)
+                return left;
+        }
+
+        uint16_t offs[MAX_BITS + 1];
+        unsigned next[MAX_BITS + 1];
+        offs[1] = 0;
+        next[1] = 0;
+        for (int len = 1; len < MAX_BITS; ++len) {
+            offs[len + 1] = offs[len] + count[len];
+            next[len + 1] = (next[len] + count[len]) << 1;
+        }
+        for (int sym = 0; sym < n; ++sym) {
+            int len = length[sym];
+            if (len == 0)
+                continue;
+            symbol[offs[len]++] = (uint16_t)sym;
+            unsigned code = next[len]++;
+            if (len > FAST_BITS)
+                continue;
+            // 编码按从高位到低位的顺序写入位流，查表用的是位流中的低位，需要反转
+            unsigned reversed = 0;
+            for (int i = 0; i < len; ++i)
+                reversed |= ((code >> i) & 1) << (len - 1 - i);
+            for (unsigned i = reversed; i <= FAST_MASK; i += 1u << len)
+                fast[i] = (uint16_t)((len << 9) | sym);
+        }
+        return left;
+    }
+};
+
+namespace {
+
+struct FixedTables {
+    PycInflater::Table lencode, distcode;
+
+    FixedTables()
+    {
+        uint8_t lengths[288];
+        int sym = 0;
+        for (; sym < 144; ++sym)
+            lengths[sym] = 8;
+        for (; sym < 256; ++sym)
+            lengths[sym] = 9;
+        for (; sym < 280; ++sym)
+            lengths[sym] = 7;
+        for (; sym < 288; ++sym)
+            lengths[sym] = 8;
+        lencode.build(lengths, 288);
+        for (sym = 0; sym < 30; ++sym)
+            lengths[sym] = 5;
+        distcode.build(lengths, 30);
+    }
+};
+
+const FixedTables& fixed_tables()
+{
+    static const FixedTables tables;
+    return tables;
+}
+
+}
+
+PycInflater::PycInflater(std::string& out, Format format, size_t limit)
+    : m_out(out), m_start(out.size()), m_limit(limit), m_format(format),
+      m_status(STATUS_NEED_INPUT), m_trailing(0), m_in(nullptr), m_inEnd(nullptr),
+      m_bitBuf(0), m_bitCount(0), m_state(format == FORMAT_ZLIB ? ZLIB_HEADER : BLOCK_HEADER),
+      m_lastBlock(false), m_storedLeft(0), m_nlen(0), m_ndist(0), m_ncode(0), m_index(0),
+      m_lencode(nullptr), m_distcode(nullptr), m_dynamic(nullptr)
+{
+}
+
+PycInflater::~PycInflater()
+{
+    delete[] m_dynamic;
+}
+
+void PycInflater::fail(const char* message)
+{
+    m_status = STATUS_ERROR;
+    m_error = message;
+}
+
+/* 从当前输入段补充位缓冲，直到缓冲中超过 56 位或输入用完 */
+void PycInflater::refill()
+{
+    while (m_bitCount <= 56 && m_in != m_inEnd) {
+        m_bitBuf |= (uint64_t)*m_in++ << m_bitCount;
+        m_bitCount += 8;
+    }
+}
+
+bool PycInflater::need(int bits)
+{
+    if (m_bitCount < bits)
+        refill();
+    return m_bitCount >= bits;
+}
+
+unsigned PycInflater::take(int bits)
+{
+    unsigned value = (unsigned)(m_bitBuf & ((1u << bits) - 1));
+    m_bitBuf >>= bits;
+    m_bitCount -= bits;
+    return value;
+}
+
+int PycInflater::decode(const Table& table)
+{
+    if (m_bitCount < MAX_BITS)
+        refill();
+
+    unsigned entry = table.fast[m_bitBuf & FAST_MASK];
+    if (entry) {
+        int len = (int)(entry >> 9);
+        if (len > m_bitCount)
+            return SYM_NEED_INPUT;
+        take(len);
+        return (int)(entry & 0x1FF);
+    }
+
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; ++len) {
+        if (len > m_bitCount)
+            return SYM_NEED_INPUT;
+        code |= (int)((m_bitBuf >> (len - 1)) & 1);
+        int count = table.count[len];
+        if (code - count < first) {
+            take(len);
+            return table.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return SYM_INVALID;
+}
+
+bool PycInflater::copyMatch(unsigned length, unsigned distance)
+{
+    size_t produced = m_out.size() - m_start;
+    if (distance > produced) {
+        fail("距离超出已解压的数据");
+        return false;
+    }
+    if (length > m_limit - produced) {
+        fail("解压后的数据超过大小上限");
+        return false;
+    }
+    size_t pos = m_out.size();
+    m_out.resize(pos + length);
+    char* dst = &m_out[pos];
+    const char* src = dst - distance;
+    if (distance >= length) {
+        memcpy(dst, src, length);
+    } else {
+        // 源与目标重叠时逐字节复制，重复最近的 distance 个字节
+        for (unsigned i = 0; i < length; ++i)
+            dst[i] = src[i];
+    }
+    return true;
+}
+
+bool PycInflater::buildTables()
+{
+    if (m_lengths[256] == 0) {
+        fail("缺少块结束符");
+        return false;
+    }
+    // 只有一个码的编码是允许的不完整编码
+    int err = m_dynamic[0].build(m_lengths, m_nlen);
+    if (err < 0 || (err > 0 && m_nlen - m_dynamic[0].count[0] != 1)) {
+        fail("字面量/长度编码无效");
+        return false;
+    }
+    err = m_dynamic[1].build(m_lengths + m_nlen, m_ndist);
+    if (err < 0 || (err > 0 && m_ndist - m_dynamic[1].count[0] != 1)) {
+        fail("距离编码无效");
+        return false;
+    }
+    m_lencode = &m_dynamic[0];
+    m_distcode = &m_dynamic[1];
+    return true;
+}
+
+PycInflater::Status PycInflater::feed(const void* data, size_t size)
+{
+    if (m_status != STATUS_NEED_INPUT)
+        return m_status;
+
+    m_in = (const unsigned char*)data;
+    m_inEnd = m_in + size;
+    run();
+    if (m_status == STATUS_DONE) {
+        // 位缓冲中整字节的部分同样没有用到
+        m_trailing = (size_t)(m_inEnd - m_in) + (size_t)(m_bitCount / 8);
+        if (m_trailing > size)
+            m_trailing = size;
+    }
+    m_in = m_inEnd = nullptr;
+    return m_status;
+}
+
+/* 每一步要么完整执行，要么在输入不足时恢复到这一步开始时的位置并返回；
+ * 恢复后把当前输入段剩余的字节全部收进位缓冲（不足一步所需，必定放得下），
+ * 下次 feed() 从同一步重新开始 */
+void PycInflater::run()
+{
+    uint64_t savedBuf = 0;
+    int savedCount = 0;
+    const unsigned char* savedIn = nullptr;
+    auto save = [&] {
+        savedBuf = m_bitBuf;
+        savedCount = m_bitCount;
+        savedIn = m_in;
+    };
+    auto suspend = [&] {
+        m_bitBuf = savedBuf;
+        m_bitCount = savedCount;
+        m_in = savedIn;
+        refill();
+    };
+
+    for (;;) {
+        save();
+        switch (m_state) {
+        case ZLIB_HEADER: {
+            if (!need(16))
+                return suspend();
+            unsigned cmf = take(8), flg = take(8);
+            if ((cmf & 0x0F) != 8 || (cmf >> 4) > 7)
+                return fail("不是 zlib 数据（压缩方法无效）");
+            if (((cmf << 8) | flg) % 31 != 0)
+                return fail("zlib 头校验失败");
+            if (flg & 0x20)
+                return fail("不支持带预设字典的 zlib 数据");
+            m_state = BLOCK_HEADER;
+            break;
+        }
+
+        case BLOCK_HEADER: {
+            if (!need(3))
+                return suspend();
+            m_lastBlock = take(1) != 0;
+            switch (take(2)) {
+            case 0:
+                m_state = STORED_HEADER;
+                break;
+            case 1:
+                m_lencode = &fixed_tables().lencode;
+                m_distcode = &fixed_tables().distcode;
+                m_state = CODES;
+                break;
+            case 2:
+                m_state = TABLE_SIZES;
+                break;
+            default:
+                return fail("无效的块类型");
+            }
+            break;
+        }
+
+        case STORED_HEADER: {
+            // 丢弃当前字节中剩余的位
+            take(m_bitCount & 7);
+            if (!need(32))
+                return suspend();
+            unsigned len = take(16), nlen = take(16);
+            if (len != (~nlen & 0xFFFF))
+                return fail("未压缩块的长度校验失败");
+            if (len > m_limit - (m_out.size() - m_start))
+                return fail("解压后的数据超过大小上限");
+            m_storedLeft = len;
+            m_state = STORED_COPY;
+            break;
+        }
+
+        case STORED_COPY: {
+            // 先取位缓冲中已有的整字节，其余直接从输入复制
+            while (m_storedLeft && m_bitCount >= 8) {
+                m_out.push_back((char)take(8));
+                --m_storedLeft;
+            }
+            size_t count = (size_t)(m_inEnd - m_in);
+            if (count > m_storedLeft)
+                count = m_storedLeft;
+            m_out.append((const char*)m_in, count);
+            m_in += count;
+            m_storedLeft -= count;
+            if (m_storedLeft)
+                return;
+            m_state = m_lastBlock ? (m_format == FORMAT_ZLIB ? ZLIB_TRAILER : FINISHED) : BLOCK_HEADER;
+            break;
+        }
+
+        case TABLE_SIZES: {
+            if (!need(14))
+                return suspend();
+            m_nlen = (int)take(5) + 257;
+            m_ndist = (int)take(5) + 1;
+            m_ncode = (int)take(4) + 4;
+            if (m_nlen > MAX_LITLEN_CODES || m_ndist > MAX_DIST_CODES)
+                return fail("动态块的编码数量无效");
+            if (!m_dynamic)
+                m_dynamic = new Table[2];
+            m_index = 0;
+            m_state = TABLE_CODE_LENGTHS;
+            break;
+        }
+
+        case TABLE_CODE_LENGTHS: {
+            while (m_index < m_ncode) {
+                if (!need(3))
+                    return;
+                m_lengths[CODE_LENGTH_ORDER[m_index++]] = (uint8_t)take(3);
+            }
+            for (int i = m_ncode; i < 19; ++i)
+                m_lengths[CODE_LENGTH_ORDER[i]] = 0;
+            if (m_dynamic[0].build(m_lengths, 19) != 0)
+                return fail("码长编码不完整");
+            m_index = 0;
+            m_state = TABLE_LENGTHS;
+            break;
+        }
+
+        case TABLE_LENGTHS: {
+            while (m_index < m_nlen + m_ndist) {
+                save();
+                int sym = decode(m_dynamic[0]);
+                if (sym == SYM_NEED_INPUT)
+                    return suspend();
+                if (sym < 0)
+                    return fail("无效的码长编码");
+                if (sym < 16) {
+                    m_lengths[m_index++] = (uint8_t)sym;
+                    continue;
+                }
+                uint8_t len = 0;
+                int repeat;
+                if (sym == 16) {
+                    if (m_index == 0)
+                        return fail("重复码长之前没有码长");
+                    if (!need(2))
+                        return suspend();
+                    len = m_lengths[m_index - 1];
+                    repeat = 3 + (int)take(2);
+                } else if (sym == 17) {
+                    if (!need(3))
+                        return suspend();
+                    repeat = 3 + (int)take(3);
+                } else {
+                    if (!need(7))
+                        return suspend();
+                    repeat = 11 + (int)take(7);
+                }
+                if (m_index + repeat > m_nlen + m_ndist)
+                    return fail("码长数量过多");
+                while (repeat--)
+                    m_lengths[m_index++] = len;
+            }
+            if (!buildTables())
+                return;
+            m_state = CODES;
+            break;
+        }
+
+        case CODES: {
+            for (;;) {
+                save();
+                int sym = decode(*m_lencode);
+                if (sym == SYM_NEED_INPUT)
+                    return suspend();
+                if (sym < 0)
+                    return fail("无效的 Huffman 编码");
+                if (sym < 256) {
+                    if (m_out.size() - m_start >= m_limit)
+                        return fail("解压后的数据超过大小上限");
+                    m_out.push_back((char)sym);
+                    continue;
+                }
+                if (sym == 256)
+                    break;
+
+                sym -= 257;
+                if (sym >= 29)
+                    return fail("无效的长度编码");
+                if (!need(LENGTH_EXTRA[sym]))
+                    return suspend();
+                unsigned length = LENGTH_BASE[sym] + take(LENGTH_EXTRA[sym]);
+                int dsym = decode(*m_distcode);
+                if (dsym == SYM_NEED_INPUT)
+                    return suspend();
+                if (dsym < 0 || dsym >= 30)
+                    return fail("无效的距离编码");
+                if (!need(DIST_EXTRA[dsym]))
+                    return suspend();
+                unsigned distance = DIST_BASE[dsym] + take(DIST_EXTRA[dsym]);
+                if (!copyMatch(length, distance))
+                    return;
+            }
+            m_state = m_lastBlock ? (m_format == FORMAT_ZLIB ? ZLIB_TRAILER : FINISHED) : BLOCK_HEADER;
+            break;
+        }
+
+        case ZLIB_TRAILER: {
+            take(m_bitCount & 7);
+            if (!need(32))
+                return suspend();
+            uint32_t expected = 0;
+            for (int i = 0; i < 4; ++i)
+                expected = (expected << 8) | take(8);
+            if (pyc_adler32(1, m_out.data() + m_start, m_out.size() - m_start) != expected)
+                return fail("Adler-32 校验失败");
+            m_state = FINISHED;
+            break;
+        }
+
+        case FINISHED:
+            m_status = STATUS_DONE;
+            return;
+        }
+    }
+}
+
+uint32_t pyc_adler32(uint32_t adler, const void* data, size_t size)
+{
+    const uint32_t MOD = 65521;
+    // 5552 是保证 32 位累加不溢出的最大块长
+    const size_t BLOCK = 5552;
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (size) {
+        size_t n = size < BLOCK ? size : BLOCK;
+        size -= n;
+        while (n--) {
+            a += *p++;
+            b += a;
+        }
+        a %= MOD;
+        b %= MOD;
+    }
+    return (b << 16) | a;
+}
+
+static bool inflate_all(PycInflater::Format format, const void* in, size_t inSize,
+                        std::string& out, std::string& error, size_t sizeHint, size_t limit)
+{
+    size_t start = out.size();
+    if (sizeHint)
+        out.reserve(start + sizeHint);
+    PycInflater inflater(out, format, limit);
+    PycInflater::Status status = inflater.feed(in, inSize);
+    if (status == PycInflater::STATUS_DONE)
+        return true;
+    error = (status == PycInflater::STATUS_ERROR) ? inflater.error() : "压缩数据不完整";
+    out.resize(start);
+    return false;
+}
+
+bool pyc_inflate(const void* in, size_t inSize, size_t expectedSize,
+                 std::string& out, std::string& error)
+{
+    return inflate_all(PycInflater::FORMAT_RAW, in, inSize, out, error, expectedSize, expectedSize);
+}
+
+bool pyc_zlib_decompress(const void* in, size_t inSize, std::string& out, std::string& error,
+                         size_t sizeHint, size_t limit)
+{
+    return inflate_all(PycInflater::FORMAT_ZLIB, in, inSize, out, error, sizeHint, limit);
+}
@@ -0,0 +1,106 @@
+﻿#ifndef _PYC_INFLATE_H
+#define _PYC_INFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* 表驱动的流式 DEFLATE 解码器（RFC 1951），可选 zlib 封装（RFC 1950）。
+ *
+ * 输入可以分任意多段交给 feed()，每段用完即可释放；解码状态（包括未用完的位）
+ * 保存在对象中。解压结果直接追加到构造时传入的字符串，字符串本身就是
+ * 回溯引用的窗口，因此结果可以原样交给 PycBuffer / loadFromBuffer 解析，无需再复制。
+ * limit 限制解压结果的总大小，超出时视为数据损坏（防止压缩炸弹）。 */
+class PycInflater {
+public:
+    enum Format {
+        FORMAT_RAW,         // zip 成员（压缩方法 8）
+        FORMAT_ZLIB,        // PyInstaller 归档、zlib.compress() 的输出
+    };
+
+    enum Status {
+        STATUS_NEED_INPUT,  // 数据流尚未结束
+        STATUS_DONE,
+        STATUS_ERROR,
+    };
+
+    PycInflater(std::string& out, Format format, size_t limit = SIZE_MAX);
+    ~PycInflater();
+
+    PycInflater(const PycInflater&) = delete;
+    PycInflater& operator=(const PycInflater&) = delete;
+
+    /* 处理一段输入，返回当前状态；结束之后再调用不会读取任何输入 */
+    Status feed(const void* data, size_t size);
+
+    Status status() const { return m_status; }
+    const std::string& error() const { return m_error; }
+
+    /* 数据流结束之后，最后一次 feed() 的输入中没有用到的字节数 */
+    size_t trailing() const { return m_trailing; }
+
+    struct Table;
+
+private:
+    enum State {
+        ZLIB_HEADER,
+        BLOCK_HEADER,
+        STORED_HEADER,
+        STORED_COPY,
+        TABLE_SIZES,
+        TABLE_CODE_LENGTHS,
+        TABLE_LENGTHS,
+        CODES,
+        ZLIB_TRAILER,
+        FINISHED,
+    };
+
+    void run();
+    void refill();
+    bool need(int bits);
+    unsigned take(int bits);
+    int decode(const Table& table);
+    bool buildTables();
+    bool copyMatch(unsigned length, unsigned distance);
+    void fail(const char* message);
+
+    std::string& m_out;
+    size_t m_start;
+    size_t m_limit;
+    Format m_format;
+    Status m_status;
+    std::string m_error;
+    size_t m_trailing;
+
+    // 当前这段输入
+    const unsigned char* m_in;
+    const unsigned char* m_inEnd;
+
+    uint64_t m_bitBuf;
+    int m_bitCount;
+
+    State m_state;
+    bool m_lastBlock;
+    size_t m_storedLeft;
+    int m_nlen, m_ndist, m_ncode, m_index;
+    uint8_t m_lengths[320];
+
+    const Table* m_lencode;
+    const Table* m_distcode;
+    Table* m_dynamic;       // 动态块的两张表，按需分配并在后续块中复用
+};
+
+/* 一次性解压 raw deflate 数据，结果追加到 out。
+ * expectedSize 为预期的解压后大小，用于预分配空间并作为上限。失败时返回 false 并设置 error。 */
+bool pyc_inflate(const void* in, size_t inSize, size_t expectedSize,
+                 std::string& out, std::string& error);
+
+/* 一次性解压 zlib 数据（校验 Adler-32），结果追加到 out；
+ * sizeHint 只用于预分配，limit 为解压结果的上限 */
+bool pyc_zlib_decompress(const void* in, size_t inSize, std::string& out, std::string& error,
+                         size_t sizeHint = 0, size_t limit = SIZE_MAX);
+
+/* Adler-32（zlib 使用的校验和），adler 为之前各段的结果，首段传 1 */
+uint32_t pyc_adler32(uint32_t adler, const void* data, size_t size);
+
+#endif
@@ -1,5 +1,7 @@
 ﻿#include "pyc_module.h"
 #include "data.h"
+#include "pyc_probes.h"
+#include <algorithm>
 #include <stdexcept>
 
 void PycModule::setVersion(unsigned int magic)
@@ -189,6 +191,16 @@ void PycModule::setVersion(unsigned int magic)
     }
 }
 
+bool PycModule::parseMagic(unsigned int magic, int& major, int& minor, bool& unicode)
+{
+    PycModule mod;
+    mod.setVersion(magic);
+    major = mod.m_maj;
+    minor = mod.m_min;
+    unicode = mod.m_unicode;
+    return mod.isValid();
+}
+
 bool PycModule::isSupportedVersion(int major, int minor)
 {
     switch (major) {
@@ -205,62 +217,213 @@ bool PycModule::isSupportedVersion(int major, int minor)
 
 void PycModule::loadFromFile(const char* filename)
 {
+    PYC_PROBE1(module__load__start, filename);
+
+    if (m_lazyLoading) {
+        // 延迟解析的代码对象需要在之后回到输入数据中读取，因此整个文件保留在内存中
+        if (!read_whole_file(filename, m_data)) {
+            pyc_warnf("Error opening file %s\n", filename);
+            PYC_PROBE3(module__load__end, filename, -1, -1);
+            return;
+        }
+        PycBuffer in(m_data.data(), (int)m_data.size());
+        loadFromStream(&in);
+        PYC_PROBE3(module__load__end, filename, m_maj, m_min);
+        return;
+    }
+
     PycFile in(filename);
     if (!in.isOpen()) {
-        fprintf(stderr, "Error opening file %s\n", filename);
+        pyc_warnf("Error opening file %s\n", filename);
+        PYC_PROBE3(module__load__end, filename, -1, -1);
         return;
     }
-    setVersion(in.get32());
+    loadFromStream(&in);
+    PYC_PROBE3(module__load__end, filename, m_maj, m_min);
+}
+
+void PycModule::loadFromBuffer(const void* buffer, int size)
+{
+    PYC_PROBE1(module__load__start, "<buffer>");
+
+    if (m_lazyLoading) {
+        m_data.assign((const char*)buffer, size);
+        buffer = m_data.data();
+    }
+    PycBuffer in(buffer, size);
+    loadFromStream(&in);
+    PYC_PROBE3(module__load__end, "<buffer>", m_maj, m_min);
+}
+
+void PycModule::loadFromStream(PycData* stream)
+{
+    setVersion(stream->get32());
     if (!isValid()) {
-        fputs("Bad MAGIC!\n", stderr);
+        pyc_warn("Bad MAGIC!\n");
         return;
     }
 
     int flags = 0;
     if (verCompare(3, 7) >= 0)
-        flags = in.get32();
+        flags = stream->get32();
 
     if (flags & 0x1) {
         // Optional checksum added in Python 3.7
-        in.get32();
-        in.get32();
+        stream->get32();
+        stream->get32();
     } else {
-        in.get32(); // Timestamp -- who cares?
+        stream->get32(); // Timestamp -- who cares?
 
         if (verCompare(3, 3) >= 0)
-            in.get32(); // Size parameter added in Python 3.3
+            stream->get32(); // Size parameter added in Python 3.3
     }
 
-    m_code = LoadObject(&in, this).cast<PycCode>();
+    m_code = LoadObject(stream, this).cast<PycCode>();
 }
 
 void PycModule::loadFromMarshalledFile(const char* filename, int major, int minor)
 {
+    if (m_lazyLoading) {
+        if (!read_whole_file(filename, m_data)) {
+            pyc_warnf("Error opening file %s\n", filename);
+            return;
+        }
+        PycBuffer in(m_data.data(), (int)m_data.size());
+        loadMarshalledStream(&in, major, minor);
+        return;
+    }
+
     PycFile in (filename);
     if (!in.isOpen()) {
-        fprintf(stderr, "Error opening file %s\n", filename);
+        pyc_warnf("Error opening file %s\n", filename);
         return;
     }
+    loadMarshalledStream(&in, major, minor);
+}
+
+void PycModule::loadFromMarshalledBuffer(const void* buffer, int size, int major, int minor)
+{
+    if (m_lazyLoading) {
+        m_data.assign((const char*)buffer, size);
+        buffer = m_data.data();
+    }
+    PycBuffer in(buffer, size);
+    loadMarshalledStream(&in, major, minor);
+}
+
+PycRef<PycObject> PycModule::loadMarshalledObject(const void* buffer, int size, int major, int minor)
+{
+    if (!isSupportedVersion(major, minor))
+        throw std::runtime_error("不支持的 Python 版本 " + std::to_string(major) + "." + std::to_string(minor));
+    m_maj = major;
+    m_min = minor;
+    m_unicode = (major >= 3);
+    PycBuffer in(buffer, size);
+    return LoadObject(&in, this);
+}
+
+void PycModule::loadMarshalledStream(PycData* stream, int major, int minor)
+{
     if (!isSupportedVersion(major, minor)) {
-        fprintf(stderr, "Unsupported version %d.%d\n", major, minor);
+        pyc_warnf("Unsupported version %d.%d\n", major, minor);
         return;
     }
     m_maj = major;
     m_min = minor;
     m_unicode = (major >= 3);
-    m_code = LoadObject(&in, this).cast<PycCode>();
+    m_code = LoadObject(stream, this).cast<PycCode>();
+}
+
+void PycModule::intern(PycRef<PycString> str)
+{
+    if (m_internCursor >= 0)
+        m_interns[(size_t)m_internCursor++] = std::move(str);
+    else
+        m_interns.emplace_back(std::move(str));
+}
+
+void PycModule::refObject(PycRef<PycObject> obj)
+{
+    if (m_refCursor >= 0)
+        m_refs[(size_t)m_refCursor++] = std::move(obj);
+    else
+        m_refs.emplace_back(std::move(obj));
 }
 
-PycRef<PycString> PycModule::getIntern(int ref) const
+PycRef<PycString> PycModule::getIntern(int ref)
 {
-    if (ref < 0 || (size_t)ref >= m_interns.size())
+    // 只能引用在当前位置之前出现的字符串，与一次性加载时的范围相同
+    if (ref < 0 || ref >= nextIntern())
         throw std::out_of_range("Intern index out of range");
+    if (m_interns[(size_t)ref] == NULL)
+        materializeSlot(true, ref);
     return m_interns[(size_t)ref];
 }
 
-PycRef<PycObject> PycModule::getRef(int ref) const
+PycRef<PycObject> PycModule::getRef(int ref)
 {
-    if (ref < 0 || (size_t)ref >= m_refs.size())
+    if (ref < 0 || ref >= nextRef())
         throw std::out_of_range("Ref index out of range");
+    if (m_refs[(size_t)ref] == NULL)
+        materializeSlot(false, ref);
     return m_refs[(size_t)ref];
 }
+
+void PycModule::reserveRef()
+{
+    if (m_refCursor >= 0)
+        ++m_refCursor;
+    else
+        m_refs.emplace_back();
+}
+
+void PycModule::reserveIntern()
+{
+    if (m_internCursor >= 0)
+        ++m_internCursor;
+    else
+        m_interns.emplace_back();
+}
+
+int PycModule::nextRef() const
+{
+    return m_refCursor >= 0 ? m_refCursor : (int)m_refs.size();
+}
+
+int PycModule::nextIntern() const
+{
+    return m_internCursor >= 0 ? m_internCursor : (int)m_interns.size();
+}
+
+PycModule::SlotCursor PycModule::seekSlots(int ref, int intern)
+{
+    SlotCursor saved = { m_refCursor, m_internCursor };
+    m_refCursor = ref;
+    m_internCursor = intern;
+    return saved;
+}
+
+void PycModule::materializeSlot(bool intern, int index)
+{
+    // 占位的编号属于某个尚未解析的代码对象；解析它（其中更深的代码对象仍可能延迟），
+    // 直到该编号被填入为止
+    for (;;) {
+        m_lazyCodes.erase(std::remove_if(m_lazyCodes.begin(), m_lazyCodes.end(),
+                                         [](const PycRef<PycCode>& code) { return !code->isLazy(); }),
+                          m_lazyCodes.end());
+
+        PycRef<PycCode> owner;
+        for (const auto& code : m_lazyCodes) {
+            if (code->lazyOwns(intern, index)) {
+                owner = code;
+                break;
+            }
+        }
+        if (owner == NULL)
+            throw std::out_of_range(intern ? "Intern index out of range" : "Ref index out of range");
+        owner->materialize();
+        if ((intern ? (PycObject*)m_interns[(size_t)index] : (PycObject*)m_refs[(size_t)index]) != NULL)
+            return;
+    }
+}
+
@@ -2,6 +2,7 @@
 #define _PYC_MODULE_H
 
 #include "pyc_code.h"
+#include <string>
 #include <vector>
 
 enum PycMagic {
@@ -42,12 +43,34 @@ enum PycMagic {
 
 class PycModule {
 public:
-    PycModule() : m_maj(-1), m_min(-1), m_unicode(false) { }
+    PycModule()
+        : m_maj(-1), m_min(-1), m_unicode(false), m_lazyLoading(false),
+          m_codeDepth(0), m_refCursor(-1), m_internCursor(-1) { }
+
+    /* 延迟加载：顶层以外的代码对象在加载时只记录位置并跳过，
+     * 首次访问其内容（通常经由 PycCode::getConst）时才解析。
+     * 须在 loadFrom*() 之前设置；启用后模块会保留一份输入数据。 */
+    void setLazyLoading(bool lazy) { m_lazyLoading = lazy; }
+    bool lazyLoading() const { return m_lazyLoading; }
 
     void loadFromFile(const char* filename);
+    void loadFromBuffer(const void* buffer, int size);
     void loadFromMarshalledFile(const char *filename, int major, int minor);
+    void loadFromMarshalledBuffer(const void* buffer, int size, int major, int minor);
+
+    /* 按给定版本读取任意一个序列化对象（例如 PyInstaller PYZ 归档的目录），
+     * 不设置模块代码；读取失败时抛出异常 */
+    PycRef<PycObject> loadMarshalledObject(const void* buffer, int size, int major, int minor);
     bool isValid() const { return (m_maj >= 0) && (m_min >= 0); }
 
+    /* 只设置版本号，供不经过 loadFrom*() 直接读取 marshal 数据的调用者使用（见 PycSkimmer） */
+    void setVersion(int major, int minor, bool unicode)
+    {
+        m_maj = major;
+        m_min = minor;
+        m_unicode = unicode;
+    }
+
     int majorVer() const { return m_maj; }
     int minorVer() const { return m_min; }
 
@@ -72,16 +95,43 @@ public:
 
     PycRef<PycCode> code() const { return m_code; }
 
-    void intern(PycRef<PycString> str) { m_interns.emplace_back(std::move(str)); }
-    PycRef<PycString> getIntern(int ref) const;
+    void intern(PycRef<PycString> str);
+    PycRef<PycString> getIntern(int ref);
+
+    void refObject(PycRef<PycObject> obj);
+    PycRef<PycObject> getRef(int ref);
+
+    /* 以下供延迟加载使用。
+     * 被跳过的代码对象中的引用 (FLAG_REF) 和 intern 字符串先占住编号，
+     * 解析时再按原来的顺序填入，保证 TYPE_OBREF / TYPE_STRINGREF 的编号与一次性加载时完全相同。 */
+    struct SlotCursor {
+        int ref, intern;
+    };
 
-    void refObject(PycRef<PycObject> obj) { m_refs.emplace_back(std::move(obj)); }
-    PycRef<PycObject> getRef(int ref) const;
+    bool deferCode() const { return m_lazyLoading && m_codeDepth > 0; }
+    void enterCode() { ++m_codeDepth; }
+    void leaveCode() { --m_codeDepth; }
+
+    void reserveRef();
+    void reserveIntern();
+    int nextRef() const;
+    int nextIntern() const;
+
+    void registerLazy(PycRef<PycCode> code) { m_lazyCodes.emplace_back(std::move(code)); }
+    const std::string& lazyData() const { return m_data; }
+
+    SlotCursor seekSlots(int ref, int intern);
+    void restoreSlots(const SlotCursor& cursor) { m_refCursor = cursor.ref; m_internCursor = cursor.intern; }
 
     static bool isSupportedVersion(int major, int minor);
 
+    /* 由文件头的 magic 得到版本号，无法识别时返回 false */
+    static bool parseMagic(unsigned int magic, int& major, int& minor, bool& unicode);
+
 private:
     void setVersion(unsigned int magic);
+    void loadFromStream(PycData* stream);
+    void loadMarshalledStream(PycData* stream, int major, int minor);
 
 private:
     int m_maj, m_min;
@@ -90,6 +140,14 @@ private:
     PycRef<PycCode> m_code;
     std::vector<PycRef<PycString>> m_interns;
     std::vector<PycRef<PycObject>> m_refs;
+
+    bool m_lazyLoading;
+    int m_codeDepth;
+    int m_refCursor, m_internCursor;    // 填入已占位编号时的写入位置，-1 表示追加
+    std::string m_data;
+    std::vector<PycRef<PycCode>> m_lazyCodes;
+
+    void materializeSlot(bool intern, int index);
 };
 
 #endif
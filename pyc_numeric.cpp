@@ -1,6 +1,7 @@
 ﻿#include "pyc_numeric.h"
 #include "pyc_module.h"
 #include "data.h"
+#include "pyc_hash.h"
 #include <cstring>
 
 #ifdef _MSC_VER
@@ -13,6 +14,12 @@ void PycInt::load(PycData* stream, PycModule*)
     m_value = stream->get32();
 }
 
+void PycInt::hash(PycHasher& hasher) const
+{
+    hasher.updateInt(type());
+    hasher.updateInt(m_value);
+}
+
 
 /* PycLong */
 void PycLong::load(PycData* stream, PycModule*)
@@ -35,6 +42,14 @@ void PycLong::load(PycData* stream, PycModule*)
     }
 }
 
+void PycLong::hash(PycHasher& hasher) const
+{
+    hasher.updateInt(type());
+    hasher.updateInt(m_size);
+    for (int digit : m_value)
+        hasher.updateInt(digit);
+}
+
 bool PycLong::isEqual(PycRef<PycObject> obj) const
 {
     if (type() != obj.type())
@@ -109,6 +124,13 @@ void PycFloat::load(PycData* stream, PycModule*)
         stream->getBuffer(len, &m_value.front());
 }
 
+void PycFloat::hash(PycHasher& hasher) const
+{
+    hasher.updateInt(type());
+    hasher.updateInt((int64_t)m_value.size());
+    hasher.update(m_value);
+}
+
 bool PycFloat::isEqual(PycRef<PycObject> obj) const
 {
     if (type() != obj.type())
@@ -133,6 +155,13 @@ void PycComplex::load(PycData* stream, PycModule* mod)
         stream->getBuffer(len, &m_imag.front());
 }
 
+void PycComplex::hash(PycHasher& hasher) const
+{
+    PycFloat::hash(hasher);
+    hasher.updateInt((int64_t)m_imag.size());
+    hasher.update(m_imag);
+}
+
 bool PycComplex::isEqual(PycRef<PycObject> obj) const
 {
     if (!PycFloat::isEqual(obj))
@@ -150,6 +179,14 @@ void PycCFloat::load(PycData* stream, PycModule*)
     memcpy(&m_value, &bits, sizeof(bits));
 }
 
+void PycCFloat::hash(PycHasher& hasher) const
+{
+    Pyc_INT64 bits;
+    memcpy(&bits, &m_value, sizeof(bits));
+    hasher.updateInt(type());
+    hasher.updateInt(bits);
+}
+
 
 /* PycCComplex */
 void PycCComplex::load(PycData* stream, PycModule* mod)
@@ -158,3 +195,11 @@ void PycCComplex::load(PycData* stream, PycModule* mod)
     Pyc_INT64 bits = stream->get64();
     memcpy(&m_imag, &bits, sizeof(bits));
 }
+
+void PycCComplex::hash(PycHasher& hasher) const
+{
+    PycCFloat::hash(hasher);
+    Pyc_INT64 bits;
+    memcpy(&bits, &m_imag, sizeof(bits));
+    hasher.updateInt(bits);
+}
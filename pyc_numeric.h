@@ -18,6 +18,7 @@ public:
     }
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     int value() const { return m_value; }
 
@@ -33,6 +34,7 @@ public:
     bool isEqual(PycRef<PycObject> obj) const override;
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     int size() const { return m_size; }
     const std::vector<int>& value() const { return m_value; }
@@ -52,6 +54,7 @@ public:
     bool isEqual(PycRef<PycObject> obj) const override;
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     const char* value() const { return m_value.c_str(); }
 
@@ -67,6 +70,7 @@ public:
     bool isEqual(PycRef<PycObject> obj) const override;
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     const char* imag() const { return m_imag.c_str(); }
 
@@ -86,6 +90,7 @@ public:
     }
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     double value() const { return m_value; }
 
@@ -105,6 +110,7 @@ public:
     }
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     double imag() const { return m_imag; }
 
@@ -2,14 +2,28 @@
 #include "pyc_module.h"
 #include "pyc_numeric.h"
 #include "pyc_code.h"
+#include "pyc_sequence.h"
 #include "data.h"
+#include "pyc_probes.h"
+#include "pyc_hash.h"
+#include <climits>
+#include <cstdint>
 #include <cstdio>
+#include <stdexcept>
+#include <vector>
 
-PycRef<PycObject> Pyc_None = new PycObject(PycObject::TYPE_NONE);
-PycRef<PycObject> Pyc_Ellipsis = new PycObject(PycObject::TYPE_ELLIPSIS);
-PycRef<PycObject> Pyc_StopIteration = new PycObject(PycObject::TYPE_STOPITER);
-PycRef<PycObject> Pyc_False = new PycObject(PycObject::TYPE_FALSE);
-PycRef<PycObject> Pyc_True = new PycObject(PycObject::TYPE_TRUE);
+static PycObject* make_singleton(int type)
+{
+    PycObject* obj = new PycObject(type);
+    obj->setImmortal();
+    return obj;
+}
+
+PycRef<PycObject> Pyc_None = make_singleton(PycObject::TYPE_NONE);
+PycRef<PycObject> Pyc_Ellipsis = make_singleton(PycObject::TYPE_ELLIPSIS);
+PycRef<PycObject> Pyc_StopIteration = make_singleton(PycObject::TYPE_STOPITER);
+PycRef<PycObject> Pyc_False = make_singleton(PycObject::TYPE_FALSE);
+PycRef<PycObject> Pyc_True = make_singleton(PycObject::TYPE_TRUE);
 
 PycRef<PycObject> CreateObject(int type)
 {
@@ -63,27 +77,538 @@ PycRef<PycObject> CreateObject(int type)
     case PycObject::TYPE_FROZENSET:
         return new PycSet(type);
     default:
-        fprintf(stderr, "CreateObject: Got unsupported type 0x%X\n", type);
+        pyc_warnf("CreateObject: Got unsupported type 0x%X\n", type);
         return NULL;
     }
 }
 
+static unsigned s_loadDepthLimit = MAX_LOAD_DEPTH;
+
+void SetLoadDepthLimit(unsigned limit)
+{
+    s_loadDepthLimit = (limit == 0 || limit > MAX_LOAD_DEPTH) ? MAX_LOAD_DEPTH : limit;
+}
+
+unsigned GetLoadDepthLimit()
+{
+    return s_loadDepthLimit;
+}
+
+static void check_load_depth(size_t depth)
+{
+    if (depth >= s_loadDepthLimit) {
+        char message[80];
+        snprintf(message, sizeof(message), "对象嵌套超过 %u 层", s_loadDepthLimit);
+        throw std::runtime_error(message);
+    }
+}
+
+namespace {
+
+/* LoadObject() / LoadContents() 的显式栈。
+ * 每个尚未读完的容器或代码对象占一帧，栈顶的帧总是在等待下一个嵌套对象；
+ * 嵌套对象读完后交给栈顶的帧，帧读完时出栈，它的对象再交给下一帧。
+ * 对象在读到类型字节时创建并登记引用，与递归解析时的引用编号相同 */
+class ObjectLoader {
+public:
+    ObjectLoader(PycData* stream, PycModule* mod) : m_stream(stream), m_mod(mod) { }
+
+    ~ObjectLoader()
+    {
+        // 因异常退出时恢复代码对象的嵌套深度
+        for (const Frame& frame : m_stack) {
+            if (frame.kind == FRAME_CODE)
+                m_mod->leaveCode();
+        }
+    }
+
+    ObjectLoader(const ObjectLoader&) = delete;
+    ObjectLoader& operator=(const ObjectLoader&) = delete;
+
+    /* 读取 obj 的内容，obj 没有嵌套对象时返回 false */
+    bool begin(const PycRef<PycObject>& obj);
+
+    /* 读取下一个对象；它有嵌套对象时 opened 为 true，此时它的帧已在栈顶 */
+    PycRef<PycObject> read(bool& opened);
+
+    /* 读完栈中的所有帧，返回最底层的对象 */
+    PycRef<PycObject> run();
+
+private:
+    enum FrameKind { FRAME_SEQUENCE, FRAME_DICT, FRAME_CODE };
+
+    struct Frame {
+        FrameKind kind;
+        PycRef<PycObject> obj;
+        int state;                  // 序列：剩余元素数；代码对象：当前字段
+        PycRef<PycObject> key;      // 字典：已读出、等待值的键
+
+        Frame(FrameKind kind, PycRef<PycObject> obj, int state)
+            : kind(kind), obj(std::move(obj)), state(state) { }
+    };
+
+    /* 把读完的对象交给栈顶的帧，帧因此读完时返回 true */
+    bool deliver(PycRef<PycObject> value);
+
+    PycData* m_stream;
+    PycModule* m_mod;
+    std::vector<Frame> m_stack;
+};
+
+bool ObjectLoader::begin(const PycRef<PycObject>& obj)
+{
+    switch (obj.type()) {
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        {
+            PycRef<PycSimpleSequence> seq = obj.cast<PycSimpleSequence>();
+            seq->loadSize(m_stream);
+            if (seq->size() <= 0)
+                return false;
+            check_load_depth(m_stack.size());
+            m_stack.emplace_back(FRAME_SEQUENCE, obj, seq->size());
+            seq->setLoading(true);
+        }
+        return true;
+    case PycObject::TYPE_DICT:
+        // 字典以空键结束，至少还要读一个对象
+        check_load_depth(m_stack.size());
+        m_stack.emplace_back(FRAME_DICT, obj, 0);
+        obj.cast<PycDict>()->setLoading(true);
+        return true;
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        {
+            check_load_depth(m_stack.size());
+            PycRef<PycCode> code = obj.cast<PycCode>();
+            // 先入栈再读取文件头，文件头出错时由析构函数恢复嵌套深度
+            m_mod->enterCode();
+            m_stack.emplace_back(FRAME_CODE, obj, PycCode::FIELD_NONE);
+            code->setLoading(true);
+            code->loadHeader(m_stream, m_mod);
+            m_stack.back().state = code->nextField(PycCode::FIELD_NONE, m_stream, m_mod);
+        }
+        return true;
+    default:
+        obj->load(m_stream, m_mod);
+        return false;
+    }
+}
+
+PycRef<PycObject> ObjectLoader::read(bool& opened)
+{
+    opened = false;
+    int type = m_stream->getByte();
+    PYC_PROBE1(object__load, type & 0x7F);
+
+    if (type == PycObject::TYPE_OBREF)
+        return m_mod->getRef(m_stream->get32());
+
+    PycRef<PycObject> obj = CreateObject(type & 0x7F);
+    if (obj == NULL)
+        return obj;
+    if (type & 0x80)
+        m_mod->refObject(obj);
+    if ((obj.type() == PycObject::TYPE_CODE || obj.type() == PycObject::TYPE_CODE2)
+            && m_mod->deferCode())
+        obj.cast<PycCode>()->defer(m_stream, m_mod);
+    else
+        opened = begin(obj);
+    return obj;
+}
+
+bool ObjectLoader::deliver(PycRef<PycObject> value)
+{
+    Frame& frame = m_stack.back();
+    switch (frame.kind) {
+    case FRAME_SEQUENCE:
+        frame.obj.cast<PycSimpleSequence>()->append(std::move(value));
+        return --frame.state == 0;
+    case FRAME_DICT:
+        if (frame.key == NULL) {
+            if (value == NULL)
+                return true;
+            frame.key = std::move(value);
+        } else {
+            frame.obj.cast<PycDict>()->append(std::move(frame.key), std::move(value));
+            frame.key = NULL;
+        }
+        return false;
+    case FRAME_CODE:
+        {
+            PycRef<PycCode> code = frame.obj.cast<PycCode>();
+            code->setField(frame.state, std::move(value));
+            frame.state = code->nextField(frame.state, m_stream, m_mod);
+            return frame.state == PycCode::FIELD_END;
+        }
+    }
+    return false;
+}
+
+PycRef<PycObject> ObjectLoader::run()
+{
+    for (;;) {
+        bool opened;
+        PycRef<PycObject> value = read(opened);
+        if (opened)
+            continue;
+        while (deliver(std::move(value))) {
+            // 读完之后才允许缓存结构哈希；因异常中止的帧保持读取中的状态
+            value = std::move(m_stack.back().obj);
+            switch (m_stack.back().kind) {
+            case FRAME_SEQUENCE:
+                value.cast<PycSimpleSequence>()->setLoading(false);
+                break;
+            case FRAME_DICT:
+                value.cast<PycDict>()->setLoading(false);
+                break;
+            case FRAME_CODE:
+                value.cast<PycCode>()->setLoading(false);
+                m_mod->leaveCode();
+                break;
+            }
+            m_stack.pop_back();
+            if (m_stack.empty())
+                return value;
+        }
+    }
+}
+
+}
+
 PycRef<PycObject> LoadObject(PycData* stream, PycModule* mod)
 {
-    int type = stream->getByte();
-    PycRef<PycObject> obj;
+    ObjectLoader loader(stream, mod);
+    bool opened;
+    PycRef<PycObject> obj = loader.read(opened);
+    if (opened)
+        loader.run();
+    return obj;
+}
+
+void LoadContents(PycObject* obj, PycData* stream, PycModule* mod)
+{
+    ObjectLoader loader(stream, mod);
+    if (loader.begin(obj))
+        loader.run();
+}
+
+/* 长度为负数说明输入格式错误，与读到文件结尾同样处理；过大的长度在读到结尾时报错 */
+static void skip_bytes(PycData* stream, int64_t count)
+{
+    if (count < 0)
+        throw std::runtime_error("SkipObject(): Unexpected end of input");
+    char buffer[256];
+    while (count > 0) {
+        int chunk = count < (int64_t)sizeof(buffer) ? (int)count : (int)sizeof(buffer);
+        stream->getBuffer(chunk, buffer);
+        count -= chunk;
+    }
+}
+
+namespace {
+
+/* SkipObject() / SkipContents() / SkimObject() 的显式栈，结构与 ObjectLoader 相同，只是不创建对象。
+ * 有 observer 时输入必须是 m_buffer，字符串以视图交给 observer */
+class ObjectSkipper {
+public:
+    ObjectSkipper(PycData* stream, PycModule* mod)
+        : m_stream(stream), m_buffer(nullptr), m_mod(mod), m_observer(nullptr) { }
+    ObjectSkipper(PycBuffer* stream, PycModule* mod, PycSkipObserver& observer)
+        : m_stream(stream), m_buffer(stream), m_mod(mod), m_observer(&observer) { }
+
+    bool begin(int kind);
+    bool read(bool& opened);
+    void run();
+
+private:
+    struct Frame {
+        int kind;
+        int state;                  // 序列：剩余元素数；字典：是否在等待值；代码对象：当前字段
+        int field;                  // 容器所在代码对象的字段，报告给 observer
+    };
+
+    int field() const;
+    void push(int kind, int state);
+    void skipString(int64_t size);
+    bool deliver(bool present);
+
+    PycData* m_stream;
+    PycBuffer* m_buffer;
+    PycModule* m_mod;
+    PycSkipObserver* m_observer;
+    std::vector<Frame> m_stack;
+};
+
+int ObjectSkipper::field() const
+{
+    if (m_stack.empty())
+        return PycCode::FIELD_NONE;
+    const Frame& frame = m_stack.back();
+    if (frame.kind == PycObject::TYPE_CODE || frame.kind == PycObject::TYPE_CODE2)
+        return frame.state;
+    return frame.field;
+}
+
+void ObjectSkipper::push(int kind, int state)
+{
+    check_load_depth(m_stack.size());
+    int current = field();
+    m_stack.push_back(Frame{kind, state, current});
+}
+
+void ObjectSkipper::skipString(int64_t size)
+{
+    if (!m_observer) {
+        skip_bytes(m_stream, size);
+        return;
+    }
+    if (size < 0 || size > INT_MAX)
+        throw std::runtime_error("SkimObject(): Unexpected end of input");
+    const char* data = (const char*)m_buffer->view((int)size);
+    m_observer->string(data, (int)size, field());
+}
+
+bool ObjectSkipper::begin(int kind)
+{
+    switch (kind) {
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        {
+            int count = (kind == PycObject::TYPE_SMALL_TUPLE) ? m_stream->getByte() : m_stream->get32();
+            if (count <= 0)
+                return false;
+            push(kind, count);
+        }
+        return true;
+    case PycObject::TYPE_DICT:
+        push(kind, 0);
+        return true;
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        PycCode::skipHeader(m_stream, m_mod);
+        push(kind, PycCode::nextField(PycCode::FIELD_NONE, m_stream, m_mod, nullptr));
+        return true;
+    }
+
+    switch (kind) {
+    case PycObject::TYPE_INT:
+        m_stream->get32();
+        break;
+    case PycObject::TYPE_STRINGREF:
+        {
+            int index = m_stream->get32();
+            if (m_observer)
+                m_observer->reference(kind, index, field());
+        }
+        break;
+    case PycObject::TYPE_INT64:
+    case PycObject::TYPE_BINARY_FLOAT:
+        skip_bytes(m_stream, 8);
+        break;
+    case PycObject::TYPE_BINARY_COMPLEX:
+        skip_bytes(m_stream, 16);
+        break;
+    case PycObject::TYPE_FLOAT:
+        skip_bytes(m_stream, m_stream->getByte());
+        break;
+    case PycObject::TYPE_COMPLEX:
+        skip_bytes(m_stream, m_stream->getByte());
+        skip_bytes(m_stream, m_stream->getByte());
+        break;
+    case PycObject::TYPE_LONG:
+        {
+            // 在 int64_t 中计算，-INT_MIN 和过大的位数不会溢出
+            int64_t size = m_stream->get32();
+            skip_bytes(m_stream, (size >= 0 ? size : -size) * 2);
+        }
+        break;
+    case PycObject::TYPE_STRING:
+    case PycObject::TYPE_UNICODE:
+    case PycObject::TYPE_ASCII:
+        skipString(m_stream->get32());
+        break;
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_ASCII_INTERNED:
+        skipString(m_stream->get32());
+        if (!m_observer)
+            m_mod->reserveIntern();
+        break;
+    case PycObject::TYPE_SHORT_ASCII:
+        skipString(m_stream->getByte());
+        break;
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        skipString(m_stream->getByte());
+        if (!m_observer)
+            m_mod->reserveIntern();
+        break;
+    default:
+        // 单例对象没有内容
+        break;
+    }
+    return false;
+}
 
+bool ObjectSkipper::read(bool& opened)
+{
+    opened = false;
+    int type = m_stream->getByte();
     if (type == PycObject::TYPE_OBREF) {
-        int index = stream->get32();
-        obj = mod->getRef(index);
-    } else {
-        obj = CreateObject(type & 0x7F);
-        if (obj != NULL) {
-            if (type & 0x80)
-                mod->refObject(obj);
-            obj->load(stream, mod);
+        int index = m_stream->get32();
+        if (m_observer)
+            m_observer->reference(type, index, field());
+        return true;
+    }
+
+    int kind = type & 0x7F;
+    switch (kind) {
+    case PycObject::TYPE_NULL:
+        return false;
+    case PycObject::TYPE_NONE:
+    case PycObject::TYPE_FALSE:
+    case PycObject::TYPE_TRUE:
+    case PycObject::TYPE_STOPITER:
+    case PycObject::TYPE_ELLIPSIS:
+    case PycObject::TYPE_INT:
+    case PycObject::TYPE_INT64:
+    case PycObject::TYPE_FLOAT:
+    case PycObject::TYPE_BINARY_FLOAT:
+    case PycObject::TYPE_COMPLEX:
+    case PycObject::TYPE_BINARY_COMPLEX:
+    case PycObject::TYPE_LONG:
+    case PycObject::TYPE_STRING:
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_STRINGREF:
+    case PycObject::TYPE_UNICODE:
+    case PycObject::TYPE_ASCII:
+    case PycObject::TYPE_ASCII_INTERNED:
+    case PycObject::TYPE_SHORT_ASCII:
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_DICT:
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        break;
+    default:
+        // 与 LoadObject() 相同：不支持的类型不读取内容，也不占用引用编号；
+        // 警告在真正解析时由 CreateObject() 给出
+        return false;
+    }
+
+    if (m_observer)
+        m_observer->object(kind, (type & 0x80) != 0, field());
+    else if (type & 0x80)
+        m_mod->reserveRef();
+    opened = begin(kind);
+    return true;
+}
+
+bool ObjectSkipper::deliver(bool present)
+{
+    Frame& frame = m_stack.back();
+    switch (frame.kind) {
+    case PycObject::TYPE_DICT:
+        // 与 PycDict::load() 相同，键为空时结束
+        if (!frame.state && !present)
+            return true;
+        frame.state = !frame.state;
+        return false;
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        frame.state = PycCode::nextField(frame.state, m_stream, m_mod, nullptr);
+        if (frame.state != PycCode::FIELD_END)
+            return false;
+        if (m_observer)
+            m_observer->endCode();
+        return true;
+    default:
+        return --frame.state == 0;
+    }
+}
+
+void ObjectSkipper::run()
+{
+    for (;;) {
+        bool opened;
+        bool present = read(opened);
+        if (opened)
+            continue;
+        while (deliver(present)) {
+            m_stack.pop_back();
+            if (m_stack.empty())
+                return;
+            present = true;
         }
     }
+}
 
-    return obj;
+}
+
+bool SkipObject(PycData* stream, PycModule* mod)
+{
+    ObjectSkipper skipper(stream, mod);
+    bool opened;
+    bool present = skipper.read(opened);
+    if (opened)
+        skipper.run();
+    return present;
+}
+
+void SkipContents(int kind, PycData* stream, PycModule* mod)
+{
+    ObjectSkipper skipper(stream, mod);
+    if (skipper.begin(kind))
+        skipper.run();
+}
+
+bool SkimObject(PycBuffer* stream, PycModule* mod, PycSkipObserver& observer)
+{
+    ObjectSkipper skipper(stream, mod, observer);
+    bool opened;
+    bool present = skipper.read(opened);
+    if (opened)
+        skipper.run();
+    return present;
+}
+
+void PycObject::release()
+{
+    thread_local std::vector<PycObject*> pending;
+    thread_local bool releasing = false;
+
+    if (releasing) {
+        pending.push_back(this);
+        return;
+    }
+    releasing = true;
+    delete this;
+    while (!pending.empty()) {
+        PycObject* obj = pending.back();
+        pending.pop_back();
+        delete obj;
+    }
+    releasing = false;
+}
+
+void PycObject::hash(PycHasher& hasher) const
+{
+    hasher.updateInt(m_type);
+}
+
+void HashObject(PycHasher& hasher, const PycObject* obj)
+{
+    if (obj == NULL)
+        hasher.updateInt(PycObject::TYPE_NULL);
+    else
+        obj->hash(hasher);
 }
@@ -89,7 +89,9 @@ private:
 
 
 class PycData;
+class PycBuffer;
 class PycModule;
+class PycHasher;
 
 /* Please only hold PycObjects inside PycRefs! */
 class PycObject {
@@ -141,15 +143,25 @@ public:
 
     virtual void load(PycData*, PycModule*) { }
 
+    /* 将对象的结构写入哈希：内容相同的对象（不论来自哪个文件）得到相同的结果 */
+    virtual void hash(PycHasher& hasher) const;
+
 private:
     int m_refs;
 
+    /* 删除对象；删除过程中引用计数归零的嵌套对象排队后逐个删除，
+     * 释放嵌套很深的结构也不会递归 */
+    void release();
+
 protected:
     int m_type;
 
 public:
-    void addRef() { ++m_refs; }
-    void delRef() { if (--m_refs == 0) delete this; }
+    /* 引用计数为负表示常驻对象（全局单例），可以被多个线程同时引用，
+     * 普通对象只属于加载它的线程，因此不需要原子操作 */
+    void addRef() { if (m_refs >= 0) ++m_refs; }
+    void delRef() { if (m_refs >= 0 && --m_refs == 0) release(); }
+    void setImmortal() { m_refs = -1; }
 };
 
 template <class _Obj>
@@ -160,6 +172,47 @@ int PycRef<_Obj>::type() const
 
 PycRef<PycObject> CreateObject(int type);
 PycRef<PycObject> LoadObject(PycData* stream, PycModule* mod);
+/* 读过一个对象而不创建它（用于延迟加载），返回值与 LoadObject() 是否得到非空对象一致 */
+bool SkipObject(PycData* stream, PycModule* mod);
+
+/* 读取已创建的对象的内容（类型字节之后的部分），供各类对象的 load() 使用。
+ * 容器和代码对象中嵌套的对象用显式的栈逐层读取，不占用本机调用栈，
+ * 嵌套再深的输入也只会因超过层数上限而失败，不会栈溢出 */
+void LoadContents(PycObject* obj, PycData* stream, PycModule* mod);
+/* 与 LoadContents() 对应的跳过版本，kind 为已读出的类型（不含引用标志） */
+void SkipContents(int kind, PycData* stream, PycModule* mod);
+
+/* SkimObject() 的回调。field 为对象所在代码对象的当前字段（PycCode::Field），
+ * 不在任何代码对象中时为 FIELD_NONE */
+class PycSkipObserver {
+public:
+    virtual ~PycSkipObserver() { }
+
+    /* 读到一个对象，在其内容之前调用；ref 表示对象占用一个引用编号（FLAG_REF） */
+    virtual void object(int kind, bool ref, int field) = 0;
+    /* TYPE_OBREF 或 TYPE_STRINGREF 的编号 */
+    virtual void reference(int kind, int index, int field) = 0;
+    /* 字符串对象的内容，data 指向输入数据，在该对象的 object() 之后调用 */
+    virtual void string(const char* data, int size, int field) = 0;
+    /* 代码对象的最后一个字段之后调用 */
+    virtual void endCode() = 0;
+};
+
+/* 与 SkipObject() 相同的语法和显式栈，把读过的结构报告给 observer（见 pyc_skim.h）。
+ * 引用编号由 observer 自行记录，不在 mod 中占位，mod 只提供版本号 */
+bool SkimObject(PycBuffer* stream, PycModule* mod, PycSkipObserver& observer);
+
+/* 容器和代码对象的最大嵌套层数，超出时抛出 std::runtime_error。
+ * 加载本身不受层数影响，但结构哈希和常量的输出仍是递归的，
+ * 因此层数不能超过 MAX_LOAD_DEPTH（与 CPython 的 MAX_MARSHAL_STACK_DEPTH 相同，
+ * CPython 写出的 pyc 不会更深），0 和更大的值按 MAX_LOAD_DEPTH 处理。
+ * 这两者每层只占几百字节栈空间，2 MB 的栈足够 MAX_LOAD_DEPTH 层。
+ * 反编译嵌套代码对象每层约占 6 KB，由单独的上限限制（见 ASTree.cpp 的 MAX_CODE_NESTING），
+ * 与此设置无关。设置对所有线程生效，须在启动工作线程之前调用 */
+const unsigned MAX_LOAD_DEPTH = 2000;
+void SetLoadDepthLimit(unsigned limit);
+unsigned GetLoadDepthLimit();
+void HashObject(PycHasher& hasher, const PycObject* obj);
 
 /* Static Singleton objects */
 extern PycRef<PycObject> Pyc_None;
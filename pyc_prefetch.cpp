@@ -0,0 +1,112 @@
+﻿#include "pyc_prefetch.h"
+#include "data.h"
+#include <filesystem>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+/* 读取线程主要在等待 I/O，数量不必与 CPU 核心数相同 */
+static const unsigned DEFAULT_READERS = 4;
+
+PycPrefetcher::PycPrefetcher(std::vector<std::string> paths, unsigned readers, uint64_t budget)
+    : m_paths(std::move(paths)), m_slots(m_paths.size()), m_next(0), m_budget(budget),
+      m_buffered(0), m_starved(0), m_stopping(false)
+{
+    if (readers == 0)
+        readers = DEFAULT_READERS;
+    if (readers > m_paths.size())
+        readers = (unsigned)m_paths.size();
+    m_threads.reserve(readers);
+    for (unsigned i = 0; i < readers; ++i)
+        m_threads.emplace_back(&PycPrefetcher::run, this);
+}
+
+PycPrefetcher::~PycPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_space.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void PycPrefetcher::run()
+{
+    for (;;) {
+        size_t index;
+        uint64_t reserved;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_space.wait(lock, [this] {
+                return m_stopping || m_next == m_slots.size()
+                    || m_buffered < m_budget || m_starved > 0;
+            });
+            if (m_stopping || m_next == m_slots.size())
+                return;
+            index = m_next++;
+            m_slots[index].state = SLOT_READING;
+        }
+
+        // 先按文件大小占用预算，读取完成后再按实际大小修正
+        std::error_code ec;
+        uintmax_t size = fs::file_size(m_paths[index], ec);
+        reserved = ec ? 0 : (uint64_t)size;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_slots[index].reserved = reserved;
+            m_buffered += reserved;
+        }
+
+        std::string data, error;
+        bool ok = read_whole_file(m_paths[index].c_str(), data);
+        if (!ok)
+            error = "无法读取文件";
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Slot& slot = m_slots[index];
+            m_buffered = m_buffered - slot.reserved + data.size();
+            slot.reserved = data.size();
+            slot.data = std::move(data);
+            slot.error = std::move(error);
+            slot.state = ok ? SLOT_READY : SLOT_FAILED;
+        }
+        m_ready.notify_all();
+    }
+}
+
+bool PycPrefetcher::take(size_t index, std::string& data, std::string& error)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Slot& slot = m_slots[index];
+    if (slot.state == SLOT_TAKEN) {
+        // 预读的内容已经交出，直接读取
+        lock.unlock();
+        if (!read_whole_file(m_paths[index].c_str(), data)) {
+            error = "无法读取文件";
+            return false;
+        }
+        return true;
+    }
+
+    if (slot.state == SLOT_PENDING) {
+        ++m_starved;
+        m_space.notify_all();
+        m_ready.wait(lock, [&slot] { return slot.state != SLOT_PENDING; });
+        --m_starved;
+    }
+    m_ready.wait(lock, [&slot] { return slot.state == SLOT_READY || slot.state == SLOT_FAILED; });
+
+    bool ok = slot.state == SLOT_READY;
+    data = std::move(slot.data);
+    error = std::move(slot.error);
+    slot.data = std::string();
+    slot.state = SLOT_TAKEN;
+    m_buffered -= slot.reserved;
+    slot.reserved = 0;
+    lock.unlock();
+    m_space.notify_all();
+    return ok;
+}
@@ -0,0 +1,68 @@
+﻿#ifndef _PYC_PREFETCH_H
+#define _PYC_PREFETCH_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* 输入预读。
+ * 若干读取线程按顺序把文件整个读入内存，反编译线程通过 take() 取走内容，
+ * 文件读取因此与加载、BuildFromCode 和输出重叠，反编译线程不会阻塞在慢速存储的 I/O 上。
+ * 已读入但尚未取走的数据总量不超过 budget（单个文件超过预算时仍会读取，但此时只预读这一个）；
+ * 反编译线程需要的文件还没有开始读取时，预读不受预算限制，避免互相等待。 */
+class PycPrefetcher {
+public:
+    /* readers 为 0 时使用默认的读取线程数 */
+    PycPrefetcher(std::vector<std::string> paths, unsigned readers, uint64_t budget);
+
+    /* 停止预读并等待读取线程退出，未取走的数据直接丢弃 */
+    ~PycPrefetcher();
+
+    PycPrefetcher(const PycPrefetcher&) = delete;
+    PycPrefetcher& operator=(const PycPrefetcher&) = delete;
+
+    size_t size() const { return m_paths.size(); }
+    const std::string& path(size_t index) const { return m_paths[index]; }
+
+    /* 取得第 index 个文件的内容，必要时等待读取完成。
+     * 预读的内容只交出一次，再次取同一个文件时在调用线程中重新读取 */
+    bool take(size_t index, std::string& data, std::string& error);
+
+private:
+    enum SlotState {
+        SLOT_PENDING,
+        SLOT_READING,
+        SLOT_READY,
+        SLOT_FAILED,
+        SLOT_TAKEN,
+    };
+
+    struct Slot {
+        SlotState state;
+        uint64_t reserved;      // 计入预算的字节数
+        std::string data;
+        std::string error;
+
+        Slot() : state(SLOT_PENDING), reserved(0) { }
+    };
+
+    void run();
+
+    std::vector<std::string> m_paths;
+    std::vector<Slot> m_slots;
+    size_t m_next;              // 下一个要读取的文件
+    uint64_t m_budget;
+    uint64_t m_buffered;        // 已读入或正在读取、尚未取走的字节数
+    size_t m_starved;           // 正在等待尚未开始读取的文件的 take() 调用数
+    bool m_stopping;
+
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::condition_variable m_space;
+    std::vector<std::thread> m_threads;
+};
+
+#endif
@@ -0,0 +1,40 @@
+﻿#ifndef _PYC_PROBES_H
+#define _PYC_PROBES_H
+
+/* USDT 静态跟踪点（provider 名为 "pycdc"），可用 bpftrace / perf 在运行中的进程上挂载，
+ * 例如：bpftrace -e 'usdt:./pycdc:pycdc:decompyle__start { printf("%s\n", str(arg0)); }'
+ * 未挂载时每个跟踪点只是一条 nop 指令；构建环境没有 <sys/sdt.h> 时全部展开为空。 */
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define PYC_PROBE0(name) DTRACE_PROBE(pycdc, name)
+#define PYC_PROBE1(name, a1) DTRACE_PROBE1(pycdc, name, a1)
+#define PYC_PROBE2(name, a1, a2) DTRACE_PROBE2(pycdc, name, a1, a2)
+#define PYC_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(pycdc, name, a1, a2, a3)
+
+#else
+
+#define PYC_PROBE0(name) ((void)0)
+#define PYC_PROBE1(name, a1) ((void)0)
+#define PYC_PROBE2(name, a1, a2) ((void)0)
+#define PYC_PROBE3(name, a1, a2, a3) ((void)0)
+
+#endif
+
+/* 跟踪点一览：
+ *   module__load__start   (const char* filename)
+ *   module__load__end     (const char* filename, int major, int minor)
+ *   object__load          (int marshal_type)
+ *   build__start          (const char* code_name, int code_length)
+ *   build__end            (const char* code_name, int clean)
+ *   decompyle__start      (const char* code_name)
+ *   decompyle__end        (const char* code_name)
+ *   decompyle__reuse      (const char* code_name)  结构相同的代码对象复用了已有的输出
+ *   print__start          (const char* code_name)
+ *   print__end            (const char* code_name)
+ *   output__flush         (const char* filename)
+ */
+
+#endif
@@ -0,0 +1,295 @@
+﻿#include "pyc_pyinstaller.h"
+#include "pyc_inflate.h"
+#include "pyc_module.h"
+#include "pyc_numeric.h"
+#include "pyc_sequence.h"
+#include "pyc_string.h"
+#include "data.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char COOKIE_MAGIC[8] = { 'M', 'E', 'I', '\014', '\013', '\012', '\013', '\016' };
+
+/* PyInstaller 2.0 以前的 cookie 只有前 24 字节，之后增加了 64 字节的 Python 动态库名 */
+const size_t COOKIE_SIZE_OLD = 24;
+const size_t COOKIE_SIZE = 88;
+
+const size_t TOC_ENTRY_HEADER = 18;
+
+/* 解压后大小未知时的上限，防止压缩炸弹 */
+const size_t MAX_UNKNOWN_SIZE = 256 * 1024 * 1024;
+
+uint32_t get_be32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+uint32_t get_le32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int int_value(PycRef<PycObject> obj)
+{
+    // 早期版本的目录用布尔值表示是否为包
+    if (obj.type() == PycObject::TYPE_TRUE || obj.type() == PycObject::TYPE_FALSE)
+        return obj.type() == PycObject::TYPE_TRUE ? 1 : 0;
+    PycRef<PycInt> value = obj.try_cast<PycInt>();
+    if (value == NULL)
+        throw std::runtime_error("PYZ 目录格式无效");
+    return value->value();
+}
+
+}
+
+size_t PycPyInstaller::findCookie(const std::string& data)
+{
+    // cookie 之后可能还有数字签名等数据，从后向前查找
+    const unsigned char* base = (const unsigned char*)data.data();
+    for (size_t pos = data.size() >= COOKIE_SIZE_OLD ? data.size() - COOKIE_SIZE_OLD + 1 : 0;
+         pos-- > 0; ) {
+        if (base[pos] == 'M' && memcmp(base + pos, COOKIE_MAGIC, sizeof(COOKIE_MAGIC)) == 0)
+            return pos;
+    }
+    return std::string::npos;
+}
+
+bool PycPyInstaller::open(const std::string& path, std::string& error)
+{
+    std::string data;
+    if (!read_whole_file(path.c_str(), data)) {
+        error = "无法读取文件";
+        return false;
+    }
+    return openBuffer(std::move(data), error);
+}
+
+bool PycPyInstaller::openBuffer(std::string data, std::string& error)
+{
+    m_data = std::move(data);
+    m_modules.clear();
+    m_pyzData.clear();
+    m_otherEntries = 0;
+
+    size_t cookie = findCookie(m_data);
+    if (cookie == std::string::npos) {
+        error = "不是 PyInstaller 可执行文件（找不到 CArchive cookie）";
+        return false;
+    }
+
+    const unsigned char* base = (const unsigned char*)m_data.data();
+    const unsigned char* p = base + cookie;
+    uint64_t length = get_be32(p + 8);
+    uint64_t tocOffset = get_be32(p + 12);
+    uint64_t tocLength = get_be32(p + 16);
+    uint32_t pyvers = get_be32(p + 20);
+
+    size_t cookieSize = COOKIE_SIZE_OLD;
+    if (cookie + COOKIE_SIZE <= m_data.size()) {
+        std::string libname((const char*)p + COOKIE_SIZE_OLD, COOKIE_SIZE - COOKIE_SIZE_OLD);
+        if (libname.find("python") != std::string::npos || libname.find("Python") != std::string::npos)
+            cookieSize = COOKIE_SIZE;
+    }
+
+    // 记录的长度包括 cookie 本身，归档从 cookie 结尾向前 length 字节处开始
+    if (length > cookie + cookieSize || tocOffset > length || tocLength > length - tocOffset) {
+        error = "CArchive cookie 损坏";
+        return false;
+    }
+    uint64_t start = cookie + cookieSize - length;
+
+    // 3.10 之后的版本记为 major * 100 + minor，之前为 major * 10 + minor
+    if (pyvers >= 100) {
+        m_major = (int)(pyvers / 100);
+        m_minor = (int)(pyvers % 100);
+    } else {
+        m_major = (int)(pyvers / 10);
+        m_minor = (int)(pyvers % 10);
+    }
+
+    return parseToc(start, tocOffset, tocLength, error);
+}
+
+bool PycPyInstaller::parseToc(uint64_t start, uint64_t tocOffset, uint64_t tocLength,
+                              std::string& error)
+{
+    const unsigned char* p = (const unsigned char*)m_data.data() + start + tocOffset;
+    const unsigned char* end = p + tocLength;
+    while (end - p >= (ptrdiff_t)TOC_ENTRY_HEADER) {
+        uint32_t entrySize = get_be32(p);
+        if (entrySize < TOC_ENTRY_HEADER || entrySize > (size_t)(end - p)) {
+            error = "CArchive 目录损坏";
+            return false;
+        }
+
+        Module module;
+        module.offset = start + get_be32(p + 4);
+        module.length = get_be32(p + 8);
+        module.size = get_be32(p + 12);
+        module.compressed = p[16] != 0;
+        module.type = (char)p[17];
+        module.buffer = -1;
+        const char* name = (const char*)p + TOC_ENTRY_HEADER;
+        module.name.assign(name, strnlen(name, entrySize - TOC_ENTRY_HEADER));
+        p += entrySize;
+
+        if (module.offset > m_data.size() || module.length > m_data.size() - module.offset) {
+            error = "CArchive 条目超出文件范围：" + module.name;
+            return false;
+        }
+
+        switch (module.type) {
+        case 's':
+        case 'm':
+        case 'M':
+            m_modules.push_back(std::move(module));
+            break;
+        case 'z':
+        case 'Z':
+            if (!parsePyz(module.name, module.offset, module.length, module.compressed,
+                          module.size, error))
+                return false;
+            break;
+        default:
+            ++m_otherEntries;
+            break;
+        }
+    }
+    return true;
+}
+
+bool PycPyInstaller::parsePyz(const std::string& name, uint64_t offset, uint64_t length,
+                              bool compressed, uint64_t size, std::string& error)
+{
+    const char* data = m_data.data() + offset;
+    int buffer = -1;
+    if (compressed) {
+        std::string inflated;
+        size_t limit = size ? (size_t)size : MAX_UNKNOWN_SIZE;
+        if (!pyc_zlib_decompress(data, (size_t)length, inflated, error, (size_t)size, limit)) {
+            error = name + ": " + error;
+            return false;
+        }
+        m_pyzData.push_back(std::move(inflated));
+        buffer = (int)m_pyzData.size() - 1;
+        data = m_pyzData.back().data();
+        length = m_pyzData.back().size();
+        offset = 0;
+    }
+
+    const unsigned char* p = (const unsigned char*)data;
+    if (length < 12 || memcmp(p, "PYZ\0", 4) != 0) {
+        error = name + ": 不是 PYZ 归档";
+        return false;
+    }
+    int major, minor;
+    bool unicode;
+    if (PycModule::parseMagic(get_le32(p + 4), major, minor, unicode) && major >= 0) {
+        m_major = major;
+        m_minor = minor;
+    }
+    uint64_t tocOffset = get_be32(p + 8);
+    if (tocOffset > length) {
+        error = name + ": PYZ 目录位置无效";
+        return false;
+    }
+
+    PycRef<PycObject> toc;
+    try {
+        PycModule loader;
+        toc = loader.loadMarshalledObject(data + tocOffset, (int)(length - tocOffset), m_major, m_minor);
+    } catch (std::exception& ex) {
+        error = name + ": 无法读取 PYZ 目录：" + ex.what();
+        return false;
+    }
+
+    // 目录是 [(名称, (类型, 偏移, 长度)), ...]，早期版本是 {名称: (是否为包, 偏移, 长度)}
+    std::vector<std::pair<PycRef<PycObject>, PycRef<PycObject>>> items;
+    PycRef<PycDict> dict = toc.try_cast<PycDict>();
+    PycRef<PycSequence> list = toc.try_cast<PycSequence>();
+    if (dict != NULL) {
+        for (const auto& item : dict->values())
+            items.emplace_back(std::get<0>(item), std::get<1>(item));
+    } else if (list != NULL) {
+        for (int i = 0; i < list->size(); ++i) {
+            PycRef<PycSequence> pair = list->get(i).try_cast<PycSequence>();
+            if (pair == NULL || pair->size() != 2) {
+                error = name + ": PYZ 目录格式无效";
+                return false;
+            }
+            items.emplace_back(pair->get(0), pair->get(1));
+        }
+    } else {
+        error = name + ": PYZ 目录格式无效";
+        return false;
+    }
+
+    try {
+        for (const auto& item : items) {
+            PycRef<PycString> modname = item.first.try_cast<PycString>();
+            PycRef<PycSequence> info = item.second.try_cast<PycSequence>();
+            if (modname == NULL || info == NULL || info->size() != 3)
+                throw std::runtime_error("PYZ 目录格式无效");
+
+            // 类型：0 模块，1 包，2 数据，3 命名空间包
+            int kind = int_value(info->get(0));
+            Module module;
+            module.name = modname->strValue();
+            module.container = name;
+            module.type = (kind == 1) ? 'p' : 'm';
+            module.offset = offset + (uint32_t)int_value(info->get(1));
+            module.length = (uint32_t)int_value(info->get(2));
+            module.size = 0;
+            module.compressed = true;
+            module.buffer = buffer;
+            if (kind == 2 || kind == 3) {
+                ++m_otherEntries;
+                continue;
+            }
+            if (module.offset - offset > length || module.length > length - (module.offset - offset))
+                throw std::runtime_error("条目超出 PYZ 范围：" + module.name);
+            m_modules.push_back(std::move(module));
+        }
+    } catch (std::exception& ex) {
+        error = name + ": " + ex.what();
+        return false;
+    }
+    return true;
+}
+
+bool PycPyInstaller::read(const Module& module, std::string& storage, const char*& data,
+                          size_t& size, std::string& error) const
+{
+    const std::string& source = (module.buffer < 0) ? m_data : m_pyzData[(size_t)module.buffer];
+    const char* raw = source.data() + module.offset;
+    if (module.compressed) {
+        storage.clear();
+        size_t limit = module.size ? (size_t)module.size : MAX_UNKNOWN_SIZE;
+        if (!pyc_zlib_decompress(raw, (size_t)module.length, storage, error, (size_t)module.size, limit)) {
+            // PyInstaller 6.0 以前可以用 --key 加密 PYZ 中的模块
+            if (!module.container.empty())
+                error += "（模块可能已加密）";
+            return false;
+        }
+        data = storage.data();
+        size = storage.size();
+    } else {
+        data = raw;
+        size = (size_t)module.length;
+    }
+
+    // 新版本的 PyInstaller 在 CArchive 的模块中保留了完整的 pyc 文件头，跳过它
+    if (module.type != 's' && module.buffer < 0 && size >= 4 && data[2] == '\r' && data[3] == '\n') {
+        size_t header = (m_major > 3 || (m_major == 3 && m_minor >= 7)) ? 16
+                      : (m_major == 3 && m_minor >= 3) ? 12 : 8;
+        if (size < header) {
+            error = "pyc 文件头不完整";
+            return false;
+        }
+        data += header;
+        size -= header;
+    }
+    return true;
+}
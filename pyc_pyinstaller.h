@@ -0,0 +1,74 @@
+﻿#ifndef _PYC_PYINSTALLER_H
+#define _PYC_PYINSTALLER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* PyInstaller 打包的可执行文件。
+ *
+ * 可执行文件末尾附加了一个 CArchive：末尾附近的 cookie（"MEI\014\013\012\013\016"）
+ * 记录归档的长度、目录位置和打包时的 Python 版本；目录中每个条目有偏移、大小、
+ * 是否经 zlib 压缩、类型和名称。其中：
+ *   's'        入口脚本，序列化的代码对象
+ *   'm' / 'M'  模块 / 包，序列化的代码对象或完整的 pyc（视 PyInstaller 版本而定）
+ *   'z' / 'Z'  PYZ 归档：4 字节 "PYZ\0"、4 字节 pyc magic、4 字节大端目录偏移，
+ *              目录是序列化的 [(模块名, (类型, 偏移, 长度)), ...]（早期版本为 dict），
+ *              每个模块是 zlib 压缩的序列化代码对象
+ * 其余类型（动态库、数据文件、运行时选项等）不含字节码，只列出不处理。
+ *
+ * 序列化的代码对象没有 pyc 文件头，按 PYZ 头中的 magic（没有 PYZ 时按 cookie 中的版本）
+ * 以 loadFromMarshalledBuffer 加载。整个文件一次性读入内存，未压缩的条目直接指向其中的数据。 */
+class PycPyInstaller {
+public:
+    struct Module {
+        std::string name;       // 模块名（PYZ 中为点分名称）
+        std::string container;  // 所在 PYZ 的名称，CArchive 中的条目为空
+        char type;              // CArchive 条目类型；PYZ 中的模块为 'p'（包）或 'm'
+        uint64_t offset;        // 数据在文件中的位置
+        uint64_t length;        // 存储的长度
+        uint64_t size;          // 解压后的长度，未知时为 0
+        bool compressed;
+        int buffer;             // -1 表示数据在文件中，否则为解压后的 PYZ 的编号
+
+        bool isPackage() const { return type == 'M' || type == 'p'; }
+    };
+
+    PycPyInstaller() : m_major(-1), m_minor(-1), m_otherEntries(0) { }
+
+    /* 读入文件并解析 CArchive 与其中的 PYZ */
+    bool open(const std::string& path, std::string& error);
+    bool openBuffer(std::string data, std::string& error);
+
+    /* 数据中是否有 CArchive 的 cookie */
+    static bool isPyInstaller(const std::string& data) { return findCookie(data) != std::string::npos; }
+
+    /* 打包时的 Python 版本（优先取 PYZ 头中的 magic） */
+    int majorVer() const { return m_major; }
+    int minorVer() const { return m_minor; }
+
+    /* 包含字节码的条目：入口脚本、CArchive 中的模块以及所有 PYZ 中的模块 */
+    const std::vector<Module>& modules() const { return m_modules; }
+
+    /* 不包含字节码、被跳过的 CArchive 条目数 */
+    size_t otherEntries() const { return m_otherEntries; }
+
+    /* 取得条目内容，即不带文件头的序列化代码对象（带有 pyc 文件头的条目会跳过文件头）。
+     * 压缩的条目解压到 storage，未压缩的条目直接指向文件数据 */
+    bool read(const Module& module, std::string& storage, const char*& data, size_t& size,
+              std::string& error) const;
+
+private:
+    static size_t findCookie(const std::string& data);
+    bool parseToc(uint64_t start, uint64_t tocOffset, uint64_t tocLength, std::string& error);
+    bool parsePyz(const std::string& name, uint64_t offset, uint64_t length, bool compressed,
+                  uint64_t size, std::string& error);
+
+    std::string m_data;
+    int m_major, m_minor;
+    std::vector<Module> m_modules;
+    size_t m_otherEntries;
+    std::vector<std::string> m_pyzData;     // 经过压缩的 PYZ 解压后的数据
+};
+
+#endif
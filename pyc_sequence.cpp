@@ -1,15 +1,22 @@
 ﻿#include "pyc_sequence.h"
 #include "pyc_module.h"
 #include "data.h"
+#include "pyc_hash.h"
 #include <stdexcept>
 
 /* PycSimpleSequence */
 void PycSimpleSequence::load(PycData* stream, PycModule* mod)
 {
-    m_size = stream->get32();
+    LoadContents(this, stream, mod);
+}
+
+void PycSimpleSequence::loadSize(PycData* stream)
+{
+    if (type() == TYPE_SMALL_TUPLE)
+        m_size = stream->getByte();
+    else
+        m_size = stream->get32();
     m_values.reserve(m_size);
-    for (int i=0; i<m_size; i++)
-        m_values.push_back(LoadObject(stream, mod));
 }
 
 bool PycSimpleSequence::isEqual(PycRef<PycObject> obj) const
@@ -30,32 +37,32 @@ bool PycSimpleSequence::isEqual(PycRef<PycObject> obj) const
     return true;
 }
 
-
-/* PycTuple */
-void PycTuple::load(PycData* stream, PycModule* mod)
+void PycSimpleSequence::hash(PycHasher& hasher) const
 {
-    if (type() == TYPE_SMALL_TUPLE)
-        m_size = stream->getByte();
-    else
-        m_size = stream->get32();
-
-    m_values.resize(m_size);
-    for (int i=0; i<m_size; i++)
-        m_values[i] = LoadObject(stream, mod);
+    if (m_hashState == HASH_BUSY) {
+        // 环：以固定标记代替，保证结果仍然确定
+        hasher.updateInt(-1);
+        return;
+    }
+    if (m_hashState != HASH_DONE) {
+        int state = m_hashState;
+        m_hashState = HASH_BUSY;
+        PycHasher own;
+        own.updateInt(type());
+        own.updateInt((int64_t)m_values.size());
+        for (const auto& value : m_values)
+            HashObject(own, value);
+        m_hash = own.digest();
+        m_hashState = (state == HASH_LOADING) ? HASH_LOADING : HASH_DONE;
+    }
+    hasher.updateInt((int64_t)m_hash);
 }
 
 
 /* PycDict */
 void PycDict::load(PycData* stream, PycModule* mod)
 {
-    PycRef<PycObject> key, val;
-    for (;;) {
-        key = LoadObject(stream, mod);
-        if (key == NULL)
-            break;
-        val = LoadObject(stream, mod);
-        m_values.emplace_back(std::make_tuple(key, val));
-    }
+    LoadContents(this, stream, mod);
 }
 
 bool PycDict::isEqual(PycRef<PycObject> obj) const
@@ -78,3 +85,25 @@ bool PycDict::isEqual(PycRef<PycObject> obj) const
     }
     return true;
 }
+
+void PycDict::hash(PycHasher& hasher) const
+{
+    if (m_hashState == HASH_BUSY) {
+        hasher.updateInt(-1);
+        return;
+    }
+    if (m_hashState != HASH_DONE) {
+        int state = m_hashState;
+        m_hashState = HASH_BUSY;
+        PycHasher own;
+        own.updateInt(type());
+        own.updateInt((int64_t)m_values.size());
+        for (const auto& item : m_values) {
+            HashObject(own, std::get<0>(item));
+            HashObject(own, std::get<1>(item));
+        }
+        m_hash = own.digest();
+        m_hashState = (state == HASH_LOADING) ? HASH_LOADING : HASH_DONE;
+    }
+    hasher.updateInt((int64_t)m_hash);
+}
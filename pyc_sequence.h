@@ -2,6 +2,7 @@
 #define _PYC_SEQUENCE_H
 
 #include "pyc_object.h"
+#include <cstdint>
 #include <tuple>
 #include <vector>
 
@@ -20,25 +21,39 @@ class PycSimpleSequence : public PycSequence {
 public:
     typedef std::vector<PycRef<PycObject>> value_t;
 
-    PycSimpleSequence(int type) : PycSequence(type) { }
+    PycSimpleSequence(int type)
+        : PycSequence(type), m_hash(), m_hashState(HASH_NONE) { }
 
     bool isEqual(PycRef<PycObject> obj) const override;
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     const value_t& values() const { return m_values; }
     PycRef<PycObject> get(int idx) const override { return m_values.at(idx); }
 
+    /* 供 LoadContents() 使用：读取元素个数，元素随后逐个 append() */
+    void loadSize(class PycData* stream);
+    void append(PycRef<PycObject> value) { m_values.push_back(std::move(value)); }
+
+    /* 供 LoadContents() 使用：读取元素期间不缓存结构哈希 */
+    void setLoading(bool loading) { m_hashState = loading ? HASH_LOADING : HASH_NONE; }
+
 protected:
     value_t m_values;
+
+private:
+    // 元素可能经由引用被多处共享甚至构成环，因此结构哈希只计算一次并缓存；
+    // 仍在读取元素的容器（HASH_LOADING）内容还会变化，每次重新计算
+    enum { HASH_NONE, HASH_LOADING, HASH_BUSY, HASH_DONE };
+    mutable uint64_t m_hash;
+    mutable int m_hashState;
 };
 
 class PycTuple : public PycSimpleSequence {
 public:
     typedef PycSimpleSequence::value_t value_t;
     PycTuple(int type = TYPE_TUPLE) : PycSimpleSequence(type) { }
-
-    void load(class PycData* stream, class PycModule* mod) override;
 };
 
 class PycList : public PycSimpleSequence {
@@ -58,16 +73,29 @@ public:
     typedef std::tuple<PycRef<PycObject>, PycRef<PycObject>> item_t;
     typedef std::vector<item_t> value_t;
 
-    PycDict(int type = TYPE_DICT) : PycObject(type) { }
+    PycDict(int type = TYPE_DICT)
+        : PycObject(type), m_hash(), m_hashState(HASH_NONE) { }
 
     bool isEqual(PycRef<PycObject> obj) const override;
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     const value_t& values() const { return m_values; }
 
+    void append(PycRef<PycObject> key, PycRef<PycObject> value)
+    {
+        m_values.emplace_back(std::move(key), std::move(value));
+    }
+
+    void setLoading(bool loading) { m_hashState = loading ? HASH_LOADING : HASH_NONE; }
+
 private:
     value_t m_values;
+
+    enum { HASH_NONE, HASH_LOADING, HASH_BUSY, HASH_DONE };
+    mutable uint64_t m_hash;
+    mutable int m_hashState;
 };
 
 #endif
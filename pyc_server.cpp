@@ -0,0 +1,413 @@
+﻿#include "pyc_server.h"
+#include "ASTree.h"
+#include "bytecode.h"
+#include "utf8out_stream.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/* 单个请求的上限，超过时认为流已损坏 */
+const uint32_t MAX_FRAME_SIZE = 512 * 1024 * 1024;
+
+struct Request {
+    std::string id;
+    std::string path;
+    std::string version;
+    bool source;
+    bool disasm;
+    std::string body;
+
+    Request() : source(true), disasm(false) { }
+};
+
+void parse_request(const std::string& payload, Request& req)
+{
+    size_t pos = 0;
+    while (pos < payload.size()) {
+        size_t eol = payload.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = payload.size();
+        if (eol == pos) {
+            // 空行之后是请求体
+            req.body.assign(payload, eol + 1, std::string::npos);
+            return;
+        }
+
+        std::string line(payload, pos, eol - pos);
+        pos = eol + 1;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("无法解析请求头：" + line);
+        std::string key = line.substr(0, eq), value = line.substr(eq + 1);
+        if (key == "id")
+            req.id = value;
+        else if (key == "path")
+            req.path = value;
+        else if (key == "version")
+            req.version = value;
+        else if (key == "source")
+            req.source = (value != "0");
+        else if (key == "disasm")
+            req.disasm = (value != "0");
+        else
+            throw std::runtime_error("未知的请求字段：" + key);
+    }
+}
+
+/* 头部字段按行分隔，值中不能出现换行 */
+std::string header_value(std::string value)
+{
+    for (char& ch : value) {
+        if (ch == '\n' || ch == '\r')
+            ch = ' ';
+    }
+    return value;
+}
+
+long long elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return (long long)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+void load_module(PycModule& mod, const Request& req)
+{
+    if (!req.version.empty()) {
+        int major, minor;
+        if (sscanf(req.version.c_str(), "%d.%d", &major, &minor) != 2)
+            throw std::runtime_error("无法解析版本字符串 (请使用 x.y 格式)");
+        if (!req.path.empty())
+            mod.loadFromMarshalledFile(req.path.c_str(), major, minor);
+        else
+            mod.loadFromMarshalledBuffer(req.body.data(), (int)req.body.size(), major, minor);
+    } else if (!req.path.empty()) {
+        mod.loadFromFile(req.path.c_str());
+    } else {
+        mod.loadFromBuffer(req.body.data(), (int)req.body.size());
+    }
+    if (!mod.isValid() || mod.code() == NULL)
+        throw std::runtime_error("无法加载输入");
+}
+
+void put_u32(char* bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        bytes[i] = (char)(value >> (i * 8));
+}
+
+uint32_t get_u32(const unsigned char* bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8)
+         | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/* 读取一帧；流正常结束时返回 false 且 error 为空 */
+template <typename ReadExact>
+bool read_frame(ReadExact readExact, std::string& payload, std::string& error)
+{
+    unsigned char header[4];
+    if (!readExact(header, sizeof(header)))
+        return false;
+    uint32_t size = get_u32(header);
+    if (size > MAX_FRAME_SIZE) {
+        error = "请求过大";
+        return false;
+    }
+    payload.resize(size);
+    if (size && !readExact(&payload[0], size)) {
+        error = "请求不完整";
+        return false;
+    }
+    return true;
+}
+
+/* 响应的输出端；同一输出上的多个工作线程通过互斥锁保证帧不交错 */
+class FrameWriter {
+public:
+    virtual ~FrameWriter() { }
+
+    bool write(const std::string& payload)
+    {
+        char header[4];
+        put_u32(header, (uint32_t)payload.size());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return writeAll(header, sizeof(header)) && writeAll(payload.data(), payload.size());
+    }
+
+protected:
+    virtual bool writeAll(const char* data, size_t size) = 0;
+
+private:
+    std::mutex m_mutex;
+};
+
+class StdoutWriter : public FrameWriter {
+protected:
+    bool writeAll(const char* data, size_t size) override
+    {
+        return fwrite(data, 1, size, stdout) == size && fflush(stdout) == 0;
+    }
+};
+
+std::string error_response(const std::string& id, const std::string& error)
+{
+    return "id=" + header_value(id) + "\nstatus=error\nerror=" + header_value(error)
+         + "\nsource=0\ndisasm=0\nwarnings=0\n\n";
+}
+
+#ifndef WIN32
+
+/* 套接字连接：所有引用它的请求处理完之后才关闭 */
+class SocketWriter : public FrameWriter {
+public:
+    explicit SocketWriter(int fd) : m_fd(fd) { }
+    ~SocketWriter() { close(m_fd); }
+
+    int fd() const { return m_fd; }
+
+protected:
+    bool writeAll(const char* data, size_t size) override
+    {
+        while (size) {
+            ssize_t count = send(m_fd, data, size, MSG_NOSIGNAL);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            data += count;
+            size -= (size_t)count;
+        }
+        return true;
+    }
+
+private:
+    int m_fd;
+};
+
+void serve_connection(std::shared_ptr<SocketWriter> conn, PycWorkerPool& pool)
+{
+    int fd = conn->fd();
+    auto readExact = [fd](void* buffer, size_t size) {
+        char* data = (char*)buffer;
+        while (size) {
+            ssize_t count = read(fd, data, size);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            data += count;
+            size -= (size_t)count;
+        }
+        return true;
+    };
+
+    std::string payload, error;
+    while (read_frame(readExact, payload, error)) {
+        auto request = std::make_shared<std::string>(std::move(payload));
+        pool.submit([conn, request] { conn->write(PycServer::handle(*request)); });
+    }
+    if (!error.empty())
+        conn->write(error_response("", error));
+}
+
+#endif
+
+}
+
+PycServer::PycServer(unsigned workers)
+    : m_workers(workers ? workers : PycWorkerPool::defaultSize())
+{
+}
+
+std::string PycServer::handle(const std::string& payload)
+{
+    Request req;
+    std::string error, warnings, source, disasm;
+    int major = -1, minor = -1;
+    long long loadUs = 0, decompileUs = 0, disasmUs = 0;
+
+    {
+        PycWarningCapture capture(warnings);
+        try {
+            parse_request(payload, req);
+
+            auto start = std::chrono::steady_clock::now();
+            PycModule mod;
+            load_module(mod, req);
+            loadUs = elapsed_us(start);
+            major = mod.majorVer();
+            minor = mod.minorVer();
+
+            if (req.source) {
+                start = std::chrono::steady_clock::now();
+                std::ostringstream out;
+                utf8out_stream pyc_output(out);
+                decompyle_reset();
+                decompyle(mod.code(), &mod, pyc_output);
+                pyc_output.flush();
+                source = out.str();
+                decompileUs = elapsed_us(start);
+            }
+            if (req.disasm) {
+                start = std::chrono::steady_clock::now();
+                std::ostringstream out;
+                bc_disasm(out, mod.code(), &mod, 0, Pyc::DISASM_PYCODE_VERBOSE);
+                disasm = out.str();
+                disasmUs = elapsed_us(start);
+            }
+        } catch (std::exception& ex) {
+            error = ex.what();
+        }
+    }
+
+    std::ostringstream response;
+    response << "id=" << header_value(req.id) << "\n";
+    if (error.empty())
+        response << "status=ok\n";
+    else
+        response << "status=error\nerror=" << header_value(error) << "\n";
+    if (major >= 0)
+        response << "version=" << major << "." << minor << "\n";
+    response << "load_us=" << loadUs << "\n"
+             << "decompile_us=" << decompileUs << "\n"
+             << "disasm_us=" << disasmUs << "\n"
+             << "source=" << source.size() << "\n"
+             << "disasm=" << disasm.size() << "\n"
+             << "warnings=" << warnings.size() << "\n\n"
+             << source << disasm << warnings;
+    return response.str();
+}
+
+int PycServer::runStdio()
+{
+#ifdef WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    auto readExact = [](void* buffer, size_t size) {
+        return fread(buffer, 1, size, stdin) == size;
+    };
+
+    StdoutWriter writer;
+    std::string payload, error;
+    {
+        PycWorkerPool pool(m_workers, m_workers * 4);
+        while (read_frame(readExact, payload, error)) {
+            auto request = std::make_shared<std::string>(std::move(payload));
+            pool.submit([&writer, request] { writer.write(handle(*request)); });
+        }
+    }
+
+    if (!error.empty()) {
+        writer.write(error_response("", error));
+        return 1;
+    }
+    return 0;
+}
+
+int PycServer::runSocket(const char* path)
+{
+#ifdef WIN32
+    (void)path;
+    fputs("错误：当前平台不支持 Unix 域套接字，请改用 --serve\n", stderr);
+    return 1;
+#else
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "错误：套接字路径过长：%s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(path);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 64) < 0) {
+        fprintf(stderr, "错误：无法监听套接字 %s：%s\n", path, strerror(errno));
+        close(listener);
+        return 1;
+    }
+
+    // 客户端提前断开时 send() 返回错误即可，不应终止整个服务
+    signal(SIGPIPE, SIG_IGN);
+
+    struct Reader {
+        std::thread thread;
+        std::weak_ptr<SocketWriter> conn;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    PycWorkerPool pool(m_workers, m_workers * 4);
+    std::vector<Reader> readers;
+    int status = 0;
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "错误：接受连接失败：%s\n", strerror(errno));
+            status = 1;
+            break;
+        }
+
+        // 回收已经断开的连接线程
+        for (auto it = readers.begin(); it != readers.end(); ) {
+            if (*it->done) {
+                it->thread.join();
+                it = readers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto conn = std::make_shared<SocketWriter>(fd);
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        Reader reader;
+        reader.conn = conn;
+        reader.done = done;
+        reader.thread = std::thread([conn, done, &pool] {
+            serve_connection(conn, pool);
+            *done = true;
+        });
+        readers.push_back(std::move(reader));
+    }
+
+    // 唤醒仍在等待请求的连接线程，使其能够退出
+    for (auto& reader : readers) {
+        if (auto conn = reader.conn.lock())
+            shutdown(conn->fd(), SHUT_RD);
+        reader.thread.join();
+    }
+    close(listener);
+    unlink(path);
+    return status;
+#endif
+}
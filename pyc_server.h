@@ -0,0 +1,41 @@
+﻿#ifndef _PYC_SERVER_H
+#define _PYC_SERVER_H
+
+#include <string>
+
+/* 常驻反编译服务（pycdc --serve / --serve-socket）。
+ *
+ * 请求与响应都以帧为单位：4 字节小端长度，后跟同样长度的内容。
+ * 请求内容为若干 "键=值" 行，空行之后是输入文件的原始内容：
+ *   id=<字符串>       原样返回，用于在并发时匹配请求与响应
+ *   path=<文件路径>   从文件读取输入，此时忽略请求体
+ *   version=<x.y>    输入是序列化的代码对象而不是 pyc 文件（相当于 -c -v）
+ *   source=0|1       是否返回反编译的源代码（默认 1）
+ *   disasm=0|1       是否返回反汇编（默认 0）
+ *
+ * 响应内容同样是 "键=值" 行加一个空行：
+ *   id, status=ok|error, error=<原因>, version=<x.y>,
+ *   load_us, decompile_us, disasm_us   各阶段耗时（微秒）
+ *   source, disasm, warnings          后面三段文本各自的字节数
+ * 空行之后依次是源代码（不含文件头）、反汇编和警告信息。
+ *
+ * 请求由固定数量的工作线程并发处理，响应按完成的先后顺序返回。 */
+class PycServer {
+public:
+    /* workers 为 0 时按 CPU 核心数创建工作线程 */
+    explicit PycServer(unsigned workers);
+
+    /* 从标准输入读取请求，响应写到标准输出；输入结束且所有请求处理完后返回 */
+    int runStdio();
+
+    /* 在 Unix 域套接字上监听，每个连接都可以连续发送多个请求（仅支持 POSIX 系统） */
+    int runSocket(const char* path);
+
+    /* 处理一个请求，返回响应内容（不含帧长度） */
+    static std::string handle(const std::string& request);
+
+private:
+    unsigned m_workers;
+};
+
+#endif
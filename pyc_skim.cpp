@@ -0,0 +1,138 @@
+﻿#include "pyc_skim.h"
+#include "data.h"
+#include <climits>
+#include <stdexcept>
+
+// 两个枚举的顺序相同，PycSkimVisitor 多出开头的 FIELD_TOP
+static_assert(PycSkimVisitor::FIELD_TOP == PycCode::FIELD_NONE + 1
+              && PycSkimVisitor::FIELD_BYTECODE == PycCode::FIELD_CODE + 1
+              && PycSkimVisitor::FIELD_LINETABLE == PycCode::FIELD_LNTABLE + 1
+              && PycSkimVisitor::FIELD_EXCEPTTABLE == PycCode::FIELD_EXCEPTTABLE + 1,
+              "PycSkimVisitor::Field 与 PycCode::Field 不一致");
+
+static PycSkimVisitor::Field skim_field(int field)
+{
+    return (PycSkimVisitor::Field)(field + 1);
+}
+
+static bool is_string_kind(int kind)
+{
+    switch (kind) {
+    case PycObject::TYPE_STRING:
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_STRINGREF:
+    case PycObject::TYPE_UNICODE:
+    case PycObject::TYPE_ASCII:
+    case PycObject::TYPE_ASCII_INTERNED:
+    case PycObject::TYPE_SHORT_ASCII:
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool PycSkimmer::skim(const void* data, size_t size, PycSkimVisitor& visitor)
+{
+    if (size > INT_MAX)
+        throw std::runtime_error("PycSkimmer: Input too large");
+    PycBuffer in(data, (int)size);
+    int major, minor;
+    bool unicode;
+    if (!PycModule::parseMagic((unsigned)in.get32(), major, minor, unicode))
+        return false;
+    m_mod.setVersion(major, minor, unicode);
+
+    // 文件头的布局见 PycModule::loadFromStream()
+    int flags = 0;
+    if (m_mod.verCompare(3, 7) >= 0)
+        flags = in.get32();
+    if (flags & 0x1) {
+        in.view(8);
+    } else {
+        in.view(4);
+        if (m_mod.verCompare(3, 3) >= 0)
+            in.view(4);
+    }
+
+    run(in, visitor);
+    return true;
+}
+
+void PycSkimmer::skimMarshalled(const void* data, size_t size, int major, int minor,
+                                PycSkimVisitor& visitor)
+{
+    if (size > INT_MAX)
+        throw std::runtime_error("PycSkimmer: Input too large");
+    PycBuffer in(data, (int)size);
+    m_mod.setVersion(major, minor, major >= 3);
+    run(in, visitor);
+}
+
+void PycSkimmer::run(PycBuffer& stream, PycSkimVisitor& visitor)
+{
+    m_visitor = &visitor;
+    m_depth = 0;
+    m_kind = PycObject::TYPE_NULL;
+    m_ref = -1;
+    // clear() 保留已分配的容量，供下一个文件使用
+    m_interns.clear();
+    m_refs.clear();
+    SkimObject(&stream, &m_mod, *this);
+}
+
+void PycSkimmer::report(const PycSkimString& str, int field)
+{
+    if (m_ref >= 0)
+        m_refs[(size_t)m_ref] = str;
+    m_visitor->visitString(str, skim_field(field));
+}
+
+void PycSkimmer::object(int kind, bool ref, int field)
+{
+    // 与 LoadObject() 相同，引用编号在读取内容之前分配
+    m_kind = kind;
+    m_ref = -1;
+    if (ref) {
+        m_ref = (int)m_refs.size();
+        m_refs.push_back(PycSkimString { kind, nullptr, 0 });
+    }
+    if (is_string_kind(kind))
+        return;
+
+    m_visitor->visitObject(kind, skim_field(field));
+    if (kind == PycObject::TYPE_CODE || kind == PycObject::TYPE_CODE2)
+        m_visitor->beginCode(m_depth++);
+}
+
+void PycSkimmer::reference(int kind, int index, int field)
+{
+    if (kind == PycObject::TYPE_STRINGREF) {
+        if (index < 0 || (size_t)index >= m_interns.size())
+            throw std::out_of_range("Intern index out of range");
+        report(m_interns[(size_t)index], field);
+        return;
+    }
+
+    if (index < 0 || (size_t)index >= m_refs.size())
+        throw std::out_of_range("Ref index out of range");
+    const PycSkimString& ref = m_refs[(size_t)index];
+    if (ref.data)
+        m_visitor->visitString(ref, skim_field(field));
+    else
+        m_visitor->visitObject(ref.type, skim_field(field));
+}
+
+void PycSkimmer::string(const char* data, int size, int field)
+{
+    PycSkimString str = { m_kind, data, size };
+    if (m_kind == PycObject::TYPE_INTERNED || m_kind == PycObject::TYPE_ASCII_INTERNED
+            || m_kind == PycObject::TYPE_SHORT_ASCII_INTERNED)
+        m_interns.push_back(str);
+    report(str, field);
+}
+
+void PycSkimmer::endCode()
+{
+    m_visitor->endCode(--m_depth);
+}
@@ -0,0 +1,91 @@
+﻿#ifndef _PYC_SKIM_H
+#define _PYC_SKIM_H
+
+#include "pyc_module.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* 字符串对象在输入数据中的位置，只在 skim() 调用期间有效 */
+struct PycSkimString {
+    int type;               // 对象类型；TYPE_STRINGREF / TYPE_OBREF 为所引用字符串的类型
+    const char* data;
+    int size;
+};
+
+/* 快速扫描的回调接口，默认实现什么也不做 */
+class PycSkimVisitor {
+public:
+    /* 对象在代码对象中所处的字段 */
+    enum Field {
+        FIELD_TOP,          // 顶层对象（通常是模块的代码对象）
+        FIELD_BYTECODE,
+        FIELD_CONSTS,       // 包括嵌套在常量元组、frozenset 中的对象
+        FIELD_NAMES,
+        FIELD_LOCALS,       // varnames / localsplusnames
+        FIELD_LOCALKINDS,
+        FIELD_FREEVARS,
+        FIELD_CELLVARS,
+        FIELD_FILENAME,
+        FIELD_NAME,
+        FIELD_QUALNAME,
+        FIELD_LINETABLE,
+        FIELD_EXCEPTTABLE,
+    };
+
+    virtual ~PycSkimVisitor() { }
+
+    /* 代码对象的开始与结束，depth 为嵌套层数（模块为 0） */
+    virtual void beginCode(int /*depth*/) { }
+    virtual void endCode(int /*depth*/) { }
+
+    virtual void visitString(const PycSkimString& /*str*/, Field /*field*/) { }
+
+    /* 字符串以外的对象，容器在其元素之前报告；引用到的非字符串对象以原类型再报告一次 */
+    virtual void visitObject(int /*type*/, Field /*field*/) { }
+};
+
+/* 按与 LoadObject() 相同的语法遍历 marshal 数据，但不创建任何对象。
+ * 语法和代码对象的字段布局都来自 SkimObject()（与延迟加载共用的显式栈和 PycCode::nextField），
+ * 这里只把结果整理成访问者的回调：字符串以指向输入数据的视图交给访问者，
+ * TYPE_STRINGREF 和指向字符串的 TYPE_OBREF 解析为原字符串的视图。
+ * 同一个 PycSkimmer 反复使用时，引用表的内存会被重用，稳定之后扫描过程不再分配内存。 */
+class PycSkimmer : private PycSkipObserver {
+public:
+    PycSkimmer() : m_visitor(), m_depth(), m_kind(), m_ref(-1) { }
+
+    /* 扫描完整的 pyc 文件内容；magic 无法识别时返回 false。
+     * 输入被截断或格式错误时抛出 std::runtime_error / std::out_of_range */
+    bool skim(const void* data, size_t size, PycSkimVisitor& visitor);
+
+    /* 扫描序列化的代码对象（相当于 -c -v x.y） */
+    void skimMarshalled(const void* data, size_t size, int major, int minor,
+                        PycSkimVisitor& visitor);
+
+    int majorVer() const { return m_mod.majorVer(); }
+    int minorVer() const { return m_mod.minorVer(); }
+    bool isUnicode() const { return m_mod.isUnicode(); }
+
+    /* 当前输入的版本，供按版本解码字节码（bc_next）使用 */
+    PycModule* module() { return &m_mod; }
+
+private:
+    void run(PycBuffer& stream, PycSkimVisitor& visitor);
+    void report(const PycSkimString& str, int field);
+
+    void object(int kind, bool ref, int field) override;
+    void reference(int kind, int index, int field) override;
+    void string(const char* data, int size, int field) override;
+    void endCode() override;
+
+    PycModule m_mod;        // 只设置版本号
+    PycSkimVisitor* m_visitor;
+    int m_depth;
+    int m_kind;             // 最近读到的对象的类型，字符串的内容随后报告
+    int m_ref;              // 最近读到的对象占用的引用编号，-1 表示不占用
+
+    std::vector<PycSkimString> m_interns;
+    std::vector<PycSkimString> m_refs;     // 非字符串对象的 data 为 nullptr
+};
+
+#endif
@@ -1,6 +1,7 @@
 ﻿#include "pyc_string.h"
 #include "pyc_module.h"
 #include "data.h"
+#include "pyc_hash.h"
 #include <stdexcept>
 
 // 检查字符串是否为ASCII编码
@@ -53,6 +54,13 @@ void PycString::load(PycData* stream, PycModule* mod)
     }
 }
 
+void PycString::hash(PycHasher& hasher) const
+{
+    hasher.updateInt(type());
+    hasher.updateInt((int64_t)m_value.size());
+    hasher.update(m_value);
+}
+
 // 比较字符串对象是否相等
 bool PycString::isEqual(PycRef<PycObject> obj) const
 {
@@ -20,6 +20,7 @@ public:
     }
 
     void load(class PycData* stream, class PycModule* mod) override;
+    void hash(PycHasher& hasher) const override;
 
     int length() const { return (int)m_value.size(); }
     const char* value() const { return m_value.c_str(); }
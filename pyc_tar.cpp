@@ -0,0 +1,208 @@
+﻿#include "pyc_tar.h"
+#include <cstring>
+
+namespace {
+
+const size_t BLOCK_SIZE = 512;
+
+const size_t NAME_SIZE = 100;
+const size_t PREFIX_SIZE = 155;
+
+/* 11 位八进制数能表示的最大大小，更大的成员需要在 pax 扩展头中记录 */
+const uint64_t MAX_OCTAL_SIZE = 077777777777ULL;
+
+void put_octal(char* field, size_t width, uint64_t value)
+{
+    // width - 1 位八进制数字，以 NUL 结尾
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i-- > 0; ) {
+        field[i] = (char)('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+/* 把名称拆成 ustar 的 prefix 与 name 两部分，拆分点必须是 '/' */
+bool split_name(const std::string& name, std::string& prefix, std::string& base)
+{
+    if (name.size() <= NAME_SIZE) {
+        prefix.clear();
+        base = name;
+        return true;
+    }
+    size_t limit = name.size() - 1 < PREFIX_SIZE ? name.size() - 1 : PREFIX_SIZE;
+    for (size_t pos = name.rfind('/', limit); pos != std::string::npos && pos > 0;
+         pos = name.rfind('/', pos - 1)) {
+        if (name.size() - pos - 1 > NAME_SIZE)
+            break;
+        if (pos <= PREFIX_SIZE) {
+            prefix = name.substr(0, pos);
+            base = name.substr(pos + 1);
+            return !base.empty();
+        }
+    }
+    return false;
+}
+
+/* pax 记录 "<长度> <键>=<值>\n"，长度包括长度字段本身 */
+std::string pax_record(const std::string& key, const std::string& value)
+{
+    size_t body = key.size() + value.size() + 3;    // 空格、'=' 和换行
+    size_t length = body + 1;
+    while (std::to_string(length).size() + body != length)
+        length = std::to_string(length).size() + body;
+    return std::to_string(length) + " " + key + "=" + value + "\n";
+}
+
+}
+
+PycTarWriter::PycTarWriter() : m_out(nullptr), m_closing(false), m_failed(false) { }
+
+PycTarWriter::~PycTarWriter()
+{
+    stop();
+    if (m_out)
+        fclose(m_out);
+}
+
+bool PycTarWriter::open(const std::string& path, std::string& error)
+{
+    m_out = fopen(path.c_str(), "wb");
+    if (!m_out) {
+        error = "无法创建文件 " + path;
+        return false;
+    }
+    m_buffer.reserve(CHUNK_SIZE + BLOCK_SIZE);
+    m_thread = std::thread(&PycTarWriter::run, this);
+    return true;
+}
+
+void PycTarWriter::appendHeader(const std::string& name, uint64_t size, char type)
+{
+    char header[BLOCK_SIZE];
+    memset(header, 0, sizeof(header));
+
+    std::string prefix, base;
+    if (!split_name(name, prefix, base)) {
+        prefix.clear();
+        base = name.substr(0, NAME_SIZE);
+    }
+    memcpy(header, base.data(), base.size());
+    put_octal(header + 100, 8, 0644);
+    put_octal(header + 108, 8, 0);
+    put_octal(header + 116, 8, 0);
+    put_octal(header + 124, 12, size > MAX_OCTAL_SIZE ? 0 : size);
+    put_octal(header + 136, 12, 0);
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memcpy(header + 345, prefix.data(), prefix.size());
+
+    // 校验和按校验和字段为空格计算，写成 6 位八进制数加 NUL 和空格
+    memset(header + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i)
+        sum += (unsigned char)header[i];
+    put_octal(header + 148, 7, sum);
+    header[155] = ' ';
+
+    m_buffer.append(header, BLOCK_SIZE);
+}
+
+bool PycTarWriter::add(const std::string& name, const void* data, size_t size, std::string& error)
+{
+    if (name.empty()) {
+        error = "成员名称为空";
+        return false;
+    }
+
+    std::string prefix, base, pax;
+    if (!split_name(name, prefix, base))
+        pax += pax_record("path", name);
+    if (size > MAX_OCTAL_SIZE)
+        pax += pax_record("size", std::to_string(size));
+    if (!pax.empty()) {
+        appendHeader("././@PaxHeader", pax.size(), 'x');
+        m_buffer += pax;
+        m_buffer.append((BLOCK_SIZE - pax.size() % BLOCK_SIZE) % BLOCK_SIZE, '\0');
+    }
+
+    appendHeader(name, size, '0');
+    m_buffer.append((const char*)data, size);
+    m_buffer.append((BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE, '\0');
+
+    if (m_buffer.size() >= CHUNK_SIZE)
+        return submit(error);
+    return true;
+}
+
+bool PycTarWriter::submit(std::string& error)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [this] { return m_failed || m_pending.size() < MAX_PENDING; });
+    if (m_failed) {
+        error = "写入归档失败";
+        return false;
+    }
+    m_pending.push_back(std::move(m_buffer));
+    m_buffer = std::string();
+    m_buffer.reserve(CHUNK_SIZE + BLOCK_SIZE);
+    lock.unlock();
+    m_changed.notify_all();
+    return true;
+}
+
+bool PycTarWriter::finish(std::string& error)
+{
+    // 归档以两个全零的块结尾
+    m_buffer.append(2 * BLOCK_SIZE, '\0');
+    bool ok = submit(error);
+    stop();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (ok && m_failed) {
+            error = "写入归档失败";
+            ok = false;
+        }
+    }
+    if (fclose(m_out) != 0 && ok) {
+        error = "写入归档失败";
+        ok = false;
+    }
+    m_out = nullptr;
+    return ok;
+}
+
+void PycTarWriter::stop()
+{
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+}
+
+void PycTarWriter::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_changed.wait(lock, [this] { return m_closing || !m_pending.empty(); });
+        if (m_pending.empty())
+            return;
+
+        std::string chunk = std::move(m_pending.front());
+        m_pending.pop_front();
+        bool failed = m_failed;
+        lock.unlock();
+        m_changed.notify_all();
+        if (!failed && fwrite(chunk.data(), 1, chunk.size(), m_out) != chunk.size())
+            failed = true;
+        lock.lock();
+        if (failed)
+            m_failed = true;
+        m_changed.notify_all();
+    }
+}
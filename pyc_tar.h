@@ -0,0 +1,56 @@
+﻿#ifndef _PYC_TAR_H
+#define _PYC_TAR_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/* 流式写出 POSIX ustar 归档（pycdc --out-tar）。
+ *
+ * 每个成员是 512 字节的文件头加上补齐到 512 字节的内容，不需要中央目录，
+ * 可以边生成边写出，也可以用 tar -x 或 Python 的 tarfile 直接读取。
+ * 名称放不进 ustar 的 name / prefix 字段时，在成员前写一个 pax 扩展头（typeflag 'x'）记录完整路径。
+ * 时间戳、属主等字段固定，内容相同时生成的归档逐字节相同。
+ *
+ * 成员先追加到内存中的缓冲区，攒够 CHUNK_SIZE 后交给专门的写出线程，
+ * 调用者不会阻塞在文件 I/O 上，写出总是大块、顺序的。
+ * 等待写出的缓冲区最多 MAX_PENDING 个，超出时 add() 等待写出线程。 */
+class PycTarWriter {
+public:
+    static const size_t CHUNK_SIZE = 1 << 20;
+    static const size_t MAX_PENDING = 4;
+
+    PycTarWriter();
+    ~PycTarWriter();
+
+    PycTarWriter(const PycTarWriter&) = delete;
+    PycTarWriter& operator=(const PycTarWriter&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    bool add(const std::string& name, const void* data, size_t size, std::string& error);
+
+    /* 写出归档结尾的两个空块，等待写出线程完成并关闭文件 */
+    bool finish(std::string& error);
+
+private:
+    void appendHeader(const std::string& name, uint64_t size, char type);
+    bool submit(std::string& error);
+    void stop();
+    void run();
+
+    FILE* m_out;
+    std::string m_buffer;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<std::string> m_pending;
+    bool m_closing;
+    bool m_failed;              // 写出线程遇到错误，之后的 add() 直接失败
+    std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,423 @@
+﻿#include "pyc_zip.h"
+#include "pyc_inflate.h"
+#include "data.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const uint32_t SIG_LOCAL = 0x04034b50;
+const uint32_t SIG_CENTRAL = 0x02014b50;
+const uint32_t SIG_EOCD = 0x06054b50;
+const uint32_t SIG_ZIP64_EOCD = 0x06064b50;
+const uint32_t SIG_ZIP64_LOCATOR = 0x07064b50;
+
+const size_t LOCAL_HEADER_SIZE = 30;
+const size_t CENTRAL_HEADER_SIZE = 46;
+const size_t EOCD_SIZE = 22;
+const size_t ZIP64_EOCD_SIZE = 56;
+const size_t ZIP64_LOCATOR_SIZE = 20;
+
+const uint16_t FLAG_ENCRYPTED = 0x0001;
+const uint16_t FLAG_UTF8 = 0x0800;
+
+uint16_t get16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint64_t get64(const unsigned char* p)
+{
+    return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+void put16(std::string& out, uint16_t value)
+{
+    out.push_back((char)value);
+    out.push_back((char)(value >> 8));
+}
+
+void put32(std::string& out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back((char)(value >> (i * 8)));
+}
+
+void put64(std::string& out, uint64_t value)
+{
+    put32(out, (uint32_t)value);
+    put32(out, (uint32_t)(value >> 32));
+}
+
+struct CrcTable {
+    uint32_t table[256];
+
+    CrcTable()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+};
+
+}
+
+uint32_t pyc_crc32(uint32_t crc, const void* data, size_t size)
+{
+    static const CrcTable crcTable;
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    while (size--)
+        crc = crcTable.table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+bool PycZipArchive::open(const std::string& path, std::string& error)
+{
+    std::string data;
+    if (!read_whole_file(path.c_str(), data)) {
+        error = "无法读取文件";
+        return false;
+    }
+    return openBuffer(std::move(data), error);
+}
+
+bool PycZipArchive::openBuffer(std::string data, std::string& error)
+{
+    m_data = std::move(data);
+    m_entries.clear();
+    if (!parse(error)) {
+        m_entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool PycZipArchive::parse(std::string& error)
+{
+    const unsigned char* base = (const unsigned char*)m_data.data();
+    size_t total = m_data.size();
+
+    // 中央目录结束记录位于末尾，其后最多有 65535 字节的注释
+    if (total < EOCD_SIZE) {
+        error = "不是 zip 归档";
+        return false;
+    }
+    size_t eocd = total - EOCD_SIZE;
+    size_t lowest = (total > EOCD_SIZE + 0xFFFF) ? total - EOCD_SIZE - 0xFFFF : 0;
+    for (;;) {
+        if (get32(base + eocd) == SIG_EOCD && eocd + EOCD_SIZE + get16(base + eocd + 20) <= total)
+            break;
+        if (eocd == lowest) {
+            error = "不是 zip 归档（找不到中央目录）";
+            return false;
+        }
+        --eocd;
+    }
+
+    uint64_t count = get16(base + eocd + 10);
+    uint64_t cdSize = get32(base + eocd + 12);
+    uint64_t cdOffset = get32(base + eocd + 16);
+    size_t cdEnd = eocd;
+
+    if (eocd >= ZIP64_LOCATOR_SIZE && get32(base + eocd - ZIP64_LOCATOR_SIZE) == SIG_ZIP64_LOCATOR) {
+        uint64_t z64 = get64(base + eocd - ZIP64_LOCATOR_SIZE + 8);
+        size_t located = eocd - ZIP64_LOCATOR_SIZE;
+        // 归档前附加了数据时记录的偏移不准确，此时 zip64 记录紧挨在定位记录之前
+        if (z64 + ZIP64_EOCD_SIZE > located || get32(base + z64) != SIG_ZIP64_EOCD) {
+            if (located < ZIP64_EOCD_SIZE) {
+                error = "zip64 中央目录结束记录损坏";
+                return false;
+            }
+            z64 = located - ZIP64_EOCD_SIZE;
+        }
+        if (get32(base + z64) != SIG_ZIP64_EOCD) {
+            error = "zip64 中央目录结束记录损坏";
+            return false;
+        }
+        count = get64(base + z64 + 32);
+        cdSize = get64(base + z64 + 40);
+        cdOffset = get64(base + z64 + 48);
+        cdEnd = (size_t)z64;
+    }
+
+    if (cdSize > cdEnd) {
+        error = "中央目录大小无效";
+        return false;
+    }
+    if (cdOffset > cdEnd - cdSize) {
+        error = "中央目录位置无效";
+        return false;
+    }
+    // 中央目录紧挨在结束记录之前；实际位置与记录的偏移之差即归档前附加数据的长度
+    uint64_t prefix = cdEnd - cdSize - cdOffset;
+
+    const unsigned char* p = base + cdEnd - cdSize;
+    const unsigned char* end = base + cdEnd;
+    m_entries.reserve((size_t)std::min<uint64_t>(count, cdSize / CENTRAL_HEADER_SIZE));
+    for (uint64_t i = 0; i < count; ++i) {
+        if ((size_t)(end - p) < CENTRAL_HEADER_SIZE || get32(p) != SIG_CENTRAL) {
+            error = "中央目录损坏";
+            return false;
+        }
+        size_t nameLen = get16(p + 28), extraLen = get16(p + 30), commentLen = get16(p + 32);
+        if ((size_t)(end - p) < CENTRAL_HEADER_SIZE + nameLen + extraLen + commentLen) {
+            error = "中央目录损坏";
+            return false;
+        }
+
+        Entry entry;
+        entry.flags = get16(p + 8);
+        entry.method = get16(p + 10);
+        entry.crc = get32(p + 16);
+        entry.compressedSize = get32(p + 20);
+        entry.size = get32(p + 24);
+        entry.localOffset = get32(p + 42);
+        entry.name.assign((const char*)p + CENTRAL_HEADER_SIZE, nameLen);
+
+        // zip64 扩展字段只包含在中央目录中取值为 0xFFFFFFFF 的字段
+        const unsigned char* extra = p + CENTRAL_HEADER_SIZE + nameLen;
+        const unsigned char* extraEnd = extra + extraLen;
+        while (extraEnd - extra >= 4) {
+            uint16_t id = get16(extra), len = get16(extra + 2);
+            const unsigned char* field = extra + 4;
+            if (len > extraEnd - field)
+                break;
+            if (id == 0x0001) {
+                const unsigned char* fieldEnd = field + len;
+                uint64_t* values[] = { &entry.size, &entry.compressedSize, &entry.localOffset };
+                for (uint64_t* value : values) {
+                    if (*value != 0xFFFFFFFF)
+                        continue;
+                    if (fieldEnd - field < 8) {
+                        error = "zip64 扩展字段损坏：" + entry.name;
+                        return false;
+                    }
+                    *value = get64(field);
+                    field += 8;
+                }
+            }
+            extra += 4 + len;
+        }
+
+        entry.localOffset += prefix;
+        m_entries.push_back(std::move(entry));
+        p += CENTRAL_HEADER_SIZE + nameLen + extraLen + commentLen;
+    }
+    return true;
+}
+
+bool PycZipArchive::read(const Entry& entry, std::string& storage, const char*& data,
+                         size_t& size, std::string& error) const
+{
+    const unsigned char* base = (const unsigned char*)m_data.data();
+    uint64_t total = m_data.size();
+
+    if (entry.flags & FLAG_ENCRYPTED) {
+        error = "不支持加密的成员";
+        return false;
+    }
+    if (entry.localOffset > total || total - entry.localOffset < LOCAL_HEADER_SIZE
+            || get32(base + entry.localOffset) != SIG_LOCAL) {
+        error = "本地文件头损坏";
+        return false;
+    }
+    // 本地文件头中的扩展字段可能与中央目录不同，只用它的长度
+    const unsigned char* local = base + entry.localOffset;
+    uint64_t dataOffset = entry.localOffset + LOCAL_HEADER_SIZE + get16(local + 26) + get16(local + 28);
+    if (dataOffset > total || total - dataOffset < entry.compressedSize) {
+        error = "成员数据超出归档范围";
+        return false;
+    }
+    const char* raw = m_data.data() + dataOffset;
+
+    if (entry.method == METHOD_STORED) {
+        if (entry.compressedSize != entry.size) {
+            error = "未压缩成员的大小不一致";
+            return false;
+        }
+        data = raw;
+        size = (size_t)entry.size;
+    } else if (entry.method == METHOD_DEFLATED) {
+        storage.clear();
+        if (!pyc_inflate(raw, (size_t)entry.compressedSize, (size_t)entry.size, storage, error))
+            return false;
+        if (storage.size() != entry.size) {
+            error = "解压后的大小与中央目录不一致";
+            return false;
+        }
+        data = storage.data();
+        size = storage.size();
+    } else {
+        error = "不支持的压缩方法 " + std::to_string(entry.method);
+        return false;
+    }
+
+    if (pyc_crc32(0, data, size) != entry.crc) {
+        error = "CRC 校验失败";
+        return false;
+    }
+    return true;
+}
+
+PycZipWriter::PycZipWriter() : m_out(nullptr), m_offset(0) { }
+
+PycZipWriter::~PycZipWriter()
+{
+    if (m_out)
+        fclose(m_out);
+}
+
+bool PycZipWriter::open(const std::string& path, std::string& error)
+{
+    m_out = fopen(path.c_str(), "wb");
+    if (!m_out) {
+        error = "无法创建文件 " + path;
+        return false;
+    }
+    m_offset = 0;
+    m_records.clear();
+    return true;
+}
+
+bool PycZipWriter::write(const void* data, size_t size, std::string& error)
+{
+    if (fwrite(data, 1, size, m_out) != size) {
+        error = "写入归档失败";
+        return false;
+    }
+    m_offset += size;
+    return true;
+}
+
+bool PycZipWriter::add(const std::string& name, const void* data, size_t size, std::string& error)
+{
+    if (name.size() > 0xFFFF) {
+        error = "成员名称过长：" + name;
+        return false;
+    }
+
+    Record record;
+    record.name = name;
+    record.crc = pyc_crc32(0, data, size);
+    record.size = size;
+    record.offset = m_offset;
+    bool zip64 = size >= 0xFFFFFFFF;
+
+    std::string header;
+    put32(header, SIG_LOCAL);
+    put16(header, zip64 ? 45 : 20);     // 解压所需的版本
+    put16(header, FLAG_UTF8);
+    put16(header, PycZipArchive::METHOD_STORED);
+    put16(header, 0);                   // 时间 00:00:00
+    put16(header, (0 << 9) | (1 << 5) | 1);    // 日期 1980-01-01
+    put32(header, record.crc);
+    put32(header, zip64 ? 0xFFFFFFFF : (uint32_t)size);
+    put32(header, zip64 ? 0xFFFFFFFF : (uint32_t)size);
+    put16(header, (uint16_t)name.size());
+    put16(header, zip64 ? 20 : 0);
+    header += name;
+    if (zip64) {
+        put16(header, 0x0001);
+        put16(header, 16);
+        put64(header, size);
+        put64(header, size);
+    }
+
+    if (!write(header.data(), header.size(), error) || !write(data, size, error))
+        return false;
+    m_records.push_back(std::move(record));
+    return true;
+}
+
+bool PycZipWriter::finish(std::string& error)
+{
+    uint64_t cdOffset = m_offset;
+    std::string cd;
+    for (const Record& record : m_records) {
+        bool bigSize = record.size >= 0xFFFFFFFF;
+        bool bigOffset = record.offset >= 0xFFFFFFFF;
+        std::string extra;
+        if (bigSize) {
+            put64(extra, record.size);
+            put64(extra, record.size);
+        }
+        if (bigOffset)
+            put64(extra, record.offset);
+
+        put32(cd, SIG_CENTRAL);
+        put16(cd, 45);                  // 创建者版本
+        put16(cd, extra.empty() ? 20 : 45);
+        put16(cd, FLAG_UTF8);
+        put16(cd, PycZipArchive::METHOD_STORED);
+        put16(cd, 0);
+        put16(cd, (0 << 9) | (1 << 5) | 1);
+        put32(cd, record.crc);
+        put32(cd, bigSize ? 0xFFFFFFFF : (uint32_t)record.size);
+        put32(cd, bigSize ? 0xFFFFFFFF : (uint32_t)record.size);
+        put16(cd, (uint16_t)record.name.size());
+        put16(cd, extra.empty() ? 0 : (uint16_t)(extra.size() + 4));
+        put16(cd, 0);                   // 注释长度
+        put16(cd, 0);                   // 起始磁盘
+        put16(cd, 0);                   // 内部属性
+        put32(cd, 0);                   // 外部属性
+        put32(cd, bigOffset ? 0xFFFFFFFF : (uint32_t)record.offset);
+        cd += record.name;
+        if (!extra.empty()) {
+            put16(cd, 0x0001);
+            put16(cd, (uint16_t)extra.size());
+            cd += extra;
+        }
+    }
+    if (!write(cd.data(), cd.size(), error))
+        return false;
+
+    uint64_t count = m_records.size();
+    uint64_t cdSize = cd.size();
+    bool zip64 = count >= 0xFFFF || cdSize >= 0xFFFFFFFF || cdOffset >= 0xFFFFFFFF;
+    std::string tail;
+    if (zip64) {
+        uint64_t z64Offset = m_offset;
+        put32(tail, SIG_ZIP64_EOCD);
+        put64(tail, ZIP64_EOCD_SIZE - 12);
+        put16(tail, 45);
+        put16(tail, 45);
+        put32(tail, 0);
+        put32(tail, 0);
+        put64(tail, count);
+        put64(tail, count);
+        put64(tail, cdSize);
+        put64(tail, cdOffset);
+
+        put32(tail, SIG_ZIP64_LOCATOR);
+        put32(tail, 0);
+        put64(tail, z64Offset);
+        put32(tail, 1);
+    }
+    put32(tail, SIG_EOCD);
+    put16(tail, 0);
+    put16(tail, 0);
+    put16(tail, zip64 ? 0xFFFF : (uint16_t)count);
+    put16(tail, zip64 ? 0xFFFF : (uint16_t)count);
+    put32(tail, zip64 ? 0xFFFFFFFF : (uint32_t)cdSize);
+    put32(tail, zip64 ? 0xFFFFFFFF : (uint32_t)cdOffset);
+    put16(tail, 0);
+    if (!write(tail.data(), tail.size(), error))
+        return false;
+
+    bool ok = fclose(m_out) == 0;
+    m_out = nullptr;
+    if (!ok) {
+        error = "写入归档失败";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+﻿#ifndef _PYC_ZIP_H
+#define _PYC_ZIP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* CRC-32（zip / gzip 使用的多项式），crc 为之前各段的结果，首段传 0 */
+uint32_t pyc_crc32(uint32_t crc, const void* data, size_t size);
+
+/* 只读的 zip 归档（包括 wheel、egg 和 zipimport 使用的归档）。
+ * 整个归档一次性读入内存，成员列表取自中央目录；支持 zip64 以及前面附加了其他数据的归档
+ * （例如自解压程序）。成员内容在内存中解压：未压缩的成员直接指向归档数据，不做复制。
+ * 打开之后的所有操作都是只读的，可以在多个线程中同时读取不同的成员。 */
+class PycZipArchive {
+public:
+    enum {
+        METHOD_STORED = 0,
+        METHOD_DEFLATED = 8,
+    };
+
+    struct Entry {
+        std::string name;           // 归档内的路径，以 '/' 分隔
+        uint16_t flags;
+        uint16_t method;
+        uint32_t crc;
+        uint64_t compressedSize;
+        uint64_t size;
+        uint64_t localOffset;       // 本地文件头在归档数据中的位置
+
+        bool isDirectory() const { return !name.empty() && name.back() == '/'; }
+    };
+
+    /* 读入归档文件并解析中央目录 */
+    bool open(const std::string& path, std::string& error);
+
+    /* 解析已在内存中的归档数据 */
+    bool openBuffer(std::string data, std::string& error);
+
+    const std::vector<Entry>& entries() const { return m_entries; }
+
+    /* 取得成员内容，data 和 size 指向结果。未压缩的成员直接指向归档数据，
+     * 压缩的成员解压到 storage 中；两种情况都会校验 CRC */
+    bool read(const Entry& entry, std::string& storage, const char*& data, size_t& size,
+              std::string& error) const;
+
+private:
+    bool parse(std::string& error);
+
+    std::string m_data;
+    std::vector<Entry> m_entries;
+};
+
+/* 顺序写出 zip 归档，成员不压缩。
+ * 成员数量或偏移超出 32 位范围时自动使用 zip64 格式；时间戳固定为 1980-01-01，
+ * 因此内容与顺序相同的输入总是得到逐字节相同的归档。 */
+class PycZipWriter {
+public:
+    PycZipWriter();
+    ~PycZipWriter();
+
+    PycZipWriter(const PycZipWriter&) = delete;
+    PycZipWriter& operator=(const PycZipWriter&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    bool add(const std::string& name, const void* data, size_t size, std::string& error);
+
+    /* 写出中央目录并关闭文件 */
+    bool finish(std::string& error);
+
+private:
+    struct Record {
+        std::string name;
+        uint32_t crc;
+        uint64_t size;
+        uint64_t offset;
+    };
+
+    bool write(const void* data, size_t size, std::string& error);
+
+    FILE* m_out;
+    uint64_t m_offset;
+    std::vector<Record> m_records;
+};
+
+#endif
@@ -3,11 +3,19 @@
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
 #include "pyc_module.h"
+#include "pyc_skim.h"
+#include "pyc_numeric.h"
 #include "bytecode.h"
+#include "data.h"
 
 #ifdef WIN32
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #endif
 
 #ifdef WIN32
@@ -34,11 +42,21 @@ void print_help(const char* argv0)
     std::printf("                 使用此选项时必须同时指定 -v 版本号\n");
     std::printf("  -v <x.y>       指定 Python 版本号 (例如: 3.8, 3.9)\n");
     std::printf("                 当使用 -c 选项加载代码对象时必须指定\n");
+    std::printf("  --skim         快速扫描：不构建对象，只列出版本、代码对象、名称和字符串常量\n");
+    std::printf("                 可以一次指定多个输入文件\n");
+    std::printf("  --consts       以 JSON Lines 格式列出所有字符串、bytes 和数值常量，\n");
+    std::printf("                 以及 names、varnames 表和所属代码对象的限定名；可指定多个文件\n");
+    std::printf("  --jsonl        以 JSON Lines 格式逐条输出指令：代码对象编号、偏移、操作码、\n");
+    std::printf("                 原始与解析后的参数、跳转目标和异常处理偏移；可指定多个文件\n");
+    std::printf("  --packed       与 --jsonl 内容相同的紧凑二进制记录格式\n");
     std::printf("  -h, --help     显示此帮助信息并退出\n");
     std::printf("\n示例:\n");
     std::printf("  %s script.pyc                    # 反汇编单个文件\n", argv0);
     std::printf("  %s -o output.txt script.pyc      # 输出到文件\n", argv0);
     std::printf("  %s -c -v 3.9 codeobj.bin        # 加载编译的代码对象\n", argv0);
+    std::printf("  %s --skim a.pyc b.pyc            # 快速扫描多个文件\n", argv0);
+    std::printf("  %s --consts *.pyc > consts.jsonl # 提取常量\n", argv0);
+    std::printf("  %s --jsonl -o insns.jsonl *.pyc  # 机器可读的反汇编\n", argv0);
     std::printf("\n注意:\n");
     std::printf("  - 支持 Python 2.7 和 3.x 版本的字节码文件\n");
     std::printf("  - 输出包含字节码指令、行号信息和代码对象结构\n");
@@ -94,11 +112,460 @@ public:
 #endif
 };
 
+/* --skim 的输出，每个文件一组以制表符分隔的记录：
+ *   file    <路径>  <x.y>  <代码对象数>  <名称数>  <字符串常量数>
+ *   code    <嵌套层数>  <限定名>
+ *   name    <co_names 中的名称>
+ *   string  <字符串常量>
+ * 控制字符和反斜杠以 \xNN、\\ 转义 */
+class SkimPrinter : public PycSkimVisitor {
+public:
+    void beginCode(int depth) override
+    {
+        m_stack.push_back(m_codes.size());
+        m_codes.emplace_back(depth, std::string());
+    }
+
+    void endCode(int) override { m_stack.pop_back(); }
+
+    void visitString(const PycSkimString& str, Field field) override
+    {
+        switch (field) {
+        case FIELD_NAME:
+            // 3.11 起的 qualname 在 name 之后出现并覆盖它
+        case FIELD_QUALNAME:
+            if (!m_stack.empty())
+                m_codes[m_stack.back()].second.assign(str.data, str.size);
+            break;
+        case FIELD_NAMES:
+            m_names.emplace_back(str.data, str.size);
+            break;
+        case FIELD_CONSTS:
+            m_strings.emplace_back(str.data, str.size);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void print(std::ostream& out, const char* path, int major, int minor)
+    {
+        out << "file\t" << path << "\t" << major << "." << minor << "\t"
+            << m_codes.size() << "\t" << m_names.size() << "\t" << m_strings.size() << "\n";
+        for (const auto& code : m_codes)
+            out << "code\t" << code.first << "\t" << escape(code.second) << "\n";
+        for (const auto& name : m_names)
+            out << "name\t" << escape(name) << "\n";
+        for (const auto& str : m_strings)
+            out << "string\t" << escape(str) << "\n";
+    }
+
+    void clear()
+    {
+        m_stack.clear();
+        m_codes.clear();
+        m_names.clear();
+        m_strings.clear();
+    }
+
+private:
+    static std::string escape(const std::string& str)
+    {
+        static const char hex[] = "0123456789abcdef";
+        std::string result;
+        for (unsigned char ch : str) {
+            if (ch == '\\') {
+                result += "\\\\";
+            } else if (ch < 0x20 || ch == 0x7F) {
+                result += "\\x";
+                result += hex[ch >> 4];
+                result += hex[ch & 0xF];
+            } else {
+                result += (char)ch;
+            }
+        }
+        return result;
+    }
+
+    std::vector<size_t> m_stack;
+    std::vector<std::pair<int, std::string>> m_codes;
+    std::vector<std::string> m_names;
+    std::vector<std::string> m_strings;
+};
+
+static int skim_files(std::ostream& out, const std::vector<const char*>& infiles,
+                      bool marshalled, int major, int minor)
+{
+    PycSkimmer skimmer;
+    SkimPrinter printer;
+    std::string contents;
+    int status = 0;
+    for (const char* infile : infiles) {
+        if (!read_whole_file(infile, contents)) {
+            std::fprintf(stderr, "错误：无法打开文件 %s\n", infile);
+            status = 1;
+            continue;
+        }
+        printer.clear();
+        try {
+            if (marshalled) {
+                skimmer.skimMarshalled(contents.data(), contents.size(), major, minor, printer);
+            } else if (!skimmer.skim(contents.data(), contents.size(), printer)) {
+                std::fprintf(stderr, "错误：无法识别文件 %s 的版本\n", infile);
+                status = 1;
+                continue;
+            }
+        } catch (std::exception& ex) {
+            std::fprintf(stderr, "错误：扫描文件 %s 时出错：%s\n", infile, ex.what());
+            status = 1;
+            continue;
+        }
+        printer.print(out, infile, skimmer.majorVer(), skimmer.minorVer());
+    }
+    return status;
+}
+
+/* --consts 的输出，每行一个 JSON 对象：
+ *   {"file": 路径, "code": 所属代码对象的限定名, "kind": 种类, "value": 值}
+ * kind 为 str、bytes、int、float、complex、name（co_names）或 varname（co_varnames）。
+ * bytes 及 Python 2 的 str 中大于 0x7F 的字节以 \u00XX 表示；
+ * 数值以 Python 字面量的文本给出，以免丢失精度。
+ * 常量元组、frozenset 中的元素逐个列出；嵌套的代码对象以自己的限定名列出。 */
+class ConstExtractor : public PycCodeVisitor {
+public:
+    ConstExtractor(std::ostream& out, const char* file, PycModule* mod)
+        : m_out(out), m_file(file), m_mod(mod) { }
+
+    void visitCode(PycRef<PycCode> code, const std::string& qualname, int, int) override
+    {
+        emitStrings(qualname, "name", code->names());
+        emitStrings(qualname, "varname", code->localNames());
+    }
+
+    void visitConst(PycRef<PycCode>, const std::string& qualname, PycRef<PycObject> obj) override
+    {
+        switch (obj.type()) {
+        case PycObject::TYPE_STRING:
+            // Python 3 中 TYPE_STRING 是 bytes；Python 2 的 str 也按字节处理
+            emitString(qualname, m_mod->majorVer() >= 3 ? "bytes" : "str", obj, true);
+            break;
+        case PycObject::TYPE_UNICODE:
+        case PycObject::TYPE_INTERNED:
+        case PycObject::TYPE_ASCII:
+        case PycObject::TYPE_ASCII_INTERNED:
+        case PycObject::TYPE_SHORT_ASCII:
+        case PycObject::TYPE_SHORT_ASCII_INTERNED:
+            emitString(qualname, "str", obj, m_mod->majorVer() < 3 && obj.type() == PycObject::TYPE_INTERNED);
+            break;
+        case PycObject::TYPE_INT:
+        case PycObject::TYPE_INT64:
+        case PycObject::TYPE_LONG:
+            emitNumber(qualname, "int", obj);
+            break;
+        case PycObject::TYPE_FLOAT:
+        case PycObject::TYPE_BINARY_FLOAT:
+            emitNumber(qualname, "float", obj);
+            break;
+        case PycObject::TYPE_COMPLEX:
+        case PycObject::TYPE_BINARY_COMPLEX:
+            emitNumber(qualname, "complex", obj);
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    void emitStrings(const std::string& qualname, const char* kind, PycRef<PycSequence> seq)
+    {
+        for (int i = 0; seq != NULL && i < seq->size(); ++i)
+            emitString(qualname, kind, seq->get(i));
+    }
+
+    void begin(const std::string& qualname, const char* kind)
+    {
+        m_out << "{\"file\": ";
+        json_print_string(m_out, m_file, std::strlen(m_file));
+        m_out << ", \"code\": ";
+        json_print_string(m_out, qualname);
+        m_out << ", \"kind\": \"" << kind << "\", \"value\": ";
+    }
+
+    void emitString(const std::string& qualname, const char* kind, PycRef<PycObject> obj,
+                    bool latin1 = false)
+    {
+        PycRef<PycString> str = obj.try_cast<PycString>();
+        if (str == NULL)
+            return;
+        begin(qualname, kind);
+        json_print_string(m_out, str->strValue(), latin1);
+        m_out << "}\n";
+    }
+
+    void emitNumber(const std::string& qualname, const char* kind, PycRef<PycObject> obj)
+    {
+        m_text.str(std::string());
+        print_const(m_text, obj, m_mod);
+        begin(qualname, kind);
+        json_print_string(m_out, m_text.str());
+        m_out << "}\n";
+    }
+
+    std::ostream& m_out;
+    const char* m_file;
+    PycModule* m_mod;
+    std::ostringstream m_text;
+};
+
+/* 逐个加载输入文件并交给 process 处理；返回 0 表示全部成功 */
+template <typename Process>
+static int for_each_module(const std::vector<const char*>& infiles, bool marshalled,
+                           int major, int minor, Process process)
+{
+    std::string contents;
+    int status = 0;
+    for (const char* infile : infiles) {
+        if (!read_whole_file(infile, contents)) {
+            std::fprintf(stderr, "错误：无法打开文件 %s\n", infile);
+            status = 1;
+            continue;
+        }
+        try {
+            PycModule mod;
+            if (marshalled)
+                mod.loadFromMarshalledBuffer(contents.data(), (int)contents.size(), major, minor);
+            else
+                mod.loadFromBuffer(contents.data(), (int)contents.size());
+            if (!mod.isValid() || mod.code() == NULL) {
+                std::fprintf(stderr, "错误：无法加载文件 %s\n", infile);
+                status = 1;
+                continue;
+            }
+            process(infile, mod);
+        } catch (std::exception& ex) {
+            std::fprintf(stderr, "错误：处理文件 %s 时出错：%s\n", infile, ex.what());
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int extract_consts(std::ostream& out, const std::vector<const char*>& infiles,
+                          bool marshalled, int major, int minor)
+{
+    return for_each_module(infiles, marshalled, major, minor,
+                           [&out](const char* infile, PycModule& mod) {
+        ConstExtractor extractor(out, infile, &mod);
+        WalkCode(mod.code(), extractor);
+    });
+}
+
+/* --jsonl / --packed：直接由解码后的指令流生成，每条指令一条记录（CACHE 除外）。
+ *
+ * JSON Lines，每个代码对象先有一条 code 记录，随后是其中的指令：
+ *   {"record": "code", "file": 路径, "id": 编号, "parent": 外层编号或 null,
+ *    "qualname": 限定名, "firstline": 首行号}
+ *   {"record": "insn", "code": 编号, "offset": 偏移, "opcode": 名称, "opnum": 原始操作码,
+ *    "arg": 参数或 null, "argkind": 参数种类, "argval": 解析后的参数或 null,
+ *    "target": 跳转目标或 null, "handler": 所在异常表区间的处理代码偏移或 null}
+ * argkind 取值见 PycInstruction::ArgKind（int、const、name、local、cell、jump、symbol、invalid）。
+ * 代码对象的编号在所有输入文件中连续递增。
+ *
+ * 紧凑二进制格式以 8 字节 "PYCDIS01" 开头，随后是若干记录，整数均为小端：
+ *   'O' u16 操作码  u8 名称长度  名称            某个操作码第一次出现之前给出其名称
+ *   'C' u32 编号  i32 外层编号  i32 首行号  u32 长度 限定名  u32 长度 文件路径
+ *   'I' u32 代码编号  u32 偏移  u16 操作码  u8 原始操作码  u8 参数种类
+ *       i32 参数  i32 跳转目标  i32 异常处理偏移  u32 长度 解析后的参数
+ * 没有的值以 -1 表示。 */
+class InstructionStreamer : public PycCodeVisitor {
+public:
+    InstructionStreamer(std::ostream& out, bool packed)
+        : m_out(out), m_packed(packed), m_nextId(0), m_file(nullptr), m_mod(nullptr),
+          m_firstId(0), m_namedOpcodes(Pyc::PYC_LAST_OPCODE)
+    {
+        if (m_packed)
+            m_out.write("PYCDIS01", 8);
+    }
+
+    void stream(const char* file, PycModule* mod)
+    {
+        m_file = file;
+        m_mod = mod;
+        m_firstId = m_nextId;
+        WalkCode(mod->code(), *this);
+    }
+
+    void visitCode(PycRef<PycCode> code, const std::string& qualname, int id, int parentId) override
+    {
+        // WalkCode() 的编号从每个文件的 0 开始
+        m_nextId = m_firstId + id + 1;
+        emitCode(m_file, m_firstId + id, parentId < 0 ? -1 : m_firstId + parentId,
+                 qualname, code->firstLine());
+        emitInstructions(m_mod, code, m_firstId + id);
+    }
+
+private:
+    void emitInstructions(PycModule* mod, PycRef<PycCode> code, int id)
+    {
+        std::vector<PycExceptionTableEntry> handlers = code->exceptionTableEntries();
+        size_t handler = 0;
+        const unsigned char* bytes = (const unsigned char*)code->code()->value();
+        PycBuffer source(code->code()->value(), code->code()->length());
+        PycInstruction insn;
+        int pos = 0;
+        while (!source.atEof()) {
+            insn.offset = pos;
+            bc_next(source, mod, insn.opcode, insn.operand, pos);
+            if (insn.opcode == Pyc::CACHE)
+                continue;
+            bc_resolve(code, mod, insn, pos);
+
+            // 原始操作码；带 EXTENDED_ARG 前缀时取真正的操作码
+            int raw = bytes[insn.offset];
+            bool extended = (mod->verCompare(3, 6) >= 0)
+                    ? pos - insn.offset > 2
+                    : Pyc::ByteToOpcode(mod->majorVer(), mod->minorVer(), raw) == Pyc::EXTENDED_ARG_A;
+            if (extended)
+                raw = bytes[insn.offset + (mod->verCompare(3, 6) >= 0 ? 2 : 3)];
+
+            // 3.11 起的异常表按偏移排序且互不重叠
+            while (handler < handlers.size() && handlers[handler].end_offset <= insn.offset)
+                ++handler;
+            int target = (handler < handlers.size() && handlers[handler].start_offset <= insn.offset)
+                       ? handlers[handler].target : -1;
+
+            if (m_packed)
+                packInstruction(id, insn, raw, target);
+            else
+                printInstruction(id, insn, raw, target);
+        }
+    }
+
+    void emitCode(const char* file, int id, int parentId, const std::string& qualname, int firstLine)
+    {
+        if (m_packed) {
+            m_out.put('C');
+            putU32(id);
+            putU32(parentId);
+            putU32(firstLine);
+            putString(qualname.data(), qualname.size());
+            putString(file, std::strlen(file));
+            return;
+        }
+        m_out << "{\"record\": \"code\", \"file\": ";
+        json_print_string(m_out, file, std::strlen(file));
+        m_out << ", \"id\": " << id << ", \"parent\": ";
+        if (parentId >= 0)
+            m_out << parentId;
+        else
+            m_out << "null";
+        m_out << ", \"qualname\": ";
+        json_print_string(m_out, qualname);
+        m_out << ", \"firstline\": " << firstLine << "}\n";
+    }
+
+    void printInstruction(int id, const PycInstruction& insn, int raw, int handler)
+    {
+        bool hasArg = insn.opcode >= Pyc::PYC_HAVE_ARG;
+        m_out << "{\"record\": \"insn\", \"code\": " << id << ", \"offset\": " << insn.offset
+              << ", \"opcode\": \"" << Pyc::OpcodeName(insn.opcode) << "\", \"opnum\": " << raw
+              << ", \"arg\": ";
+        if (hasArg)
+            m_out << insn.operand;
+        else
+            m_out << "null";
+        m_out << ", \"argkind\": \"" << PycInstruction::argKindName(insn.argKind) << "\", \"argval\": ";
+        if (!insn.resolved.empty())
+            json_print_string(m_out, insn.resolved);
+        else
+            m_out << "null";
+        m_out << ", \"target\": ";
+        if (insn.target >= 0)
+            m_out << insn.target;
+        else
+            m_out << "null";
+        m_out << ", \"handler\": ";
+        if (handler >= 0)
+            m_out << handler;
+        else
+            m_out << "null";
+        m_out << "}\n";
+    }
+
+    void packInstruction(int id, const PycInstruction& insn, int raw, int handler)
+    {
+        if (insn.opcode >= 0 && insn.opcode < Pyc::PYC_LAST_OPCODE && !m_namedOpcodes[insn.opcode]) {
+            const char* name = Pyc::OpcodeName(insn.opcode);
+            size_t length = std::strlen(name);
+            m_out.put('O');
+            putU16(insn.opcode);
+            m_out.put((char)length);
+            m_out.write(name, length);
+            m_namedOpcodes[insn.opcode] = true;
+        }
+        m_out.put('I');
+        putU32(id);
+        putU32(insn.offset);
+        putU16(insn.opcode);
+        m_out.put((char)raw);
+        m_out.put((char)insn.argKind);
+        putU32(insn.opcode >= Pyc::PYC_HAVE_ARG ? insn.operand : -1);
+        putU32(insn.target);
+        putU32(handler);
+        putString(insn.resolved.data(), insn.resolved.size());
+    }
+
+    void putU16(unsigned value)
+    {
+        char bytes[2] = { (char)value, (char)(value >> 8) };
+        m_out.write(bytes, sizeof(bytes));
+    }
+
+    void putU32(int value)
+    {
+        unsigned bits = (unsigned)value;
+        char bytes[4] = { (char)bits, (char)(bits >> 8), (char)(bits >> 16), (char)(bits >> 24) };
+        m_out.write(bytes, sizeof(bytes));
+    }
+
+    void putString(const char* str, size_t length)
+    {
+        putU32((int)length);
+        m_out.write(str, length);
+    }
+
+    std::ostream& m_out;
+    bool m_packed;
+    int m_nextId;
+    const char* m_file;
+    PycModule* m_mod;
+    int m_firstId;
+    std::vector<bool> m_namedOpcodes;
+};
+
+static int stream_instructions(std::ostream& out, const std::vector<const char*>& infiles,
+                               bool marshalled, int major, int minor, bool packed)
+{
+    InstructionStreamer streamer(out, packed);
+    int status = for_each_module(infiles, marshalled, major, minor,
+                                 [&streamer](const char* infile, PycModule& mod) {
+        streamer.stream(infile, &mod);
+    });
+    out.flush();
+    return status;
+}
+
 int main(int argc, char* argv[])
 {
     ConsoleEncodingHelper encodingHelper;
 
     const char* infile = nullptr;
+    std::vector<const char*> infiles;
+    bool skim = false;
+    bool consts = false;
+    bool jsonl = false;
+    bool packed = false;
+    const char* outfile = nullptr;
     bool marshalled = false;
     const char* version = nullptr;
     std::ostream* raw_output = &std::cout;
@@ -107,15 +574,7 @@ int main(int argc, char* argv[])
     for (int arg = 1; arg < argc; ++arg) {
         if (std::strcmp(argv[arg], "-o") == 0) {
             if (arg + 1 < argc) {
-                const char* filename = argv[++arg];
-                out_file.open(filename, std::ios_base::out);
-                if (out_file.fail()) {
-                    std::fprintf(stderr, "错误：打开文件 '%s' 写入失败\n", filename);
-                    print_error_help(argv[0]);
-                    encodingHelper.restoreEarly();
-                    return 1;
-                }
-                raw_output = &out_file;
+                outfile = argv[++arg];
             } else {
                 std::fputs("错误：选项 '-o' 需要指定文件名\n", stderr);
                 print_error_help(argv[0]);
@@ -133,15 +592,42 @@ int main(int argc, char* argv[])
                 encodingHelper.restoreEarly();
                 return 1;
             }
+        } else if (std::strcmp(argv[arg], "--skim") == 0) {
+            skim = true;
+        } else if (std::strcmp(argv[arg], "--consts") == 0) {
+            consts = true;
+        } else if (std::strcmp(argv[arg], "--jsonl") == 0) {
+            jsonl = true;
+        } else if (std::strcmp(argv[arg], "--packed") == 0) {
+            packed = true;
         } else if (std::strcmp(argv[arg], "-h") == 0 ||
                    std::strcmp(argv[arg], "--help") == 0) {
             print_help(argv[0]);
             return 0;
         } else {
             infile = argv[arg];
+            infiles.push_back(infile);
         }
     }
 
+    if (outfile) {
+        // --packed 的输出是二进制数据
+        out_file.open(outfile, packed ? std::ios_base::out | std::ios_base::binary
+                                      : std::ios_base::out);
+        if (out_file.fail()) {
+            std::fprintf(stderr, "错误：打开文件 '%s' 写入失败\n", outfile);
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+        raw_output = &out_file;
+    }
+#ifdef WIN32
+    else if (packed) {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
     if (!infile) {
         std::fputs("错误：未指定输入文件\n", stderr);
         print_error_help(argv[0]);
@@ -149,17 +635,8 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    PycModule mod;
-    if (!marshalled) {
-        try {
-            mod.loadFromFile(infile);
-        } catch (std::exception& ex) {
-            std::fprintf(stderr, "错误：加载文件 %s 时出错：%s\n", infile, ex.what());
-            print_error_help(argv[0]);
-            encodingHelper.restoreEarly();
-            return 1;
-        }
-    } else {
+    int major = -1, minor = -1;
+    if (marshalled) {
         if (!version) {
             std::fputs("错误：打开原始代码对象需要指定版本号\n", stderr);
             print_error_help(argv[0]);
@@ -174,8 +651,30 @@ int main(int argc, char* argv[])
             encodingHelper.restoreEarly();
             return 1;
         }
-        int major = std::stoi(s.substr(0, dot));
-        int minor = std::stoi(s.substr(dot+1, s.size()));
+        major = std::stoi(s.substr(0, dot));
+        minor = std::stoi(s.substr(dot+1, s.size()));
+    }
+
+    if (skim || consts || jsonl || packed) {
+        int status = skim ? skim_files(*raw_output, infiles, marshalled, major, minor)
+                   : consts ? extract_consts(*raw_output, infiles, marshalled, major, minor)
+                   : stream_instructions(*raw_output, infiles, marshalled, major, minor, packed);
+        if (status != 0)
+            encodingHelper.restoreEarly();
+        return status;
+    }
+
+    PycModule mod;
+    if (!marshalled) {
+        try {
+            mod.loadFromFile(infile);
+        } catch (std::exception& ex) {
+            std::fprintf(stderr, "错误：加载文件 %s 时出错：%s\n", infile, ex.what());
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+    } else {
         try {
             mod.loadFromMarshalledFile(infile, major, minor);
         } catch (std::exception& ex) {
@@ -1,8 +1,20 @@
-﻿#include <cstring>
+﻿#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include "ASTree.h"
+#include "ASTExport.h"
+#include "bytecode.h"
+#include "data.h"
 #include "utf8out_stream.h"
+#include "trace.h"
+#include "pyc_probes.h"
+#include "result_cache.h"
+#include "pyc_server.h"
+#include "pyc_batch.h"
 
 #ifdef WIN32
 #include <windows.h>
@@ -26,11 +38,49 @@ void print_help(const char* argv0)
     std::printf("                 使用此选项时必须同时指定 -v 版本号\n");
     std::printf("  -v <x.y>       指定 Python 版本号 (例如: 3.8, 3.9)\n");
     std::printf("                 当使用 -c 选项加载代码对象时必须指定\n");
+    std::printf("  --cache-dir <目录>  启用结果缓存：内容相同的输入直接复用之前的反编译结果\n");
+    std::printf("  --cache-size <MB>   结果缓存的大小上限，超出后淘汰最久未使用的条目 (默认 1024)\n");
+    std::printf("  --serve             常驻服务模式：从标准输入读取带长度前缀的请求，结果写到标准输出\n");
+    std::printf("                      协议说明见 pyc_server.h\n");
+    std::printf("  --serve-socket <路径>  常驻服务模式：在 Unix 域套接字上监听请求 (仅 POSIX)\n");
+    std::printf("  --workers <N>       服务模式和归档模式下的工作线程数 (默认为 CPU 核心数)\n");
+    std::printf("  --out-dir <目录>    归档模式：输入是 zip 归档 (wheel、egg 等) 或 PyInstaller 打包的可执行文件，\n");
+    std::printf("                      其中每个 .pyc 成员或模块在内存中解压并反编译，结果按原有目录结构写到指定目录\n");
+    std::printf("                      输入也可以是一个目录，其中所有 .pyc 文件由读取线程预读后并行反编译\n");
+    std::printf("  --out-zip <文件>    归档模式：同上，结果写入一个 zip 归档\n");
+    std::printf("  --out-tar <文件>    归档模式：同上，结果流式写入一个 tar 归档，由单独的线程大块顺序写出\n");
+    std::printf("  --with-disasm       归档模式：每个模块同时输出反汇编 (a/b.dis)\n");
+    std::printf("  --with-stats        归档模式：每个模块同时输出版本、各阶段耗时与输出大小 (a/b.stats)\n");
+    std::printf("  --isolate           归档模式：在预先创建的工作进程中反编译，进程数由 --workers 指定；\n");
+    std::printf("                      某个文件使工作进程崩溃或超时时只跳过该文件，并补充新的工作进程 (仅 POSIX)\n");
+    std::printf("  --timeout <秒>      进程隔离模式下单个文件的处理时限，0 表示不限 (默认 60)\n");
+    std::printf("  --read-ahead <MB>   归档模式下输入为目录时，已预读但尚未反编译的数据上限 (默认 64)\n");
+    std::printf("  --only <限定名> 只反编译指定的函数或类 (例如 A.f、outer.<locals>.inner)\n");
+    std::printf("                 其余代码对象不会被解析或反编译\n");
+    std::printf("  --outline      大纲模式：只输出模块、类的内容和函数签名，函数体以 ... 代替\n");
+    std::printf("  --max-time <毫秒>   反编译预算：每个文件的墙钟时间\n");
+    std::printf("  --max-insns <N>     反编译预算：每个文件在 BuildFromCode 中处理的指令数\n");
+    std::printf("  --max-nodes <N>     反编译预算：每个文件创建的语法树节点数\n");
+    std::printf("  --max-output <KB>   反编译预算：每个文件输出的源代码大小\n");
+    std::printf("                      超出预算时当前代码对象改为注释形式的反汇编，其余部分照常输出\n");
+    std::printf("  --max-depth <层数>  加载 pyc 时容器和代码对象的最大嵌套层数，1 到 2000 (默认 2000)\n");
+    std::printf("  --disasm <文件> 同时将反汇编结果（与 pycdas 的输出相同）写入文件\n");
+    std::printf("  --exception-table <文件>  同时将各代码对象的异常表写入文件 (Python 3.11+)\n");
+    std::printf("  --metadata <文件>  同时将各代码对象的元数据以 JSON 格式写入文件\n");
+    std::printf("  --ast-json <文件>  同时将语法树以 JSON 格式写入文件（格式见 ASTExport.h）\n");
+    std::printf("  --ast-bin <文件>   同时将语法树以紧凑的二进制格式写入文件\n");
+    std::printf("  --no-source    不输出反编译的源代码，只写出上面指定的文件\n");
+    std::printf("                 以上输出共用一次加载，输入只读取和解析一次\n");
+    std::printf("  --trace <文件> 将各阶段耗时以 Chrome trace-event JSON 格式写入文件\n");
+    std::printf("                 可在 chrome://tracing 或 Perfetto 中打开\n");
     std::printf("  -h, --help     显示此帮助信息并退出\n");
     std::printf("\n示例:\n");
     std::printf("  %s script.pyc                    # 反编译单个文件\n", argv0);
     std::printf("  %s -o output.py script.pyc       # 输出到文件\n", argv0);
     std::printf("  %s -c -v 3.9 codeobj.bin        # 加载编译的代码对象\n", argv0);
+    std::printf("  %s -o a.py --disasm a.dis a.pyc  # 一次得到源代码和反汇编\n", argv0);
+    std::printf("  %s --out-dir src pkg.whl         # 反编译 wheel 中的所有 .pyc\n", argv0);
+    std::printf("  %s --out-zip src.zip build/      # 反编译目录树中的所有 .pyc\n", argv0);
     std::printf("\n注意:\n");
     std::printf("  - 支持 Python 2.7 和 3.x 版本的字节码文件\n");
     std::printf("  - 对于加密或混淆的字节码文件可能无法正确反编译\n");
@@ -85,15 +135,195 @@ public:
 #endif
 };
 
+static void print_header(utf8out_stream& pyc_output, const char* dispname,
+                         int major, int minor, bool unicode)
+{
+    pyc_output << "# 源代码由 Decompyle++ 生成\n";
+
+    formatted_print(pyc_output, "# 文件：%s (Python %d.%d%s)\n\n", dispname,
+                    major, minor, (major < 3 && unicode) ? " Unicode" : "");
+}
+
+/* 与 pycdas 的默认输出相同 */
+static void write_disasm(std::ostream& out, PycModule& mod, const char* dispname)
+{
+    out << "# 反汇编代码由 pycdas 生成\n";
+    out << "# 文件: " << dispname << " (Python " << mod.majorVer() << "." << mod.minorVer();
+    if (mod.majorVer() < 3 && mod.isUnicode())
+        out << " Unicode";
+    out << ")\n\n";
+    bc_disasm(out, mod.code(), &mod, 0, Pyc::DISASM_PYCODE_VERBOSE);
+}
+
+/* 对每个代码对象调用 visit(code, qualname)，先外层后内层 */
+template <typename Visit>
+static void walk_code(PycRef<PycCode> root, Visit& visit)
+{
+    struct Adapter : public PycCodeVisitor {
+        explicit Adapter(Visit& visit) : m_visit(visit) { }
+
+        void visitCode(PycRef<PycCode> code, const std::string& qualname, int, int) override
+        {
+            m_visit(code, qualname);
+        }
+
+        Visit& m_visit;
+    } adapter(visit);
+    WalkCode(root, adapter);
+}
+
+static void write_exception_tables(std::ostream& out, PycModule& mod)
+{
+    auto visit = [&out](PycRef<PycCode> code, const std::string& qualname) {
+        std::vector<PycExceptionTableEntry> entries = code->exceptionTableEntries();
+        if (entries.empty())
+            return;
+        out << qualname << ":\n";
+        bc_exceptiontable(out, code, 1);
+    };
+    walk_code(mod.code(), visit);
+}
+
+static void json_print_names(std::ostream& out, const char* key, PycRef<PycSequence> seq)
+{
+    out << ",\"" << key << "\":[";
+    for (int i = 0; seq != NULL && i < seq->size(); ++i) {
+        if (i)
+            out << ",";
+        PycRef<PycString> str = seq->get(i).try_cast<PycString>();
+        if (str != NULL)
+            json_print_string(out, str->strValue());
+        else
+            out << "null";
+    }
+    out << "]";
+}
+
+/* 一个 JSON 对象：文件与版本信息，以及每个代码对象的签名、大小和名称表 */
+static void write_metadata(std::ostream& out, PycModule& mod, const char* dispname)
+{
+    out << "{\"file\":";
+    json_print_string(out, dispname, strlen(dispname));
+    out << ",\"version\":\"" << mod.majorVer() << "." << mod.minorVer() << "\""
+        << ",\"unicode\":" << (mod.isUnicode() ? "true" : "false")
+        << ",\"codes\":[";
+    bool first = true;
+    auto visit = [&](PycRef<PycCode> code, const std::string& qualname) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"qualname\":";
+        json_print_string(out, qualname);
+        out << ",\"filename\":";
+        if (code->fileName() != NULL)
+            json_print_string(out, code->fileName()->strValue());
+        else
+            out << "null";
+        out << ",\"firstline\":" << code->firstLine()
+            << ",\"argcount\":" << code->argCount()
+            << ",\"posonlyargcount\":" << code->posOnlyArgCount()
+            << ",\"kwonlyargcount\":" << code->kwOnlyArgCount()
+            << ",\"nlocals\":" << code->numLocals()
+            << ",\"stacksize\":" << code->stackSize()
+            << ",\"flags\":" << code->flags()
+            << ",\"bytecode_size\":" << (code->code() != NULL ? code->code()->length() : 0)
+            << ",\"consts\":" << (code->consts() != NULL ? code->consts()->size() : 0)
+            << ",\"exception_table\":" << code->exceptionTableEntries().size();
+        json_print_names(out, "names", code->names());
+        json_print_names(out, "varnames", code->localNames());
+        json_print_names(out, "freevars", code->freeVars());
+        json_print_names(out, "cellvars", code->cellVars());
+        out << "}";
+    };
+    walk_code(mod.code(), visit);
+    out << "\n]}\n";
+}
+
+static bool open_output(std::ofstream& file, const char* filename,
+                        std::ios_base::openmode mode = std::ios_base::out)
+{
+    file.open(filename, mode);
+    if (file.fail()) {
+        fprintf(stderr, "错误：打开文件 '%s' 写入失败\n", filename);
+        return false;
+    }
+    return true;
+}
+
+/* 归档模式：并行反编译 zip 归档、PyInstaller 可执行文件或目录中的所有模块，失败的模块不影响其他模块 */
+static int decompile_archive(const char* infile, const char* out_dir, const char* out_zip,
+                             const char* out_tar, unsigned workers, uint64_t read_ahead,
+                             const PycBatchOptions& options)
+{
+    // 大量模块中常有相同的函数体；拆分顶层定义交给其他线程也依赖结果复用。
+    // 须在创建服务进程之前设置，工作进程继承这一设置
+    decompyle_set_memo(true);
+
+    // 服务进程必须在预读线程和 tar 写出线程之前创建（见 PycForkServer）
+    std::unique_ptr<PycForkServer> server;
+    if (options.isolate)
+        server.reset(new PycForkServer(options));
+
+    std::vector<PycBatchItem> items;
+    std::string error;
+    {
+        Trace::Span span("archive_open", "input", infile);
+        std::error_code ec;
+        bool ok = std::filesystem::is_directory(std::filesystem::u8path(infile), ec)
+                  ? pyc_directory_items(infile, read_ahead, items, error)
+                  : pyc_archive_items(infile, items, error);
+        if (!ok) {
+            fprintf(stderr, "错误：无法打开归档 %s：%s\n", infile, error.c_str());
+            return 1;
+        }
+    }
+
+    std::unique_ptr<PycBatchSink> sink = out_dir ? pyc_directory_sink(out_dir, error)
+                                       : out_zip ? pyc_zip_sink(out_zip, error)
+                                                 : pyc_tar_sink(out_tar, error);
+    if (!sink) {
+        fprintf(stderr, "错误：%s\n", error.c_str());
+        return 1;
+    }
+
+    size_t failed = pyc_batch_run(items, *sink, workers, options, server.get());
+    fprintf(stderr, "已反编译 %zu 个成员，%zu 个失败\n", items.size() - failed, failed);
+    return failed ? 1 : 0;
+}
+
+/* 在 main 的任意返回路径上写出 trace 文件 */
+struct TraceFileGuard {
+    ~TraceFileGuard() {
+        if (!Trace::close())
+            fputs("错误：写入 trace 文件失败\n", stderr);
+    }
+};
+
 int main(int argc, char* argv[])
 {
     ConsoleEncodingHelper encodingHelper;
+    TraceFileGuard traceGuard;
 
     const char* infile = nullptr;
     bool marshalled = false;
     const char* version = nullptr;
+    const char* cache_dir = nullptr;
+    uint64_t cache_size = 1024;
+    bool serve = false;
+    const char* serve_socket = nullptr;
+    const char* only = nullptr;
+    bool outline = false;
+    PycDecompileBudget budget;
+    unsigned workers = 0;
+    const char* out_dir = nullptr;
+    const char* out_zip = nullptr;
+    const char* out_tar = nullptr;
+    PycBatchOptions batch_options;
+    uint64_t read_ahead = 64;
     std::ostream* raw_output = &std::cout;
     std::ofstream out_file;
+    // 与源代码共用一次加载的其他输出
+    bool no_source = false;
+    std::ofstream disasm_file, exctable_file, metadata_file, ast_json_file, ast_bin_file;
 
     for (int arg = 1; arg < argc; ++arg) {
         if (strcmp(argv[arg], "-o") == 0) {
@@ -124,6 +354,167 @@ int main(int argc, char* argv[])
                 encodingHelper.restoreEarly();
                 return 1;
             }
+        } else if (strcmp(argv[arg], "--cache-dir") == 0) {
+            if (arg + 1 < argc) {
+                cache_dir = argv[++arg];
+            } else {
+                fputs("错误：选项 '--cache-dir' 需要指定目录\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--cache-size") == 0) {
+            if (arg + 1 < argc && atoi(argv[arg + 1]) > 0) {
+                cache_size = (uint64_t)atoi(argv[++arg]);
+            } else {
+                fputs("错误：选项 '--cache-size' 需要指定以 MB 为单位的正整数\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--serve") == 0) {
+            serve = true;
+        } else if (strcmp(argv[arg], "--serve-socket") == 0) {
+            if (arg + 1 < argc) {
+                serve_socket = argv[++arg];
+            } else {
+                fputs("错误：选项 '--serve-socket' 需要指定套接字路径\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--workers") == 0) {
+            if (arg + 1 < argc && atoi(argv[arg + 1]) > 0) {
+                workers = (unsigned)atoi(argv[++arg]);
+            } else {
+                fputs("错误：选项 '--workers' 需要指定正整数\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--out-dir") == 0 || strcmp(argv[arg], "--out-zip") == 0
+                   || strcmp(argv[arg], "--out-tar") == 0) {
+            if (arg + 1 >= argc) {
+                fprintf(stderr, "错误：选项 '%s' 需要指定%s\n", argv[arg],
+                        argv[arg][6] == 'd' ? "目录" : "文件名");
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+            (argv[arg][6] == 'd' ? out_dir : argv[arg][6] == 'z' ? out_zip : out_tar) = argv[arg + 1];
+            ++arg;
+        } else if (strcmp(argv[arg], "--with-disasm") == 0) {
+            batch_options.disasm = true;
+        } else if (strcmp(argv[arg], "--with-stats") == 0) {
+            batch_options.stats = true;
+        } else if (strcmp(argv[arg], "--isolate") == 0) {
+            batch_options.isolate = true;
+        } else if (strcmp(argv[arg], "--timeout") == 0) {
+            if (arg + 1 < argc && argv[arg + 1][0] >= '0' && argv[arg + 1][0] <= '9') {
+                batch_options.timeout = (unsigned)atoi(argv[++arg]);
+            } else {
+                fputs("错误：选项 '--timeout' 需要指定秒数\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--read-ahead") == 0) {
+            if (arg + 1 < argc && atoi(argv[arg + 1]) > 0) {
+                read_ahead = (uint64_t)atoi(argv[++arg]);
+            } else {
+                fputs("错误：选项 '--read-ahead' 需要指定正整数 (MB)\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--only") == 0) {
+            if (arg + 1 < argc) {
+                only = argv[++arg];
+            } else {
+                fputs("错误：选项 '--only' 需要指定限定名\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--outline") == 0) {
+            outline = true;
+        } else if (strcmp(argv[arg], "--max-depth") == 0) {
+            char* end = nullptr;
+            unsigned long value = (arg + 1 < argc) ? strtoul(argv[arg + 1], &end, 10) : 0;
+            if (value >= 1 && value <= MAX_LOAD_DEPTH && *end == '\0') {
+                SetLoadDepthLimit((unsigned)value);
+                ++arg;
+            } else {
+                fprintf(stderr, "错误：选项 '--max-depth' 需要指定 1 到 %u 之间的层数\n", MAX_LOAD_DEPTH);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--max-time") == 0 || strcmp(argv[arg], "--max-insns") == 0
+                   || strcmp(argv[arg], "--max-nodes") == 0 || strcmp(argv[arg], "--max-output") == 0) {
+            char* end = nullptr;
+            unsigned long long value = (arg + 1 < argc) ? strtoull(argv[arg + 1], &end, 10) : 0;
+            if (value == 0 || *end != '\0') {
+                fprintf(stderr, "错误：选项 '%s' 需要指定正整数\n", argv[arg]);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+            switch (argv[arg][6]) {
+            case 't': budget.timeMs = (unsigned)value; break;
+            case 'i': budget.instructions = value; break;
+            case 'n': budget.nodes = value; break;
+            default: budget.outputBytes = value * 1024; break;
+            }
+            ++arg;
+        } else if (strcmp(argv[arg], "--disasm") == 0
+                   || strcmp(argv[arg], "--exception-table") == 0
+                   || strcmp(argv[arg], "--metadata") == 0) {
+            std::ofstream& file = (argv[arg][2] == 'd') ? disasm_file
+                                : (argv[arg][2] == 'e') ? exctable_file : metadata_file;
+            if (arg + 1 >= argc) {
+                fprintf(stderr, "错误：选项 '%s' 需要指定文件名\n", argv[arg]);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+            if (!open_output(file, argv[++arg])) {
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--ast-json") == 0 || strcmp(argv[arg], "--ast-bin") == 0) {
+            bool binary = strcmp(argv[arg], "--ast-bin") == 0;
+            if (arg + 1 >= argc) {
+                fprintf(stderr, "错误：选项 '%s' 需要指定文件名\n", argv[arg]);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+            if (!open_output(binary ? ast_bin_file : ast_json_file, argv[++arg],
+                             binary ? std::ios_base::out | std::ios_base::binary
+                                    : std::ios_base::out)) {
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--no-source") == 0) {
+            no_source = true;
+        } else if (strcmp(argv[arg], "--trace") == 0) {
+            if (arg + 1 < argc) {
+                const char* filename = argv[++arg];
+                if (!Trace::open(filename)) {
+                    fprintf(stderr, "错误：打开文件 '%s' 写入失败\n", filename);
+                    print_error_help(argv[0]);
+                    encodingHelper.restoreEarly();
+                    return 1;
+                }
+            } else {
+                fputs("错误：选项 '--trace' 需要指定文件名\n", stderr);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
         } else if (strcmp(argv[arg], "--help") == 0 || strcmp(argv[arg], "-h") == 0) {
             print_help(argv[0]);
             return 0;
@@ -132,6 +523,41 @@ int main(int argc, char* argv[])
         }
     }
 
+    decompyle_set_outline(outline);
+    decompyle_set_budget(budget);
+    if (cache_dir && (budget.timeMs || budget.instructions || budget.nodes || budget.outputBytes)) {
+        // 超出预算时的输出与运行情况有关，不能缓存
+        fputs("错误：--cache-dir 不能与 --max-* 预算选项同时使用\n", stderr);
+        print_error_help(argv[0]);
+        encodingHelper.restoreEarly();
+        return 1;
+    }
+    if (cache_dir && !PycResultCache::hasBuildVersion()) {
+        // 缓存键中没有构建版本时，不同的 pycdc 会读到彼此的结果
+        fputs("错误：此 pycdc 构建时无法确定版本（不在 git 仓库中），不能使用 --cache-dir；"
+              "请在配置时用 -DPYCDC_BUILD_REVISION=<版本> 指定\n", stderr);
+        print_error_help(argv[0]);
+        encodingHelper.restoreEarly();
+        return 1;
+    }
+
+    if (serve || serve_socket) {
+        std::unique_ptr<PycResultCache> cache;
+        if (cache_dir) {
+            cache.reset(new PycResultCache(cache_dir, cache_size * 1024 * 1024));
+            if (!cache->isOpen()) {
+                fprintf(stderr, "错误：无法创建缓存目录 '%s'\n", cache_dir);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+            decompyle_set_memo(true, cache.get());
+        }
+
+        PycServer server(workers);
+        return serve_socket ? server.runSocket(serve_socket) : server.runStdio();
+    }
+
     if (!infile) {
         fputs("错误：未指定输入文件\n", stderr);
         print_error_help(argv[0]);
@@ -139,11 +565,110 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    if ((batch_options.disasm || batch_options.stats || batch_options.isolate)
+            && !out_dir && !out_zip && !out_tar) {
+        fputs("错误：--with-disasm、--with-stats 和 --isolate 只能在归档模式下使用\n", stderr);
+        print_error_help(argv[0]);
+        encodingHelper.restoreEarly();
+        return 1;
+    }
+    if (out_dir || out_zip || out_tar) {
+        if ((out_dir != nullptr) + (out_zip != nullptr) + (out_tar != nullptr) > 1) {
+            fputs("错误：--out-dir、--out-zip 与 --out-tar 只能使用其中一个\n", stderr);
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+        if (marshalled || only || raw_output != &std::cout || cache_dir || no_source
+                || disasm_file.is_open() || exctable_file.is_open() || metadata_file.is_open()
+                || ast_json_file.is_open() || ast_bin_file.is_open()) {
+            fputs("错误：归档模式不支持 -o、-c、--cache-dir、--only 以及附加输出选项\n", stderr);
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+        int status = decompile_archive(infile, out_dir, out_zip, out_tar, workers,
+                                       read_ahead * 1024 * 1024, batch_options);
+        encodingHelper.restoreEarly();
+        return status;
+    }
+
+    bool extra_outputs = disasm_file.is_open() || exctable_file.is_open()
+                         || metadata_file.is_open() || ast_json_file.is_open()
+                         || ast_bin_file.is_open();
+    if (no_source && !extra_outputs) {
+        fputs("错误：--no-source 需要与 --disasm、--exception-table、--metadata 或 --ast-* 一起使用\n", stderr);
+        print_error_help(argv[0]);
+        encodingHelper.restoreEarly();
+        return 1;
+    }
+    bool need_source = !no_source;
+
+    const char* dispname = strrchr(infile, PATHSEP);
+    dispname = (dispname == NULL) ? infile : dispname + 1;
+
+    utf8out_stream pyc_output(*raw_output);
+
+    // 启用结果缓存时，命中则直接输出缓存的结果，完全跳过加载与反编译
+    std::unique_ptr<PycResultCache> cache;
+    std::string input, cache_key;
+    if (cache_dir && marshalled) {
+        fputs("警告：-c 模式不使用结果缓存\n", stderr);
+    } else if (cache_dir && need_source) {
+        cache.reset(new PycResultCache(cache_dir, cache_size * 1024 * 1024));
+        if (!cache->isOpen()) {
+            fprintf(stderr, "错误：无法创建缓存目录 '%s'\n", cache_dir);
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+        if (!read_whole_file(infile, input)) {
+            fprintf(stderr, "错误：无法读取文件 %s\n", infile);
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+        // --only 的结果与限定名有关，单独保存
+        std::string ns = only ? std::string("only:") + only : std::string("module");
+        if (outline)
+            ns += ":outline";
+        cache_key = PycResultCache::makeKey(input.data(), input.size(), ns.c_str());
+        // 整个文件未命中时，其中的代码对象仍可能与之前处理过的文件相同
+        decompyle_set_memo(true, cache.get());
+
+        PycResultCache::Entry entry;
+        if (cache->lookup(cache_key, entry)) {
+            print_header(pyc_output, dispname, entry.major, entry.minor, entry.unicode);
+            pyc_output.flush();
+            raw_output->write(entry.output.data(), entry.output.size());
+            fputs(entry.warnings.c_str(), stderr);
+            raw_output->flush();
+            PYC_PROBE1(output__flush, infile);
+            if (!extra_outputs)
+                return 0;
+            // 其他输出仍需要加载模块，但不必再反编译
+            need_source = false;
+        }
+    }
+
+    // 缓存未命中时，警告信息先收集起来，随结果一起写入缓存
+    PycResultCache::Entry result;
+    std::unique_ptr<PycWarningCapture> capture;
+    if (cache && need_source)
+        capture.reset(new PycWarningCapture(result.warnings));
+
     PycModule mod;
+    // 只反编译一个函数或只输出大纲时，多数代码对象不必解析（或只需读取签名）
+    mod.setLazyLoading(only != nullptr || outline);
+    Trace::Span load_span("load", "input", infile);
     if (!marshalled) {
         try {
-            mod.loadFromFile(infile);
+            if (cache)
+                mod.loadFromBuffer(input.data(), (int)input.size());
+            else
+                mod.loadFromFile(infile);
         } catch (std::exception& ex) {
+            fputs(result.warnings.c_str(), stderr);
             fprintf(stderr, "错误：加载文件 %s 时出错：%s\n", infile, ex.what());
             print_error_help(argv[0]);
             encodingHelper.restoreEarly();
@@ -166,35 +691,115 @@ int main(int argc, char* argv[])
         }
         int major = std::stoi(s.substr(0, dot));
         int minor = std::stoi(s.substr(dot+1, s.size()));
-        mod.loadFromMarshalledFile(infile, major, minor);
+        try {
+            mod.loadFromMarshalledFile(infile, major, minor);
+        } catch (std::exception& ex) {
+            fprintf(stderr, "错误：加载代码对象 %s 时出错：%s\n", infile, ex.what());
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
     }
+    load_span.finish();
 
     if (!mod.isValid()) {
+        fputs(result.warnings.c_str(), stderr);
         fprintf(stderr, "错误：无法加载文件 %s\n", infile);
         print_error_help(argv[0]);
         encodingHelper.restoreEarly();
         return 1;
     }
-    
-    const char* dispname = strrchr(infile, PATHSEP);
-    dispname = (dispname == NULL) ? infile : dispname + 1;
-    
-    utf8out_stream pyc_output(*raw_output);
-    
-    pyc_output << "# 源代码由 Decompyle++ 生成\n";
-    
-    formatted_print(pyc_output, "# 文件：%s (Python %d.%d%s)\n\n", dispname,
-                    mod.majorVer(), mod.minorVer(),
-                    (mod.majorVer() < 3 && mod.isUnicode()) ? " Unicode" : "");
-    
+
+    if (need_source) {
+        print_header(pyc_output, dispname, mod.majorVer(), mod.minorVer(), mod.isUnicode());
+
+        try {
+            bool found = true;
+            if (cache) {
+                std::ostringstream body;
+                utf8out_stream body_output(body);
+                if (only)
+                    found = decompyle_only(mod.code(), &mod, only, body_output);
+                else
+                    decompyle(mod.code(), &mod, body_output);
+                body_output.flush();
+                result.output = body.str();
+            } else if (only) {
+                found = decompyle_only(mod.code(), &mod, only, pyc_output);
+            } else {
+                decompyle(mod.code(), &mod, pyc_output);
+            }
+            if (!found) {
+                pyc_output.flush();
+                fputs(result.warnings.c_str(), stderr);
+                fprintf(stderr, "错误：%s 中没有限定名为 %s 的函数或类\n", infile, only);
+                print_error_help(argv[0]);
+                encodingHelper.restoreEarly();
+                return 1;
+            }
+        } catch (std::exception& ex) {
+            fputs(result.warnings.c_str(), stderr);
+            fprintf(stderr, "错误：反编译 %s 时出错：%s\n", infile, ex.what());
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+
+        if (cache) {
+            capture.reset();
+            result.major = mod.majorVer();
+            result.minor = mod.minorVer();
+            result.unicode = mod.isUnicode();
+            if (!cache->store(cache_key, result))
+                fputs("警告：写入结果缓存失败\n", stderr);
+
+            pyc_output.flush();
+            raw_output->write(result.output.data(), result.output.size());
+            fputs(result.warnings.c_str(), stderr);
+        }
+    }
+
     try {
-        decompyle(mod.code(), &mod, pyc_output);
+        if (disasm_file.is_open()) {
+            Trace::Span span("disasm", "output");
+            write_disasm(disasm_file, mod, dispname);
+        }
+        if (exctable_file.is_open()) {
+            Trace::Span span("exception_table", "output");
+            write_exception_tables(exctable_file, mod);
+        }
+        if (metadata_file.is_open()) {
+            Trace::Span span("metadata", "output");
+            write_metadata(metadata_file, mod, dispname);
+        }
+        if (ast_json_file.is_open() || ast_bin_file.is_open()) {
+            Trace::Span span("ast_export", "output");
+            if (ast_json_file.is_open())
+                ast_export_json(&mod, ast_json_file);
+            if (ast_bin_file.is_open())
+                ast_export_binary(&mod, ast_bin_file);
+        }
     } catch (std::exception& ex) {
-        fprintf(stderr, "错误：反编译 %s 时出错：%s\n", infile, ex.what());
+        fprintf(stderr, "错误：输出 %s 的反汇编、元数据或语法树时出错：%s\n", infile, ex.what());
         print_error_help(argv[0]);
         encodingHelper.restoreEarly();
         return 1;
     }
+    for (std::ofstream* file : { &disasm_file, &exctable_file, &metadata_file,
+                                 &ast_json_file, &ast_bin_file }) {
+        if (file->is_open() && !file->flush()) {
+            fputs("错误：写入输出文件失败\n", stderr);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+    }
+
+    {
+        Trace::Span flush_span("flush", "output");
+        pyc_output.flush();
+        raw_output->flush();
+        PYC_PROBE1(output__flush, infile);
+    }
 
     return 0;
 }
\ No newline at end of file
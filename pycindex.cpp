@@ -0,0 +1,248 @@
+﻿#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "pyc_index.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+namespace fs = std::filesystem;
+
+void print_help(const char* argv0)
+{
+    std::printf("用法: %s update <索引文件> [文件|目录|-]...\n", argv0);
+    std::printf("      %s remove <索引文件> 文件...\n", argv0);
+    std::printf("      %s prune <索引文件>\n", argv0);
+    std::printf("      %s query [--prefix] <索引文件> 词...\n\n", argv0);
+    std::printf("描述:\n");
+    std::printf("  为一批 .pyc 文件建立名称与常量的倒排索引，并按名称快速查找引用它的文件\n\n");
+    std::printf("命令:\n");
+    std::printf("  update         把文件加入索引；目录会递归查找其中的 .pyc 文件，\n");
+    std::printf("                 '-' 表示从标准输入逐行读取文件路径。\n");
+    std::printf("                 已在索引中且大小、修改时间和内容都没有变化的文件不会重新解析。\n");
+    std::printf("                 每次 update、remove 和 prune 都会重写整个索引文件，\n");
+    std::printf("                 因此应尽量在一次调用中处理多个文件\n");
+    std::printf("  remove         从索引中删除指定的文件\n");
+    std::printf("  prune          从索引中删除磁盘上已不存在的文件\n");
+    std::printf("  query          查找索引词，每个命中输出一行，以制表符分隔：\n");
+    std::printf("                 词  文件  限定名  种类  字节码偏移（-1 表示来自名称表或常量表）\n");
+    std::printf("  --prefix       查找所有以给定字符串开头的词\n\n");
+    std::printf("索引词:\n");
+    std::printf("  name           co_names 中的名称\n");
+    std::printf("  varname        co_varnames 中的局部变量名\n");
+    std::printf("  const          字符串常量\n");
+    std::printf("  import         导入的模块（import a.b）或名称（from a import b 记为 a.b）\n");
+    std::printf("  attr           属性访问链，例如 subprocess.Popen、os.path.join\n\n");
+    std::printf("示例:\n");
+    std::printf("  %s update corpus.idx cache/\n", argv0);
+    std::printf("  %s query corpus.idx subprocess.Popen\n", argv0);
+    std::printf("  %s query --prefix corpus.idx https://\n", argv0);
+}
+
+void print_error_help(const char* argv0)
+{
+    std::fprintf(stderr, "\n使用 '%s -h' 查看完整的帮助信息\n", argv0);
+}
+
+class ConsoleEncodingHelper {
+#ifdef WIN32
+private:
+    UINT originalOutputCP;
+    bool encodingChanged;
+
+public:
+    ConsoleEncodingHelper() : encodingChanged(false) {
+        originalOutputCP = GetConsoleOutputCP();
+        SetConsoleOutputCP(65001);
+        encodingChanged = (originalOutputCP != 65001);
+    }
+
+    ~ConsoleEncodingHelper() { restoreEarly(); }
+
+    void restoreEarly() {
+        if (encodingChanged) {
+            SetConsoleOutputCP(originalOutputCP);
+            encodingChanged = false;
+        }
+    }
+#else
+public:
+    void restoreEarly() {}
+#endif
+};
+
+/* 把命令行上的文件、目录和 '-' 展开为文件列表 */
+static void collect_files(const std::string& arg, std::vector<std::string>& files)
+{
+    if (arg == "-") {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                files.push_back(line);
+        }
+        return;
+    }
+
+    std::error_code ec;
+    if (!fs::is_directory(arg, ec)) {
+        files.push_back(arg);
+        return;
+    }
+    for (fs::recursive_directory_iterator it(arg, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().extension() == ".pyc")
+            files.push_back(it->path().string());
+    }
+}
+
+static int run_update(const std::string& indexPath, const std::vector<std::string>& args)
+{
+    PycIndexWriter writer;
+    std::string error;
+    if (!writer.load(indexPath, error)) {
+        fprintf(stderr, "错误：%s: %s\n", indexPath.c_str(), error.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    for (const auto& arg : args)
+        collect_files(arg, files);
+
+    size_t indexed = 0, unchanged = 0, failed = 0;
+    for (const auto& file : files) {
+        switch (writer.update(file, error)) {
+        case PycIndexWriter::UPDATE_INDEXED:
+            ++indexed;
+            break;
+        case PycIndexWriter::UPDATE_UNCHANGED:
+            ++unchanged;
+            break;
+        case PycIndexWriter::UPDATE_FAILED:
+            fprintf(stderr, "警告：跳过 %s: %s\n", file.c_str(), error.c_str());
+            ++failed;
+            break;
+        }
+    }
+
+    if (!writer.save(indexPath, error)) {
+        fprintf(stderr, "错误：%s\n", error.c_str());
+        return 1;
+    }
+    fprintf(stderr, "已索引 %zu 个文件，%zu 个未变化，%zu 个失败，索引中共 %zu 个文件\n",
+            indexed, unchanged, failed, writer.fileCount());
+    return 0;
+}
+
+static int run_remove(const std::string& indexPath, const std::vector<std::string>& args, bool prune)
+{
+    PycIndexWriter writer;
+    std::string error;
+    if (!writer.load(indexPath, error)) {
+        fprintf(stderr, "错误：%s: %s\n", indexPath.c_str(), error.c_str());
+        return 1;
+    }
+
+    size_t removed = 0;
+    if (prune) {
+        removed = writer.prune();
+    } else {
+        for (const auto& file : args) {
+            if (writer.remove(file))
+                ++removed;
+            else
+                fprintf(stderr, "警告：%s 不在索引中\n", file.c_str());
+        }
+    }
+
+    if (!writer.save(indexPath, error)) {
+        fprintf(stderr, "错误：%s\n", error.c_str());
+        return 1;
+    }
+    fprintf(stderr, "已删除 %zu 个文件，索引中共 %zu 个文件\n", removed, writer.fileCount());
+    return 0;
+}
+
+static int run_query(const std::string& indexPath, const std::vector<std::string>& terms, bool prefix)
+{
+    PycIndexReader reader(indexPath);
+    if (!reader.isOpen()) {
+        fprintf(stderr, "错误：%s: %s\n", indexPath.c_str(), reader.error().c_str());
+        return 1;
+    }
+
+    int result = 0;
+    for (const auto& term : terms) {
+        std::vector<PycIndex::Hit> hits;
+        if (!reader.find(term, prefix, hits)) {
+            fprintf(stderr, "错误：%s: %s\n", indexPath.c_str(), reader.error().c_str());
+            return 1;
+        }
+        if (hits.empty())
+            result = 2;
+        for (const auto& hit : hits) {
+            printf("%s\t%s\t%s\t%s\t%d\n", hit.term.c_str(), hit.file.c_str(),
+                   hit.qualname.c_str(), PycIndex::kindName(hit.kind), hit.offset);
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    ConsoleEncodingHelper encodingHelper;
+
+    if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+        print_help(argv[0]);
+        return argc < 2 ? 1 : 0;
+    }
+
+    std::string command = argv[1];
+    bool prefix = false;
+    int arg = 2;
+    if (command == "query" && arg < argc && strcmp(argv[arg], "--prefix") == 0) {
+        prefix = true;
+        ++arg;
+    }
+    if (arg >= argc) {
+        fprintf(stderr, "错误：缺少索引文件参数\n");
+        print_error_help(argv[0]);
+        encodingHelper.restoreEarly();
+        return 1;
+    }
+    std::string indexPath = argv[arg++];
+    std::vector<std::string> args(argv + arg, argv + argc);
+
+    int result;
+    if (command == "update") {
+        result = run_update(indexPath, args);
+    } else if (command == "remove" || command == "prune") {
+        if (command == "remove" && args.empty()) {
+            fprintf(stderr, "错误：remove 需要至少一个文件参数\n");
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+        result = run_remove(indexPath, args, command == "prune");
+    } else if (command == "query") {
+        if (args.empty()) {
+            fprintf(stderr, "错误：query 需要至少一个索引词\n");
+            print_error_help(argv[0]);
+            encodingHelper.restoreEarly();
+            return 1;
+        }
+        result = run_query(indexPath, args, prefix);
+    } else {
+        fprintf(stderr, "错误：未知命令 '%s'\n", command.c_str());
+        print_error_help(argv[0]);
+        encodingHelper.restoreEarly();
+        return 1;
+    }
+    encodingHelper.restoreEarly();
+    return result;
+}
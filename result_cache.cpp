@@ -0,0 +1,238 @@
+﻿#include "result_cache.h"
+#include "pyc_hash.h"
+#include "pycdc_revision.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/* 条目格式变化时需要修改此值，使旧条目全部失效 */
+const char CACHE_MAGIC[8] = { 'P', 'Y', 'C', 'D', 'C', 'R', 'C', '2' };
+const char* const CACHE_SUFFIX = ".pycc";
+
+/* 保存缓存总大小估计值的文件，位于缓存目录下 */
+const char* const USAGE_FILE = "usage";
+
+bool writeU64(FILE* out, uint64_t value)
+{
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; ++i)
+        bytes[i] = (unsigned char)(value >> (i * 8));
+    return fwrite(bytes, 1, sizeof(bytes), out) == sizeof(bytes);
+}
+
+bool readU64(FILE* in, uint64_t& value)
+{
+    unsigned char bytes[8];
+    if (fread(bytes, 1, sizeof(bytes), in) != sizeof(bytes))
+        return false;
+    value = 0;
+    for (int i = 7; i >= 0; --i)
+        value = (value << 8) | bytes[i];
+    return true;
+}
+
+bool readUsage(const fs::path& path, uint64_t& value)
+{
+    FILE* in = fopen(path.string().c_str(), "rb");
+    if (!in)
+        return false;
+    bool ok = readU64(in, value);
+    fclose(in);
+    return ok;
+}
+
+/* 临时文件的后缀，在并发写入的线程和进程之间不重复 */
+std::string tempSuffix()
+{
+    static std::atomic<unsigned> s_counter(0);
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".tmp%llx.%u",
+             (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count(),
+             s_counter.fetch_add(1));
+    return suffix;
+}
+
+void writeUsage(const fs::path& path, uint64_t value)
+{
+    // 与条目相同，先写临时文件再重命名
+    fs::path tmpPath = path;
+    tmpPath += tempSuffix();
+    FILE* out = fopen(tmpPath.string().c_str(), "wb");
+    if (!out)
+        return;
+    bool ok = writeU64(out, value);
+    ok = (fclose(out) == 0) && ok;
+    std::error_code ec;
+    if (ok)
+        fs::rename(tmpPath, path, ec);
+    if (!ok || ec)
+        fs::remove(tmpPath, ec);
+}
+
+bool readString(FILE* in, uint64_t length, std::string& str)
+{
+    // 长度字段来自磁盘，先做基本的合理性检查，避免损坏条目造成巨大分配
+    if (length > (uint64_t(1) << 32))
+        return false;
+    str.resize((size_t)length);
+    return length == 0 || fread(&str[0], 1, (size_t)length, in) == length;
+}
+
+}
+
+PycResultCache::PycResultCache(std::string directory, uint64_t maxBytes)
+    : m_directory(std::move(directory)), m_maxBytes(maxBytes), m_open(false)
+{
+    std::error_code ec;
+    fs::create_directories(m_directory, ec);
+    m_open = fs::is_directory(m_directory, ec);
+}
+
+const char* PycResultCache::buildVersion()
+{
+    return "pycdc " PYCDC_BUILD_REVISION;
+}
+
+bool PycResultCache::hasBuildVersion()
+{
+    return PYCDC_BUILD_REVISION[0] != '\0';
+}
+
+std::string PycResultCache::makeKey(const void* data, size_t size, const char* ns)
+{
+    // 两个不同种子的 64 位哈希拼成 128 位键，使碰撞概率可以忽略
+    PycHasher first(0), second(0x5059434443);
+    for (PycHasher* hasher : { &first, &second }) {
+        hasher->update(buildVersion(), strlen(buildVersion()) + 1);
+        hasher->update(ns, strlen(ns) + 1);
+        hasher->update(data, size);
+    }
+    return pyc_hash_hex(first.digest()) + pyc_hash_hex(second.digest());
+}
+
+std::string PycResultCache::entryPath(const std::string& key) const
+{
+    // 以键的前两个字符分目录，避免单个目录下文件过多
+    return (fs::path(m_directory) / key.substr(0, 2) / (key + CACHE_SUFFIX)).string();
+}
+
+bool PycResultCache::lookup(const std::string& key, Entry& entry) const
+{
+    if (!m_open)
+        return false;
+
+    std::string path = entryPath(key);
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in)
+        return false;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint64_t major, minor, unicode, clean, outputLen, warningsLen;
+    bool ok = fread(magic, 1, sizeof(magic), in) == sizeof(magic)
+            && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0
+            && readU64(in, major) && readU64(in, minor) && readU64(in, unicode) && readU64(in, clean)
+            && readU64(in, outputLen) && readU64(in, warningsLen)
+            && readString(in, outputLen, entry.output)
+            && readString(in, warningsLen, entry.warnings);
+    fclose(in);
+    if (!ok)
+        return false;
+
+    entry.major = (int)major;
+    entry.minor = (int)minor;
+    entry.unicode = unicode != 0;
+    entry.clean = clean != 0;
+
+    // 更新修改时间，作为 LRU 淘汰的依据
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+bool PycResultCache::store(const std::string& key, const Entry& entry)
+{
+    if (!m_open)
+        return false;
+
+    std::string path = entryPath(key);
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    // 先写入临时文件再重命名，保证并发读取者不会看到写了一半的条目
+    std::string tmpPath = path + tempSuffix();
+
+    FILE* out = fopen(tmpPath.c_str(), "wb");
+    if (!out)
+        return false;
+    bool ok = fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), out) == sizeof(CACHE_MAGIC)
+            && writeU64(out, (uint64_t)entry.major) && writeU64(out, (uint64_t)entry.minor)
+            && writeU64(out, entry.unicode ? 1 : 0) && writeU64(out, entry.clean ? 1 : 0)
+            && writeU64(out, entry.output.size()) && writeU64(out, entry.warnings.size())
+            && fwrite(entry.output.data(), 1, entry.output.size(), out) == entry.output.size()
+            && fwrite(entry.warnings.data(), 1, entry.warnings.size(), out) == entry.warnings.size();
+    ok = (fclose(out) == 0) && ok;
+
+    if (ok) {
+        fs::rename(tmpPath, path, ec);
+        ok = !ec;
+    }
+    if (!ok) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+
+    // 每次写入都把条目大小累加到 usage 文件中的估计值上，超出上限时淘汰。
+    // 多个进程同时写入时累加可能丢失（覆盖同一条目时则会重复计入），
+    // 因此仍在大约 1/16 的写入后完整扫描一次目录，校正估计值
+    uint64_t size = sizeof(CACHE_MAGIC) + 6 * 8 + entry.output.size() + entry.warnings.size();
+    fs::path usagePath = fs::path(m_directory) / USAGE_FILE;
+    uint64_t usage;
+    if (key.back() == '0' || !readUsage(usagePath, usage) || usage + size > m_maxBytes)
+        evict();
+    else
+        writeUsage(usagePath, usage + size);
+    return true;
+}
+
+void PycResultCache::evict()
+{
+    if (!m_open)
+        return;
+
+    typedef std::tuple<fs::file_time_type, uint64_t, fs::path> item_t;
+    std::vector<item_t> items;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(m_directory, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec) || it->path().extension() != CACHE_SUFFIX)
+            continue;
+        uint64_t size = it->file_size(ec);
+        if (ec)
+            continue;
+        items.emplace_back(it->last_write_time(ec), size, it->path());
+        total += size;
+    }
+    if (total > m_maxBytes) {
+        // 删除最久未使用的条目，直到总大小降到上限的 90% 以下，避免每次写入都触发淘汰
+        std::sort(items.begin(), items.end());
+        uint64_t target = m_maxBytes - m_maxBytes / 10;
+        for (const auto& item : items) {
+            if (total <= target)
+                break;
+            if (fs::remove(std::get<2>(item), ec))
+                total -= std::get<1>(item);
+        }
+    }
+    writeUsage(fs::path(m_directory) / USAGE_FILE, total);
+}
@@ -0,0 +1,50 @@
+﻿#ifndef _PYC_RESULT_CACHE_H
+#define _PYC_RESULT_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+/* 基于内容寻址的反编译结果磁盘缓存。
+ * 键由输入文件内容的哈希与 pycdc 构建版本共同决定，条目以原子方式写入，
+ * 总大小超过上限时按最近使用时间淘汰最旧的条目。
+ * 总大小的估计值保存在缓存目录下的 usage 文件中，每次写入时检查。 */
+class PycResultCache {
+public:
+    struct Entry {
+        int major, minor;
+        bool unicode;
+        bool clean;             // 反编译是否完整
+        std::string output;     // decompyle() 生成的源代码（不含文件头）
+        std::string warnings;   // 反编译期间输出的警告信息
+
+        Entry() : major(-1), minor(-1), unicode(false), clean(true) { }
+    };
+
+    PycResultCache(std::string directory, uint64_t maxBytes);
+
+    bool isOpen() const { return m_open; }
+
+    /* 根据输入内容计算缓存键；ns 用于区分不同种类的缓存结果 */
+    static std::string makeKey(const void* data, size_t size, const char* ns = "module");
+
+    bool lookup(const std::string& key, Entry& entry) const;
+    bool store(const std::string& key, const Entry& entry);
+
+    /* 将缓存总大小压缩到上限以下 */
+    void evict();
+
+    static const char* buildVersion();
+
+    /* 构建时是否确定了版本（见 scripts/build_revision.cmake）；
+     * 否则不同的 pycdc 会共用缓存条目，不能使用缓存 */
+    static bool hasBuildVersion();
+
+private:
+    std::string entryPath(const std::string& key) const;
+
+    std::string m_directory;
+    uint64_t m_maxBytes;
+    bool m_open;
+};
+
+#endif
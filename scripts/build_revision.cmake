@@ -0,0 +1,41 @@
+# 每次构建时由 CMakeLists.txt 中的 pycdc_revision 目标以 cmake -P 运行，生成 pycdc_revision.h。
+# 参数：SOURCE_DIR、OUTPUT、TEMPLATE、GIT_EXECUTABLE（可为空）、REVISION_OVERRIDE（可为空）
+#
+# 版本取 git describe 的结果；工作区有未提交的修改时再附加差异内容的哈希，
+# 使不同的修改不会得到同一个版本。不在 git 仓库中构建（例如源码包）且没有用
+# -DPYCDC_BUILD_REVISION 指定时版本为空，pycdc 拒绝使用结果缓存。
+# 内容没有变化时 configure_file 不改写输出文件，不会引起重新编译。
+
+set(PYCDC_BUILD_REVISION "${REVISION_OVERRIDE}")
+if(NOT PYCDC_BUILD_REVISION AND GIT_EXECUTABLE)
+    # 源码包解压在另一个 git 仓库中时，git describe 得到的是外层仓库的版本
+    execute_process(COMMAND "${GIT_EXECUTABLE}" rev-parse --show-toplevel
+        WORKING_DIRECTORY "${SOURCE_DIR}"
+        OUTPUT_VARIABLE toplevel
+        OUTPUT_STRIP_TRAILING_WHITESPACE
+        ERROR_QUIET)
+    get_filename_component(toplevel "${toplevel}" REALPATH)
+    get_filename_component(source "${SOURCE_DIR}" REALPATH)
+    set(status 1)
+    if(toplevel STREQUAL source)
+        execute_process(COMMAND "${GIT_EXECUTABLE}" describe --always --dirty
+            WORKING_DIRECTORY "${SOURCE_DIR}"
+            RESULT_VARIABLE status
+            OUTPUT_VARIABLE PYCDC_BUILD_REVISION
+            OUTPUT_STRIP_TRAILING_WHITESPACE
+            ERROR_QUIET)
+    endif()
+    if(NOT status EQUAL 0)
+        set(PYCDC_BUILD_REVISION "")
+    elseif(PYCDC_BUILD_REVISION MATCHES "-dirty$")
+        execute_process(COMMAND "${GIT_EXECUTABLE}" diff HEAD --binary
+            WORKING_DIRECTORY "${SOURCE_DIR}"
+            OUTPUT_VARIABLE diff
+            ERROR_QUIET)
+        string(SHA1 digest "${diff}")
+        string(SUBSTRING "${digest}" 0 16 digest)
+        set(PYCDC_BUILD_REVISION "${PYCDC_BUILD_REVISION}-${digest}")
+    endif()
+endif()
+
+configure_file("${TEMPLATE}" "${OUTPUT}" @ONLY)
@@ -0,0 +1,1621 @@
+#!/usr/bin/env python3
+
+# Behavior tests for the pycdc, pycdas and pycindex features beyond plain
+# decompilation: containers, output modes, caches and resource limits.
+# Fixtures are generated on the fly, either from the modules in
+# tests/compiled or as small hand-assembled Python 2.7 modules, and each test
+# checks concrete output against the output of decompiling the same .pyc
+# file directly or against a known expected text.
+
+import io
+import os
+import sys
+import glob
+import json
+import time
+import zlib
+import shutil
+import socket
+import struct
+import tarfile
+import zipfile
+import argparse
+import tempfile
+import subprocess
+
+try:
+    import resource
+except ImportError:
+    resource = None
+
+TEST_DIR = os.path.dirname(os.path.realpath(__file__))
+COMPILED_DIR = os.path.join(TEST_DIR, 'compiled')
+
+# A few modules covering both old and new bytecode formats.  Each is large
+# enough that zlib picks dynamic Huffman codes for it by default.
+SAMPLE_MODULES = [
+    'test_class.2.5.pyc',
+    'f-string.3.7.pyc',
+    'test_calls.3.10.pyc',
+    'binary_ops.3.11.pyc',
+    'test_loops3.3.12.pyc',
+]
+
+# DEFLATE block types (RFC 1951, section 3.2.3)
+BTYPE_STORED = 0
+BTYPE_FIXED = 1
+BTYPE_DYNAMIC = 2
+
+
+# Stack size for the tests of deeply nested input (POSIX only)
+SMALL_STACK = 2 * 1024 * 1024
+
+
+def tool(name):
+    return os.path.join(os.getcwd(), name)
+
+
+def run(args, **kwargs):
+    return subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          universal_newlines=True, encoding='utf-8', errors='replace',
+                          **kwargs)
+
+
+def run_small_stack(args, size=SMALL_STACK):
+    """Runs a tool with a 2 MB stack, so that unbounded recursion crashes it"""
+    def limit_stack():
+        resource.setrlimit(resource.RLIMIT_STACK, (size, size))
+    return run(args, preexec_fn=limit_stack if resource else None)
+
+
+def strip_header(source):
+    """
+    Drops the header comment lines, which contain the input file name and
+    therefore differ between a module inside an archive and the same module
+    decompiled directly.
+    """
+    lines = source.splitlines(True)
+    for i, line in enumerate(lines):
+        if '# 文件：' in line:
+            return ''.join(lines[i + 1:])
+    return source
+
+
+_direct_cache = {}
+
+def decompile_direct(pyc_file):
+    """Returns the decompiled source of pyc_file, or None if pycdc fails on it"""
+    if pyc_file not in _direct_cache:
+        proc = run([tool('pycdc'), pyc_file])
+        _direct_cache[pyc_file] = strip_header(proc.stdout) if proc.returncode == 0 else None
+    return _direct_cache[pyc_file]
+
+
+def deflate(data, level, strategy=zlib.Z_DEFAULT_STRATEGY):
+    """Raw DEFLATE stream, as stored in zip members"""
+    compressor = zlib.compressobj(level, zlib.DEFLATED, -15, 9, strategy)
+    return compressor.compress(data) + compressor.flush()
+
+
+def first_block_type(stream):
+    return (stream[0] >> 1) & 3
+
+
+def make_zip(path, members):
+    """
+    Writes a zip archive from (name, method, raw data, compressed data)
+    tuples.  zipfile cannot choose the DEFLATE strategy, so the archive is
+    assembled by hand.
+    """
+    out = io.BytesIO()
+    central = b''
+    for name, method, data, packed in members:
+        encoded = name.encode('utf-8')
+        crc = zlib.crc32(data) & 0xffffffff
+        offset = out.tell()
+        out.write(struct.pack('<IHHHHHIIIHH', 0x04034b50, 20, 0x0800, method, 0, 0x21,
+                              crc, len(packed), len(data), len(encoded), 0))
+        out.write(encoded)
+        out.write(packed)
+        central += struct.pack('<IHHHHHHIIIHHHHHII', 0x02014b50, 20, 20, 0x0800, method,
+                               0, 0x21, crc, len(packed), len(data), len(encoded),
+                               0, 0, 0, 0, 0, offset)
+        central += encoded
+    directory = out.tell()
+    out.write(central)
+    out.write(struct.pack('<IHHHHIIH', 0x06054b50, 0, 0, len(members), len(members),
+                          len(central), directory, 0))
+    with open(path, 'wb') as zip_file:
+        zip_file.write(out.getvalue())
+
+
+def marshal_int(value):
+    return struct.pack('<i', value)
+
+
+def marshal_string(data):
+    return b's' + marshal_int(len(data)) + data
+
+
+def marshal_interned(data, ref=False):
+    """Interned string, optionally flagged as a reference target (FLAG_REF)"""
+    return (b'\xf4' if ref else b't') + marshal_int(len(data)) + data
+
+
+def marshal_tuple(items):
+    return b'(' + marshal_int(len(items)) + b''.join(items)
+
+
+def py27_code(code, consts, names=(), name=b'<module>', flags=0x40, raw_names=None,
+              stacksize=8):
+    """
+    Marshalled Python 2.7 code object; consts (and raw_names, which replace
+    names) are already marshalled
+    """
+    if raw_names is None:
+        raw_names = [marshal_string(n) for n in names]
+    return (b'c' + marshal_int(0) + marshal_int(0) + marshal_int(stacksize) + marshal_int(flags)
+            + marshal_string(code) + marshal_tuple(consts)
+            + marshal_tuple(raw_names)
+            + marshal_tuple([]) + marshal_tuple([]) + marshal_tuple([])
+            + marshal_string(b'<test>') + marshal_string(name)
+            + marshal_int(1) + marshal_string(b''))
+
+
+def write_py27(path, code):
+    with open(path, 'wb') as pyc:
+        pyc.write(b'\x03\xf3\r\n' + marshal_int(0) + code)
+
+
+# x = <const 0>; return None
+PY27_STORE_CONST = b'd\x00\x00Z\x00\x00d\x01\x00S'
+# return None
+PY27_RETURN_NONE = b'd\x00\x00S'
+
+CO_FUNCTION = 0x43      # CO_OPTIMIZED | CO_NEWLOCALS | CO_NOFREE
+
+
+def py27_defines(functions, name=b'<module>', flags=0x40):
+    """Code object that defines each (name, code) function in turn, then returns None"""
+    code = b''
+    for i in range(len(functions)):
+        code += b'd' + struct.pack('<H', i) + b'\x84\x00\x00Z' + struct.pack('<H', i)
+    code += b'd' + struct.pack('<H', len(functions)) + b'S'
+    return py27_code(code, [body for _, body in functions] + [b'N'],
+                     [fname for fname, _ in functions], name, flags)
+
+
+def py27_function(name):
+    return py27_code(PY27_RETURN_NONE, [b'N'], name=name, flags=CO_FUNCTION)
+
+
+def marshal_short_ascii(data):
+    return b'z' + bytes([len(data)]) + data
+
+
+def marshal_small_tuple(items):
+    return b')' + bytes([len(items)]) + b''.join(items)
+
+
+def py311_try_module():
+    """
+    Python 3.11 module 'try: x = 1 / except: x = 2' with one exception table
+    entry, covering offsets 4 to 8 and handled at offset 12
+    """
+    code = bytes([151, 0, 9, 0, 100, 0, 90, 0, 100, 2, 83, 0,      # RESUME .. RETURN_VALUE
+                  35, 0, 1, 0, 100, 1, 90, 0, 89, 0, 100, 2, 83, 0])  # PUSH_EXC_INFO ..
+    exception_table = bytes([0x82, 0x02, 0x06, 0x00])
+    consts = [b'i' + marshal_int(1), b'i' + marshal_int(2), b'N']
+    module = (b'c' + marshal_int(0) + marshal_int(0) + marshal_int(0) + marshal_int(2)
+              + marshal_int(0) + marshal_string(code) + marshal_small_tuple(consts)
+              + marshal_small_tuple([marshal_short_ascii(b'x')]) + marshal_small_tuple([])
+              + marshal_string(b'') + marshal_short_ascii(b'<test>')
+              + marshal_short_ascii(b'<module>') + marshal_short_ascii(b'<module>')
+              + marshal_int(1) + marshal_string(b'') + marshal_string(exception_table))
+    return b'\xa7\r\r\n' + marshal_int(0) + marshal_int(0) + marshal_int(0) + module
+
+
+def nested_tuple(depth):
+    """Marshalled tuple nested depth levels deep: ((((),),),)"""
+    return b'(\x01\x00\x00\x00' * (depth - 1) + marshal_tuple([])
+
+
+def nested_functions(depth):
+    """Module with depth nested 'def f():' levels"""
+    code = py27_function(b'f')
+    for _ in range(depth - 1):
+        code = py27_defines([(b'f', code)], b'f', CO_FUNCTION)
+    return py27_defines([(b'f', code)])
+
+
+def check_tree(out_dir, expected):
+    """Compares the files written by --out-dir with the direct output"""
+    errors = []
+    for name, pyc_file in expected.items():
+        path = os.path.join(out_dir, name)
+        if not os.path.exists(path):
+            errors.append('missing output {}\n'.format(name))
+            continue
+        with open(path, 'r', encoding='utf-8', errors='replace') as src:
+            if strip_header(src.read()) != decompile_direct(pyc_file):
+                errors.append('{} differs from the output for {}\n'
+                              .format(name, os.path.basename(pyc_file)))
+    return errors
+
+
+def test_deflate(workdir, btype, level, strategy):
+    """A zip member compressed with the given block type decompiles like the plain file"""
+    errors = []
+    members = []
+    expected = {}
+    for module in SAMPLE_MODULES:
+        pyc_file = os.path.join(COMPILED_DIR, module)
+        with open(pyc_file, 'rb') as pyc:
+            data = pyc.read()
+        packed = deflate(data, level, strategy)
+        if first_block_type(packed) != btype:
+            errors.append('zlib produced block type {} for {}, expected {}\n'
+                          .format(first_block_type(packed), module, btype))
+        members.append((module, 8, data, packed))
+        expected[module[:-len('.pyc')] + '.py'] = pyc_file
+
+    archive = os.path.join(workdir, 'deflate.zip')
+    make_zip(archive, members)
+    out_dir = os.path.join(workdir, 'out')
+    proc = run([tool('pycdc'), '--out-dir', out_dir, '--workers', '2', archive])
+    if proc.returncode != 0:
+        errors.append('pycdc exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    return errors + check_tree(out_dir, expected)
+
+
+def test_deflate_stored(workdir):
+    return test_deflate(workdir, BTYPE_STORED, 0, zlib.Z_DEFAULT_STRATEGY)
+
+
+def test_deflate_fixed(workdir):
+    return test_deflate(workdir, BTYPE_FIXED, 9, zlib.Z_FIXED)
+
+
+def test_deflate_dynamic(workdir):
+    return test_deflate(workdir, BTYPE_DYNAMIC, 9, zlib.Z_DEFAULT_STRATEGY)
+
+
+def test_deflate_truncated(workdir):
+    """A truncated member fails on its own; the other members are still written"""
+    good = os.path.join(COMPILED_DIR, SAMPLE_MODULES[0])
+    bad = os.path.join(COMPILED_DIR, SAMPLE_MODULES[2])
+    with open(good, 'rb') as pyc:
+        good_data = pyc.read()
+    with open(bad, 'rb') as pyc:
+        bad_data = pyc.read()
+    bad_packed = deflate(bad_data, 9)
+    archive = os.path.join(workdir, 'truncated.zip')
+    make_zip(archive, [('good.pyc', 8, good_data, deflate(good_data, 9)),
+                       ('bad.pyc', 8, bad_data, bad_packed[:len(bad_packed) // 2])])
+
+    errors = []
+    out_dir = os.path.join(workdir, 'out')
+    proc = run([tool('pycdc'), '--out-dir', out_dir, archive])
+    if proc.returncode != 1:
+        errors.append('pycdc exited with {}, expected 1:\n{}'.format(proc.returncode, proc.stderr))
+    if 'bad.pyc' not in proc.stderr:
+        errors.append('no error reported for the truncated member:\n{}'.format(proc.stderr))
+    if os.path.exists(os.path.join(out_dir, 'bad.py')):
+        errors.append('output written for the truncated member\n')
+    return errors + check_tree(out_dir, {'good.py': good})
+
+
+def test_wheel(workdir):
+    """A wheel with __pycache__ members is written out as a source tree"""
+    pyc_file = os.path.join(COMPILED_DIR, 'test_sets.3.10.pyc')
+    with open(pyc_file, 'rb') as pyc:
+        data = pyc.read()
+    metadata = b'Metadata-Version: 2.1\nName: pkg\n'
+    archive = os.path.join(workdir, 'pkg-1.0-py3-none-any.whl')
+    make_zip(archive, [('pkg/__pycache__/sets.cpython-310.pyc', 8, data, deflate(data, 6)),
+                       ('pkg/mod.pyc', 0, data, data),
+                       ('pkg-1.0.dist-info/METADATA', 8, metadata, deflate(metadata, 6))])
+
+    errors = []
+    out_dir = os.path.join(workdir, 'out')
+    proc = run([tool('pycdc'), '--out-dir', out_dir, archive])
+    if proc.returncode != 0:
+        errors.append('pycdc exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    written = sorted(os.path.relpath(os.path.join(root, name), out_dir).replace(os.sep, '/')
+                     for root, _, names in os.walk(out_dir) for name in names)
+    if written != ['pkg/mod.py', 'pkg/sets.py']:
+        errors.append('unexpected output files: {}\n'.format(written))
+    return errors + check_tree(out_dir, {'pkg/sets.py': pyc_file, 'pkg/mod.py': pyc_file})
+
+
+def pyinstaller_pyz(modules):
+    """PYZ archive of (name, kind, marshalled code) with a Python 2.7 magic"""
+    data = b''
+    toc = []
+    for name, kind, code in modules:
+        stored = zlib.compress(code)
+        info = [b'i' + marshal_int(kind), b'i' + marshal_int(12 + len(data)),
+                b'i' + marshal_int(len(stored))]
+        toc.append(marshal_tuple([marshal_string(name), marshal_tuple(info)]))
+        data += stored
+    return (b'PYZ\0\x03\xf3\r\n' + struct.pack('>I', 12 + len(data)) + data
+            + b'[' + marshal_int(len(toc)) + b''.join(toc))
+
+
+def pyinstaller_executable(entries):
+    """
+    An executable stub followed by a CArchive of (name, type code, payload,
+    compressed) entries, packed for Python 2.7
+    """
+    data = b''
+    toc = b''
+    for name, type_code, payload, compressed in entries:
+        stored = zlib.compress(payload) if compressed else payload
+        name += b'\0' * (16 - (len(name) + 18) % 16)
+        toc += struct.pack('>IIIIBc', 18 + len(name), len(data), len(stored), len(payload),
+                           int(compressed), type_code) + name
+        data += stored
+    cookie = (b'MEI\014\013\012\013\016'
+              + struct.pack('>IIII', len(data) + len(toc) + 88, len(data), len(toc), 27)
+              + b'libpython2.7.so'.ljust(64, b'\0'))
+    return b'\x7fELF' + b'\0' * 200 + data + toc + cookie
+
+
+def test_pyinstaller(workdir):
+    """
+    The entry script, modules stored in the CArchive (with and without a pyc
+    header) and modules and packages in a PYZ are decompiled to a tree named
+    after the module names; data entries are skipped.
+    """
+    def module(value):
+        return py27_code(PY27_STORE_CONST1, [b'N', b'i' + marshal_int(value)], [b'x'])
+    pyz = pyinstaller_pyz([(b'pkg', 1, module(3)), (b'pkg.sub', 0, module(4)), (b'res', 2, b'data')])
+    exe = os.path.join(workdir, 'app.exe')
+    with open(exe, 'wb') as f:
+        f.write(pyinstaller_executable([
+            (b'main', b's', module(1), False),
+            (b'helper', b'm', b'\x03\xf3\r\n' + marshal_int(0) + module(2), True),
+            (b'libfoo.so', b'b', b'\x7fELF', False),
+            (b'PYZ-00.pyz', b'z', pyz, False),
+        ]))
+    expected = [('main.py', 'x = 1'), ('helper.py', 'x = 2'),
+                ('pkg/__init__.py', 'x = 3'), ('pkg/sub.py', 'x = 4')]
+
+    errors = []
+    out_dir = os.path.join(workdir, 'out')
+    proc = run([tool('pycdc'), '--out-dir', out_dir, '--workers', '2', exe])
+    if proc.returncode != 0 or '已反编译 4 个成员，0 个失败' not in proc.stderr + proc.stdout:
+        return ['pycdc --out-dir exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    found = sorted(os.path.relpath(os.path.join(root, name), out_dir).replace(os.sep, '/')
+                   for root, _, names in os.walk(out_dir) for name in names)
+    if found != sorted(name for name, _ in expected):
+        errors.append('unexpected files: {}\n'.format(found))
+    for name, source in expected:
+        path = os.path.join(out_dir, name)
+        if os.path.exists(path):
+            with open(path, 'r', encoding='utf-8') as f:
+                if strip_header(f.read()) != '\n' + source + '\n':
+                    errors.append('{}: expected "{}"\n'.format(name, source))
+
+    out_zip = os.path.join(workdir, 'out.zip')
+    proc = run([tool('pycdc'), '--out-zip', out_zip, '--workers', '3', exe])
+    if proc.returncode != 0:
+        errors.append('pycdc --out-zip exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    else:
+        with zipfile.ZipFile(out_zip) as archive:
+            if archive.namelist() != [name for name, _ in expected]:
+                errors.append('unexpected zip members: {}\n'.format(archive.namelist()))
+    return errors
+
+
+def test_tar_corpus(workdir):
+    """
+    Decompiles the whole compiled corpus into a tar stream, with threads and
+    with worker processes, and compares every member with the direct output.
+    """
+    pyc_files = sorted(glob.glob(os.path.join(COMPILED_DIR, '*.pyc')))
+    errors = []
+    modes = [['--workers', '4']]
+    if os.name == 'posix':
+        modes.append(['--workers', '4', '--isolate'])
+    for mode in modes:
+        archive = os.path.join(workdir, 'corpus.tar')
+        proc = run([tool('pycdc'), '--out-tar', archive] + mode + [COMPILED_DIR])
+        expected_rc = 0 if all(decompile_direct(f) is not None for f in pyc_files) else 1
+        if proc.returncode != expected_rc:
+            errors.append('{}: pycdc exited with {}:\n{}'
+                          .format(' '.join(mode), proc.returncode, proc.stderr))
+        with tarfile.open(archive) as tar:
+            names = tar.getnames()
+            members = {m.name: tar.extractfile(m).read().decode('utf-8', 'replace')
+                       for m in tar.getmembers() if m.isfile()}
+        expected = [os.path.basename(f)[:-len('.pyc')] + '.py' for f in pyc_files
+                    if decompile_direct(f) is not None]
+        if sorted(names) != sorted(expected):
+            errors.append('{}: tar members do not match the corpus\n'.format(' '.join(mode)))
+        for pyc_file in pyc_files:
+            name = os.path.basename(pyc_file)[:-len('.pyc')] + '.py'
+            if name in members and strip_header(members[name]) != decompile_direct(pyc_file):
+                errors.append('{}: {} differs from the direct output\n'
+                              .format(' '.join(mode), name))
+    return errors
+
+
+def test_prefetch(workdir):
+    """
+    A directory is decompiled with its .pyc and .pyo files read ahead in the
+    background: the output tree, the tar member order and every source are
+    the same with any read-ahead limit and number of workers, including a file
+    larger than the read-ahead limit.
+    """
+    corpus = os.path.join(workdir, 'corpus')
+    os.makedirs(os.path.join(corpus, 'pkg', '__pycache__'))
+    os.makedirs(os.path.join(corpus, 'other'))
+    inputs = {
+        'top.py': os.path.join(corpus, 'top.pyc'),
+        'pkg/mod.py': os.path.join(corpus, 'pkg', '__pycache__', 'mod.cpython-27.pyc'),
+        'other/opt.py': os.path.join(corpus, 'other', 'opt.pyo'),
+        'big.py': os.path.join(corpus, 'big.pyc'),
+    }
+    for value, name in enumerate(['top.py', 'pkg/mod.py', 'other/opt.py']):
+        write_py27(inputs[name], py27_code(PY27_STORE_CONST1, [b'N', b'i' + marshal_int(value)], [b'x']))
+    names = [('f{}'.format(i)).encode('ascii') for i in range(12000)]
+    write_py27(inputs['big.py'], py27_defines([(name, py27_function(name)) for name in names]))
+    if os.path.getsize(inputs['big.py']) <= 1024 * 1024:
+        return ['big.pyc is not larger than the read-ahead limit\n']
+    with open(os.path.join(corpus, 'other', 'readme.txt'), 'w') as f:
+        f.write('not bytecode\n')
+
+    errors = []
+    for mode in [['--workers', '1'], ['--workers', '4', '--read-ahead', '1'], ['--workers', '4']]:
+        label = ' '.join(mode)
+        archive = os.path.join(workdir, 'out.tar')
+        proc = run([tool('pycdc'), '--out-tar', archive] + mode + [corpus])
+        if proc.returncode != 0 or '已反编译 4 个成员，0 个失败' not in proc.stderr + proc.stdout:
+            errors.append('{}: pycdc exited with {}:\n{}'.format(label, proc.returncode, proc.stderr))
+            continue
+        with tarfile.open(archive) as tar:
+            members = [(m.name, tar.extractfile(m).read().decode('utf-8')) for m in tar.getmembers()]
+        if [name for name, _ in members] != sorted(inputs):
+            errors.append('{}: unexpected members {}\n'.format(label, [name for name, _ in members]))
+        for name, source in members:
+            if name in inputs and strip_header(source) != decompile_direct(inputs[name]):
+                errors.append('{}: {} differs from the direct output\n'.format(label, name))
+    return errors
+
+
+def test_tar_extras(workdir):
+    """
+    --out-tar with --with-disasm and --with-stats writes each module's source,
+    disassembly and statistics next to each other, in input order, with paths
+    longer than the 100 bytes of a plain tar header.
+    """
+    corpus = os.path.join(workdir, 'corpus')
+    long_dir = os.path.join(corpus, *['directory_with_a_long_name_{}'.format(i) for i in range(6)])
+    os.makedirs(long_dir)
+    inputs = [('cls', os.path.join(COMPILED_DIR, 'test_class.2.5.pyc')),
+              (os.path.relpath(long_dir, corpus).replace(os.sep, '/') + '/module',
+               os.path.join(COMPILED_DIR, 'test_sets.3.10.pyc'))]
+    for name, pyc_file in inputs:
+        shutil.copyfile(pyc_file, os.path.join(corpus, *name.split('/')) + '.pyc')
+
+    archive = os.path.join(workdir, 'out.tar')
+    proc = run([tool('pycdc'), '--out-tar', archive, '--with-disasm', '--with-stats',
+                '--workers', '2', corpus])
+    if proc.returncode != 0:
+        return ['pycdc exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    with tarfile.open(archive) as tar:
+        members = [(m.name, tar.extractfile(m).read().decode('utf-8')) for m in tar.getmembers()]
+
+    errors = []
+    expected = [name + suffix for name, _ in inputs for suffix in ('.py', '.dis', '.stats')]
+    if [name for name, _ in members] != expected:
+        return ['unexpected members: {}\n'.format([name for name, _ in members])]
+    contents = dict(members)
+    for name, pyc_file in inputs:
+        source = contents[name + '.py']
+        disasm = contents[name + '.dis']
+        stats = dict(line.split('=', 1) for line in contents[name + '.stats'].splitlines())
+        if strip_header(source) != decompile_direct(pyc_file):
+            errors.append('{}.py differs from the direct output\n'.format(name))
+        # The second line of pycdas output names the input, relative inside the archive
+        direct = run([tool('pycdas'), os.path.join(corpus, *name.split('/')) + '.pyc']).stdout
+        if disasm.split('\n', 2)[2] != direct.split('\n', 2)[2]:
+            errors.append('{}.dis differs from the pycdas output\n'.format(name))
+        version = os.path.basename(pyc_file).split('.', 1)[1][:-len('.pyc')]
+        if (stats.get('version') != version or stats.get('warnings') != '0'
+                or stats.get('source') != str(len(source.encode('utf-8')))
+                or stats.get('disasm') != str(len(disasm.encode('utf-8')))):
+            errors.append('unexpected statistics for {}: {}\n'.format(name, stats))
+    return errors
+
+
+def test_work_stealing(workdir):
+    """
+    A module large enough to be split between threads, among small ones and
+    behind a read-ahead limit smaller than the window, decompiles to the same
+    files with one thread and with four.
+    """
+    in_dir = os.path.join(workdir, 'in')
+    os.mkdir(in_dir)
+    functions = [('f{}'.format(i).encode(), py27_function('f{}'.format(i).encode()))
+                 for i in range(3000)]
+    big = os.path.join(in_dir, 'big.pyc')
+    write_py27(big, py27_defines(functions))
+    expected = {'big.py': big}
+    for name in SAMPLE_MODULES:
+        shutil.copy(os.path.join(COMPILED_DIR, name), in_dir)
+        expected[name[:-len('.pyc')] + '.py'] = os.path.join(in_dir, name)
+
+    errors = []
+    outputs = {}
+    for workers in ['1', '4']:
+        out_dir = os.path.join(workdir, 'out' + workers)
+        proc = run([tool('pycdc'), '--out-dir', out_dir, '--workers', workers,
+                    '--read-ahead', '1', in_dir])
+        if proc.returncode != 0:
+            errors.append('--workers {}: pycdc exited with {}:\n{}'
+                          .format(workers, proc.returncode, proc.stderr))
+            continue
+        errors += ['--workers {}: {}'.format(workers, e) for e in check_tree(out_dir, expected)]
+        with open(os.path.join(out_dir, 'big.py'), 'r', encoding='utf-8') as src:
+            outputs[workers] = src.read()
+    if len(outputs) == 2 and outputs['1'] != outputs['4']:
+        errors.append('big.py differs between one and four threads\n')
+    if '1' in outputs and 'def f2999():\n    pass\n' not in outputs['1']:
+        errors.append('big.py is missing its last function\n')
+    return errors
+
+
+def test_isolate_recovery(workdir):
+    """
+    With --isolate, a module that crashes its worker process (nesting too
+    deep for a 256 KB stack) and one that runs past --timeout are reported
+    and skipped; the other modules are still decompiled.
+    """
+    if os.name != 'posix' or resource is None:
+        return []
+    in_dir = os.path.join(workdir, 'in')
+    os.mkdir(in_dir)
+    write_py27(os.path.join(in_dir, 'crash.pyc'), nested_functions(200))
+    # 1.2 million 'x = 1' statements take a few seconds to decompile
+    code = b'd\x00\x00Z\x00\x00' * 1200000 + b'd\x01\x00S'
+    write_py27(os.path.join(in_dir, 'slow.pyc'),
+               py27_code(code, [b'i' + marshal_int(1), b'N'], [b'x']))
+    expected = {}
+    for name in SAMPLE_MODULES:
+        shutil.copy(os.path.join(COMPILED_DIR, name), in_dir)
+        expected[name[:-len('.pyc')] + '.py'] = os.path.join(COMPILED_DIR, name)
+
+    errors = []
+    out_dir = os.path.join(workdir, 'out')
+    proc = run_small_stack([tool('pycdc'), '--out-dir', out_dir, '--isolate', '--workers', '2',
+                            '--timeout', '1', in_dir], 256 * 1024)
+    if proc.returncode != 1:
+        errors.append('pycdc exited with {}, expected 1:\n{}'.format(proc.returncode, proc.stderr))
+    for line in ['错误：crash.pyc: 工作进程被信号 11 终止，已跳过该文件\n',
+                 '错误：slow.pyc: 处理超过 1 秒，已跳过该文件\n',
+                 '警告：2 个文件导致工作进程崩溃或超时\n']:
+        if line not in proc.stderr:
+            errors.append('missing {!r} in:\n{}'.format(line, proc.stderr))
+    errors += check_tree(out_dir, expected)
+    for name in ['crash.py', 'slow.py']:
+        if os.path.exists(os.path.join(out_dir, name)):
+            errors.append('output written for the skipped {}\n'.format(name))
+    return errors
+
+
+def cache_phases(trace_file):
+    with open(trace_file, 'r', encoding='utf-8') as trace:
+        return {event['name'] for event in json.load(trace)['traceEvents']}
+
+
+def test_cache(workdir):
+    """The second run hits the cache: same output, and the module is not loaded again"""
+    pyc_file = os.path.join(COMPILED_DIR, 'test_sets.3.10.pyc')
+    cache_dir = os.path.join(workdir, 'cache')
+    errors = []
+    outputs = []
+    for i, expect_hit in enumerate([False, True]):
+        trace_file = os.path.join(workdir, 'trace{}.json'.format(i))
+        proc = run([tool('pycdc'), '--cache-dir', cache_dir, '--trace', trace_file, pyc_file])
+        if proc.returncode != 0:
+            errors.append('pycdc exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+            return errors
+        outputs.append(proc.stdout)
+        hit = 'load' not in cache_phases(trace_file)
+        if hit != expect_hit:
+            errors.append('run {}: expected a cache {}\n'.format(i + 1, 'hit' if expect_hit else 'miss'))
+    if outputs[0] != outputs[1]:
+        errors.append('cached output differs from the first run\n')
+    if strip_header(outputs[0]) != decompile_direct(pyc_file):
+        errors.append('output with --cache-dir differs from the output without it\n')
+    if not glob.glob(os.path.join(cache_dir, '*', '*')):
+        errors.append('no cache entries written\n')
+
+    # Different content with the same path must miss
+    copy = os.path.join(workdir, 'module.pyc')
+    shutil.copyfile(pyc_file, copy)
+    trace_file = os.path.join(workdir, 'trace2.json')
+    run([tool('pycdc'), '--cache-dir', cache_dir, '--trace', trace_file, copy])
+    if 'load' in cache_phases(trace_file):
+        errors.append('copy of a cached file missed the cache\n')
+    shutil.copyfile(os.path.join(COMPILED_DIR, 'unpack_assign.3.7.pyc'), copy)
+    run([tool('pycdc'), '--cache-dir', cache_dir, '--trace', trace_file, copy])
+    if 'load' not in cache_phases(trace_file):
+        errors.append('changed file hit the cache\n')
+    return errors
+
+
+def build_counts(trace_file):
+    """Number of BuildFromCode spans for each code object name"""
+    counts = {}
+    with open(trace_file, 'r', encoding='utf-8') as trace:
+        for event in json.load(trace)['traceEvents']:
+            if event['name'] == 'BuildFromCode':
+                name = event['args']['detail']
+                counts[name] = counts.get(name, 0) + 1
+    return counts
+
+
+def test_cache_size(workdir):
+    """
+    Every store keeps the cache under --cache-size by dropping the least
+    recently used entries: the newest module still hits, the oldest misses.
+    """
+    cache_dir = os.path.join(workdir, 'cache')
+    modules = []
+    for i in range(6):
+        # 30 assignments of a 10 KB string: about 300 KB of output
+        value = marshal_string(str(i).encode('ascii') * 10000)
+        pyc_file = os.path.join(workdir, 'm{}.pyc'.format(i))
+        write_py27(pyc_file, py27_code(b'd\x00\x00Z\x00\x00' * 30 + b'd\x01\x00S',
+                                       [value, b'N'], [b'x']))
+        modules.append(pyc_file)
+        run([tool('pycdc'), '--cache-dir', cache_dir, '--cache-size', '1', pyc_file])
+
+    errors = []
+    entries = [path for path in glob.glob(os.path.join(cache_dir, '*', '*'))
+               if not path.endswith('usage')]
+    total = sum(os.path.getsize(path) for path in entries)
+    if total > 1024 * 1024 or len(entries) != 3:
+        errors.append('{} entries with {} bytes left in a 1 MB cache\n'.format(len(entries), total))
+    for pyc_file, expect_hit in [(modules[-1], True), (modules[0], False)]:
+        trace_file = os.path.join(workdir, 'trace.json')
+        run([tool('pycdc'), '--cache-dir', cache_dir, '--cache-size', '1', '--trace', trace_file,
+             pyc_file])
+        if ('load' not in cache_phases(trace_file)) != expect_hit:
+            errors.append('{}: expected a cache {}\n'.format(os.path.basename(pyc_file),
+                                                             'hit' if expect_hit else 'miss'))
+    return errors
+
+
+def test_memo(workdir):
+    """
+    Identical function bodies are decompiled once in archive mode, and again
+    in other files through --cache-dir; a plain run decompiles every body.
+    """
+    body = py27_code(PY27_STORE_CONST, [b'i' + marshal_int(7), b'N'], [b'x'],
+                     name=b'f', flags=CO_FUNCTION)
+    other = py27_code(PY27_STORE_CONST, [b'i' + marshal_int(8), b'N'], [b'y'],
+                      name=b'g', flags=CO_FUNCTION)
+    corpus = os.path.join(workdir, 'corpus')
+    os.makedirs(corpus)
+    twice = os.path.join(corpus, 'twice.pyc')
+    write_py27(twice, py27_defines([(b'f', body), (b'f', body)]))
+    expected = 'def f():\n    x = 7\n\n\ndef f():\n    x = 7\n\n'
+
+    errors = []
+    trace_file = os.path.join(workdir, 'direct.json')
+    proc = run([tool('pycdc'), '--trace', trace_file, twice])
+    if not proc.stdout.endswith(expected):
+        errors.append('unexpected output:\n{}'.format(proc.stdout))
+    if build_counts(trace_file).get('f') != 2:
+        errors.append('a plain run reused a function body: {}\n'.format(build_counts(trace_file)))
+
+    out_dir = os.path.join(workdir, 'out')
+    trace_file = os.path.join(workdir, 'archive.json')
+    proc = run([tool('pycdc'), '--trace', trace_file, '--out-dir', out_dir, '--workers', '1', corpus])
+    if proc.returncode != 0:
+        return errors + ['pycdc --out-dir exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    with open(os.path.join(out_dir, 'twice.py'), 'r', encoding='utf-8') as src:
+        if not src.read().endswith(expected):
+            errors.append('archive output differs from the plain run\n')
+    if build_counts(trace_file).get('f') != 1:
+        errors.append('archive mode decompiled the body {} times, expected once\n'
+                      .format(build_counts(trace_file).get('f')))
+
+    # The second file shares f with the first one but is not identical to it
+    cache_dir = os.path.join(workdir, 'cache')
+    first = os.path.join(workdir, 'first.pyc')
+    second = os.path.join(workdir, 'second.pyc')
+    write_py27(first, py27_defines([(b'f', body)]))
+    write_py27(second, py27_defines([(b'g', other), (b'f', body)]))
+    run([tool('pycdc'), '--cache-dir', cache_dir, first])
+    trace_file = os.path.join(workdir, 'cached.json')
+    proc = run([tool('pycdc'), '--cache-dir', cache_dir, '--trace', trace_file, second])
+    if not proc.stdout.endswith('def g():\n    y = 8\n\n\ndef f():\n    x = 7\n\n'):
+        errors.append('unexpected output with --cache-dir:\n{}'.format(proc.stdout))
+    counts = build_counts(trace_file)
+    if counts.get('f') or counts.get('g') != 1:
+        errors.append('--cache-dir did not reuse f from another file: {}\n'.format(counts))
+    return errors
+
+
+def server_frame(data):
+    return struct.pack('<I', len(data)) + data
+
+
+def parse_server_response(data):
+    """Splits one --serve response into its header fields and text sections"""
+    head, _, rest = data.partition(b'\n\n')
+    fields = dict(line.split('=', 1) for line in head.decode('utf-8').splitlines())
+    for key in ('source', 'disasm', 'warnings'):
+        size = int(fields[key])
+        fields[key], rest = rest[:size].decode('utf-8'), rest[size:]
+    return fields
+
+
+def read_server_responses(data):
+    responses = {}
+    while data:
+        size, = struct.unpack('<I', data[:4])
+        response = parse_server_response(data[4:4 + size])
+        responses[response['id']] = response
+        data = data[4 + size:]
+    return responses
+
+
+def test_server(workdir):
+    """
+    --serve answers framed requests with inline content or a path, with and
+    without disassembly, and reports a bad input as an error without stopping;
+    --serve-socket speaks the same protocol over a Unix domain socket.
+    """
+    body = py27_code(PY27_STORE_CONST, [b'i' + marshal_int(7), b'N'], [b'x'],
+                     name=b'f', flags=CO_FUNCTION)
+    module = b'\x03\xf3\r\n' + marshal_int(0) + py27_defines([(b'f', body)])
+    path = os.path.join(COMPILED_DIR, 'test_sets.3.10.pyc')
+    requests = (server_frame(b'id=inline\ndisasm=1\n\n' + module)
+                + server_frame('id=path\npath={}\n\n'.format(path).encode('utf-8'))
+                + server_frame(b'id=bad\n\nnot a pyc file'))
+
+    errors = []
+    proc = subprocess.run([tool('pycdc'), '--serve', '--workers', '2'], input=requests,
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if proc.returncode != 0:
+        return ['pycdc --serve exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    responses = read_server_responses(proc.stdout)
+    if sorted(responses) != ['bad', 'inline', 'path']:
+        return ['unexpected responses: {}\n'.format(sorted(responses))]
+
+    inline = responses['inline']
+    if (inline['status'] != 'ok' or inline['version'] != '2.7'
+            or inline['source'] != '\ndef f():\n    x = 7\n\n'
+            or 'MAKE_FUNCTION' not in inline['disasm'] or inline['warnings']):
+        errors.append('unexpected response for inline content: {}\n'.format(inline))
+    by_path = responses['path']
+    if (by_path['status'] != 'ok' or by_path['version'] != '3.10' or by_path['disasm']
+            or '\n' + by_path['source'] != decompile_direct(path)):
+        errors.append('unexpected response for a path: {}\n'.format(by_path))
+    bad = responses['bad']
+    if bad['status'] != 'error' or 'Bad MAGIC' not in bad['warnings']:
+        errors.append('unexpected response for bad input: {}\n'.format(bad))
+
+    if not hasattr(socket, 'AF_UNIX'):
+        return errors
+    socket_path = os.path.join(workdir, 'pycdc.sock')
+    server = subprocess.Popen([tool('pycdc'), '--serve-socket', socket_path],
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        for _ in range(100):
+            if os.path.exists(socket_path):
+                break
+            time.sleep(0.05)
+        client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        client.connect(socket_path)
+        client.sendall(server_frame(b'id=sock\n\n' + module))
+        client.shutdown(socket.SHUT_WR)
+        data = b''
+        while True:
+            chunk = client.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+        client.close()
+        response = read_server_responses(data).get('sock')
+        if response is None or response['source'] != inline['source']:
+            errors.append('unexpected response over the socket: {}\n'.format(response))
+    finally:
+        server.kill()
+        server.wait()
+    return errors
+
+
+def test_pycindex(workdir):
+    """Builds an index over a copy of some modules, queries it, then prunes a file"""
+    corpus = os.path.join(workdir, 'corpus')
+    os.makedirs(corpus)
+    for module in SAMPLE_MODULES + ['test_sets.3.10.pyc']:
+        shutil.copyfile(os.path.join(COMPILED_DIR, module), os.path.join(corpus, module))
+    index = os.path.join(workdir, 'corpus.idx')
+
+    errors = []
+    proc = run([tool('pycindex'), 'update', index, corpus])
+    if proc.returncode != 0:
+        return ['pycindex update exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+
+    # test_sets calls set(); no other sample module uses that name
+    proc = run([tool('pycindex'), 'query', index, 'set'])
+    hits = [line.split('\t') for line in proc.stdout.splitlines()]
+    files = {os.path.basename(hit[1]) for hit in hits}
+    if files != {'test_sets.3.10.pyc'} or any(hit[0] != 'set' or hit[3] != 'name' for hit in hits):
+        errors.append('unexpected hits for "set":\n{}'.format(proc.stdout))
+
+    proc = run([tool('pycindex'), 'query', '--prefix', index, 'se'])
+    if not any(line.split('\t')[0] == 'set' for line in proc.stdout.splitlines()):
+        errors.append('prefix query "se" does not find "set":\n{}'.format(proc.stdout))
+
+    proc = run([tool('pycindex'), 'update', index, corpus])
+    if '已索引 0 个文件' not in proc.stderr + proc.stdout:
+        errors.append('unchanged files were indexed again:\n{}'.format(proc.stderr + proc.stdout))
+
+    os.unlink(os.path.join(corpus, 'test_sets.3.10.pyc'))
+    proc = run([tool('pycindex'), 'prune', index])
+    if proc.returncode != 0:
+        errors.append('pycindex prune exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    proc = run([tool('pycindex'), 'query', index, 'set'])
+    if proc.stdout:
+        errors.append('pruned file is still in the index:\n{}'.format(proc.stdout))
+    return errors
+
+
+def test_consts(workdir):
+    """
+    pycdas --consts lists names and constants in code object order, with
+    container elements one by one, numbers as Python literals and non-ASCII
+    bytes of Python 2 strings as \\u00XX; Python 3 bytes are told apart from str.
+    """
+    inner = py27_code(PY27_STORE_CONST1, [b'N', marshal_string(b'tab\there\xff')], [b'y'],
+                      name=b'g', flags=CO_FUNCTION)
+    numbers = [b'i' + marshal_int(42), b'g' + struct.pack('<d', 1.5),
+               b'y' + struct.pack('<dd', 0.5, 2.0), b'u' + marshal_int(2) + '\u00e9'.encode('utf-8')]
+    pyc_file = os.path.join(workdir, 'consts.pyc')
+    write_py27(pyc_file, py27_code(PY27_STORE_CONST1, [b'N', marshal_tuple(numbers), inner], [b'x']))
+    expected = [
+        ('<module>', 'name', 'x'),
+        ('<module>', 'int', '42'),
+        ('<module>', 'float', '1.5'),
+        ('<module>', 'complex', '(0.5+2j)'),
+        ('<module>', 'str', '\u00e9'),
+        ('g', 'name', 'y'),
+        ('g', 'str', 'tab\there\u00ff'),
+    ]
+
+    errors = []
+    py3_file = os.path.join(COMPILED_DIR, 'unicode_future.3.7.pyc')
+    proc = run([tool('pycdas'), '--consts', pyc_file, py3_file])
+    if proc.returncode != 0:
+        return ['pycdas --consts exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    records = [json.loads(line) for line in proc.stdout.splitlines()]
+    found = [(r['code'], r['kind'], r['value']) for r in records if r['file'] == pyc_file]
+    if found != expected:
+        errors.append('unexpected constants:\n{}'.format(proc.stdout))
+    found = [(r['kind'], r['value']) for r in records if r['file'] == py3_file]
+    if found[-3:] != [('str', 'Unicode'), ('bytes', 'Bytes'), ('str', 'Default')]:
+        errors.append('unexpected Python 3 constants: {}\n'.format(found))
+    return errors
+
+
+def test_code_walk(workdir):
+    """
+    pycdas --jsonl/--consts, pycdc --metadata and pycindex visit every code
+    object of a deeply nested module in the same preorder, with a stack far
+    smaller than recursion over the code objects would need.
+    """
+    depth = 990
+    pyc_file = os.path.join(workdir, 'nested.pyc')
+    write_py27(pyc_file, nested_functions(depth))
+    stack = 128 * 1024
+    qualnames = ['<module>'] + ['f' + '.<locals>.f' * i for i in range(depth)]
+
+    errors = []
+    proc = run_small_stack([tool('pycdas'), '--jsonl', pyc_file], stack)
+    if proc.returncode != 0:
+        errors.append('pycdas --jsonl exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    else:
+        records = [json.loads(line) for line in proc.stdout.splitlines()]
+        codes = [(r['id'], r['parent'], r['qualname']) for r in records if r['record'] == 'code']
+        expected = [(i, i - 1 if i else None, qualnames[i]) for i in range(depth + 1)]
+        if codes != expected:
+            errors.append('pycdas --jsonl: unexpected code records {}...\n'.format(codes[:3]))
+
+    proc = run_small_stack([tool('pycdas'), '--consts', pyc_file], stack)
+    if proc.returncode != 0:
+        errors.append('pycdas --consts exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    else:
+        # Every level but the innermost function refers to f in co_names
+        names = [r['code'] for r in map(json.loads, proc.stdout.splitlines()) if r['kind'] == 'name']
+        if names != qualnames[:depth]:
+            errors.append('pycdas --consts: unexpected names {}...\n'.format(names[:3]))
+
+    metadata = os.path.join(workdir, 'metadata.json')
+    proc = run_small_stack([tool('pycdc'), '--no-source', '--metadata', metadata, pyc_file], stack)
+    if proc.returncode != 0:
+        errors.append('pycdc --metadata exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    else:
+        with open(metadata, 'r', encoding='utf-8') as f:
+            codes = [code['qualname'] for code in json.load(f)['codes']]
+        if codes != qualnames:
+            errors.append('pycdc --metadata: unexpected codes {}...\n'.format(codes[:3]))
+
+    index = os.path.join(workdir, 'nested.idx')
+    proc = run_small_stack([tool('pycindex'), 'update', index, pyc_file], stack)
+    if proc.returncode != 0:
+        errors.append('pycindex update exited with {}:\n{}'.format(proc.returncode, proc.stderr))
+    else:
+        proc = run([tool('pycindex'), 'query', index, 'f'])
+        hits = {(hit[2], hit[3]) for hit in (line.split('\t') for line in proc.stdout.splitlines())}
+        if (qualnames[depth - 1], 'name') not in hits or (qualnames[depth], 'name') in hits:
+            errors.append('pycindex: unexpected hits for "f" in the innermost functions\n')
+    return errors
+
+
+def test_multi_output(workdir):
+    """
+    One pycdc run loads the module once and writes the source, the same
+    disassembly as pycdas, the exception table and the metadata.
+    """
+    pyc_file = os.path.join(workdir, 'try.pyc')
+    with open(pyc_file, 'wb') as pyc:
+        pyc.write(py311_try_module())
+    outputs = {name: os.path.join(workdir, name)
+               for name in ('try.py', 'try.dis', 'try.exc', 'try.json', 'trace.json')}
+    proc = run([tool('pycdc'), '-o', outputs['try.py'], '--disasm', outputs['try.dis'],
+                '--exception-table', outputs['try.exc'], '--metadata', outputs['try.json'],
+                '--trace', outputs['trace.json'], pyc_file])
+    if proc.returncode != 0:
+        return ['pycdc exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    texts = {}
+    for name, path in outputs.items():
+        with open(path, 'r', encoding='utf-8') as f:
+            texts[name] = f.read()
+
+    errors = []
+    if strip_header(texts['try.py']) != decompile_direct(pyc_file):
+        errors.append('source differs from a plain run:\n{}'.format(texts['try.py']))
+    if texts['try.dis'] != run([tool('pycdas'), pyc_file]).stdout:
+        errors.append('disassembly differs from pycdas:\n{}'.format(texts['try.dis']))
+    if texts['try.exc'] != '<module>:\n    4 to 8 -> 12 [0] \n':
+        errors.append('unexpected exception table:\n{}'.format(texts['try.exc']))
+    metadata = json.loads(texts['try.json'])
+    code = metadata['codes'][0]
+    if (metadata['version'] != '3.11' or len(metadata['codes']) != 1
+            or code['qualname'] != '<module>' or code['bytecode_size'] != 26
+            or code['consts'] != 3 or code['exception_table'] != 1 or code['names'] != ['x']):
+        errors.append('unexpected metadata:\n{}'.format(texts['try.json']))
+    loads = [e for e in json.loads(texts['trace.json'])['traceEvents'] if e['name'] == 'load']
+    if len(loads) != 1:
+        errors.append('the module was loaded {} times\n'.format(len(loads)))
+    return errors
+
+
+class AstBinaryReader(object):
+    """Decodes pycdc --ast-bin output into the same values as --ast-json"""
+
+    def __init__(self, data):
+        if data[:8] != b'PYCAST01':
+            raise ValueError('bad magic')
+        self.data = data
+        self.pos = 8
+        self.kinds = []
+        for _ in range(self.varint()):
+            name = self.string()
+            self.kinds.append((name, [self.string() for _ in range(self.varint())]))
+
+    def varint(self):
+        result = shift = 0
+        while True:
+            byte = self.data[self.pos]
+            self.pos += 1
+            result |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return result
+
+    def string(self):
+        size = self.varint()
+        self.pos += size
+        return self.data[self.pos - size:self.pos].decode('utf-8')
+
+    def value(self):
+        tag = self.data[self.pos]
+        self.pos += 1
+        if tag <= 2:
+            return [None, False, True][tag]
+        if tag == 3:
+            number = self.varint()
+            return (number >> 1) ^ -(number & 1)
+        if tag == 4:
+            return self.string()
+        size = self.varint()
+        end = self.pos + size
+        if tag == 5:
+            result = [self.value() for _ in range(self.varint())]
+        elif tag == 6:
+            kind, fields = self.kinds[self.varint()]
+            result = {'node': kind}
+            for field in fields:
+                result[field] = self.value()
+        else:
+            raise ValueError('bad tag {}'.format(tag))
+        if self.pos != end:
+            raise ValueError('size of a list or node does not match its contents')
+        return result
+
+
+def test_ast_export(workdir):
+    """
+    --ast-json writes the tree built by BuildFromCode, including nested code
+    and a clean flag; --ast-bin decodes to exactly the same tree.
+    """
+    function = py27_code(PY27_STORE_CONST1, [b'N', b'i' + marshal_int(7)], [b'x'],
+                         name=b'f', flags=CO_FUNCTION)
+    pyc_file = os.path.join(workdir, 'simple.pyc')
+    write_py27(pyc_file, py27_defines([(b'f', function)]))
+    try_file = os.path.join(workdir, 'try.pyc')
+    with open(try_file, 'wb') as pyc:
+        pyc.write(py311_try_module())
+
+    errors = []
+    trees = {}
+    for path in [pyc_file, try_file] + [os.path.join(COMPILED_DIR, m) for m in SAMPLE_MODULES]:
+        json_file = os.path.join(workdir, 'tree.json')
+        bin_file = os.path.join(workdir, 'tree.bin')
+        proc = run([tool('pycdc'), '--no-source', '--ast-json', json_file, '--ast-bin', bin_file, path])
+        if proc.returncode != 0:
+            errors.append('{}: pycdc exited with {}:\n{}'.format(path, proc.returncode, proc.stderr))
+            continue
+        with open(json_file, 'r', encoding='utf-8') as f:
+            tree = json.load(f)
+        with open(bin_file, 'rb') as f:
+            try:
+                if AstBinaryReader(f.read()).value() != tree:
+                    errors.append('{}: --ast-bin differs from --ast-json\n'.format(path))
+            except (ValueError, IndexError) as e:
+                errors.append('{}: cannot decode --ast-bin: {}\n'.format(path, e))
+        trees[path] = tree
+
+    store = trees[pyc_file]['body']['nodes'][0]
+    function_node = store['value']
+    if (trees[pyc_file]['version'] != '2.7' or not trees[pyc_file]['clean']
+            or store['target'] != {'node': 'Name', 'id': 'f'}
+            or function_node['node'] != 'Function' or function_node['qualname'] != 'f'
+            or function_node['args'] != [] or not function_node['clean']
+            or function_node['body']['nodes'][0] != {
+                'node': 'Store', 'target': {'node': 'Name', 'id': 'x'},
+                'value': {'node': 'Object', 'type': 'int', 'value': None, 'repr': '7'}}):
+        errors.append('unexpected tree:\n{}\n'.format(json.dumps(trees[pyc_file])))
+    if trees[try_file]['clean']:
+        errors.append('incomplete decompilation of try.pyc is marked clean\n')
+    return errors
+
+
+ARG_KINDS = ['none', 'int', 'const', 'name', 'local', 'cell', 'jump', 'symbol', 'invalid']
+
+
+def read_packed_instructions(data):
+    """Decodes pycdas --packed output into the same records as --jsonl"""
+    if data[:8] != b'PYCDIS01':
+        raise ValueError('bad magic')
+    pos = 8
+    names = {}
+    records = []
+
+    def take(fmt):
+        nonlocal pos
+        values = struct.unpack_from(fmt, data, pos)
+        pos += struct.calcsize(fmt)
+        return values
+
+    def string():
+        size, = take('<I')
+        return take('{}s'.format(size))[0].decode('utf-8')
+
+    def optional(value):
+        return None if value == -1 else value
+
+    while pos < len(data):
+        tag = data[pos:pos + 1]
+        pos += 1
+        if tag == b'O':
+            opcode, size = take('<HB')
+            names[opcode] = take('{}s'.format(size))[0].decode('ascii')
+        elif tag == b'C':
+            code_id, parent, firstline = take('<Iii')
+            qualname = string()
+            records.append({'record': 'code', 'file': string(), 'id': code_id,
+                            'parent': optional(parent), 'qualname': qualname,
+                            'firstline': firstline})
+        elif tag == b'I':
+            code_id, offset, opcode, opnum, argkind, arg, target, handler = take('<IIHBBiii')
+            argval = string()
+            records.append({'record': 'insn', 'code': code_id, 'offset': offset,
+                            'opcode': names[opcode], 'opnum': opnum, 'arg': optional(arg),
+                            'argkind': ARG_KINDS[argkind], 'argval': argval or None,
+                            'target': optional(target), 'handler': optional(handler)})
+        else:
+            raise ValueError('bad record {!r} at {}'.format(tag, pos - 1))
+    return records
+
+
+def test_instruction_stream(workdir):
+    """
+    pycdas --jsonl gives each code object and decoded instruction with its
+    resolved argument, jump target and exception handler, numbering code
+    objects across all inputs; --packed carries exactly the same records.
+    """
+    try_file = os.path.join(workdir, 'try.pyc')
+    with open(try_file, 'wb') as pyc:
+        pyc.write(py311_try_module())
+    defines_file = os.path.join(workdir, 'defines.pyc')
+    write_py27(defines_file, py27_defines([(b'f', py27_function(b'f'))]))
+    loops_file = os.path.join(COMPILED_DIR, 'test_loops3.3.12.pyc')
+    inputs = [try_file, defines_file, loops_file]
+
+    errors = []
+    proc = run([tool('pycdas'), '--jsonl'] + inputs)
+    if proc.returncode != 0:
+        return ['pycdas --jsonl exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    records = [json.loads(line) for line in proc.stdout.splitlines()]
+
+    def insn(offset, opcode, opnum, arg, argkind, argval, handler=None):
+        return {'record': 'insn', 'code': 0, 'offset': offset, 'opcode': opcode, 'opnum': opnum,
+                'arg': arg, 'argkind': argkind, 'argval': argval, 'target': None,
+                'handler': handler}
+    expected = [
+        {'record': 'code', 'file': try_file, 'id': 0, 'parent': None, 'qualname': '<module>',
+         'firstline': 1},
+        insn(0, 'RESUME', 151, 0, 'int', None),
+        insn(2, 'NOP', 9, None, 'none', None),
+        insn(4, 'LOAD_CONST', 100, 0, 'const', '1', 12),
+        insn(6, 'STORE_NAME', 90, 0, 'name', 'x', 12),
+        insn(8, 'LOAD_CONST', 100, 2, 'const', 'None'),
+        insn(10, 'RETURN_VALUE', 83, None, 'none', None),
+        insn(12, 'PUSH_EXC_INFO', 35, None, 'none', None),
+    ]
+    if records[:len(expected)] != expected:
+        errors.append('unexpected records for try.pyc:\n{}'.format(proc.stdout[:2000]))
+    codes = [(r['file'], r['id'], r['parent'], r['qualname'])
+             for r in records if r['record'] == 'code']
+    if codes[1:3] != [(defines_file, 1, None, '<module>'), (defines_file, 2, 1, 'f')]:
+        errors.append('unexpected code records for defines.pyc: {}\n'.format(codes))
+    if [c[1] for c in codes] != list(range(len(codes))):
+        errors.append('code objects are not numbered across inputs: {}\n'.format(codes))
+    if not any(r['record'] == 'insn' and r['argkind'] == 'jump' and r['target'] is not None
+               for r in records):
+        errors.append('no jump targets in {}\n'.format(os.path.basename(loops_file)))
+
+    packed = os.path.join(workdir, 'insns.bin')
+    proc = run([tool('pycdas'), '--packed', '-o', packed] + inputs)
+    if proc.returncode != 0:
+        return errors + ['pycdas --packed exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    with open(packed, 'rb') as f:
+        try:
+            if read_packed_instructions(f.read()) != records:
+                errors.append('--packed records differ from --jsonl\n')
+        except (ValueError, KeyError, IndexError, struct.error) as e:
+            errors.append('cannot decode --packed output: {}\n'.format(e))
+    return errors
+
+
+def test_skim(workdir):
+    """
+    pycdas --skim lists the code objects, names and string constants,
+    resolving interned-string and object references to the original strings;
+    deep nesting is bounded by the same limit as loading, without recursion.
+    """
+    errors = []
+    pyc_file = os.path.join(workdir, 'refs.pyc')
+    consts = [marshal_interned(b'hello', ref=True), b'r' + marshal_int(0),
+              py27_function(b'g'), marshal_string(b'tab\there'), b'N']
+    names = [marshal_interned(b'x'), b'R' + marshal_int(0)]
+    write_py27(pyc_file, py27_code(PY27_STORE_CONST, consts, raw_names=names))
+    proc = run_small_stack([tool('pycdas'), '--skim', pyc_file])
+    expected = ('file\t{}\t2.7\t2\t2\t3\n'.format(pyc_file)
+                + 'code\t0\t<module>\ncode\t1\tg\n'
+                + 'name\tx\nname\thello\n'
+                + 'string\thello\nstring\thello\nstring\ttab\\x09here\n')
+    if proc.returncode != 0 or proc.stdout != expected:
+        errors.append('unexpected --skim output (exit {}):\n{}{}'
+                      .format(proc.returncode, proc.stdout, proc.stderr))
+
+    for depth, expected_rc in [(1999, 0), (2000, 1)]:
+        pyc_file = os.path.join(workdir, 'tuple{}.pyc'.format(depth))
+        write_py27(pyc_file, py27_code(PY27_STORE_CONST, [nested_tuple(depth), b'N'], [b'x']))
+        proc = run_small_stack([tool('pycdas'), '--skim', pyc_file])
+        if proc.returncode != expected_rc:
+            errors.append('depth {}: pycdas --skim exited with {}:\n{}'
+                          .format(depth, proc.returncode, proc.stderr))
+        elif expected_rc == 0 and 'name\tx\n' not in proc.stdout:
+            errors.append('depth {}: names missing from --skim output\n'.format(depth))
+        elif expected_rc != 0 and '对象嵌套超过 2000 层' not in proc.stderr:
+            errors.append('depth {}: expected the load depth error:\n{}'
+                          .format(depth, proc.stderr))
+    return errors
+
+
+# x = <const 1>; return <const 0>
+PY27_STORE_CONST1 = b'd\x01\x00Z\x00\x00d\x00\x00S'
+
+
+def test_lazy_load(workdir):
+    """
+    --only and --outline load code objects lazily: a function nested in
+    another one is not parsed unless it is decompiled, while references into
+    the interned strings of skipped functions still resolve as when the whole
+    file is loaded.
+    """
+    shared = py27_code(PY27_STORE_CONST1, [b'N', marshal_interned(b'shared')],
+                       raw_names=[marshal_interned(b'x')], name=b'a', flags=CO_FUNCTION)
+    # The reference to intern 99 fails only when 'inner' itself is parsed
+    broken = py27_code(PY27_STORE_CONST1, [b'N', b'R' + marshal_int(99)],
+                       raw_names=[b'R' + marshal_int(1)], name=b'inner', flags=CO_FUNCTION)
+    outer = py27_defines([(b'inner', broken)], b'f', CO_FUNCTION)
+    user = py27_code(PY27_STORE_CONST1, [b'N', b'R' + marshal_int(0)],
+                     raw_names=[b'R' + marshal_int(1)], name=b'g', flags=CO_FUNCTION)
+    pyc_file = os.path.join(workdir, 'lazy.pyc')
+    write_py27(pyc_file, py27_defines([(b'a', shared), (b'f', outer), (b'g', user)]))
+
+    errors = []
+    proc = run([tool('pycdc'), pyc_file])
+    if proc.returncode == 0 or 'Intern index out of range' not in proc.stderr:
+        errors.append('loading the whole file did not fail:\n{}'.format(proc.stderr))
+    proc = run([tool('pycdc'), '--only', 'g', pyc_file])
+    if proc.returncode != 0 or strip_header(proc.stdout) != "\n\ndef g():\n    x = 'shared'\n\n":
+        errors.append('--only g: unexpected output:\n{}{}'.format(proc.stdout, proc.stderr))
+    proc = run([tool('pycdc'), '--outline', pyc_file])
+    expected = '\n\ndef a():\n    ...\n\n\ndef f():\n    ...\n\n\ndef g():\n    ...\n\n'
+    if proc.returncode != 0 or strip_header(proc.stdout) != expected:
+        errors.append('--outline: unexpected output:\n{}{}'.format(proc.stdout, proc.stderr))
+
+    # Python 3 modules refer back to earlier objects with FLAG_REF
+    pyc_file = os.path.join(COMPILED_DIR, 'test_class_method_py3.3.7.pyc')
+    proc = run([tool('pycdc'), '--only', 'MyClass.method', pyc_file])
+    method = strip_header(proc.stdout).strip('\n').splitlines()
+    indented = ''.join('    ' + line + '\n' for line in method)
+    if proc.returncode != 0 or not method or indented not in decompile_direct(pyc_file):
+        errors.append('--only MyClass.method differs from the method in the whole module:\n{}'
+                      .format(proc.stdout))
+    return errors
+
+
+OUTLINE_DOCSTRING = """\
+'''
+Module docstring
+'''
+
+def Doc_Test():
+    '''Function docstring'''
+    ...
+
+
+class XXX:
+    '''Class docstring'''
+    
+    def __init__(self):
+        '''__init__:  Member function docstring'''
+        ...
+
+    
+    def XXX11():
+        '''XXX11: Member Function docstring'''
+        ...
+
+    
+    def XXX12():
+        ...
+
+    
+    def XXX13():
+        ...
+
+
+
+def Y11():
+    ...
+
+print __doc__
+"""
+
+
+def test_outline(workdir):
+    """
+    --outline keeps module and class bodies, signatures and docstrings, and
+    replaces each function body (including the functions nested in it) by '...'.
+    """
+    errors = []
+    pyc_file = os.path.join(COMPILED_DIR, 'test_docstring.2.7.pyc')
+    proc = run([tool('pycdc'), '--outline', pyc_file])
+    if proc.returncode != 0 or strip_header(proc.stdout) != '\n' + OUTLINE_DOCSTRING:
+        errors.append('{}: unexpected outline:\n{}{}'.format(os.path.basename(pyc_file),
+                                                              proc.stdout, proc.stderr))
+
+    # Every signature, with its defaults and keyword-only markers, is the same
+    # as in the full output
+    pyc_file = os.path.join(COMPILED_DIR, 'test_functions_py3.3.4.pyc')
+    proc = run([tool('pycdc'), '--outline', pyc_file])
+    signatures = [line for line in decompile_direct(pyc_file).splitlines() if line.startswith('def ')]
+    expected = ''.join('\n\n{}\n    ...\n'.format(line) for line in signatures) + '\n'
+    if proc.returncode != 0 or len(signatures) != 13 or strip_header(proc.stdout) != expected:
+        errors.append('{}: unexpected outline:\n{}{}'.format(os.path.basename(pyc_file),
+                                                              proc.stdout, proc.stderr))
+    return errors
+
+
+def test_only(workdir):
+    """
+    --only prints just the def / class statement of the named code object,
+    including base classes; the enclosing code is built only up to that
+    statement, so an unsupported opcode after it is never reached.
+    """
+    errors = []
+    cases = [
+        ('test_class.2.5.pyc', 'A.A1.foo', "def foo(self):\n    print 'A1.foo'\n"),
+        ('class_NODE_BINARY.3.9.pyc', 'MyNet', 'class MyNet(Test.t):\n    pass\n'),
+        ('test_class_method_py3.3.7.pyc', 'MyClass.method',
+         "def method(self, i):\n    if i is 5:\n        print('five')\n"),
+    ]
+    for name, qualname, expected in cases:
+        proc = run([tool('pycdc'), '--only', qualname, os.path.join(COMPILED_DIR, name)])
+        if proc.returncode != 0 or not strip_header(proc.stdout).lstrip('\n').startswith(expected):
+            errors.append('--only {} {}: unexpected output (exit {}):\n{}{}'
+                          .format(qualname, name, proc.returncode, proc.stdout, proc.stderr))
+
+    # def f(): pass; then STOP_CODE, which pycdc does not support
+    pyc_file = os.path.join(workdir, 'stop.pyc')
+    code = b'd\x00\x00\x84\x00\x00Z\x00\x00' + b'\x00' + b'd\x01\x00S'
+    write_py27(pyc_file, py27_code(code, [py27_function(b'f'), b'N'], [b'f']))
+    proc = run([tool('pycdc'), '--only', 'f', pyc_file])
+    if proc.returncode != 0 or strip_header(proc.stdout).strip('\n') != 'def f():\n    pass':
+        errors.append('--only f: unexpected output (exit {}):\n{}'
+                      .format(proc.returncode, proc.stdout))
+    if proc.stderr:
+        errors.append('--only f: the code after the definition was built:\n{}'.format(proc.stderr))
+
+    proc = run([tool('pycdc'), '--only', 'missing', pyc_file])
+    if proc.returncode != 1 or '没有限定名为 missing 的函数或类' not in proc.stderr:
+        errors.append('--only missing: expected an error, got exit {}:\n{}'
+                      .format(proc.returncode, proc.stderr))
+    return errors
+
+
+def test_deep_expressions(workdir):
+    """
+    Expressions nested tens of thousands of levels deep, with the parentheses
+    they need, are printed with a stack far smaller than recursion over the
+    expression tree would need.
+    """
+    depth = 20000
+    load_a = b'e\x00\x00'     # LOAD_NAME a
+    store_x = b'Z\x01\x00'    # STORE_NAME x
+    # ((a + a) * a + a) * a ...: BINARY_ADD and BINARY_MULTIPLY in turn
+    code = load_a
+    expected = 'a'
+    for i in range(depth):
+        if i % 2 == 0:
+            code += load_a + b'\x17'
+            expected += ' + a'
+        else:
+            code += load_a + b'\x14'
+            expected = '(' + expected + ') * a'
+    operators = os.path.join(workdir, 'operators.pyc')
+    write_py27(operators, py27_code(code + store_x + PY27_RETURN_NONE, [b'N'], [b'a', b'x']))
+
+    # f(f(f(...(a)...))): CALL_FUNCTION with one argument
+    code = b'e\x02\x00' * depth + load_a + b'\x83\x01\x00' * depth
+    calls = os.path.join(workdir, 'calls.pyc')
+    write_py27(calls, py27_code(code + store_x + PY27_RETURN_NONE, [b'N'], [b'a', b'x', b'f'],
+                                stacksize=depth + 1))
+
+    errors = []
+    for pyc_file, source in [(operators, expected), (calls, 'f(' * depth + 'a' + ')' * depth)]:
+        proc = run_small_stack([tool('pycdc'), pyc_file], 256 * 1024)
+        if proc.returncode != 0:
+            errors.append('{}: pycdc exited with {}:\n{}'.format(os.path.basename(pyc_file),
+                                                                 proc.returncode, proc.stderr))
+        elif strip_header(proc.stdout) != '\nx = ' + source + '\n':
+            errors.append('{}: unexpected output:\n{}...\n'.format(os.path.basename(pyc_file),
+                                                                   proc.stdout[:200]))
+    return errors
+
+
+def test_max_depth(workdir):
+    """
+    Nesting up to the --max-depth limit loads (and prints without recursing
+    off a small stack); one level more is reported as an input error.
+    """
+    errors = []
+    cases = [
+        # (tuple depth, extra options, expected exit code, expected text)
+        (1999, [], 0, 'x = ' + '(' * 1999 + ')' + ',)' * 1998 + '\n'),
+        (2000, [], 1, '对象嵌套超过 2000 层'),
+        (5, ['--max-depth', '6'], 0, 'x = (((((),),),),)\n'),
+        (5, ['--max-depth', '5'], 1, '对象嵌套超过 5 层'),
+    ]
+    for depth, options, expected_rc, expected in cases:
+        pyc_file = os.path.join(workdir, 'tuple{}.pyc'.format(depth))
+        write_py27(pyc_file, py27_code(PY27_STORE_CONST, [nested_tuple(depth), b'N'], [b'x']))
+        proc = run_small_stack([tool('pycdc')] + options + [pyc_file])
+        label = 'depth {} {}'.format(depth, ' '.join(options))
+        if proc.returncode != expected_rc:
+            errors.append('{}: pycdc exited with {}, expected {}:\n{}'
+                          .format(label, proc.returncode, expected_rc, proc.stderr))
+        elif expected not in (proc.stdout if expected_rc == 0 else proc.stderr):
+            errors.append('{}: expected output not found\n'.format(label))
+
+    for value in ['0', '2001']:
+        proc = run([tool('pycdc'), '--max-depth', value, pyc_file])
+        if proc.returncode != 1 or '1 到 2000' not in proc.stderr:
+            errors.append('--max-depth {} was not rejected:\n{}'.format(value, proc.stderr))
+    return errors
+
+
+def test_code_nesting(workdir):
+    """
+    Functions nested far deeper than real source allows (but within the load
+    limit) are decompiled down to the fixed nesting limit, then elided with a
+    warning instead of overflowing a small stack.
+    """
+    pyc_file = os.path.join(workdir, 'nested.pyc')
+    write_py27(pyc_file, nested_functions(900))
+    errors = []
+    for options in [[], ['--out-dir', os.path.join(workdir, 'out'), '--workers', '2']]:
+        args = [tool('pycdc')] + options + [pyc_file if not options else workdir]
+        proc = run_small_stack(args)
+        label = ' '.join(options) or 'single file'
+        if proc.returncode != 0:
+            errors.append('{}: pycdc exited with {}:\n{}'.format(label, proc.returncode, proc.stderr))
+            continue
+        if options:
+            with open(os.path.join(workdir, 'out', 'nested.py'), 'r', encoding='utf-8') as src:
+                output = src.read()
+        else:
+            output = proc.stdout
+        if output.count('def f():') != 256:
+            errors.append('{}: {} nested functions decompiled, expected 256\n'
+                          .format(label, output.count('def f():')))
+        indent = '    ' * 256
+        if indent + '# 警告：代码对象嵌套超过 256 层，未反编译\n' + indent + 'pass\n' not in output:
+            errors.append('{}: no placeholder for the elided body\n'.format(label))
+        if '嵌套超过 256 层' not in proc.stderr:
+            errors.append('{}: no warning for the elided body\n'.format(label))
+    return errors
+
+
+def test_budget_fallback(workdir):
+    """
+    A module whose own code object exceeds the budget is printed as commented
+    disassembly, followed by the disassembly of every function nested in it;
+    the result is still valid Python.
+    """
+    pyc_file = os.path.join(workdir, 'budget.pyc')
+    write_py27(pyc_file, py27_defines([
+        (b'first', py27_function(b'first')),
+        (b'second', py27_defines([(b'inner', py27_function(b'inner'))], b'second', CO_FUNCTION)),
+    ]))
+
+    errors = []
+    proc = run([tool('pycdc'), '--max-insns', '1', pyc_file])
+    output = strip_header(proc.stdout)
+    if proc.returncode != 0:
+        return ['pycdc exited with {}:\n{}'.format(proc.returncode, proc.stderr)]
+    expected_lines = [
+        '# 警告：超出反编译预算（指令数），以下为反汇编\n',
+        '# 0       LOAD_CONST                      0: <CODE> first\n',
+        '# first 的反汇编：\n',
+        '# second 的反汇编：\n',
+        '# second.inner 的反汇编：\n',
+        '# 0       LOAD_CONST                      0: None\n',
+    ]
+    for line in expected_lines:
+        if line not in output:
+            errors.append('missing line {!r} in:\n{}'.format(line, output))
+    if not output.endswith('pass\n'):
+        errors.append('fallback does not end with pass:\n{}'.format(output))
+    try:
+        compile(output, 'budget.py', 'exec')
+    except SyntaxError as ex:
+        errors.append('fallback output does not compile: {}\n'.format(ex))
+    if '<module> 超出反编译预算（指令数）' not in proc.stderr:
+        errors.append('no warning for the exceeded budget:\n{}'.format(proc.stderr))
+
+    # Output-size budget: the functions printed before the limit stay, the
+    # rest are replaced without appending any disassembly
+    many_file = os.path.join(workdir, 'many.pyc')
+    write_py27(many_file, py27_defines([(name, py27_function(name))
+                                        for name in (b'f%d' % i for i in range(300))]))
+    proc = run([tool('pycdc'), '--max-output', '1', many_file])
+    if ('def f0():' not in proc.stdout or '（输出大小）' not in proc.stdout
+            or '的反汇编' in proc.stdout or 'LOAD_' in proc.stdout):
+        errors.append('unexpected output under --max-output:\n{}'.format(proc.stdout))
+
+    # Generous budgets do not change the output
+    proc = run([tool('pycdc'), '--max-insns', '1000000', '--max-nodes', '1000000',
+                os.path.join(COMPILED_DIR, 'test_class.2.5.pyc')])
+    if strip_header(proc.stdout) != decompile_direct(os.path.join(COMPILED_DIR, 'test_class.2.5.pyc')):
+        errors.append('output within the budget differs from the output without budgets\n')
+    return errors
+
+
+TESTS = [
+    test_deflate_stored,
+    test_deflate_fixed,
+    test_deflate_dynamic,
+    test_deflate_truncated,
+    test_wheel,
+    test_tar_corpus,
+    test_pyinstaller,
+    test_tar_extras,
+    test_prefetch,
+    test_work_stealing,
+    test_isolate_recovery,
+    test_cache,
+    test_cache_size,
+    test_memo,
+    test_server,
+    test_pycindex,
+    test_consts,
+    test_code_walk,
+    test_multi_output,
+    test_ast_export,
+    test_instruction_stream,
+    test_skim,
+    test_only,
+    test_lazy_load,
+    test_outline,
+    test_deep_expressions,
+    test_max_depth,
+    test_code_nesting,
+    test_budget_fallback,
+]
+
+
+def run_test(test):
+    test_name = test.__name__[len('test_'):]
+    workdir = tempfile.mkdtemp(prefix='pycdc-' + test_name + '-')
+    try:
+        errors = test(workdir)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    status_line = '\033[1m*** {}:\033[0m '.format(test_name)
+    if errors:
+        status_line += '\033[31mFAIL\033[0m\n'
+    else:
+        status_line += '\033[32mPASS\033[0m\n'
+    return len(errors) != 0, [status_line] + ['\t' + err for err in errors]
+
+
+def main():
+    default_filter = os.environ['FILTER'] if 'FILTER' in os.environ else ''
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--filter', type=str, default=default_filter,
+            help='Run only test(s) matching the supplied filter')
+    args = parser.parse_args()
+
+    total_fails = 0
+    for test in TESTS:
+        if args.filter and args.filter not in test.__name__:
+            continue
+        failed, output = run_test(test)
+        total_fails += failed
+        sys.stdout.writelines(output)
+
+    if total_fails:
+        print('{} test(s) failed'.format(total_fails))
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
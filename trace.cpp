@@ -0,0 +1,118 @@
+﻿#include "trace.h"
+#include "data.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    std::string detail;
+    bool hasDetail;
+    int tid;
+    double start;   // 微秒
+    double duration;
+};
+
+std::atomic<bool> s_enabled(false);
+std::mutex s_mutex;
+std::vector<TraceEvent> s_events;
+std::string s_filename;
+std::chrono::steady_clock::time_point s_epoch;
+
+std::atomic<int> s_nextTid(1);
+
+int currentTid()
+{
+    // 使用从 1 开始的小整数编号线程，比原始线程 ID 更易读
+    static thread_local int tid = s_nextTid.fetch_add(1);
+    return tid;
+}
+
+double elapsedMicros()
+{
+    return std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - s_epoch).count();
+}
+
+}
+
+bool Trace::open(const char* filename)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::ofstream probe(filename, std::ios_base::out);
+    if (probe.fail())
+        return false;
+
+    s_filename = filename;
+    s_events.clear();
+    s_epoch = std::chrono::steady_clock::now();
+    s_enabled = true;
+    return true;
+}
+
+bool Trace::close()
+{
+    if (!s_enabled.exchange(false))
+        return true;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::ofstream out(s_filename, std::ios_base::out | std::ios_base::binary);
+    if (out.fail())
+        return false;
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+           "\"args\":{\"name\":\"pycdc\"}}";
+    for (const auto& event : s_events) {
+        out << ",\n{\"name\":";
+        json_print_string(out, event.name, strlen(event.name));
+        out << ",\"cat\":";
+        json_print_string(out, event.category, strlen(event.category));
+        formatted_print(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                        event.tid, event.start, event.duration);
+        if (event.hasDetail) {
+            out << ",\"args\":{\"detail\":";
+            json_print_string(out, event.detail);
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+    s_events.clear();
+    return !out.fail();
+}
+
+bool Trace::enabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+double Trace::Span::begin()
+{
+    return elapsedMicros();
+}
+
+void Trace::Span::end()
+{
+    double stop = elapsedMicros();
+    TraceEvent event;
+    event.name = m_name;
+    event.category = m_category;
+    event.hasDetail = (m_detail != nullptr);
+    if (event.hasDetail)
+        event.detail = m_detail;
+    event.tid = currentTid();
+    event.start = m_start;
+    event.duration = stop - m_start;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_enabled)
+        s_events.push_back(std::move(event));
+}
@@ -0,0 +1,51 @@
+﻿#ifndef _PYC_TRACE_H
+#define _PYC_TRACE_H
+
+/* Chrome trace-event 格式的耗时区间记录。
+ * 输出的 JSON 文件可以直接在 chrome://tracing 或 Perfetto 中打开。
+ * 未调用 Trace::open() 时，Span 的构造与析构只有一次布尔判断的开销。 */
+namespace Trace {
+
+bool open(const char* filename);
+bool close();
+
+bool enabled();
+
+class Span {
+public:
+    Span(const char* name, const char* category)
+        : m_name(name), m_category(category), m_detail(nullptr),
+          m_start(enabled() ? begin() : -1) { }
+
+    /* detail 必须在 Span 生命周期内保持有效（例如代码对象的名称） */
+    Span(const char* name, const char* category, const char* detail)
+        : m_name(name), m_category(category), m_detail(detail),
+          m_start(enabled() ? begin() : -1) { }
+
+    ~Span() { finish(); }
+
+    /* 提前结束区间，之后析构不再重复记录 */
+    void finish()
+    {
+        if (m_start >= 0) {
+            end();
+            m_start = -1;
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    static double begin();
+    void end();
+
+    const char* m_name;
+    const char* m_category;
+    const char* m_detail;
+    double m_start;
+};
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+﻿#include "worker_pool.h"
+
+PycWorkerPool::PycWorkerPool(unsigned threads, size_t maxQueued)
+    : m_maxQueued(maxQueued), m_active(0), m_stopping(false)
+{
+    if (threads == 0)
+        threads = defaultSize();
+    m_threads.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i)
+        m_threads.emplace_back(&PycWorkerPool::run, this);
+}
+
+PycWorkerPool::~PycWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_taskReady.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+unsigned PycWorkerPool::defaultSize()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+void PycWorkerPool::submit(std::function<void()> task)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_maxQueued) {
+        m_spaceReady.wait(lock, [this] { return m_queue.size() < m_maxQueued; });
+    }
+    m_queue.push_back(std::move(task));
+    lock.unlock();
+    m_taskReady.notify_one();
+}
+
+void PycWorkerPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_queue.empty() && m_active == 0; });
+}
+
+void PycWorkerPool::run()
+{
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_taskReady.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            // 退出前先把队列中剩余的任务做完
+            if (m_queue.empty())
+                return;
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+            ++m_active;
+        }
+        m_spaceReady.notify_one();
+
+        try {
+            task();
+        } catch (...) {
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_active;
+            if (m_queue.empty() && m_active == 0)
+                m_idle.notify_all();
+        }
+    }
+}
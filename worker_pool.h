@@ -0,0 +1,50 @@
+﻿#ifndef _PYC_WORKER_POOL_H
+#define _PYC_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* 固定数量工作线程的任务池。
+ * 线程在构造时一次性创建并常驻，任务之间不再有线程创建的开销；
+ * 排队的任务数达到上限时 submit() 会阻塞，防止生产者无限制地占用内存。 */
+class PycWorkerPool {
+public:
+    /* threads 为 0 时使用 defaultSize()；maxQueued 为 0 时不限制排队数量 */
+    explicit PycWorkerPool(unsigned threads = 0, size_t maxQueued = 0);
+
+    /* 等待所有已提交的任务完成后退出 */
+    ~PycWorkerPool();
+
+    PycWorkerPool(const PycWorkerPool&) = delete;
+    PycWorkerPool& operator=(const PycWorkerPool&) = delete;
+
+    /* 任务抛出的异常会被捕获并丢弃，调用者应在任务内部自行处理错误 */
+    void submit(std::function<void()> task);
+
+    /* 等待当前已提交的任务全部完成 */
+    void wait();
+
+    unsigned size() const { return (unsigned)m_threads.size(); }
+
+    static unsigned defaultSize();
+
+private:
+    void run();
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_queue;
+    size_t m_maxQueued;
+    size_t m_active;
+    bool m_stopping;
+
+    std::mutex m_mutex;
+    std::condition_variable m_taskReady;
+    std::condition_variable m_spaceReady;
+    std::condition_variable m_idle;
+};
+
+#endif